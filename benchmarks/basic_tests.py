@@ -6,6 +6,7 @@ import numpy as np
 import pandas as pd
 import platform
 import pyemu
+from datetime import datetime
 
 bin_path = os.path.join("test_bin")
 if "linux" in platform.platform().lower():
@@ -749,6 +750,16 @@ def tplins1_test():
     lines_in = open(os.path.join(t_d,"hk_Layer_1.ref"),'r').readlines()
     assert len(lines_tpl) - 1 == len(lines_in)
 
+    # the compiled tpl/ins plans should give the same results on several threads
+    pst = pyemu.Pst(os.path.join(t_d,"pest.pst"))
+    pst.pestpp_options["num_tpl_ins_threads"] = 4
+    pst.write(os.path.join(t_d,"pest_threads.pst"))
+    pyemu.os_utils.run("{0} pest_threads.pst".format(exe_path.replace("-ies","-glm")),cwd=t_d)
+    pst = pyemu.Pst(os.path.join(t_d,"pest_threads.pst"))
+    d = (obf_df.obsval - pst.res.modelled).apply(np.abs)
+    print(d.max())
+    assert d.max() < 1.0e-5, d
+
     pst = pyemu.Pst(os.path.join(t_d, "pest.pst"))
     dum_obs = ['h01_03', 'h01_07']
     pst.observation_data.drop(index=dum_obs, inplace=True)
@@ -1000,6 +1011,1001 @@ def cmdline_test():
         raise Exception("should have failed")
     
 
+def run_storage_mmap_test():
+    model_d = "ies_10par_xsec"
+    local=True
+    if "linux" in platform.platform().lower() and "10par" in model_d:
+        #print("travis_prep")
+        #prep_for_travis(model_d)
+        local=False
+    
+    t_d = os.path.join(model_d,"template")
+    pst = pyemu.Pst(os.path.join(t_d,"pest.pst"))
+    pe = pyemu.ParameterEnsemble.from_uniform_draw(pst,num_reals=500)
+    pe.to_csv(os.path.join(t_d,"sweep_in.csv"))
+    
+    dfs,times = [],[]
+    for use_mmap in [False,True]:
+        m_d = os.path.join(model_d,"master_sweep_mmap_{0}".format(use_mmap))
+        if os.path.exists(m_d):
+            shutil.rmtree(m_d)
+        pst.pestpp_options = {"run_storage_mmap":use_mmap,"run_storage_commit_nruns":50}
+        pst.write(os.path.join(t_d,"pest_mmap.pst"))
+        pyemu.os_utils.start_workers(t_d, exe_path.replace("-ies","-swp"), "pest_mmap.pst", 10, master_dir=m_d,
+                               worker_root=model_d,local=local,port=port)
+        # the master reports the time spent in the run storage calls of each batch -
+        # the model runs and the network are not part of it
+        stor_secs = 0.0
+        with open(os.path.join(m_d,"pest_mmap.rmr"),'r') as f:
+            for line in f:
+                if "run storage seconds:" in line:
+                    stor_secs += float(line.split(":")[-1])
+        times.append(stor_secs)
+        dfs.append(pd.read_csv(os.path.join(m_d, "sweep_out.csv"),index_col=0))
+        assert not os.path.exists(os.path.join(m_d,"pest_mmap.rns.jnl"))
+    print("stream run storage: {0:.4f} sec, mmap run storage: {1:.4f} sec".format(times[0],times[1]))
+    diff = (dfs[0] - dfs[1]).abs()
+    print(diff.max())
+    assert diff.max().max() == 0.0
+
+
+def panther_payload_codec_test():
+    model_d = "ies_10par_xsec"
+    local=True
+    if "linux" in platform.platform().lower() and "10par" in model_d:
+        local=False
+
+    t_d = os.path.join(model_d,"template")
+    pst = pyemu.Pst(os.path.join(t_d,"pest.pst"))
+    pst.control_data.noptmax = -1
+    jcos = []
+    for use_codec in [False,True]:
+        m_d = os.path.join(model_d,"master_glm_codec_{0}".format(use_codec))
+        if os.path.exists(m_d):
+            shutil.rmtree(m_d)
+        pst.pestpp_options = {"panther_payload_codec":use_codec}
+        pst.write(os.path.join(t_d,"pest_codec.pst"))
+        pyemu.os_utils.start_workers(t_d, exe_path.replace("-ies","-glm"), "pest_codec.pst", 5, master_dir=m_d,
+                               worker_root=model_d,local=local,port=port)
+        jcos.append(pyemu.Jco.from_binary(os.path.join(m_d,"pest_codec.jcb")).to_dataframe())
+        if use_codec:
+            with open(os.path.join(m_d,"pest_codec.rmr"),'r') as f:
+                assert "payload codec" in f.read()
+    diff = (jcos[0] - jcos[1]).abs()
+    print(diff.max())
+    assert diff.max().max() == 0.0
+
+
+def ins_mmap_parity_test():
+    """check the memory-mapped instruction file reader against pyemu's reader on the
+    tplins_test_1 and secondary_marker_test outputs, then time a big marker-heavy
+    output file"""
+    import time
+    model_d = "ins_mmap_parity"
+    if os.path.exists(model_d):
+        shutil.rmtree(model_d)
+    os.makedirs(model_d)
+    cases = []
+    t_d = os.path.join(model_d, "tplins")
+    shutil.copytree(os.path.join("tplins_test_1", "template"), t_d)
+    cases.append((t_d, "AOC_obs.txt.ins", "AOC_obs.txt", ""))
+    t_d = os.path.join(model_d, "secondary")
+    shutil.copytree(os.path.join("secondary_marker_test", "template"), t_d)
+    for ins_file in [f for f in os.listdir(t_d) if f.endswith(".ins")]:
+        out_file = ins_file.replace(".ins", "")
+        shutil.copy2(os.path.join(t_d, out_file + "_bak"), os.path.join(t_d, out_file))
+        cases.append((t_d, ins_file, out_file, "|"))
+
+    # a large listing-style output: many filler lines between each primary marker
+    t_d = os.path.join(model_d, "big")
+    os.makedirs(t_d)
+    np.random.seed(11)
+    with open(os.path.join(t_d, "big.out"), 'w') as f, open(os.path.join(t_d, "big.out.ins"), 'w') as fi:
+        fi.write("pif ~\n")
+        for b in range(100):
+            for i in range(2000):
+                f.write(" filler line {0} 1.0 2.0 3.0\n".format(i))
+            f.write(" HEAD BLOCK {0}\n".format(b))
+            f.write(" ".join(["{0:15.8E}".format(v) for v in np.random.randn(5)]) + "\n")
+            fi.write("~BLOCK {0}~\n".format(b))
+            fi.write("l1 " + " ".join(["!b{0}_{1}!".format(b, i) for i in range(5)]) + "\n")
+    cases.append((t_d, "big.out.ins", "big.out", ""))
+
+    for t_d, ins_file, out_file, delims in cases:
+        ref_df = pyemu.pst_utils.try_process_output_file(os.path.join(t_d, ins_file), os.path.join(t_d, out_file))
+        if ref_df is None:
+            print("pyemu could not process {0}, skipping parity check".format(ins_file))
+            continue
+        tpl_file = os.path.join(t_d, "par.dat.tpl")
+        with open(tpl_file, 'w') as f:
+            f.write("ptf ~\n")
+            f.write("~ p1    ~\n")
+        with open(os.path.join(t_d, "forward_run.py"), 'w') as f:
+            f.write("pass\n")
+        b_d = os.getcwd()
+        os.chdir(t_d)
+        try:
+            pst = pyemu.Pst.from_io_files("par.dat.tpl", "par.dat", ins_file, out_file)
+            pst.control_data.noptmax = 0
+            if len(delims) > 0:
+                pst.pestpp_options["additional_ins_delimiters"] = delims
+            pst.model_command = "python forward_run.py"
+            pst.write("parity.pst")
+            start = time.time()
+            pyemu.os_utils.run("{0} parity.pst".format(exe_path))
+            print("{0}: {1:.3f} sec".format(ins_file, time.time() - start))
+            pst = pyemu.Pst("parity.pst")
+        except Exception as e:
+            os.chdir(b_d)
+            raise Exception(e)
+        os.chdir(b_d)
+        assert pst.res is not None
+        d = (pst.res.loc[ref_df.index, "modelled"] - ref_df.obsval).apply(np.abs)
+        print(ins_file, d.max())
+        assert d.max() < 1.0e-10, d
+
+
+def model_plugin_test():
+    """sweep an analytic model through an in-process model plugin and check it against
+    the same model run through tpl/ins files and a forward run script"""
+    model_d = "model_plugin_test"
+    t_d = os.path.join(model_d, "template")
+    if os.path.exists(model_d):
+        shutil.rmtree(model_d)
+    os.makedirs(t_d)
+    npar, nobs = 10, 20
+    par_names = ["p{0}".format(i) for i in range(npar)]
+    obs_names = ["o{0}".format(i) for i in range(nobs)]
+    with open(os.path.join(t_d, "pars.dat.tpl"), 'w') as f:
+        f.write("ptf ~\n")
+        for pname in par_names:
+            f.write("~   {0}   ~\n".format(pname))
+    with open(os.path.join(t_d, "obs.dat.ins"), 'w') as f:
+        f.write("pif ~\n")
+        for oname in obs_names:
+            f.write("l1 !{0}!\n".format(oname))
+    # o_j = sum_i (i+1) * (j+1) * p_i
+    with open(os.path.join(t_d, "forward_run.py"), 'w') as f:
+        f.write("import numpy as np\n")
+        f.write("p = np.loadtxt('pars.dat')\n")
+        f.write("o = np.arange(1,{0}+1) * (np.arange(1,{1}+1) * p).sum()\n".format(nobs, npar))
+        f.write("np.savetxt('obs.dat',o,fmt='%20.12E')\n")
+    # the plugin looks values up by name, since the order it is given need not be the control file order
+    with open(os.path.join(t_d, "plugin.c"), 'w') as f:
+        f.write('''#include <stdlib.h>
+#include "pestpp_plugin.h"
+static int np_ = 0, no_ = 0, *pidx = NULL, *oidx = NULL;
+PESTPP_PLUGIN_EXPORT int pestpp_plugin_api_version(void) { return PESTPP_PLUGIN_API_VERSION; }
+PESTPP_PLUGIN_EXPORT int pestpp_plugin_init(int npar, const char* const* par_names, int nobs,
+    const char* const* obs_names, const char* config)
+{
+    int i;
+    np_ = npar; no_ = nobs;
+    pidx = (int*)malloc(npar * sizeof(int));
+    oidx = (int*)malloc(nobs * sizeof(int));
+    for (i = 0; i < npar; i++) pidx[i] = atoi(par_names[i] + 1) + 1;
+    for (i = 0; i < nobs; i++) oidx[i] = atoi(obs_names[i] + 1) + 1;
+    return 0;
+}
+PESTPP_PLUGIN_EXPORT int pestpp_plugin_run(const double* p, double* o)
+{
+    int i;
+    double s = 0.0;
+    for (i = 0; i < np_; i++) s += pidx[i] * p[i];
+    for (i = 0; i < no_; i++) o[i] = oidx[i] * s;
+    return 0;
+}
+PESTPP_PLUGIN_EXPORT int pestpp_plugin_run_batch(int nruns, const double* p, double* o, int* status)
+{
+    int r;
+    for (r = 0; r < nruns; r++) status[r] = pestpp_plugin_run(p + r * np_, o + r * no_);
+    return 0;
+}
+PESTPP_PLUGIN_EXPORT void pestpp_plugin_finalize(void) { free(pidx); free(oidx); }
+''')
+    inc_d = os.path.abspath(os.path.join("..", "src", "libs", "run_managers", "abstract_base"))
+    lib_name = "plugin" + (".dll" if "window" in platform.platform().lower() else ".so")
+    pyemu.os_utils.run("cc -O2 -shared -fPIC -I{0} plugin.c -o {1}".format(inc_d, lib_name), cwd=t_d)
+
+    b_d = os.getcwd()
+    os.chdir(t_d)
+    try:
+        with open("pars.dat", 'w') as f:
+            for _ in par_names:
+                f.write("1.0\n")
+        pyemu.os_utils.run("python forward_run.py")
+        pst = pyemu.Pst.from_io_files("pars.dat.tpl", "pars.dat", "obs.dat.ins", "obs.dat")
+    except Exception as e:
+        os.chdir(b_d)
+        raise Exception(e)
+    os.chdir(b_d)
+    pst.parameter_data.loc[:, "parlbnd"] = -10.0
+    pst.parameter_data.loc[:, "parubnd"] = 10.0
+    pst.model_command = "python forward_run.py"
+    pst.control_data.noptmax = 0
+    pe = pyemu.ParameterEnsemble.from_uniform_draw(pst, num_reals=200)
+    pe.to_csv(os.path.join(t_d, "sweep_in.csv"))
+
+    dfs = []
+    for plugin in ["", "./" + lib_name]:
+        pst.pestpp_options = {"model_plugin": plugin, "model_plugin_batch_size": 64}
+        pst.write(os.path.join(t_d, "pest_plugin.pst"))
+        start = datetime.now()
+        pyemu.os_utils.run("{0} pest_plugin.pst".format(exe_path.replace("-ies", "-swp")), cwd=t_d)
+        print("model_plugin '{0}': {1:.2f} sec".format(plugin, (datetime.now() - start).total_seconds()))
+        dfs.append(pd.read_csv(os.path.join(t_d, "sweep_out.csv"), index_col=0).loc[:, obs_names])
+    diff = ((dfs[0] - dfs[1]) / dfs[0].abs().clip(lower=1.0)).abs()
+    print(diff.max().max())
+    assert diff.max().max() < 1.0e-6, diff.max()
+
+
+def local_workers_test():
+    """run the same sweep with the serial run manager and with local worker threads
+    and check the outputs match"""
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d,"template")
+    pst = pyemu.Pst(os.path.join(t_d,"pest.pst"))
+    pe = pyemu.ParameterEnsemble.from_uniform_draw(pst,num_reals=50)
+    pe.to_csv(os.path.join(t_d,"sweep_in.csv"))
+
+    dfs,times = [],[]
+    for num_workers in [1,4]:
+        m_d = os.path.join(model_d,"master_sweep_local_workers_{0}".format(num_workers))
+        if os.path.exists(m_d):
+            shutil.rmtree(m_d)
+        shutil.copytree(t_d,m_d)
+        pst.pestpp_options = {"num_local_workers":num_workers}
+        pst.write(os.path.join(m_d,"pest_local.pst"))
+        start = datetime.now()
+        pyemu.os_utils.run("{0} pest_local.pst".format(exe_path.replace("-ies","-swp")),cwd=m_d)
+        times.append((datetime.now() - start).total_seconds())
+        dfs.append(pd.read_csv(os.path.join(m_d, "sweep_out.csv"),index_col=0))
+        if num_workers > 1:
+            for i in range(num_workers):
+                assert os.path.exists(os.path.join(m_d,"pestpp_local_worker_{0}".format(i)))
+    print("serial: {0:.2f} sec, local workers: {1:.2f} sec".format(times[0],times[1]))
+    diff = (dfs[0] - dfs[1]).abs()
+    print(diff.max())
+    assert diff.max().max() == 0.0
+
+
+def panther_schedule_policy_test():
+    """run the same ies problem under each panther scheduling policy and check the
+    results do not depend on the order the runs are handed out"""
+    model_d = "ies_10par_xsec"
+    local=True
+    if "linux" in platform.platform().lower() and "10par" in model_d:
+        local=False
+
+    t_d = os.path.join(model_d,"template")
+    pst = pyemu.Pst(os.path.join(t_d,"pest.pst"))
+    pst.control_data.noptmax = 2
+    phis = []
+    for policy in ["fifo","longest_first","agent_affinity"]:
+        m_d = os.path.join(model_d,"master_schedule_{0}".format(policy))
+        if os.path.exists(m_d):
+            shutil.rmtree(m_d)
+        pst.pestpp_options = {"panther_schedule_policy":policy,"ies_num_reals":10}
+        pst.write(os.path.join(t_d,"pest_schedule.pst"))
+        pyemu.os_utils.start_workers(t_d, exe_path, "pest_schedule.pst", 5, master_dir=m_d,
+                               worker_root=model_d,local=local,port=port)
+        phis.append(pd.read_csv(os.path.join(m_d,"pest_schedule.phi.actual.csv"),index_col=0))
+    for phi in phis[1:]:
+        diff = (phis[0].iloc[:,1:] - phi.iloc[:,1:]).abs()
+        print(diff.max().max())
+        assert diff.max().max() < 1.0e-6
+
+
+def ies_num_threads_scaling_test():
+    """time the localized ies upgrade (autoadaloc) from 1 to 64 threads and check
+    the results do not depend on the number of threads"""
+    model_d = "mf6_freyberg"
+    t_d = os.path.join(model_d,"template")
+    pst = pyemu.Pst(os.path.join(t_d,"freyberg6_run_ies.pst"))
+    pst.control_data.noptmax = 1
+    phis,times = [],[]
+    num_threads = [1,2,4,8,16,32,64]
+    for nt in num_threads:
+        m_d = os.path.join(model_d,"master_ies_threads_{0}".format(nt))
+        if os.path.exists(m_d):
+            shutil.rmtree(m_d)
+        pst.pestpp_options["ies_num_reals"] = 20
+        pst.pestpp_options["ies_autoadaloc"] = True
+        pst.pestpp_options["ies_num_threads"] = nt
+        pst.write(os.path.join(t_d,"freyberg6_run_ies_threads.pst"))
+        start = datetime.now()
+        pyemu.os_utils.start_workers(t_d, exe_path, "freyberg6_run_ies_threads.pst", num_workers=10,
+                                     master_dir=m_d,worker_root=model_d,port=port)
+        times.append((datetime.now() - start).total_seconds())
+        phis.append(pd.read_csv(os.path.join(m_d,"freyberg6_run_ies_threads.phi.actual.csv"),index_col=0))
+    for nt,t in zip(num_threads,times):
+        print("ies_num_threads {0}: {1:.2f} sec".format(nt,t))
+    for phi in phis[1:]:
+        diff = (phis[0].iloc[:,1:] - phi.iloc[:,1:]).abs()
+        print(diff.max().max())
+        assert diff.max().max() < 1.0e-6
+
+
+def ies_lambda_en_mmap_test():
+    """run ies with a subset with the lambda ensembles in memory and in the
+    memory-mapped scratch file and check the results are the same"""
+    model_d = "mf6_freyberg"
+    t_d = os.path.join(model_d,"template")
+    pst = pyemu.Pst(os.path.join(t_d,"freyberg6_run_ies.pst"))
+    pst.control_data.noptmax = 2
+    pst.pestpp_options["ies_num_reals"] = 20
+    pst.pestpp_options["ies_subset_size"] = 5
+    pst.pestpp_options["lambda_scale_fac"] = [0.5,1.0]
+    pes = []
+    for use_mmap in [False,True]:
+        m_d = os.path.join(model_d,"master_ies_lambda_en_mmap_{0}".format(use_mmap))
+        if os.path.exists(m_d):
+            shutil.rmtree(m_d)
+        pst.pestpp_options["ies_lambda_en_mmap"] = use_mmap
+        pst.write(os.path.join(t_d,"freyberg6_run_ies_mmap.pst"))
+        pyemu.os_utils.start_workers(t_d, exe_path, "freyberg6_run_ies_mmap.pst", num_workers=10,
+                                     master_dir=m_d,worker_root=model_d,port=port)
+        pes.append(pd.read_csv(os.path.join(m_d,"freyberg6_run_ies_mmap.2.par.csv"),index_col=0))
+        #the scratch file is removed at the end of each iteration
+        assert len([f for f in os.listdir(m_d) if f.endswith(".mmap")]) == 0
+    diff = (pes[0] - pes[1]).abs()
+    print(diff.max().max())
+    assert diff.max().max() < 1.0e-10
+
+
+def ies_csv_io_test():
+    """time reading and writing a large par ensemble csv, both by realization and
+    by variable, with 1 and 4 threads, and check the round trip"""
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d,"template")
+    m_d = os.path.join(model_d,"master_csv_io")
+    if os.path.exists(m_d):
+        shutil.rmtree(m_d)
+    shutil.copytree(t_d,m_d)
+    pst = pyemu.Pst(os.path.join(m_d,"pest.pst"))
+    pst.pestpp_options = {}
+    pst.pestpp_options["ies_num_reals"] = 200000
+    pst.control_data.noptmax = -2
+    pst.write(os.path.join(m_d,"pest_csv.pst"))
+    pyemu.os_utils.run("{0} pest_csv.pst".format(exe_path),cwd=m_d)
+    org = pd.read_csv(os.path.join(m_d,"pest_csv.0.par.csv"),index_col=0)
+    org.to_csv(os.path.join(m_d,"pe_by_reals.csv"))
+    org.T.to_csv(os.path.join(m_d,"pe_by_vars.csv"),index_label="var_name")
+    pst.pestpp_options.pop("ies_num_reals")
+    for by_reals in [True,False]:
+        for nt in [1,4]:
+            pst.pestpp_options["ies_csv_by_reals"] = by_reals
+            pst.pestpp_options["ies_num_threads"] = nt
+            pst.pestpp_options["ies_par_en"] = "pe_by_reals.csv" if by_reals else "pe_by_vars.csv"
+            pst.write(os.path.join(m_d,"pest_csv.pst"))
+            start = datetime.now()
+            pyemu.os_utils.run("{0} pest_csv.pst".format(exe_path),cwd=m_d)
+            print("csv_by_reals {0}, threads {1}: {2:.2f} sec".format(by_reals,nt,(datetime.now() - start).total_seconds()))
+            pe = pd.read_csv(os.path.join(m_d,"pest_csv.0.par.csv"),index_col=0)
+            if not by_reals:
+                pe = pe.T
+            pe.index = pe.index.astype(str)
+            pe = pe.loc[org.index.astype(str),org.columns]
+            diff = (pe.values - org.values) / org.values
+            print(np.abs(diff).max())
+            assert np.abs(diff).max() < 1.0e-5
+
+
+def read_dense_bin(filename):
+    """read a dense binary ensemble file into a dataframe"""
+    with open(filename,"rb") as f:
+        buf = f.read()
+    assert buf[:8] == b"PESTENS1"
+    vsize,nvar,cblock = np.frombuffer(buf,dtype=np.int32,count=3,offset=8)
+    pos = 20
+    def read_name(pos):
+        n = int(np.frombuffer(buf,dtype=np.int32,count=1,offset=pos)[0])
+        return buf[pos+4:pos+4+n].decode(),pos+4+n
+    var_names = []
+    for _ in range(nvar):
+        name,pos = read_name(pos)
+        var_names.append(name)
+    dtype = np.float32 if vsize == 4 else np.float64
+    real_names,blocks = [],[]
+    while pos < len(buf):
+        nreal = int(np.frombuffer(buf,dtype=np.int32,count=1,offset=pos)[0])
+        pos += 4
+        for _ in range(nreal):
+            name,pos = read_name(pos)
+            real_names.append(name)
+        tiles = []
+        for c0 in range(0,nvar,cblock):
+            tw = min(cblock,nvar - c0)
+            tiles.append(np.frombuffer(buf,dtype=dtype,count=nreal*tw,offset=pos).reshape(nreal,tw))
+            pos += nreal * tw * vsize
+        blocks.append(np.hstack(tiles))
+    return pd.DataFrame(np.vstack(blocks).astype(np.float64),index=real_names,columns=var_names)
+
+
+def ies_dense_binary_test():
+    """save ies ensembles in the dense binary format, check them against the csv
+    ensembles and restart from them, reading only some of the realizations"""
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d,"template")
+    m_d = os.path.join(model_d,"master_dense")
+    if os.path.exists(m_d):
+        shutil.rmtree(m_d)
+    shutil.copytree(t_d,m_d)
+    pst = pyemu.Pst(os.path.join(m_d,"pest.pst"))
+    pst.pestpp_options = {}
+    pst.pestpp_options["ies_num_reals"] = 30
+    pst.control_data.noptmax = 1
+    pst.write(os.path.join(m_d,"pest_csv.pst"))
+    pyemu.os_utils.run("{0} pest_csv.pst".format(exe_path),cwd=m_d)
+    pst.pestpp_options["ies_save_dense"] = True
+    pst.pestpp_options["ies_dense_obs_float32"] = True
+    pst.write(os.path.join(m_d,"pest_dense.pst"))
+    pyemu.os_utils.run("{0} pest_dense.pst".format(exe_path),cwd=m_d)
+    for tag in ["0.par","obs+noise","1.par"]:
+        csv = pd.read_csv(os.path.join(m_d,"pest_csv.{0}.csv".format(tag)),index_col=0)
+        csv.index = csv.index.astype(str)
+        den = read_dense_bin(os.path.join(m_d,"pest_dense.{0}.bin".format(tag)))
+        den = den.loc[csv.index,csv.columns]
+        diff = np.abs(den.values - csv.values) / np.abs(csv.values).clip(1.0e-10)
+        print(tag,diff.max())
+        assert diff.max() < 1.0e-5
+
+    pst.pestpp_options["ies_par_en"] = "pest_dense.0.par.bin"
+    pst.pestpp_options["ies_obs_en"] = "pest_dense.obs+noise.bin"
+    pst.pestpp_options["ies_num_reals"] = 10
+    pst.write(os.path.join(m_d,"pest_restart.pst"))
+    pyemu.os_utils.run("{0} pest_restart.pst".format(exe_path),cwd=m_d)
+    org = read_dense_bin(os.path.join(m_d,"pest_dense.0.par.bin"))
+    pe = read_dense_bin(os.path.join(m_d,"pest_restart.0.par.bin"))
+    assert pe.shape[0] == 10
+    assert np.abs(pe.values[:9] - org.values[:9]).max() < 1.0e-10
+
+
+def ies_pipeline_lambdas_test():
+    """run the lambda tests with and without pipelining.  without canceling the
+    results must match; with canceling the same lambda should win in fewer runs"""
+    model_d = "mf6_freyberg"
+    t_d = os.path.join(model_d,"template")
+    pst = pyemu.Pst(os.path.join(t_d,"freyberg6_run_ies.pst"))
+    pst.control_data.noptmax = 2
+    pst.pestpp_options["ies_num_reals"] = 20
+    pst.pestpp_options["ies_subset_size"] = 8
+    pst.pestpp_options["ies_lambda_mults"] = [0.1,1.0,1000.0]
+    pst.pestpp_options["lambda_scale_fac"] = [0.5,1.0]
+    pes,phis = [],[]
+    for tag,pipeline,fac in [("org",False,2.0),("nocancel",True,0.0),("cancel",True,2.0)]:
+        m_d = os.path.join(model_d,"master_ies_pipeline_{0}".format(tag))
+        if os.path.exists(m_d):
+            shutil.rmtree(m_d)
+        pst.pestpp_options["ies_pipeline_lambdas"] = pipeline
+        pst.pestpp_options["ies_pipeline_cancel_fac"] = fac
+        pst.write(os.path.join(t_d,"freyberg6_run_ies_pipe.pst"))
+        pyemu.os_utils.start_workers(t_d, exe_path, "freyberg6_run_ies_pipe.pst", num_workers=5,
+                                     master_dir=m_d,worker_root=model_d,port=port)
+        pes.append(pd.read_csv(os.path.join(m_d,"freyberg6_run_ies_pipe.2.par.csv"),index_col=0))
+        phis.append(pd.read_csv(os.path.join(m_d,"freyberg6_run_ies_pipe.phi.actual.csv"),index_col=0))
+    diff = (pes[0] - pes[1]).abs()
+    print(diff.max().max())
+    assert diff.max().max() < 1.0e-10
+    print(phis[0].total_runs.values,phis[2].total_runs.values)
+    assert phis[2].total_runs.values[-1] <= phis[0].total_runs.values[-1]
+
+
+def ies_phi_group_test():
+    """check the obs group phi contributions sum to the actual phi of each
+    realization, with and without threads"""
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d,"template")
+    m_d = os.path.join(model_d,"master_phi_group")
+    if os.path.exists(m_d):
+        shutil.rmtree(m_d)
+    shutil.copytree(t_d,m_d)
+    pst = pyemu.Pst(os.path.join(m_d,"pest.pst"))
+    pst.pestpp_options = {}
+    pst.pestpp_options["ies_num_reals"] = 10
+    pst.control_data.noptmax = 1
+    phis = []
+    for num_threads in [0,4]:
+        pst.pestpp_options["ies_num_threads"] = num_threads
+        pst.write(os.path.join(m_d,"pest_{0}.pst".format(num_threads)))
+        pyemu.os_utils.run("{0} pest_{1}.pst".format(exe_path,num_threads),cwd=m_d)
+        act = pd.read_csv(os.path.join(m_d,"pest_{0}.phi.actual.csv".format(num_threads)))
+        grp = pd.read_csv(os.path.join(m_d,"pest_{0}.phi.group.csv".format(num_threads)))
+        ogrps = [g for g in pst.obs_groups if g in grp.columns]
+        for iiter in act.iteration.values:
+            a = act.loc[act.iteration==iiter,:].iloc[0]
+            g = grp.loc[grp.iteration==iiter,:]
+            for oreal,gsum in zip(g.obs_realization,g.loc[:,ogrps].sum(axis=1)):
+                assert np.abs(a[str(oreal)] - gsum) <= 1.0e-4 * max(1.0,gsum)
+        phis.append(act)
+    assert np.abs(phis[0].iloc[:,2:].values - phis[1].iloc[:,2:].values).max() < 1.0e-10
+
+
+def ies_draw_engine_test():
+    """check the prior par ensemble of the new draw engine is the same for any number
+    of threads, with and without a full parcov, and that the legacy draws are still
+    the default"""
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d,"template")
+    m_d = os.path.join(model_d,"master_draw_engine")
+    if os.path.exists(m_d):
+        shutil.rmtree(m_d)
+    shutil.copytree(t_d,m_d)
+    pst = pyemu.Pst(os.path.join(m_d,"pest.pst"))
+    cov = pyemu.Cov.from_parameter_data(pst)
+    cov = pyemu.Cov(x=np.exp(-np.abs(np.subtract.outer(np.arange(cov.shape[0]),
+                    np.arange(cov.shape[0])))/3.0) * np.outer(np.sqrt(cov.x.flatten()),
+                    np.sqrt(cov.x.flatten())),names=cov.names)
+    cov.to_ascii(os.path.join(m_d,"full.cov"))
+    pst.pestpp_options = {}
+    pst.pestpp_options["ies_num_reals"] = 10
+    pst.pestpp_options["ies_legacy_draws"] = False
+    pst.control_data.noptmax = -1
+    for parcov in [None,"full.cov"]:
+        pes = []
+        for num_threads in [0,4]:
+            pst.pestpp_options["ies_num_threads"] = num_threads
+            if parcov is not None:
+                pst.pestpp_options["parcov"] = parcov
+            pst.write(os.path.join(m_d,"pest_{0}.pst".format(num_threads)))
+            pyemu.os_utils.run("{0} pest_{1}.pst".format(exe_path,num_threads),cwd=m_d)
+            pes.append(pd.read_csv(os.path.join(m_d,"pest_{0}.0.par.csv".format(num_threads)),index_col=0))
+        assert np.abs(pes[0].values - pes[1].values).max() < 1.0e-10
+    pes = []
+    for legacy in [True,None]:
+        if legacy is None:
+            pst.pestpp_options.pop("ies_legacy_draws")
+        else:
+            pst.pestpp_options["ies_legacy_draws"] = legacy
+        pst.write(os.path.join(m_d,"pest_legacy.pst"))
+        pyemu.os_utils.run("{0} pest_legacy.pst".format(exe_path),cwd=m_d)
+        pes.append(pd.read_csv(os.path.join(m_d,"pest_legacy.0.par.csv"),index_col=0))
+    assert np.abs(pes[0].values - pes[1].values).max() == 0.0
+
+
+def linear_jac(npar, nobs):
+    """a smooth, full rank jacobian for a linear model with nobs outputs and npar inputs"""
+    irow = np.arange(nobs)[:, None]
+    jcol = np.arange(npar)[None, :]
+    return 1.0 / (1.0 + np.abs(irow / 3.0 - jcol)) + 0.1 * (irow + 1) / (jcol + 1)
+
+
+def setup_linear_model(t_d, jac):
+    """write a linear model o = jac p (pars p0..., obs o...) to t_d, run it once with
+    all pars at 1.0 and return the control file for it"""
+    if os.path.exists(t_d):
+        shutil.rmtree(t_d)
+    os.makedirs(t_d)
+    nobs, npar = jac.shape
+    np.savetxt(os.path.join(t_d, "jac.dat"), jac, fmt="%20.12E")
+    with open(os.path.join(t_d, "pars.dat.tpl"), 'w') as f:
+        f.write("ptf ~\n")
+        for i in range(npar):
+            f.write("~   p{0}   ~\n".format(i))
+    with open(os.path.join(t_d, "obs.dat.ins"), 'w') as f:
+        f.write("pif ~\n")
+        for i in range(nobs):
+            f.write("l1 !o{0}!\n".format(i))
+    with open(os.path.join(t_d, "forward_run.py"), 'w') as f:
+        f.write("import numpy as np\n")
+        f.write("np.savetxt('obs.dat',np.loadtxt('jac.dat').dot(np.loadtxt('pars.dat')),fmt='%20.12E')\n")
+    b_d = os.getcwd()
+    os.chdir(t_d)
+    try:
+        np.savetxt("pars.dat", np.ones(npar), fmt="%20.12E")
+        pyemu.os_utils.run("python forward_run.py")
+        pst = pyemu.Pst.from_io_files("pars.dat.tpl", "pars.dat", "obs.dat.ins", "obs.dat")
+    except Exception as e:
+        os.chdir(b_d)
+        raise Exception(e)
+    os.chdir(b_d)
+    pst.model_command = "python forward_run.py"
+    return pst
+
+
+def glm_normal_form_upgrade(jac, resid, q, lam, form, eigthresh, prior_inv, shared):
+    """the glm upgrade for one lambda, as formed before the lambdas could share one
+    decomposition of the normal matrix (shared=False) and as formed when they do"""
+    def tsvd(mat, thresh):
+        u, s, vt = np.linalg.svd(mat)
+        k = int(np.sum(s / s[0] > thresh))
+        return u[:, :k], s[:k], vt[:k]
+    jtqj = jac.T.dot(np.diag(q)).dot(jac)
+    innov = jac.T.dot(q * resid)
+    n = jtqj.shape[0]
+    if form == "diag" and not shared:
+        u, s, vt = tsvd(jtqj, 0.0)
+        smat = np.diag(np.diag(vt.T.dot(np.diag(1.0 / np.sqrt(s))).dot(u.T)))
+        js = jac.dot(smat)
+        u, s, vt = tsvd(js.T.dot(np.diag(q)).dot(js) + lam * smat.T.dot(smat), eigthresh)
+        upgrade = smat.dot(vt.T.dot(u.T.dot(js.T.dot(q * resid)) / s))
+    elif form == "diag":
+        u, s, vt = tsvd(jtqj, eigthresh)
+        upgrade = vt.T.dot(u.T.dot(innov) / (s + lam))
+    else:
+        if form == "prior" and shared:
+            jtqj = jtqj + prior_inv
+        elif form == "prior":
+            jtqj = jtqj + prior_inv + np.ones((n, n)) * (lam + 1.0)
+        u, s, vt = tsvd(jtqj, eigthresh)
+        s = s + np.sqrt(s * s * lam)
+        upgrade = vt.T.dot(u.T.dot(innov) / s)
+    # jac_scale
+    gam = jac.dot(upgrade)
+    beta = resid.dot(q * gam) / gam.dot(q * gam)
+    if 0.0 < beta < 1.0:
+        upgrade *= beta
+    return upgrade
+
+
+def glm_normal_form_test():
+    """check each glm normal form runs and lowers phi, and that the upgrades at fixed lambdas
+    match the normal forms computed with numpy - both the default (one decomposition per lambda
+    for diag and prior) and glm_lambda_shared_svd"""
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d,"template")
+    m_d = os.path.join(model_d,"master_glm_normal_form")
+    if os.path.exists(m_d):
+        shutil.rmtree(m_d)
+    shutil.copytree(t_d,m_d)
+    pst = pyemu.Pst(os.path.join(m_d,"pest.pst"))
+    pst.pestpp_options = {}
+    pst.control_data.noptmax = 2
+    init_phi = None
+    for form in ["ident","diag","prior"]:
+        pst.pestpp_options["glm_normal_form"] = form
+        pst.write(os.path.join(m_d,"pest_{0}.pst".format(form)))
+        pyemu.os_utils.run("{0} pest_{1}.pst".format(exe_path.replace("-ies","-glm"),form),cwd=m_d)
+        iobj = pd.read_csv(os.path.join(m_d,"pest_{0}.iobj".format(form)),index_col=0)
+        if init_phi is None:
+            init_phi = iobj.loc[0,"total_phi"]
+        assert iobj.loc[0,"total_phi"] == init_phi
+        assert iobj.total_phi.iloc[-1] < init_phi, iobj.total_phi
+
+    # a linear model with more (weighted) obs than pars, so the jacobian is exact and the
+    # normal matrix is full rank.  the par changes aren't limited, so the upgrades in the
+    # upg.csv file are the raw upgrades
+    t_d = os.path.join("glm_normal_form", "template")
+    npar, nobs = 8, 24
+    jac = linear_jac(npar, nobs)
+    pst = setup_linear_model(t_d, jac)
+    par_names = ["p{0}".format(i) for i in range(npar)]
+    obs_names = ["o{0}".format(i) for i in range(nobs)]
+    par = pst.parameter_data
+    par.loc[:, "partrans"] = "none"
+    par.loc[:, "parval1"] = 1.0
+    par.loc[:, "parlbnd"] = -100.0
+    par.loc[:, "parubnd"] = 100.0
+    obs = pst.observation_data
+    p_true = 1.0 + 0.1 * np.arange(npar)
+    obs.loc[obs_names, "obsval"] = jac.dot(p_true)
+    obs.loc[obs_names, "weight"] = 1.0 + (np.arange(nobs) % 3)
+    pst.control_data.noptmax = 1
+    pst.control_data.relparmax = 1.0e10
+    pst.control_data.facparmax = 1.0e10
+
+    resid = jac.dot(p_true) - jac.dot(par.loc[par_names, "parval1"].values)
+    q = obs.loc[obs_names, "weight"].values ** 2
+    # the default prior par cov: the bounds span four standard deviations
+    prior_inv = np.eye(npar) / (((par.parubnd - par.parlbnd).values / 4.0) ** 2)
+    for shared in [False, True]:
+        for form in ["ident", "diag", "prior"]:
+            pst.pestpp_options = {"glm_normal_form": form, "glm_lambda_shared_svd": shared,
+                                  "svd_pack": "eigen", "lambdas": [0.1, 1.0, 10.0],
+                                  "lambda_scale_fac": 1.0}
+            pst.write(os.path.join(t_d, "pest.pst"))
+            m_d = os.path.join("glm_normal_form", "master_{0}_{1}".format(form, shared))
+            if os.path.exists(m_d):
+                shutil.rmtree(m_d)
+            shutil.copytree(t_d, m_d)
+            pyemu.os_utils.run("{0} pest.pst".format(exe_path.replace("-ies", "-glm")), cwd=m_d)
+            upg = pd.read_csv(os.path.join(m_d, "pest.upg.csv"))
+            upg.columns = upg.columns.str.lower()
+            assert upg.shape[0] == 3, upg
+            for _, row in upg.iterrows():
+                expected = par.loc[par_names, "parval1"].values + glm_normal_form_upgrade(jac, resid, q, row["_lambda"], form,
+                                                  pst.svd_data.eigthresh, prior_inv, shared)
+                diff = np.abs(row.loc[par_names].values.astype(float) - expected).max() / np.abs(expected).max()
+                print(form, shared, row["_lambda"], diff)
+                assert diff < 1.0e-4, (form, shared, row["_lambda"], diff)
+
+
+def glm_jco_threads_test():
+    """check the jacobian is the same with threaded assembly off (the default) and with
+    threads, with prior information and central differences"""
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d,"template")
+    m_d = os.path.join(model_d,"master_jco_threads")
+    if os.path.exists(m_d):
+        shutil.rmtree(m_d)
+    shutil.copytree(t_d,m_d)
+    pst = pyemu.Pst(os.path.join(m_d,"pest.pst"))
+    pyemu.helpers.zero_order_tikhonov(pst)
+    pst.parameter_groups.loc[:,"forcen"] = "always_3"
+    pst.pestpp_options = {}
+    pst.control_data.noptmax = -1
+    jcos = []
+    for num_threads in [-1,4]:
+        pst.pestpp_options["num_jco_threads"] = num_threads
+        pst.write(os.path.join(m_d,"pest_{0}.pst".format(num_threads)))
+        pyemu.os_utils.run("{0} pest_{1}.pst".format(exe_path.replace("-ies","-glm"),num_threads),cwd=m_d)
+        jcos.append(pyemu.Jco.from_binary(os.path.join(m_d,"pest_{0}.jcb".format(num_threads))).to_dataframe())
+    assert jcos[0].shape == (pst.nobs + pst.nprior,pst.npar_adj)
+    assert np.abs(jcos[0].values - jcos[1].values).max() == 0.0
+
+
+def glm_fosm_factor_test():
+    """check the factor-based fosm parameter and forecast variances are consistent with the
+    posterior covariance matrix, and match the explicit inverse of the posterior precision
+    for both the obs-space and par-space forms"""
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d,"template")
+    m_d = os.path.join(model_d,"master_fosm_factor")
+    if os.path.exists(m_d):
+        shutil.rmtree(m_d)
+    shutil.copytree(t_d,m_d)
+    pst = pyemu.Pst(os.path.join(m_d,"pest.pst"))
+    pst.pestpp_options = {}
+    pst.control_data.noptmax = -1
+    obs = pst.observation_data
+    pred_names = obs.obsnme.iloc[-3:].tolist()
+    obs.loc[pred_names,"weight"] = 0.0
+    pst.pestpp_options["forecasts"] = pred_names
+    pst.write(os.path.join(m_d,"pest.pst"))
+    pyemu.os_utils.run("{0} pest.pst".format(exe_path.replace("-ies","-glm")),cwd=m_d)
+    post = pyemu.Cov.from_ascii(os.path.join(m_d,"pest.post.cov")).to_dataframe()
+    psum = pd.read_csv(os.path.join(m_d,"pest.par.usum.csv"),index_col=0)
+    psum.index = psum.index.str.lower()
+    for pname in post.index:
+        assert np.isclose(psum.loc[pname,"post_stdev"]**2,post.loc[pname,pname],rtol=1.0e-4)
+    jco = pyemu.Jco.from_binary(os.path.join(m_d,"pest.jcb")).to_dataframe()
+    fsum = pd.read_csv(os.path.join(m_d,"pest.pred.usum.csv"),index_col=0)
+    fsum.index = fsum.index.str.lower()
+    for pred_name in pred_names:
+        y = jco.loc[pred_name,post.index].values
+        assert np.isclose(fsum.loc[pred_name,"post_stdev"]**2,y.dot(post.values).dot(y),rtol=1.0e-3)
+
+    # linear models that take each branch of the posterior calculation: the obs-space form
+    # (fewer obs than pars) and the par-space form (a diagonal prior and more obs than pars).
+    # the par and forecast variances must match the explicit inverse of the posterior precision
+    # J^T Q J + C^-1 that was used before the factor-based forms
+    npred = 3
+    for npar,nobs in [(24,6),(8,24)]:
+        t_d = os.path.join("glm_fosm_factor","template_{0}_{1}".format(npar,nobs))
+        jac = linear_jac(npar,nobs + npred)
+        pst = setup_linear_model(t_d,jac)
+        par_names = ["p{0}".format(i) for i in range(npar)]
+        pred_names = ["o{0}".format(i) for i in range(nobs,nobs + npred)]
+        par = pst.parameter_data
+        par.loc[:,"partrans"] = "none"
+        par.loc[:,"parval1"] = 1.0
+        par.loc[par_names,"parlbnd"] = -5.0 - np.arange(npar)
+        par.loc[par_names,"parubnd"] = 5.0 + np.arange(npar)
+        obs = pst.observation_data
+        obs_names = ["o{0}".format(i) for i in range(nobs + npred)]
+        obs.loc[obs_names,"obsval"] = jac.dot(1.0 + 0.1 * np.arange(npar))
+        obs.loc[obs_names,"weight"] = 1.0 + (np.arange(nobs + npred) % 3)
+        obs.loc[pred_names,"weight"] = 0.0
+        pst.pestpp_options = {"forecasts": pred_names}
+        pst.control_data.noptmax = -1
+        pst.write(os.path.join(t_d,"pest.pst"))
+        pyemu.os_utils.run("{0} pest.pst".format(exe_path.replace("-ies","-glm")),cwd=t_d)
+
+        # fosm reweights each obs so its residual contributes no more than 1 to phi
+        resid = obs.loc[obs_names,"obsval"].values - jac.dot(par.loc[par_names,"parval1"].values)
+        weight = obs.loc[obs_names,"weight"].values
+        weight = np.where(weight > 0.0,np.minimum(weight,1.0 / np.abs(resid)),0.0)
+        prior_var = ((par.loc[par_names,"parubnd"] - par.loc[par_names,"parlbnd"]).values / 4.0) ** 2
+        post = np.linalg.inv(jac.T.dot(np.diag(weight ** 2)).dot(jac) + np.diag(1.0 / prior_var))
+
+        # the usum files are written to 6 significant digits
+        psum = pd.read_csv(os.path.join(t_d,"pest.par.usum.csv"),index_col=0)
+        psum.index = psum.index.str.lower()
+        pvar = psum.loc[par_names,"post_stdev"].values ** 2
+        print(npar,nobs,"par variance max rel diff:",np.abs(pvar / np.diag(post) - 1.0).max())
+        assert np.allclose(pvar,np.diag(post),rtol=1.0e-4),(npar,nobs)
+        fsum = pd.read_csv(os.path.join(t_d,"pest.pred.usum.csv"),index_col=0)
+        fsum.index = fsum.index.str.lower()
+        fvar = fsum.loc[pred_names,"post_stdev"].values ** 2
+        fref = np.array([jac[i].dot(post).dot(jac[i]) for i in range(nobs,nobs + npred)])
+        print(npar,nobs,"forecast variance max rel diff:",np.abs(fvar / fref - 1.0).max())
+        assert np.allclose(fvar,fref,rtol=1.0e-4),(npar,nobs)
+
+
+def ies_name_align_test():
+    """check a par ensemble with shuffled columns is aligned to the control file
+    par order without changing any values"""
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d,"template")
+    m_d = os.path.join(model_d,"master_name_align")
+    if os.path.exists(m_d):
+        shutil.rmtree(m_d)
+    shutil.copytree(t_d,m_d)
+    pst = pyemu.Pst(os.path.join(m_d,"pest.pst"))
+    pe = pyemu.ParameterEnsemble.from_gaussian_draw(pst,num_reals=10)
+    pe = pe._df.loc[:,pe.columns[::-1]]
+    pe.to_csv(os.path.join(m_d,"shuffled.csv"))
+    pst.pestpp_options = {}
+    pst.pestpp_options["ies_par_en"] = "shuffled.csv"
+    pst.control_data.noptmax = -1
+    pst.write(os.path.join(m_d,"pest.pst"))
+    pyemu.os_utils.run("{0} pest.pst".format(exe_path),cwd=m_d)
+    pe0 = pd.read_csv(os.path.join(m_d,"pest.0.par.csv"),index_col=0)
+    pe0.columns = pe0.columns.str.lower()
+    assert list(pe0.columns) == list(pst.par_names)
+    pe.index = pe.index.map(str)
+    pe0.index = pe0.index.map(str)
+    diff = np.abs(pe0.loc[pe.index,pe.columns].values - pe.values)
+    assert diff.max() < 1.0e-6 * np.abs(pe.values).max(), diff.max()
+
+
+def glm_svd_seconds(log_file):
+    """sum the performance log events from the start to the end of each SVD factorization"""
+    svd_secs,in_svd = 0.0,False
+    for line in open(log_file).readlines()[1:]:
+        raw = line.strip().split(",",2)
+        if len(raw) < 3:
+            continue
+        secs,msg = float(raw[1]),raw[2]
+        if in_svd:
+            svd_secs += secs
+        in_svd = (in_svd or "commencing SVD factorization" in msg) and \
+                 "SVD factorization complete" not in msg
+    return svd_secs
+
+
+def glm_rsvd_test():
+    """check the randomized svd package gives the same upgrades as the Eigen JacobiSVD
+    package, with and without the prior normal form and threads, and report the
+    time each spends factoring the normal matrix"""
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d,"template")
+    m_d = os.path.join(model_d,"master_glm_rsvd")
+    if os.path.exists(m_d):
+        shutil.rmtree(m_d)
+    shutil.copytree(t_d,m_d)
+    pst = pyemu.Pst(os.path.join(m_d,"pest.pst"))
+    pst.pestpp_options = {}
+    pst.control_data.noptmax = 2
+    for form in ["diag","prior"]:
+        results = {}
+        for svd_pack,num_threads in [("eigen",0),("randomized",1),("randomized",4)]:
+            tag = "{0}_{1}_{2}".format(form,svd_pack,num_threads)
+            pst.pestpp_options["glm_normal_form"] = form
+            pst.pestpp_options["svd_pack"] = svd_pack
+            pst.pestpp_options["num_svd_threads"] = num_threads
+            pst.write(os.path.join(m_d,"pest_{0}.pst".format(tag)))
+            pyemu.os_utils.run("{0} pest_{1}.pst".format(exe_path.replace("-ies","-glm"),tag),cwd=m_d)
+            print(tag,"svd factorization seconds:",glm_svd_seconds(os.path.join(m_d,"pest_{0}.log".format(tag))))
+            iobj = pd.read_csv(os.path.join(m_d,"pest_{0}.iobj".format(tag)),index_col=0)
+            par = pyemu.pst_utils.read_parfile(os.path.join(m_d,"pest_{0}.par".format(tag)))
+            results[(svd_pack,num_threads)] = (iobj.total_phi.values,par.parval1.values)
+        phi,parval = results[("eigen",0)]
+        for key in [("randomized",1),("randomized",4)]:
+            assert np.allclose(results[key][0],phi,rtol=1.0e-6),(key,results[key][0],phi)
+            assert np.allclose(results[key][1],parval,rtol=1.0e-6),key
+        assert np.array_equal(results[("randomized",1)][1],results[("randomized",4)][1])
+
+    # a benchmark-sized case: 400 log-transformed pars and 100 obs from a smooth linear kernel
+    # (o_i = sum_j exp(-((4i - j) / 20)^2) p_j) run through a model plugin.  JtQJ has rank
+    # of about 30 at the default eigthresh, which is where the randomized package pays off.  a
+    # weak zero-order tikhonov term keeps JtQJ full rank, so the scaling the default diag
+    # form takes from the full spectrum is well defined and the same for both packages
+    model_d = "glm_rsvd"
+    t_d = os.path.join(model_d,"template")
+    if os.path.exists(model_d):
+        shutil.rmtree(model_d)
+    os.makedirs(t_d)
+    npar,nobs = 400,100
+    par_names = ["p{0}".format(i) for i in range(npar)]
+    obs_names = ["o{0}".format(i) for i in range(nobs)]
+    with open(os.path.join(t_d,"pars.dat.tpl"),'w') as f:
+        f.write("ptf ~\n")
+        for pname in par_names:
+            f.write("~   {0}   ~\n".format(pname))
+    with open(os.path.join(t_d,"obs.dat.ins"),'w') as f:
+        f.write("pif ~\n")
+        for oname in obs_names:
+            f.write("l1 !{0}!\n".format(oname))
+    with open(os.path.join(t_d,"plugin.c"),'w') as f:
+        f.write('''#include <stdlib.h>
+#include <math.h>
+#include "pestpp_plugin.h"
+static int np_ = 0, no_ = 0, *pidx = NULL, *oidx = NULL;
+PESTPP_PLUGIN_EXPORT int pestpp_plugin_api_version(void) { return PESTPP_PLUGIN_API_VERSION; }
+PESTPP_PLUGIN_EXPORT int pestpp_plugin_init(int npar, const char* const* par_names, int nobs,
+    const char* const* obs_names, const char* config)
+{
+    int i;
+    np_ = npar; no_ = nobs;
+    pidx = (int*)malloc(npar * sizeof(int));
+    oidx = (int*)malloc(nobs * sizeof(int));
+    for (i = 0; i < npar; i++) pidx[i] = atoi(par_names[i] + 1);
+    for (i = 0; i < nobs; i++) oidx[i] = atoi(obs_names[i] + 1);
+    return 0;
+}
+PESTPP_PLUGIN_EXPORT int pestpp_plugin_run(const double* p, double* o)
+{
+    int i, j;
+    double d;
+    for (i = 0; i < no_; i++)
+    {
+        o[i] = 0.0;
+        for (j = 0; j < np_; j++)
+        {
+            d = (4.0 * oidx[i] - pidx[j]) / 20.0;
+            o[i] += exp(-d * d) * p[j];
+        }
+    }
+    return 0;
+}
+PESTPP_PLUGIN_EXPORT int pestpp_plugin_run_batch(int nruns, const double* p, double* o, int* status)
+{
+    int r;
+    for (r = 0; r < nruns; r++) status[r] = pestpp_plugin_run(p + r * np_, o + r * no_);
+    return 0;
+}
+PESTPP_PLUGIN_EXPORT void pestpp_plugin_finalize(void) { free(pidx); free(oidx); }
+''')
+    inc_d = os.path.abspath(os.path.join("..","src","libs","run_managers","abstract_base"))
+    lib_name = "plugin" + (".dll" if "window" in platform.platform().lower() else ".so")
+    pyemu.os_utils.run("cc -O2 -shared -fPIC -I{0} plugin.c -o {1} -lm".format(inc_d,lib_name),cwd=t_d)
+    irow = np.arange(nobs)[:,None]
+    jcol = np.arange(npar)[None,:]
+    kern = np.exp(-((4.0 * irow - jcol) / 20.0) ** 2)
+    p_true = np.exp(0.5 * np.sin(np.arange(npar) / 15.0))
+    b_d = os.getcwd()
+    os.chdir(t_d)
+    try:
+        np.savetxt("pars.dat",np.ones(npar),fmt="%20.12E")
+        np.savetxt("obs.dat",kern.dot(np.ones(npar)),fmt="%20.12E")
+        pst = pyemu.Pst.from_io_files("pars.dat.tpl","pars.dat","obs.dat.ins","obs.dat")
+    except Exception as e:
+        os.chdir(b_d)
+        raise Exception(e)
+    os.chdir(b_d)
+    par = pst.parameter_data
+    par.loc[:,"partrans"] = "log"
+    par.loc[:,"parval1"] = 1.0
+    par.loc[:,"parlbnd"] = 0.1
+    par.loc[:,"parubnd"] = 10.0
+    pst.observation_data.loc[obs_names,"obsval"] = kern.dot(p_true)
+    pst.observation_data.loc[obs_names,"weight"] = 1.0
+    pyemu.helpers.zero_order_tikhonov(pst)
+    pst.prior_information.loc[:,"weight"] = 0.01
+    pst.control_data.pestmode = "estimation"
+    pst.model_command = "none"
+    pst.control_data.noptmax = 1
+    for form in ["ident","diag","prior"]:
+        for shared in [False,True]:
+            if form == "ident" and shared:
+                continue
+            results = {}
+            for svd_pack,num_threads in [("eigen",0),("randomized",1),("randomized",4)]:
+                tag = "{0}_{1}_{2}_{3}".format(form,shared,svd_pack,num_threads)
+                pst.pestpp_options = {"model_plugin": "./" + lib_name, "glm_normal_form": form,
+                                      "glm_lambda_shared_svd": shared, "svd_pack": svd_pack,
+                                      "num_svd_threads": num_threads}
+                m_d = os.path.join(model_d,"master_{0}".format(tag))
+                if os.path.exists(m_d):
+                    shutil.rmtree(m_d)
+                shutil.copytree(t_d,m_d)
+                pst.write(os.path.join(m_d,"pest.pst"))
+                pyemu.os_utils.run("{0} pest.pst".format(exe_path.replace("-ies","-glm")),cwd=m_d)
+                print(tag,"svd factorization seconds:",glm_svd_seconds(os.path.join(m_d,"pest.log")))
+                iobj = pd.read_csv(os.path.join(m_d,"pest.iobj"),index_col=0)
+                upg = pd.read_csv(os.path.join(m_d,"pest.upg.csv"))
+                upg.columns = upg.columns.str.lower()
+                results[(svd_pack,num_threads)] = (iobj.total_phi.values,upg.loc[:,par_names].values)
+            phi,upgs = results[("eigen",0)]
+            assert phi[-1] < phi[0],phi
+            for key in [("randomized",1),("randomized",4)]:
+                # the upg.csv values are only written to 6 significant digits
+                assert np.allclose(results[key][0],phi,rtol=1.0e-5),(form,shared,key,results[key][0],phi)
+                assert np.allclose(results[key][1],upgs,rtol=1.0e-4,atol=0.0,equal_nan=True),(form,shared,key)
+            assert np.array_equal(results[("randomized",1)][1],results[("randomized",4)][1],equal_nan=True)
+
+
 if __name__ == "__main__":
     
     #glm_long_name_test()
@@ -1021,3 +2027,21 @@ if __name__ == "__main__":
     #mf6_v5_opt_stack_test()
     #mf6_v5_glm_test()
     #cmdline_test()
+    #run_storage_mmap_test()
+    #panther_payload_codec_test()
+    #ins_mmap_parity_test()
+    #model_plugin_test()
+    #local_workers_test()
+    #panther_schedule_policy_test()
+    #ies_num_threads_scaling_test()
+    #ies_lambda_en_mmap_test()
+    #ies_csv_io_test()
+    #ies_dense_binary_test()
+    #ies_pipeline_lambdas_test()
+    #ies_phi_group_test()
+    #ies_draw_engine_test()
+    #glm_normal_form_test()
+    #glm_jco_threads_test()
+    #glm_fosm_factor_test()
+    #ies_name_align_test()
+    #glm_rsvd_test()
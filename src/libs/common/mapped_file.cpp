@@ -0,0 +1,225 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdint>
+#include <sstream>
+#include "mapped_file.h"
+#include "pest_error.h"
+
+#ifdef OS_WIN
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <io.h>
+#endif
+
+#ifdef OS_LINUX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::MappedFile() : mode(Mode::READ_ONLY), fd_open(false), addr(nullptr), map_size(0)
+#ifdef OS_WIN
+	, file_handle(nullptr), map_handle(nullptr)
+#else
+	, fd(-1)
+#endif
+{
+}
+
+MappedFile::MappedFile(const string &_filename, Mode _mode) : MappedFile()
+{
+	open(_filename, _mode);
+}
+
+void MappedFile::open(const string &_filename, Mode _mode)
+{
+	close();
+	filename = _filename;
+	mode = _mode;
+#ifdef OS_WIN
+	DWORD access = GENERIC_READ;
+	DWORD disp = OPEN_EXISTING;
+	if (mode == Mode::READ_WRITE)
+	{
+		access |= GENERIC_WRITE;
+		disp = OPEN_ALWAYS;
+	}
+	HANDLE fh = CreateFileA(filename.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		disp, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fh == INVALID_HANDLE_VALUE)
+		throw PestFileError(filename, " MappedFile::open() failed");
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(fh, &fsize))
+	{
+		CloseHandle(fh);
+		throw PestFileErrorAccess(filename, " MappedFile::open() could not get file size");
+	}
+	file_handle = fh;
+	map_size = (size_t)fsize.QuadPart;
+#else
+	int flags = (mode == Mode::READ_WRITE) ? (O_RDWR | O_CREAT) : O_RDONLY;
+	fd = ::open(filename.c_str(), flags, 0644);
+	if (fd < 0)
+		throw PestFileError(filename, " MappedFile::open() failed");
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		fd = -1;
+		throw PestFileErrorAccess(filename, " MappedFile::open() could not stat file");
+	}
+	map_size = (size_t)st.st_size;
+#endif
+	fd_open = true;
+	map_view();
+}
+
+void MappedFile::map_view()
+{
+	addr = nullptr;
+	//zero-length files can't be mapped, but they are still valid
+	if (map_size == 0)
+		return;
+#ifdef OS_WIN
+	DWORD protect = (mode == Mode::READ_WRITE) ? PAGE_READWRITE : PAGE_READONLY;
+	DWORD view_access = (mode == Mode::READ_WRITE) ? FILE_MAP_WRITE : FILE_MAP_READ;
+	uint64_t sz = map_size;
+	HANDLE mh = CreateFileMappingA((HANDLE)file_handle, NULL, protect,
+		(DWORD)(sz >> 32), (DWORD)(sz & 0xFFFFFFFF), NULL);
+	if (mh == NULL)
+		throw PestFileErrorAccess(filename, " MappedFile: CreateFileMapping() failed");
+	void *p = MapViewOfFile(mh, view_access, 0, 0, map_size);
+	if (p == NULL)
+	{
+		CloseHandle(mh);
+		throw PestFileErrorAccess(filename, " MappedFile: MapViewOfFile() failed");
+	}
+	map_handle = mh;
+	addr = static_cast<char*>(p);
+#else
+	int prot = (mode == Mode::READ_WRITE) ? (PROT_READ | PROT_WRITE) : PROT_READ;
+	void *p = mmap(nullptr, map_size, prot, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		throw PestFileErrorAccess(filename, " MappedFile: mmap() failed");
+	addr = static_cast<char*>(p);
+#endif
+}
+
+void MappedFile::unmap_view()
+{
+	if (addr == nullptr)
+		return;
+#ifdef OS_WIN
+	UnmapViewOfFile(addr);
+	CloseHandle((HANDLE)map_handle);
+	map_handle = nullptr;
+#else
+	munmap(addr, map_size);
+#endif
+	addr = nullptr;
+}
+
+void MappedFile::resize(size_t new_size)
+{
+	if (!fd_open)
+		throw PestError("MappedFile::resize(): file not open");
+	if (mode != Mode::READ_WRITE)
+		throw PestError("MappedFile::resize(): file '" + filename + "' is mapped read-only");
+	if (new_size == map_size)
+		return;
+	unmap_view();
+#ifdef OS_WIN
+	LARGE_INTEGER li;
+	li.QuadPart = (LONGLONG)new_size;
+	if ((!SetFilePointerEx((HANDLE)file_handle, li, NULL, FILE_BEGIN)) || (!SetEndOfFile((HANDLE)file_handle)))
+		throw PestFileErrorAccess(filename, " MappedFile::resize() failed");
+#else
+	if (ftruncate(fd, (off_t)new_size) != 0)
+		throw PestFileErrorAccess(filename, " MappedFile::resize() failed");
+#endif
+	map_size = new_size;
+	map_view();
+}
+
+void MappedFile::sync(size_t offset, size_t len)
+{
+	if ((addr == nullptr) || (mode != Mode::READ_WRITE))
+		return;
+	if (offset >= map_size)
+		return;
+	if ((len == 0) || (offset + len > map_size))
+		len = map_size - offset;
+#ifdef OS_WIN
+	FlushViewOfFile(addr + offset, len);
+	FlushFileBuffers((HANDLE)file_handle);
+#else
+	//msync() wants a page-aligned start address
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t aligned = (offset / page) * page;
+	msync(addr + aligned, len + (offset - aligned), MS_SYNC);
+#endif
+}
+
+void MappedFile::advise_sequential()
+{
+#ifdef OS_LINUX
+	if (addr != nullptr)
+		madvise(addr, map_size, MADV_SEQUENTIAL);
+#endif
+}
+
+void MappedFile::sync_stream(FILE *fp)
+{
+	if (fp == nullptr)
+		return;
+	fflush(fp);
+#ifdef OS_WIN
+	_commit(_fileno(fp));
+#else
+	fsync(fileno(fp));
+#endif
+}
+
+void MappedFile::close()
+{
+	unmap_view();
+	if (fd_open)
+	{
+#ifdef OS_WIN
+		CloseHandle((HANDLE)file_handle);
+		file_handle = nullptr;
+#else
+		::close(fd);
+		fd = -1;
+#endif
+	}
+	fd_open = false;
+	map_size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
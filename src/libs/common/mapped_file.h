@@ -0,0 +1,72 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <string>
+#include <cstdio>
+#include <cstddef>
+#include "config_os.h"
+
+class MappedFile
+{
+	// Thin portable wrapper around a memory-mapped file (mmap on linux/mac,
+	// CreateFileMapping on windows).  READ_ONLY maps an existing file,
+	// READ_WRITE maps an existing (or newly created) file with a shared,
+	// writable view that can be grown with resize().
+public:
+	enum class Mode { READ_ONLY, READ_WRITE };
+	MappedFile();
+	MappedFile(const std::string &_filename, Mode _mode = Mode::READ_ONLY);
+	void open(const std::string &_filename, Mode _mode = Mode::READ_ONLY);
+	void close();
+	//grow (or shrink) the underlying file and remap it.  READ_WRITE only
+	void resize(size_t new_size);
+	//flush dirty pages in [offset, offset+len) to disk.  len=0 means the whole view
+	void sync(size_t offset = 0, size_t len = 0);
+	//hint to the OS that the view will be scanned front-to-back
+	void advise_sequential();
+	bool is_open() const { return fd_open; }
+	char *data() { return addr; }
+	const char *data() const { return addr; }
+	size_t size() const { return map_size; }
+	const std::string &get_filename() const { return filename; }
+	//force a stdio stream all the way to disk (fflush + fsync)
+	static void sync_stream(std::FILE *fp);
+	~MappedFile();
+private:
+	std::string filename;
+	Mode mode;
+	bool fd_open;
+	char *addr;
+	size_t map_size;
+#ifdef OS_WIN
+	void *file_handle;
+	void *map_handle;
+#else
+	int fd;
+#endif
+	void map_view();
+	void unmap_view();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+};
+
+#endif /* MAPPED_FILE_H_ */
@@ -151,54 +151,51 @@ void NetPackage::reset(PackType _type, int _group, int _run_id, const string &_d
 std::pair<int,std::string> NetPackage::send(int sockfd, const void *data, int64_t data_len_l)
 {
 	int n;
-
-	// first send security code
-	int64_t security_code_size = sizeof(security_code);
-	int i = 0;
-	n = w_sendall(sockfd, &security_code[0], &security_code_size);
-	
-	if (n < 1)
-	{
-		//cerr << "NetPackage::send error: could not send security code" << endl;
-		return pair<int,string>(n,"NetPackage::send error: could not send security code");
-	}
-	int64_t buf_sz = 0;
-	//calculate the size of buffer
-	buf_sz += sizeof(buf_sz);
-	buf_sz += sizeof(type);
-	buf_sz += sizeof(group);
-	buf_sz += sizeof(run_id);
-	buf_sz += sizeof(desc);
+	// message layout: security code | buf_sz, type, group, run_id | desc (only if non-empty) | data
+	// buf_sz counts everything after the security code.  An empty description is flagged in the
+	// type field and not sent, which saves DESC_LEN bytes on most messages.
+	bool send_desc = (desc[0] != '\0');
+	uint32_t wire_type = static_cast<uint32_t>(type);
+	if (!send_desc)
+		wire_type |= NO_DESC_FLAG;
+	if (data_len_l < 0)
+		data_len_l = 0;
+	int64_t buf_sz = FIXED_HEADER_LEN;
+	if (send_desc)
+		buf_sz += sizeof(desc);
 	buf_sz += data_len_l;
-	//pack information into buffer
-	//unique_ptr<char[]> buf(new char[buf_sz]);
-	vector<int8_t> buf;
-	buf.resize(buf_sz, '\0');
+	//pack the fixed part of the header; the description and data are sent from where they are
+	int8_t header[FIXED_HEADER_LEN];
 	size_t i_start = 0;
-	w_memcpy_s(&buf[i_start], buf_sz-i_start, &buf_sz, sizeof(buf_sz));
+	w_memcpy_s(&header[i_start], FIXED_HEADER_LEN - i_start, &buf_sz, sizeof(buf_sz));
 	i_start += sizeof(buf_sz);
-	w_memcpy_s(&buf[i_start], buf_sz-i_start, &type, sizeof(type));
-	i_start += sizeof(type);
-	w_memcpy_s(&buf[i_start], buf_sz-i_start, &group, sizeof(group));
+	w_memcpy_s(&header[i_start], FIXED_HEADER_LEN - i_start, &wire_type, sizeof(wire_type));
+	i_start += sizeof(wire_type);
+	w_memcpy_s(&header[i_start], FIXED_HEADER_LEN - i_start, &group, sizeof(group));
 	i_start += sizeof(group);
-	w_memcpy_s(&buf[i_start], buf_sz-i_start, &run_id, sizeof(run_id));
+	w_memcpy_s(&header[i_start], FIXED_HEADER_LEN - i_start, &run_id, sizeof(run_id));
 	i_start += sizeof(run_id);
-	w_memcpy_s(&buf[i_start], buf_sz-i_start, desc, sizeof(desc));
-	i_start += sizeof(desc);
-	if (data_len_l > 0) {
-		w_memcpy_s(&buf[i_start], buf_sz-i_start, data, data_len_l);
-		i_start += data_len_l;
-	}
-	n = w_sendall(sockfd, buf.data(), &buf_sz);
+
+	vector<pair<const int8_t*, int64_t> > bufs;
+	bufs.reserve(4);
+	bufs.push_back(make_pair(&security_code[0], (int64_t)sizeof(security_code)));
+	bufs.push_back(make_pair(&header[0], (int64_t)FIXED_HEADER_LEN));
+	if (send_desc)
+		bufs.push_back(make_pair(&desc[0], (int64_t)sizeof(desc)));
+	if (data_len_l > 0)
+		bufs.push_back(make_pair(static_cast<const int8_t*>(data), data_len_l));
+	int64_t total_sz = sizeof(security_code) + buf_sz;
+	int64_t sent_sz = total_sz;
+	n = w_sendallv(sockfd, bufs, &sent_sz);
 	if (n < 1)
 	{
 		//cerr << "NetPackage::send error: could not send data" << endl;
 		return pair<int,string> (n, "NetPackage::send error : could not send data");
 	}
-	if (i_start != buf_sz) {
+	if (sent_sz != total_sz) {
 		stringstream ss;
-		ss << "NetPackage::send error: could only send" << i_start
-			<< " out of " << buf_sz << "bytes" << endl;
+		ss << "NetPackage::send error: could only send" << sent_sz
+			<< " out of " << total_sz << "bytes" << endl;
 		return pair<int, string>(-2, ss.str());
 	}
 	stringstream ss;
@@ -215,13 +212,11 @@ pair<int,string>  NetPackage::recv(int sockfd)
 	int8_t rcv_security_code[5] = { 0, 0, 0, 0, 0 };
 	int temp,temp1,temp2, sum;
 	int64_t rcv_security_code_size = sizeof(rcv_security_code);
-	bool corrupt_desc = false;
 	stringstream ss;
 	try{
-		//get header (ie size, seq_id, id and name)
-		header_sz = sizeof(buf_sz) + sizeof(type) + sizeof(group) + sizeof(run_id) + sizeof(desc);
-		vector<int8_t> header_buf;
-		header_buf.resize(header_sz, '\0');
+		//get the fixed part of the header (ie size, type, group and run id)
+		header_sz = FIXED_HEADER_LEN;
+		int8_t header_buf[FIXED_HEADER_LEN];
 		n = w_recvall(sockfd, &rcv_security_code[0], &rcv_security_code_size);
 		//int security_cmp = memcmp(security_code, rcv_security_code, sizeof(security_code))
 		if (n == -1)
@@ -269,53 +264,81 @@ pair<int,string>  NetPackage::recv(int sockfd)
 		n = w_recvall(sockfd, &header_buf[0], &header_sz);
 		
 		ss << "recv'd " << buf_sz << " bytes";
-		if (n > 0 && header_sz != header_buf.size()) {
+		if (n > 0 && header_sz != FIXED_HEADER_LEN) {
 			// corrupt message; message not the correct length
 			n = -2;
 			ss.str("");
-			ss << "NetPackage::recv error reading header: expected" << header_buf.size()
+			ss << "NetPackage::recv error reading header: expected" << FIXED_HEADER_LEN
 				<< " bytes, but received " << header_sz << "bytes" << endl;
 		}
 		else if (n > 0) {
+			uint32_t wire_type;
 			i_start = 0;
 			w_memcpy_s(&buf_sz, sizeof(buf_sz), &header_buf[i_start], sizeof(buf_sz));
 			i_start += sizeof(buf_sz);
-			w_memcpy_s(&type, sizeof(type), &header_buf[i_start], sizeof(type));
-			i_start += sizeof(type);
+			w_memcpy_s(&wire_type, sizeof(wire_type), &header_buf[i_start], sizeof(wire_type));
+			i_start += sizeof(wire_type);
 			w_memcpy_s(&group, sizeof(group), &header_buf[i_start], sizeof(group));
 			i_start += sizeof(group);
 			w_memcpy_s(&run_id, sizeof(run_id), &header_buf[i_start], sizeof(run_id));
 			i_start += sizeof(run_id);
-			//w_memcpy_s(&desc, sizeof(desc), &header_buf[i_start], sizeof(desc));
-			// This is done to remove possible system dependicies on whether char/uchar
-			// is use to represent a standard char
-			for (int i = 0; i < DESC_LEN; ++i)
+			bool has_desc = ((wire_type & NO_DESC_FLAG) == 0);
+			type = static_cast<PackType>(wire_type & ~NO_DESC_FLAG);
+			memset(desc, '\0', DESC_LEN);
+			if (has_desc)
 			{
-				if (!allowable_ascii_char(header_buf[i_start + i]))
+				int64_t desc_sz = DESC_LEN;
+				int8_t desc_buf[DESC_LEN];
+				n = w_recvall(sockfd, &desc_buf[0], &desc_sz);
+				if (n > 0 && desc_sz != DESC_LEN)
 				{
-					corrupt_desc = true;
 					n = -2;
 					ss.str("");
-					ss << "non - ascii char in header buffer at position " << i << ": " << header_buf[i_start + i];
-					return pair<int,string> (n,ss.str());
+					ss << "NetPackage::recv error reading description: expected" << DESC_LEN
+						<< " bytes, but received " << desc_sz << "bytes" << endl;
+					return pair<int, string>(n, ss.str());
+				}
+				if (n <= 0)
+				{
+					return pair<int, string>(n, "NetPackage::recv error reading description");
 				}
-				else
+				// This is done to remove possible system dependicies on whether char/uchar
+				// is use to represent a standard char
+				for (int i = 0; i < DESC_LEN; ++i)
 				{
-					desc[i] = header_buf[i_start + i];
+					if (!allowable_ascii_char(desc_buf[i]))
+					{
+						n = -2;
+						ss.str("");
+						ss << "non - ascii char in header buffer at position " << i << ": " << desc_buf[i];
+						return pair<int,string> (n,ss.str());
+					}
+					else
+					{
+						desc[i] = desc_buf[i];
+					}
 				}
+				i_start += sizeof(desc);
 			}
-			i_start += sizeof(desc);
 			desc[DESC_LEN - 1] = '\0';
-			//get data
+			//get data.  data keeps its capacity, so a reused NetPackage (or a buffer handed
+			//in with swap_data()) doesn't reallocate for every message
 			data_len = buf_sz - i_start;
-			data.resize(data_len, '\0');
+			if (data_len < 0)
+			{
+				n = -2;
+				ss.str("");
+				ss << "NetPackage::recv error: invalid message size " << buf_sz << endl;
+				return pair<int, string>(n, ss.str());
+			}
+			data.resize(data_len);
 			if (data_len > 0) {
 				n = w_recvall(sockfd, &data[0], &data_len);
-				if (data_len != buf_sz - header_sz)
+				if (data_len != buf_sz - (int64_t)i_start)
 				{
 					n = -2;
 					ss.str("");
-					ss << "NetPackage::recv error reading data: expected" << buf_sz - header_sz
+					ss << "NetPackage::recv error reading data: expected" << buf_sz - i_start
 						<< " bytes, but received " << data_len << "bytes" << endl;
 				}
 			}
@@ -36,10 +36,15 @@ public:
 	int64_t get_group_id() const { return group; }
 	std::string get_info_txt();
 	const std::vector<int8_t> &get_data(){ return data; }
+	//exchange the receive buffer with an external one so its capacity can be reused across messages
+	void swap_data(std::vector<int8_t> &buf) { data.swap(buf); }
 	void print_header(std::ostream &fout);
 
 
 private:
+	//set in the wire type field when the (empty) description is left out of the message
+	static const uint32_t NO_DESC_FLAG = 0x80000000;
+	static const int64_t FIXED_HEADER_LEN = sizeof(int64_t) + sizeof(uint32_t) + sizeof(int64_t) + sizeof(int64_t);
 	bool verbose;
 	int64_t data_len;
 	static int64_t last_group_id;
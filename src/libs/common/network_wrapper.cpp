@@ -218,6 +218,78 @@ int w_sendall(int sockfd, int8_t *buf, int64_t *len)
 	return n; // return -1 on failure, 0 closed connection or 1 on success
 }
 
+int w_sendallv(int sockfd, const vector<pair<const int8_t*, int64_t> > &bufs, int64_t *len)
+{
+	// scatter/gather version of w_sendall(): the buffers go out back-to-back through
+	// writev()/WSASend() without first being copied into one contiguous block
+	int64_t total = 0; // how many bytes we've sent
+	int64_t expected = 0;
+	int n = 1;
+#ifdef OS_WIN
+	vector<WSABUF> iov;
+	for (auto &b : bufs)
+	{
+		if (b.second <= 0) continue;
+		WSABUF wb;
+		wb.buf = (CHAR*)b.first;
+		wb.len = (ULONG)b.second;
+		iov.push_back(wb);
+		expected += b.second;
+	}
+#else
+	vector<iovec> iov;
+	for (auto &b : bufs)
+	{
+		if (b.second <= 0) continue;
+		iovec v;
+		v.iov_base = (void*)b.first;
+		v.iov_len = (size_t)b.second;
+		iov.push_back(v);
+		expected += b.second;
+	}
+#endif
+	size_t i_iov = 0;
+	while (total < expected)
+	{
+		int64_t sent;
+#ifdef OS_WIN
+		DWORD n_sent = 0;
+		if (WSASend(sockfd, &iov[i_iov], (DWORD)(iov.size() - i_iov), &n_sent, 0, NULL, NULL) == SOCKET_ERROR)
+		{
+			n = -1;
+			break;
+		}
+		sent = n_sent;
+#else
+		//writev() takes at most IOV_MAX buffers per call, more than enough for a NetPackage
+		ssize_t n_sent = writev(sockfd, &iov[i_iov], (int)(iov.size() - i_iov));
+		if (n_sent < 0)
+		{
+			if (errno == EINTR) continue;
+			n = -1;
+			break;
+		}
+		sent = n_sent;
+#endif
+		if (sent == 0) { n = 0; break; } //connection closed
+		total += sent;
+		//step over the buffers that went out completely and trim the one that went out partially
+		while (sent > 0 && i_iov < iov.size())
+		{
+#ifdef OS_WIN
+			int64_t blen = iov[i_iov].len;
+			if (sent >= blen) { sent -= blen; ++i_iov; }
+			else { iov[i_iov].buf += sent; iov[i_iov].len -= (ULONG)sent; sent = 0; }
+#else
+			int64_t blen = iov[i_iov].iov_len;
+			if (sent >= blen) { sent -= blen; ++i_iov; }
+			else { iov[i_iov].iov_base = (char*)iov[i_iov].iov_base + sent; iov[i_iov].iov_len -= (size_t)sent; sent = 0; }
+#endif
+		}
+	}
+	*len = total; // return number actually sent here
+	return n; // return -1 on failure, 0 closed connection or 1 on success
+}
 
 int w_recvall(int sockfd, int8_t *buf, int64_t *len)
 {
@@ -21,12 +21,14 @@
   #include <signal.h>
   #include <netdb.h>
   #include <sys/socket.h>
+  #include <sys/uio.h>
 #endif
 
 //common for all systems
 #include <iostream>
 #include <vector>
 #include <string>
+#include <utility>
 
 std::string w_init();
 std::string w_get_hostname();
@@ -43,6 +45,7 @@ int w_listen(int sockfd, int backlog);
 int w_accept(int sockfd, struct sockaddr *addr, socklen_t *addr_len);
 int w_send(int sockfd, int8_t *buf, int64_t len, int flags);
 int w_sendall(int sockfd, int8_t *buf, int64_t *len);
+int w_sendallv(int sockfd, const std::vector<std::pair<const int8_t*, int64_t> > &bufs, int64_t *len);
 int w_recv(int sockfd, int8_t *buf, int64_t len, int flags);
 int w_recvall(int sockfd, int8_t *buf, int64_t *len);
 int w_select(int numfds, fd_set *readfds, fd_set *writefds,
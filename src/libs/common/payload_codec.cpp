@@ -0,0 +1,232 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include "payload_codec.h"
+#include "pest_error.h"
+
+using namespace std;
+
+const string PayloadCodec::NAME = "xor_shuffle_rle_v1";
+
+//zero runs shorter than this are cheaper to leave inside a literal
+static const size_t MIN_ZERO_RUN = 3;
+
+uint64_t PayloadCodec::hash_block(const uint8_t *p, size_t nbytes)
+{
+	//fnv-1a over 8-byte words
+	uint64_t h = 14695981039346656037ULL;
+	size_t n_words = nbytes / 8;
+	uint64_t w;
+	for (size_t i = 0; i < n_words; ++i)
+	{
+		memcpy(&w, p + i * 8, sizeof(w));
+		h = (h ^ w) * 1099511628211ULL;
+	}
+	for (size_t j = n_words * 8; j < nbytes; ++j)
+		h = (h ^ p[j]) * 1099511628211ULL;
+	return h;
+}
+
+void PayloadCodec::put_varint(uint64_t v, vector<int8_t> &enc)
+{
+	while (v >= 0x80)
+	{
+		enc.push_back((int8_t)((v & 0x7F) | 0x80));
+		v >>= 7;
+	}
+	enc.push_back((int8_t)v);
+}
+
+uint64_t PayloadCodec::get_varint(const uint8_t *&p, const uint8_t *end)
+{
+	uint64_t v = 0;
+	int shift = 0;
+	while (true)
+	{
+		if ((p >= end) || (shift > 63))
+			throw PestError("PayloadCodec::decode(): truncated or corrupt token stream");
+		uint8_t b = *p++;
+		v |= (uint64_t)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0)
+			break;
+		shift += 7;
+	}
+	return v;
+}
+
+void PayloadCodec::put_literal(const uint8_t *p, size_t n, vector<int8_t> &enc)
+{
+	if (n == 0)
+		return;
+	put_varint((uint64_t)(n - 1) << 1, enc);
+	enc.insert(enc.end(), (const int8_t*)p, (const int8_t*)p + n);
+}
+
+void PayloadCodec::encode(const int8_t *raw, size_t nbytes, const int8_t *ref, size_t ref_nbytes,
+	int64_t ref_id, vector<int8_t> &enc)
+{
+	if (ref == nullptr)
+	{
+		ref_nbytes = 0;
+		ref_id = -1;
+	}
+	size_t n_delta = min(nbytes, ref_nbytes);
+	const uint8_t *r = (const uint8_t*)raw;
+	const uint8_t *f = (const uint8_t*)ref;
+
+	//xor against the reference and shuffle in one pass
+	size_t n_words = nbytes / 8;
+	vector<uint8_t> shuf(nbytes);
+	for (size_t i = 0; i < n_words; ++i)
+	{
+		size_t j = i * 8;
+		for (size_t k = 0; k < 8; ++k, ++j)
+			shuf[k * n_words + i] = (j < n_delta) ? (r[j] ^ f[j]) : r[j];
+	}
+	for (size_t j = n_words * 8; j < nbytes; ++j)
+		shuf[j] = (j < n_delta) ? (r[j] ^ f[j]) : r[j];
+
+	enc.clear();
+	enc.reserve(HEADER_LEN + nbytes / 4 + 16);
+	enc.resize(HEADER_LEN);
+	enc[0] = 'P';
+	enc[1] = 'C';
+	enc[2] = VERSION;
+	enc[3] = (ref_id >= 0) ? FLAG_DELTA : 0;
+	uint64_t u_raw = nbytes, u_ref = n_delta;
+	memcpy(&enc[4], &ref_id, sizeof(ref_id));
+	memcpy(&enc[12], &u_raw, sizeof(u_raw));
+	memcpy(&enc[20], &u_ref, sizeof(u_ref));
+	uint64_t ref_hash = hash_block(f, n_delta);
+	memcpy(&enc[28], &ref_hash, sizeof(ref_hash));
+
+	const uint8_t *s = shuf.data();
+	size_t lit_start = 0;
+	size_t i = 0;
+	while (i < nbytes)
+	{
+		if (s[i] != 0)
+		{
+			++i;
+			continue;
+		}
+		const uint8_t *nz = s + i;
+		const uint8_t *end = s + nbytes;
+		while ((nz < end) && (*nz == 0))
+			++nz;
+		size_t j = nz - s;
+		if (j - i >= MIN_ZERO_RUN)
+		{
+			put_literal(s + lit_start, i - lit_start, enc);
+			put_varint(((uint64_t)(j - i - 1) << 1) | 1, enc);
+			lit_start = j;
+		}
+		i = j;
+	}
+	put_literal(s + lit_start, nbytes - lit_start, enc);
+}
+
+void PayloadCodec::check_header(const int8_t *enc, size_t enc_nbytes)
+{
+	if ((enc == nullptr) || (enc_nbytes < HEADER_LEN) || (enc[0] != 'P') || (enc[1] != 'C'))
+		throw PestError("PayloadCodec: buffer is not an encoded payload");
+	if (enc[2] != VERSION)
+	{
+		stringstream ss;
+		ss << "PayloadCodec: unsupported codec version " << (int)enc[2];
+		throw PestError(ss.str());
+	}
+}
+
+int64_t PayloadCodec::get_ref_id(const int8_t *enc, size_t enc_nbytes)
+{
+	check_header(enc, enc_nbytes);
+	int64_t ref_id;
+	memcpy(&ref_id, &enc[4], sizeof(ref_id));
+	return ref_id;
+}
+
+size_t PayloadCodec::get_raw_nbytes(const int8_t *enc, size_t enc_nbytes)
+{
+	check_header(enc, enc_nbytes);
+	uint64_t u_raw;
+	memcpy(&u_raw, &enc[12], sizeof(u_raw));
+	return (size_t)u_raw;
+}
+
+void PayloadCodec::decode(const int8_t *enc, size_t enc_nbytes, const int8_t *ref, size_t ref_nbytes,
+	vector<int8_t> &raw)
+{
+	check_header(enc, enc_nbytes);
+	uint64_t u_raw, u_ref;
+	memcpy(&u_raw, &enc[12], sizeof(u_raw));
+	memcpy(&u_ref, &enc[20], sizeof(u_ref));
+	size_t nbytes = (size_t)u_raw;
+	size_t n_delta = 0;
+	if (enc[3] & FLAG_DELTA)
+	{
+		n_delta = (size_t)u_ref;
+		if ((ref == nullptr) || (ref_nbytes < n_delta))
+			throw PestError("PayloadCodec::decode(): payload was delta-encoded but the reference block is missing or too short");
+		uint64_t ref_hash;
+		memcpy(&ref_hash, &enc[28], sizeof(ref_hash));
+		if (hash_block((const uint8_t*)ref, n_delta) != ref_hash)
+			throw PestError("PayloadCodec::decode(): reference block does not match the one used to encode");
+	}
+
+	vector<uint8_t> shuf(nbytes);
+	const uint8_t *p = (const uint8_t*)enc + HEADER_LEN;
+	const uint8_t *end = (const uint8_t*)enc + enc_nbytes;
+	size_t pos = 0;
+	while (p < end)
+	{
+		uint64_t v = get_varint(p, end);
+		size_t len = (size_t)(v >> 1) + 1;
+		if (len > nbytes - pos)
+			throw PestError("PayloadCodec::decode(): token stream overruns payload length");
+		if (v & 1)
+			memset(&shuf[pos], 0, len);
+		else
+		{
+			if ((size_t)(end - p) < len)
+				throw PestError("PayloadCodec::decode(): truncated literal in token stream");
+			memcpy(&shuf[pos], p, len);
+			p += len;
+		}
+		pos += len;
+	}
+	if (pos != nbytes)
+		throw PestError("PayloadCodec::decode(): token stream shorter than payload length");
+
+	raw.resize(nbytes);
+	uint8_t *r = (uint8_t*)raw.data();
+	const uint8_t *f = (const uint8_t*)ref;
+	size_t n_words = nbytes / 8;
+	for (size_t i = 0; i < n_words; ++i)
+	{
+		size_t j = i * 8;
+		for (size_t k = 0; k < 8; ++k, ++j)
+			r[j] = (j < n_delta) ? (shuf[k * n_words + i] ^ f[j]) : shuf[k * n_words + i];
+	}
+	for (size_t j = n_words * 8; j < nbytes; ++j)
+		r[j] = (j < n_delta) ? (shuf[j] ^ f[j]) : shuf[j];
+}
@@ -0,0 +1,71 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PAYLOAD_CODEC_H_
+#define PAYLOAD_CODEC_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class PayloadCodec
+{
+	// Lossless codec for blocks of packed doubles (run results).  The payload is
+	// optionally xor'ed against a reference block (e.g. a previous run of the same
+	// model), byte-shuffled so that byte k of every double is stored together, and
+	// the shuffled stream is run-length coded for zero bytes.  Nearby runs share
+	// sign, exponent and leading mantissa bytes, so the xor + shuffle turns most of
+	// the payload into long zero runs.
+	//
+	// encoded layout: [magic 'P','C'][version][flags][int64 ref_id][uint64 raw_nbytes]
+	//                 [uint64 ref_nbytes][uint64 ref_hash][token stream]
+	// ref_hash guards against decoding with a reference block that differs from the
+	// one the sender used.
+	// token: varint v, len = (v >> 1) + 1.  (v & 1) ? len zero bytes : len literal bytes follow
+public:
+	//name used to negotiate the codec during the panther handshake
+	static const std::string NAME;
+	//token exchanged in the package descriptions of the panther handshake
+	static std::string handshake_token() { return "PAYLOAD_CODEC=" + NAME; }
+	static const size_t HEADER_LEN = 36;
+	//encode raw[0:nbytes).  if ref is not null, the first min(nbytes, ref_nbytes) bytes
+	//are xor'ed against ref before coding; ref_id is stored so the receiver can locate
+	//the same reference block (-1 means no reference)
+	static void encode(const int8_t *raw, size_t nbytes, const int8_t *ref, size_t ref_nbytes,
+		int64_t ref_id, std::vector<int8_t> &enc);
+	//reference id stored in an encoded buffer (-1 if encoded without a reference)
+	static int64_t get_ref_id(const int8_t *enc, size_t enc_nbytes);
+	//number of bytes the decoded payload will occupy
+	static size_t get_raw_nbytes(const int8_t *enc, size_t enc_nbytes);
+	//decode into raw, which is resized to the original payload length.  ref must be the
+	//same reference block that was used to encode (ignored if ref_id was -1)
+	static void decode(const int8_t *enc, size_t enc_nbytes, const int8_t *ref, size_t ref_nbytes,
+		std::vector<int8_t> &raw);
+private:
+	static const int8_t VERSION = 1;
+	static const int8_t FLAG_DELTA = 0x01;
+	static uint64_t hash_block(const uint8_t *p, size_t nbytes);
+	static void check_header(const int8_t *enc, size_t enc_nbytes);
+	static void put_varint(uint64_t v, std::vector<int8_t> &enc);
+	static uint64_t get_varint(const uint8_t *&p, const uint8_t *end);
+	static void put_literal(const uint8_t *p, size_t n, std::vector<int8_t> &enc);
+};
+
+#endif /* PAYLOAD_CODEC_H_ */
@@ -0,0 +1,155 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include "socket_poller.h"
+#include "pest_error.h"
+
+using namespace std;
+
+#ifdef PESTPP_USE_EPOLL
+
+SocketPoller::SocketPoller() : epoll_fd(-1)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0)
+		throw PestError("SocketPoller: epoll_create1() failed: " + w_get_error_msg());
+	events.resize(64);
+}
+
+bool SocketPoller::add(int fd)
+{
+	if (contains(fd))
+		return true;
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+	{
+		cerr << "epoll_ctl error: " << w_get_error_msg() << endl;
+		return false;
+	}
+	fds.insert(fd);
+	//let the event buffer grow with the number of sockets so a busy wait() drains them in one call
+	if (fds.size() > events.size())
+		events.resize(events.size() * 2);
+	return true;
+}
+
+void SocketPoller::remove(int fd)
+{
+	if (!contains(fd))
+		return;
+	//closing a socket drops it from the epoll set anyway, but the socket may still be open here
+	epoll_event ev;
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+	fds.erase(fd);
+}
+
+int SocketPoller::wait(int timeout_ms, vector<int> &ready_fds)
+{
+	ready_fds.clear();
+	int n = epoll_wait(epoll_fd, events.data(), (int)events.size(), timeout_ms);
+	if (n < 0)
+	{
+		if (errno == EINTR)
+			return 0;
+		cerr << "epoll_wait error: " << w_get_error_msg() << endl;
+		return -1;
+	}
+	for (int i = 0; i < n; ++i)
+	{
+		ready_fds.push_back(events[i].data.fd);
+	}
+	return n;
+}
+
+const char *SocketPoller::get_backend_name() const
+{
+	return "epoll";
+}
+
+SocketPoller::~SocketPoller()
+{
+	if (epoll_fd >= 0)
+		close(epoll_fd);
+}
+
+#else
+
+SocketPoller::SocketPoller() : fdmax(-1)
+{
+	FD_ZERO(&master);
+}
+
+bool SocketPoller::add(int fd)
+{
+	if (contains(fd))
+		return true;
+#ifndef OS_WIN
+	//windows fd_sets are arrays of handles, everywhere else fd must fit in the bitmap
+	if (fd >= FD_SETSIZE)
+	{
+		cerr << "SocketPoller: socket " << fd << " exceeds FD_SETSIZE (" << FD_SETSIZE << ")" << endl;
+		return false;
+	}
+#endif
+	FD_SET(fd, &master);
+	if (fd > fdmax)
+		fdmax = fd;
+	fds.insert(fd);
+	return true;
+}
+
+void SocketPoller::remove(int fd)
+{
+	if (!contains(fd))
+		return;
+	FD_CLR(fd, &master);
+	fds.erase(fd);
+}
+
+int SocketPoller::wait(int timeout_ms, vector<int> &ready_fds)
+{
+	ready_fds.clear();
+	fd_set read_fds = master;
+	timeval tv;
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	int n = w_select(fdmax + 1, &read_fds, NULL, NULL, &tv);
+	if (n <= 0)
+		return n;
+	for (int fd : fds)
+	{
+		if (FD_ISSET(fd, &read_fds))
+			ready_fds.push_back(fd);
+	}
+	return (int)ready_fds.size();
+}
+
+const char *SocketPoller::get_backend_name() const
+{
+	return "select";
+}
+
+SocketPoller::~SocketPoller()
+{
+}
+
+#endif
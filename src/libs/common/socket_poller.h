@@ -0,0 +1,63 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SOCKET_POLLER_H_
+#define SOCKET_POLLER_H_
+
+#include <vector>
+#include <unordered_set>
+#include "network_wrapper.h"
+
+#if defined(__linux__)
+#define PESTPP_USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+class SocketPoller
+{
+	// Readiness queue for a set of sockets.  On linux this is a level-triggered epoll instance, so
+	// each wait() costs O(number of ready sockets) and there is no FD_SETSIZE ceiling on the number
+	// of sockets.  Other platforms fall back to select() over an fd_set.
+public:
+	SocketPoller();
+	bool add(int fd);
+	void remove(int fd);
+	bool contains(int fd) const { return fds.find(fd) != fds.end(); }
+	size_t size() const { return fds.size(); }
+	std::vector<int> get_fds() const { return std::vector<int>(fds.begin(), fds.end()); }
+	//wait up to timeout_ms for sockets that are ready to read (data or, for a listener, a new
+	//connection).  ready_fds is filled with those sockets.  Returns -1 on error
+	int wait(int timeout_ms, std::vector<int> &ready_fds);
+	const char *get_backend_name() const;
+	~SocketPoller();
+private:
+	std::unordered_set<int> fds;
+#ifdef PESTPP_USE_EPOLL
+	int epoll_fd;
+	std::vector<epoll_event> events;
+#else
+	fd_set master;
+	int fdmax;
+#endif
+	SocketPoller(const SocketPoller &) = delete;
+	SocketPoller &operator=(const SocketPoller &) = delete;
+};
+
+#endif /* SOCKET_POLLER_H_ */
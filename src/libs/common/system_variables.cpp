@@ -24,6 +24,8 @@
 #include <sstream>
 #include <cmath>
 #include <vector>
+#include <fstream>
+#include <algorithm>
 #include "system_variables.h"
 
 #ifdef OS_WIN
@@ -33,6 +35,9 @@
 #ifdef OS_LINUX
 #include "stdio.h"
 #include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <cerrno>
 
 #endif
 
@@ -122,15 +127,117 @@ bool OperSys::double_is_invalid(double x)
 }
 
 
+bool OperSys::is_absolute_path(const string &path)
+{
+	if (path.empty())
+		return false;
+	if ((path[0] == '/') || (path[0] == '\\'))
+		return true;
+#ifdef OS_WIN
+	//drive letter
+	if ((path.size() > 1) && (path[1] == ':'))
+		return true;
+#endif
+	return false;
+}
+
+void OperSys::make_dir(const string &path)
+{
+#ifdef OS_WIN
+	if ((!CreateDirectoryA(path.c_str(), NULL)) && (GetLastError() != ERROR_ALREADY_EXISTS))
+		throw runtime_error("OperSys::make_dir() could not create directory '" + path + "'");
+#endif
+#ifdef OS_LINUX
+	if ((::mkdir(path.c_str(), 0755) != 0) && (errno != EEXIST))
+		throw runtime_error("OperSys::make_dir() could not create directory '" + path + "'");
+#endif
+}
+
+static bool skip_dir_entry(const string &name, const vector<string> &skip_names, const vector<string> &skip_prefixes)
+{
+	if ((name == ".") || (name == ".."))
+		return true;
+	if (find(skip_names.begin(), skip_names.end(), name) != skip_names.end())
+		return true;
+	for (auto &prefix : skip_prefixes)
+		if (name.compare(0, prefix.size(), prefix) == 0)
+			return true;
+	return false;
+}
+
+void OperSys::copy_dir(const string &src, const string &dst,
+	const vector<string> &skip_names, const vector<string> &skip_prefixes)
+{
+	make_dir(dst);
+#ifdef OS_WIN
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA((src + "\\*").c_str(), &fd);
+	if (h == INVALID_HANDLE_VALUE)
+		throw runtime_error("OperSys::copy_dir() could not list directory '" + src + "'");
+	do
+	{
+		string name(fd.cFileName);
+		if (skip_dir_entry(name, skip_names, skip_prefixes))
+			continue;
+		string s = src + "\\" + name, d = dst + "\\" + name;
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			copy_dir(s, d, vector<string>(), vector<string>());
+		else if (!CopyFileA(s.c_str(), d.c_str(), FALSE))
+		{
+			FindClose(h);
+			throw runtime_error("OperSys::copy_dir() could not copy '" + s + "' to '" + d + "'");
+		}
+	} while (FindNextFileA(h, &fd));
+	FindClose(h);
+#endif
+#ifdef OS_LINUX
+	DIR *dir = opendir(src.c_str());
+	if (dir == NULL)
+		throw runtime_error("OperSys::copy_dir() could not list directory '" + src + "'");
+	struct dirent *entry;
+	vector<string> names;
+	while ((entry = readdir(dir)) != NULL)
+		names.push_back(entry->d_name);
+	closedir(dir);
+	for (auto &name : names)
+	{
+		if (skip_dir_entry(name, skip_names, skip_prefixes))
+			continue;
+		string s = src + "/" + name, d = dst + "/" + name;
+		struct stat st;
+		if (::stat(s.c_str(), &st) != 0)
+			continue;
+		if (S_ISDIR(st.st_mode))
+			copy_dir(s, d, vector<string>(), vector<string>());
+		else if (S_ISREG(st.st_mode))
+		{
+			ifstream fin(s, ios::binary);
+			ofstream fout(d, ios::binary | ios::trunc);
+			if ((!fin) || (!fout))
+				throw runtime_error("OperSys::copy_dir() could not copy '" + s + "' to '" + d + "'");
+			if (st.st_size > 0)
+				fout << fin.rdbuf();
+			fout.close();
+			if (!fout)
+				throw runtime_error("OperSys::copy_dir() error writing '" + d + "'");
+			//keep model executables executable
+			chmod(d.c_str(), st.st_mode & 07777);
+		}
+	}
+#endif
+}
+
+
 #ifdef OS_WIN
-PROCESS_INFORMATION start(string &cmd_string)
+PROCESS_INFORMATION start(string &cmd_string, const string &work_dir)
 {
 	char* cmd_line = _strdup(cmd_string.c_str());
 	STARTUPINFO si;
 	PROCESS_INFORMATION pi;
 	ZeroMemory(&si, sizeof(si));
 	ZeroMemory(&pi, sizeof(pi));
-	if (!CreateProcess(NULL, cmd_line, NULL, NULL, false, 0, NULL, NULL, &si, &pi))
+	const char* cwd = work_dir.empty() ? NULL : work_dir.c_str();
+	if (!CreateProcess(NULL, cmd_line, NULL, NULL, false, 0, NULL, cwd, &si, &pi))
 	{
 		std::string cmd_string(cmd_line);
 		throw std::runtime_error("CreateProcess() failed for command: " + cmd_string);
@@ -142,7 +249,7 @@ PROCESS_INFORMATION start(string &cmd_string)
 
 
 #ifdef OS_LINUX
-int start(string &cmd_string)
+int start(string &cmd_string, const string &work_dir)
 {
 	//split cmd_string on whitespaces
 	stringstream cmd_ss(cmd_string);
@@ -171,6 +278,8 @@ int start(string &cmd_string)
 	if (pid == 0)
 	{
 		setpgid(0, 0);
+		if ((!work_dir.empty()) && (::chdir(work_dir.c_str()) != 0))
+			_exit(127);
 		int success = execvp(arg_v[0], const_cast<char* const*>(&(arg_v[0])));
 		if (success == -1)
 		{
@@ -21,6 +21,7 @@
 
 #include "config_os.h"
 #include <string>
+#include <vector>
 
 class OperSys
 {
@@ -34,14 +35,23 @@ public:
 	static void chdir(const char *str);
 	static char *gets_s(char *str, size_t len);
 	static bool double_is_invalid(double x);
+	static bool is_absolute_path(const std::string &path);
+	//create a directory, succeeding if it already exists
+	static void make_dir(const std::string &path);
+	//recursively copy the contents of src into dst (created if needed), skipping any
+	//entry whose name is in skip_names or starts with one of skip_prefixes
+	static void copy_dir(const std::string &src, const std::string &dst,
+		const std::vector<std::string> &skip_names, const std::vector<std::string> &skip_prefixes);
 };
 
 #ifdef OS_WIN
 #include <Windows.h>
-PROCESS_INFORMATION start(std::string &cmd_string);
+//start cmd_string in work_dir (the current directory if empty)
+PROCESS_INFORMATION start(std::string &cmd_string, const std::string &work_dir="");
 #endif
 #ifdef OS_LINUX
-int start(std::string &cmd_string);
+//start cmd_string in work_dir (the current directory if empty)
+int start(std::string &cmd_string, const std::string &work_dir="");
 #endif
 
 
@@ -21,6 +21,7 @@ sequentialLP::sequentialLP(Pest &_pest_scenario, RunManagerAbstract* _run_mgr_pt
 	constraints(_pest_scenario,_file_mgr_ptr,_of_wr, _pfm)
 {
 	rand_gen = std::mt19937(pest_scenario.get_pestpp_options().get_random_seed());
+	jco.set_num_threads(pest_scenario.get_pestpp_options().get_num_jco_threads());
 	
 	try
 	{
@@ -4,7 +4,10 @@
 #include <iterator>
 #include <limits>
 #include <cstddef>
+#include <cstring>
+#include <numeric>
 #include "Ensemble.h"
+#include "EnsembleDraw.h"
 #include "RestartController.h"
 #include "utilities.h"
 #include "ParamTransformSeq.h"
@@ -133,21 +136,6 @@ void Ensemble::add_2_cols_ip(Ensemble &other)
 }
 
 
-void draw_thread_function(int id, DrawThread &worker, int num_reals, int ies_verbose, map<string, int> idx_map, map<string, double> std_map, exception_ptr &eptr)
-{
-	try
-	{
-		worker.work(id, num_reals, ies_verbose, idx_map, std_map);
-	}
-	catch (...)
-	{
-		eptr = current_exception();
-	}
-
-	return;
-}
-
-
 void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const vector<string> &draw_names,
 	const map<string, vector<string>> &grouper, PerformanceLog *plog, int level)
 {
@@ -166,16 +154,32 @@ void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const ve
 	if (cov.get_col_names() != draw_names)
 		cov = cov.get(draw_names);
 
-	//make standard normal draws
+	//make standard normal draws - the draw engine is keyed from rand_gen_ptr, so the
+	//draws are the same for any number of threads
+	const PestppOptions &ppo = pest_scenario_ptr->get_pestpp_options();
+	bool legacy = ppo.get_ies_legacy_draws();
+	int num_threads = ppo.get_ies_num_threads();
+	uint64_t key = 0;
+	if (!legacy)
+	{
+		key = (*rand_gen_ptr)();
+		key = (key << 32) | (*rand_gen_ptr)();
+	}
+	EnsembleDraw drawer(key, num_threads, ppo.get_ies_draw_rank());
 	plog->log_event("making standard normal draws");
 	//RedSVD::sample_gaussian(draws);
-	for (int i = 0; i < num_reals; i++)
+	if (legacy)
 	{
-		for (int j = 0; j < draw_names.size(); j++)
+		for (int i = 0; i < num_reals; i++)
 		{
-			draws(i, j) = draw_standard_normal(*rand_gen_ptr);
+			for (int j = 0; j < draw_names.size(); j++)
+			{
+				draws(i, j) = draw_standard_normal(*rand_gen_ptr);
+			}
 		}
 	}
+	else
+		drawer.standard_normal(draws);
 
 	if (level > 2)
 	{
@@ -186,13 +190,13 @@ void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const ve
 	//Eigen::MatrixXd draws_temp = draws;
 
 	Eigen::VectorXd std = cov.e_ptr()->diagonal().cwiseSqrt();
-	map<string, double> std_map;
-	for (int i = 0; i < std.size(); i++)
+	if (!legacy)
 	{
-		std_map[var_names[i]] = std(i);
+		plog->log_event("correlating standard normal draws");
+		drawer.apply_cov(draws, cov, draw_names, grouper, plog);
 	}
 	//if diagonal cov, then scale by std
-	if (cov.isdiagonal())
+	else if (cov.isdiagonal())
 	{
 		plog->log_event("scaling by std");
 
@@ -214,73 +218,26 @@ void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const ve
 			plog->log_event(ss.str());
 			cout << ss.str();
 			map<string, int> idx_map;
-			
+			map<string, double> std_map;
 			for (int i = 0; i < var_names.size(); i++)
 				idx_map[var_names[i]] = i;
+			for (int i = 0; i < std.size(); i++)
+				std_map[var_names[i]] = std(i);
 			vector<string> group_keys;
 			for (auto gi : grouper)
 				group_keys.push_back(gi.first);
 			DrawThread worker(plog, cov, &draws, group_keys, grouper);
-			int num_threads = pest_scenario_ptr->get_pestpp_options().get_ies_num_threads();
-			if ((num_threads <= 0) || (group_keys.size() == 1))
-			{
-				worker.work(0, num_reals, level, idx_map, std_map);
-			}
-			else
+			if (group_keys.size() == 1)
+				num_threads = 0;
+			WorkQueue queue(group_keys.size());
+			if (num_threads > 0)
 			{
 				Eigen::setNbThreads(1);
-				vector<thread> threads;
-				vector<exception_ptr> exception_ptrs;
 				plog->log_event("launching draw threads");
-
-				for (int i = 0; i < num_threads; i++)
-				{
-					exception_ptrs.push_back(exception_ptr());
-				}
-
-				for (int i = 0; i < num_threads; i++)
-				{
-					//threads.push_back(thread(&LocalUpgradeThread::work, &worker, i, iter, cur_lam));
-
-					threads.push_back(thread(draw_thread_function, i, std::ref(worker), num_reals, level, idx_map, std_map,std::ref(exception_ptrs[i])));
-
-				}
-				plog->log_event("waiting to join threads");
-				//for (auto &t : threads)
-				//	t.join();
-				for (int i = 0; i < num_threads; ++i)
-				{
-					if (exception_ptrs[i])
-					{
-						try
-						{
-							rethrow_exception(exception_ptrs[i]);
-						}
-						catch (const std::exception& e)
-						{
-							ss.str("");
-							ss << "thread " << i << "raised an exception: " << e.what();
-							throw runtime_error(ss.str());
-						}
-					}
-					threads[i].join();
-					if (exception_ptrs[i])
-					{
-						try
-						{
-							rethrow_exception(exception_ptrs[i]);
-						}
-						catch (const std::exception& e)
-						{
-							ss.str("");
-							ss << "thread " << i << "raised an exception: " << e.what();
-							throw runtime_error(ss.str());
-						}
-					}
-				}
-				plog->log_event("threaded draws done");
-
 			}
+			queue.run(num_threads, [&](int thread_id) { worker.work(thread_id, num_reals, level, idx_map, std_map, queue); });
+			if (num_threads > 0)
+				plog->log_event("threaded draws done");
 			
 
 			//Covariance gcov;
@@ -404,25 +361,25 @@ void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const ve
 
 	//check for invalid values
 	plog->log_event("checking realization for invalid values");
-	bool found_invalid = false;
-	int iv = 0;
-	for (int j = 0; j < draw_names.size(); j++)
+	vector<int> num_invalid(draw_names.size(), 0);
+	WorkQueue::for_each(draw_names.size(), num_threads, WorkQueue::get_chunk_size(draw_names.size(), num_threads),
+		[&](int thread_id, int j)
 	{
-		iv = 0;
 		for (int i = 0; i < num_reals; i++)
 		{
-
-
 			if (OperSys::double_is_invalid(draws(i, j)))
-			{
-				found_invalid = true;
-				iv++;
-			}
-
+				num_invalid[j]++;
 		}
-		if ((level>2) && (iv > 0))
+	});
+	bool found_invalid = false;
+	for (int j = 0; j < draw_names.size(); j++)
+	{
+		if (num_invalid[j] == 0)
+			continue;
+		found_invalid = true;
+		if (level > 2)
 		{
-			cout << iv+1 << " invalid values found for " << draw_names[j] << endl;
+			cout << num_invalid[j] + 1 << " invalid values found for " << draw_names[j] << endl;
 		}
 	}
 
@@ -432,29 +389,43 @@ void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const ve
 
 	org_real_names = real_names;
 	//add the mean values - using the Transformable instance (initial par value or observed value)
-	plog->log_event("resizing reals matrix");
-	reals.resize(num_reals, var_names.size());
-	reals.setZero(); // zero-weighted obs and fixed/tied pars get zero values here.
-	plog->log_event("filling reals matrix and adding mean values");
-	vector<string>::const_iterator start = draw_names.begin(), end=draw_names.end(), name;
-	set<string> dset(draw_names.begin(), draw_names.end());
-	map<string, int> dmap;
-	for (int i = 0; i < draw_names.size(); i++)
-		dmap[draw_names[i]] = i;
-	for (int j = 0; j < var_names.size(); j++)
+	if (var_names == draw_names)
 	{
-		//int jj;
-		//name = find(start, end, var_names[j]);
-		//if (name != end)
-		//{
-		//	jj = name - start;
-		//	reals.col(j) = draws.col(jj).array() + tran.get_rec(var_names[j]);
-		//}
-		if (dset.find(var_names[j]) != dset.end())
-		{
-			//Eigen::MatrixXd temp = draws.col(dmap[var_names[j]]);
-			//double dtemp = tran.get_rec(var_names[j]);
-			reals.col(j) = draws.col(dmap[var_names[j]]).array() + tran.get_rec(var_names[j]);
+		//the draws already line up with the reals, so add the means in place and take the draws
+		plog->log_event("adding mean values");
+		vector<double> means(var_names.size());
+		for (int j = 0; j < var_names.size(); j++)
+			means[j] = tran.get_rec(var_names[j]);
+		WorkQueue::for_each(var_names.size(), num_threads, WorkQueue::get_chunk_size(var_names.size(), num_threads),
+			[&](int thread_id, int j) { draws.col(j).array() += means[j]; });
+		reals.swap(draws);
+	}
+	else
+	{
+		plog->log_event("resizing reals matrix");
+		reals.resize(num_reals, var_names.size());
+		reals.setZero(); // zero-weighted obs and fixed/tied pars get zero values here.
+		plog->log_event("filling reals matrix and adding mean values");
+		vector<string>::const_iterator start = draw_names.begin(), end = draw_names.end(), name;
+		set<string> dset(draw_names.begin(), draw_names.end());
+		map<string, int> dmap;
+		for (int i = 0; i < draw_names.size(); i++)
+			dmap[draw_names[i]] = i;
+		for (int j = 0; j < var_names.size(); j++)
+		{
+			//int jj;
+			//name = find(start, end, var_names[j]);
+			//if (name != end)
+			//{
+			//	jj = name - start;
+			//	reals.col(j) = draws.col(jj).array() + tran.get_rec(var_names[j]);
+			//}
+			if (dset.find(var_names[j]) != dset.end())
+			{
+				//Eigen::MatrixXd temp = draws.col(dmap[var_names[j]]);
+				//double dtemp = tran.get_rec(var_names[j]);
+				reals.col(j) = draws.col(dmap[var_names[j]]).array() + tran.get_rec(var_names[j]);
+			}
 		}
 	}
 	if (found_invalid)
@@ -772,46 +743,20 @@ void Ensemble::keep_rows(const vector<string> &keep_names)
 
 Eigen::MatrixXd Ensemble::get_eigen(vector<string> row_names, vector<string> col_names, bool update_vmap)
 {
-	//get a dense eigen matrix from reals by row and col names
-	vector<string> missing_rows,missing_cols;
-	vector<string>::iterator iter, start = real_names.begin(), end = real_names.end();
-	vector<int> row_idxs, col_idxs;
-
-	//check for missing
+	//get a dense eigen matrix from reals by row and col names.  with update_vmap false, the var
+	//names are trusted to be unchanged since the last update_var_map()
+	shared_ptr<const vector<int>> row_idxs, col_idxs;
 	vector<string> missing;
 
 	if (row_names.size() > 0)
 	{
-		map<string, int> real_map;
-		for (int i = 0; i < real_names.size(); i++)
-			real_map[real_names[i]] = i;
-		set<string> real_set(real_names.begin(), end = real_names.end());
-		set<string>::iterator end = real_set.end();
-		for (auto &name : row_names)
-		{
-			if (real_set.find(name) == end)
-				missing.push_back(name);
-			row_idxs.push_back(real_map[name]);
-		}
+		row_idxs = real_aligner.positions(real_names, row_names, missing);
 		if (missing.size() > 0)
 			throw_ensemble_error("Ensemble.get_eigen() error: the following realization names were not found:", missing);
 	}
 	if (col_names.size() > 0)
 	{
-		//map<string, int> var_map;
-		//for (int i = 0; i < var_names.size(); i++)
-		//	var_map[var_names[i]] = i;
-		if (update_vmap)
-			update_var_map();
-
-		//set<string> var_set(var_names.begin(), var_names.end());
-		map<string,int>::iterator end = var_map.end();
-		for (auto &name : col_names)
-		{
-			if (var_map.find(name) == end)
-				missing.push_back(name);
-			col_idxs.push_back(var_map[name]);
-		}
+		col_idxs = var_aligner.positions(var_names, col_names, missing, update_vmap);
 		if (missing.size() > 0)
 			throw_ensemble_error("Ensemble.get_eigen() error: the following variable names were not found:", missing);
 	}
@@ -822,51 +767,30 @@ Eigen::MatrixXd Ensemble::get_eigen(vector<string> row_names, vector<string> col
 	// only mess with columns, keep rows the same
 	if (row_names.size() == 0)
 	{
-		if (missing_cols.size() > 0)
-			throw_ensemble_error("Ensemble.get_eigen() the following col_names not found:", missing_cols);
 		mat.resize(real_names.size(), col_names.size());
-		int j = 0;
-		for (auto &jj : col_idxs)
-		{
-			mat.col(j) = reals.col(jj);
-			j++;
-		}
+		for (int j = 0; j < col_idxs->size(); j++)
+			mat.col(j) = reals.col((*col_idxs)[j]);
 		return mat;
 	}
 
 	// only mess with rows, keep cols the same
 	if (col_names.size() == 0)
 	{
-		if (missing_rows.size() > 0)
-			throw_ensemble_error("Ensemble.get_eigen() the following row_names not found:", missing_rows);
 		mat.resize(row_names.size(), var_names.size());
-		int i = 0;
-		for (auto &ii : row_idxs)
-		{
-			mat.row(i) = reals.row(ii);
-			i++;
-		}
+		for (int i = 0; i < row_idxs->size(); i++)
+			mat.row(i) = reals.row((*row_idxs)[i]);
 		return mat;
 	}
 
-	//the slow one where we are rearranging rows and cols
-	if (missing_rows.size() > 0)
-		throw_ensemble_error("Ensemble.get_eigen() the following row_names not found:", missing_rows);
-
-	if (missing_cols.size() > 0)
-		throw_ensemble_error("Ensemble.get_eigen() the following col_names not found:", missing_cols);
+	//rearranging rows and cols: gather down each (contiguous) column
 	mat.resize(row_names.size(), col_names.size());
-	int i=0, j=0;
-	for (auto &ii : row_idxs)
+	const vector<int> &ridxs = *row_idxs;
+	for (int j = 0; j < col_idxs->size(); j++)
 	{
-		j = 0;
-		for (auto &jj : col_idxs)
-		{
-			//cout << i << ',' << j << ';' << ii << ',' << jj << endl;
-			mat(i, j) = reals(ii, jj);
-			j++;
-		}
-		i++;
+		const double *src = reals.col((*col_idxs)[j]).data();
+		double *dest = mat.col(j).data();
+		for (int i = 0; i < ridxs.size(); i++)
+			dest[i] = src[ridxs[i]];
 	}
 	return mat;
 
@@ -891,37 +815,41 @@ void Ensemble::to_csv(string file_name)
 	}
 }
 
-void Ensemble::to_csv_by_vars(ofstream &csv)
+vector<int> Ensemble::get_csv_real_idxs()
 {
-	csv << "var_name";
-	
-	//for (int ireal = 0; ireal < reals.rows(); ireal++)
-	int ireal = 0;
+	//the rows to write, in the order of the realizations originally read or drawn
 	map<string, int> real_map;
 	for (int i = 0; i < real_names.size(); i++)
 		real_map[real_names[i]] = i;
 	map<string, int>::iterator end = real_map.end();
-	for (auto rname : org_real_names)
+	vector<int> idxs;
+	for (auto &rname : org_real_names)
 	{
 		if (real_map.find(rname) == end)
 			continue;
+		idxs.push_back(real_map[rname]);
+	}
+	return idxs;
+}
 
-		ireal = real_map[rname];
+void Ensemble::to_csv_by_vars(ofstream &csv)
+{
+	csv << "var_name";
+	vector<int> ireals = get_csv_real_idxs();
+	for (auto ireal : ireals)
 		csv << ',' << pest_utils::lower_cp(real_names[ireal]);
-	}
 	csv << endl;
-	for (int ivar = 0; ivar < reals.cols(); ivar++)
+	CsvWriter::write_lines(csv, reals.cols(), pest_scenario_ptr->get_pestpp_options().get_ies_num_threads(), ireals.size() * 14,
+		[&](int thread_id, int ivar, string &buf)
 	{
-		csv << pest_utils::lower_cp(var_names[ivar]);
-		for (auto rname : org_real_names)
+		buf += pest_utils::lower_cp(var_names[ivar]);
+		for (auto ireal : ireals)
 		{
-			if (real_map.find(rname) == end)
-				continue;
-			ireal = real_map[rname];
-			csv << ',' << reals.block(ireal, ivar, 1, 1);
+			buf += ',';
+			CsvWriter::append_double(buf, reals(ireal, ivar));
 		}
-		csv << endl;
-	}
+		buf += '\n';
+	});
 }
 
 void Ensemble::to_csv_by_reals(ofstream &csv)
@@ -930,25 +858,19 @@ void Ensemble::to_csv_by_reals(ofstream &csv)
 	for (auto &vname : var_names)
 		csv << ',' << pest_utils::lower_cp(vname);
 	csv << endl;
-	//for (int ireal = 0; ireal < reals.rows(); ireal++)
-	int ireal = 0;
-	map<string, int> real_map;
-	for (int i = 0; i < real_names.size(); i++)
-		real_map[real_names[i]] = i;
-	map<string, int>::iterator end = real_map.end();	
-	for (auto rname : org_real_names)
+	vector<int> ireals = get_csv_real_idxs();
+	CsvWriter::write_lines(csv, ireals.size(), pest_scenario_ptr->get_pestpp_options().get_ies_num_threads(), reals.cols() * 14,
+		[&](int thread_id, int i, string &buf)
 	{
-		if (real_map.find(rname) == end)
-			continue;
-		ireal = real_map[rname];
-		csv << pest_utils::lower_cp(real_names[ireal]);
-		for (int ivar=0; ivar < reals.cols(); ivar++)
+		int ireal = ireals[i];
+		buf += pest_utils::lower_cp(real_names[ireal]);
+		for (int ivar = 0; ivar < reals.cols(); ivar++)
 		{
-			csv << ',' << reals.block(ireal, ivar,1,1);
+			buf += ',';
+			CsvWriter::append_double(buf, reals(ireal, ivar));
 		}
-		csv << endl;
-	}
-
+		buf += '\n';
+	});
 }
 
 const vector<string> Ensemble::get_real_names(vector<int> &indices)
@@ -1007,6 +929,7 @@ void Ensemble::update_var_map()
 	var_map.clear();
 	for (int i = 0; i < var_names.size(); i++)
 		var_map[var_names[i]] = i;
+	var_aligner.reset(var_names);
 }
 
 void Ensemble::throw_ensemble_error(string message, vector<string> vec)
@@ -1062,42 +985,42 @@ map<string, int> Ensemble::get_real_map()
 //	
 //}
 
-pair<map<string,int>, map<string, int>> Ensemble::prepare_csv(const vector<string> &names, ifstream &csv, bool forgive)
+pair<map<string,int>, map<string, int>> Ensemble::prepare_csv(const vector<string> &names, CsvReader &csv, bool forgive)
 {
 	//prepare the input csv for reading checks for compatibility with var_names, forgives extra names in csv
-	if (!csv.good())
-	{
-		throw runtime_error("ifstream not good");
-	}
 
 	//process the header
 	//any missing header labels will be marked to ignore those columns later
 	string line;
 	vector<string> header_tokens;
-	if (!getline(csv, line))
+	if (csv.get_num_lines() == 0)
 		throw runtime_error("error reading header (first) line from csv file :");
-	pest_utils::strip_ip(line);
+	line = csv.get_line(0).str();
 	pest_utils::upper_ip(line);
 	pest_utils::tokenize(line, header_tokens, ",", false);
 	
-	//read the index labels
-	vector<string> index_tokens,tokens;
-	int lcount = 1, nerr = 0;
+	//read the index labels and count the items on each line
+	int num_lines = csv.get_num_lines() - 1;
+	vector<string> index_tokens(num_lines);
+	vector<size_t> num_tokens(num_lines);
+	int num_threads = csv.get_num_threads();
+	WorkQueue::for_each(num_lines, num_threads, WorkQueue::get_chunk_size(num_lines, num_threads), [&](int thread_id, int i)
+	{
+		CsvField f = csv.get_line(i + 1);
+		const char *comma = static_cast<const char*>(memchr(f.ptr, ',', f.len));
+		index_tokens[i] = string(f.ptr, (comma == nullptr) ? f.len : comma - f.ptr);
+		pest_utils::upper_ip(index_tokens[i]);
+		num_tokens[i] = count(f.ptr, f.ptr + f.len, ',') + 1;
+	});
+	int nerr = 0;
 	stringstream ss;
-	
-	while (getline(csv, line))
+	for (int i = 0; i < num_lines; i++)
 	{
-		pest_utils::strip_ip(line);
-		pest_utils::upper_ip(line);
-		tokens.clear();
-		pest_utils::tokenize(line, tokens, ",", false);
-		if (header_tokens.size() != tokens.size())
+		if (header_tokens.size() != num_tokens[i])
 		{
-			ss << "wrong number of items on line " << lcount << ", expecting " << header_tokens.size() << " but found " << tokens.size() << endl;
+			ss << "wrong number of items on line " << i + 1 << ", expecting " << header_tokens.size() << " but found " << num_tokens[i] << endl;
 			nerr++;
 		}
-		index_tokens.push_back(tokens[0]);
-		lcount++;
 	}
 
 	if (nerr > 0)
@@ -1545,6 +1468,65 @@ map<string, int> Ensemble::from_binary(string file_name, vector<string> &names,
 }
 
 
+void Ensemble::to_dense(string file_name, bool single_precision, bool append)
+{
+	int num_threads = pest_scenario_ptr->get_pestpp_options().get_ies_num_threads();
+	if (append)
+		EnsembleBinary::append(file_name, real_names, var_names, reals, num_threads);
+	else
+		EnsembleBinary::write(file_name, real_names, var_names, reals, single_precision, num_threads);
+}
+
+map<string, int> Ensemble::from_dense(string file_name, const vector<string> &names, int num_reals)
+{
+	//load from a dense binary file, reading only the columns of the names that are in the file and,
+	//if num_reals > 0, only the first num_reals realizations.  var_names is set to names, with any
+	//names not in the file left as zeros.  returns the file column of each name that was found
+	EnsembleBinary bin(pest_scenario_ptr->get_pestpp_options().get_ies_num_threads());
+	bin.open(file_name);
+	const vector<string> &file_var_names = bin.get_var_names();
+	map<string, int> header_info;
+	for (int i = 0; i < file_var_names.size(); i++)
+		header_info[file_var_names[i]] = i;
+	vector<int> file_idxs, col_idxs;
+	map<string, int>::iterator end = header_info.end(), it;
+	for (int j = 0; j < names.size(); j++)
+	{
+		it = header_info.find(names[j]);
+		if (it == end)
+			continue;
+		file_idxs.push_back(it->second);
+		col_idxs.push_back(j);
+	}
+	if (file_idxs.size() == 0)
+		throw_ensemble_error("Ensemble.from_dense() error: none of the expected names found in " + file_name);
+
+	int n_real = bin.get_real_names().size();
+	if ((num_reals > 0) && (num_reals < n_real))
+		n_real = num_reals;
+	vector<int> real_idxs(n_real);
+	iota(real_idxs.begin(), real_idxs.end(), 0);
+	Eigen::MatrixXd mat = bin.read(real_idxs, file_idxs);
+	real_names = vector<string>(bin.get_real_names().begin(), bin.get_real_names().begin() + n_real);
+	var_names = names;
+	if (col_idxs.size() == names.size())
+		reals = mat;
+	else
+	{
+		reals.resize(n_real, names.size());
+		reals.setZero();
+		for (int k = 0; k < col_idxs.size(); k++)
+			reals.col(col_idxs[k]) = mat.col(k);
+	}
+	bin.close();
+
+	map<string, int> found;
+	for (int k = 0; k < col_idxs.size(); k++)
+		found[names[col_idxs[k]]] = file_idxs[k];
+	org_real_names = real_names;
+	return found;
+}
+
 map<string,int> Ensemble::from_binary_old(string file_name, vector<string> &names, bool transposed)
 {
 	//load an ensemble from a binary jco-type file.  if transposed=true, reals is transposed and row/col names are swapped for var/real names.
@@ -1718,131 +1700,144 @@ map<string,int> Ensemble::from_binary_old(string file_name, vector<string> &name
 
 
 
-void Ensemble::read_csv_by_reals(int num_reals,ifstream &csv, map<string,int> &header_info, map<string,int> &index_info)
+void Ensemble::read_csv_by_reals(int num_reals, CsvReader &csv, map<string,int> &header_info, map<string,int> &index_info)
 {
-	//read a csv file to an Ensmeble
-	int lcount = 1;
-	//vector<vector<double>> vectors;
-	double val;
-	string line;
-	vector<string> tokens;
-	string real_id;
-
-	//real_names.clear();
+	//read a csv file to an Ensmeble - each line is a realization, so the lines can be parsed in parallel
 	reals.resize(num_reals, var_names.size());
 	reals.setZero();
-	int irow = 0;
+	int num_lines = csv.get_num_lines() - 1;
+	if (num_lines != num_reals)
+		throw runtime_error("different number of reals found");
 
 	map<string, int> var_map;
 	for (int i = 0; i < var_names.size(); i++)
 		var_map[var_names[i]] = i;
+	//csv item index, var index and name for each header entry
+	vector<pair<int, int>> item_var_idxs;
+	vector<const string*> item_names;
+	for (auto &hi : header_info)
+	{
+		item_var_idxs.push_back(pair<int, int>(hi.second, var_map[hi.first]));
+		item_names.push_back(&hi.first);
+	}
 
-	while (getline(csv, line))
+	int num_threads = csv.get_num_threads();
+	vector<vector<CsvField>> thread_tokens(max(1, num_threads));
+	WorkQueue::for_each(num_lines, num_threads, 1, [&](int thread_id, int irow)
 	{
-		pest_utils::strip_ip(line);
-		tokens.clear();
-		pest_utils::tokenize(line, tokens, ",", false);
-		if (tokens[tokens.size() - 1].size() == 0)
+		vector<CsvField> &tokens = thread_tokens[thread_id];
+		int lcount = irow + 1;
+		csv.split_line(lcount, tokens);
+		if (tokens[tokens.size() - 1].len == 0)
 			tokens.pop_back();
 
+		string real_id;
 		try
 		{
-			pest_utils::convert_ip(tokens[0], real_id);
+			pest_utils::convert_ip(tokens[0].str(), real_id);
 		}
 		catch (exception &e)
 		{
 			stringstream ss;
-			ss << "error converting token '" << tokens[0] << "' to <string> real_name on line " << lcount << ": " << line << endl << e.what();
+			ss << "error converting token '" << tokens[0].str() << "' to <string> real_name on line " << lcount << ": " << csv.get_line(lcount).str() << endl << e.what();
 			throw runtime_error(ss.str());
 		}
-		//real_names.push_back(real_id);
-		
 
-		for (auto &hi : header_info)
+		double val;
+		for (int i = 0; i < item_var_idxs.size(); i++)
 		{
-			try
-			{
-				//val = pest_utils::convert_cp<double>(tokens[hi.second]);
-				val = stod(tokens[hi.second]);
-			}
-			catch (exception &e)
+			int item = item_var_idxs[i].first;
+			if ((item >= tokens.size()) || (!CsvReader::parse_double(tokens[item], val)))
 			{
 				stringstream ss;
-				ss << "error converting token '" << tokens[hi.second] << "' to double for " << hi.first << " on line " << lcount << " : " << e.what();
+				ss << "error converting token '" << ((item < tokens.size()) ? tokens[item].str() : "") << "' to double for " << *item_names[i] << " on line " << lcount << " : stod";
 				throw runtime_error(ss.str());
 			}
-			reals(irow, var_map[hi.first]) = val;
+			reals(irow, item_var_idxs[i].second) = val;
 		}
-		lcount++;
-		irow++;
-
-	}
-	if (lcount-1 != num_reals)
-		throw runtime_error("different number of reals found");
-	
+	});
 }
 
 
-void Ensemble::read_csv_by_vars(int num_reals, ifstream &csv, map<string, int> &header_info, map<string, int> &index_info)
+void Ensemble::read_csv_by_vars(int num_reals, CsvReader &csv, map<string, int> &header_info, map<string, int> &index_info)
 {
-	//read a csv file to an Ensmeble
-	int lcount = 1;
-	//vector<vector<double>> vectors;
-	double val;
-	string line;
-	vector<string> tokens;
-	string var_name;
-
-	//real_names.clear();
+	//read a csv file to an Ensmeble - each line is a variable, so the lines can be parsed in parallel
 	reals.resize(num_reals, var_names.size());
 	reals.setZero();
-	int var_idx;
+	int num_lines = csv.get_num_lines() - 1;
 
 	map<string, int> var_map;
 	for (int i = 0; i < var_names.size(); i++)
 		var_map[var_names[i]] = i;
-
-	while (getline(csv, line))
+	//csv item index (realization index + 1) and name for each header entry
+	vector<pair<int, const string*>> items;
+	for (auto &hi : header_info)
 	{
-		
-		pest_utils::strip_ip(line);
-		pest_utils::upper_ip(line);
-		tokens.clear();
-		pest_utils::tokenize(line, tokens, ",", false);
-		if (tokens[tokens.size() - 1].size() == 0)
-			tokens.pop_back();
+		if ((hi.second < 1) || (hi.second > num_reals))
+			throw runtime_error("realization '" + hi.first + "' in csv header doesn't match the number of realizations");
+		items.push_back(pair<int, const string*>(hi.second, &hi.first));
+	}
 
+	//first work out which var each line is for
+	int num_threads = csv.get_num_threads();
+	int chunk_size = WorkQueue::get_chunk_size(num_lines, num_threads);
+	vector<int> line_var_idxs(num_lines, -1);
+	WorkQueue::for_each(num_lines, num_threads, chunk_size, [&](int thread_id, int i)
+	{
+		CsvField f = csv.get_line(i + 1);
+		const char *comma = static_cast<const char*>(memchr(f.ptr, ',', f.len));
+		string token(f.ptr, (comma == nullptr) ? f.len : comma - f.ptr), var_name;
+		pest_utils::upper_ip(token);
 		try
 		{
-			pest_utils::convert_ip(tokens[0], var_name);
+			pest_utils::convert_ip(token, var_name);
 		}
 		catch (exception &e)
 		{
+			string line = f.str();
+			pest_utils::upper_ip(line);
 			stringstream ss;
-			ss << "error converting token '" << tokens[0] << "' to <string> var_name on line " << lcount << ": " << line << endl << e.what();
+			ss << "error converting token '" << token << "' to <string> var_name on line " << i + 1 << ": " << line << endl << e.what();
 			throw runtime_error(ss.str());
 		}
-		//real_names.push_back(real_id);
-		var_idx = var_map[var_name];
-		for (auto &hi : header_info)
+		map<string, int>::const_iterator it = var_map.find(var_name);
+		if (it != var_map.end())
+			line_var_idxs[i] = it->second;
+	});
+	//a var listed more than once takes the values from its last line, same as reading in order
+	vector<int> var_lines(var_names.size(), -1);
+	for (int i = 0; i < num_lines; i++)
+		if (line_var_idxs[i] != -1)
+			var_lines[line_var_idxs[i]] = i;
+	for (int i = 0; i < num_lines; i++)
+		if ((line_var_idxs[i] != -1) && (var_lines[line_var_idxs[i]] != i))
+			line_var_idxs[i] = -1;
+
+	vector<vector<CsvField>> thread_tokens(max(1, num_threads));
+	WorkQueue::for_each(num_lines, num_threads, chunk_size, [&](int thread_id, int i)
+	{
+		int var_idx = line_var_idxs[i];
+		if (var_idx == -1)
+			return;
+		vector<CsvField> &tokens = thread_tokens[thread_id];
+		int lcount = i + 1;
+		csv.split_line(lcount, tokens);
+		if (tokens[tokens.size() - 1].len == 0)
+			tokens.pop_back();
+		double val;
+		for (auto &item : items)
 		{
-			try
-			{
-				val = pest_utils::convert_cp<double>(tokens[hi.second]);
-			}
-			catch (exception &e)
+			if ((item.first >= tokens.size()) || (!CsvReader::parse_double_strict(tokens[item.first], val)))
 			{
+				string token = (item.first < tokens.size()) ? tokens[item.first].str() : "";
+				pest_utils::upper_ip(token);
 				stringstream ss;
-				ss << "error converting token '" << tokens[hi.second] << "' to double for " << hi.first << " on line " << lcount << " : " << e.what();
+				ss << "error converting token '" << token << "' to double for " << *item.second << " on line " << lcount << " : " << PestConversionError(token).what();
 				throw runtime_error(ss.str());
 			}
-			reals(hi.second-1, var_idx) = val;
+			reals(item.first - 1, var_idx) = val;
 		}
-		lcount++;
-		
-
-	}
-	
+	});
 }
 
 
@@ -1886,29 +1881,35 @@ void ParameterEnsemble::draw(int num_reals, Parameters par, Covariance &cov, Per
 	//Parameters par = pest_scenario_ptr->get_ctl_parameters();
 	par_transform.active_ctl2numeric_ip(par);//removes fixed/tied pars
 	tstat = transStatus::NUM;
-	ParameterGroupInfo pgi = pest_scenario_ptr->get_base_group_info();
+	const ParameterGroupInfo &pgi = pest_scenario_ptr->get_base_group_info();
 	//vector<string> group_names = pgi.get_group_names();
 	vector<string> group_names = pest_scenario_ptr->get_ctl_ordered_par_group_names();
-	vector<string> vars_in_group,sorted_var_names;
+	vector<string> sorted_var_names;
 	map<string, vector<string>> grouper;
 	sorted_var_names.reserve(var_names.size());
 	bool same = true;
 	if (pest_scenario_ptr->get_pestpp_options().get_ies_group_draws())
 	{
-		for (auto &group : group_names)
+		//bucket the pars by group in one pass
+		unordered_map<string, int> group_idx;
+		for (int i = 0; i < group_names.size(); i++)
+			group_idx[group_names[i]] = i;
+		vector<vector<string>> group_vars(group_names.size());
+		for (auto &name : var_names)
 		{
-			vars_in_group.clear();
-			for (auto name : var_names)
-			{
-				if (pgi.get_group_rec_ptr(name)->name == group)
-					vars_in_group.push_back(name);
-			}
+			unordered_map<string, int>::iterator it = group_idx.find(pgi.get_group_rec_ptr(name)->name);
+			if (it != group_idx.end())
+				group_vars[it->second].push_back(name);
+		}
+		for (int i = 0; i < group_names.size(); i++)
+		{
+			vector<string> &vars_in_group = group_vars[i];
 			if (vars_in_group.size() == 0)
 				continue;
 			sort(vars_in_group.begin(), vars_in_group.end());
 			sorted_var_names.insert(sorted_var_names.end(), vars_in_group.begin(), vars_in_group.end());
 
-			grouper[group] = vars_in_group;
+			grouper[group_names[i]].swap(vars_in_group);
 		}
 
 		//check
@@ -1979,7 +1980,8 @@ ParameterEnsemble ParameterEnsemble::zeros_like()
 
 }
 
-map<int,int> ParameterEnsemble::add_runs(RunManagerAbstract *run_mgr_ptr,const vector<int> &real_idxs)
+map<int,int> ParameterEnsemble::add_runs(RunManagerAbstract *run_mgr_ptr,const vector<int> &real_idxs,
+	RunManagerAbstract::RUN_PRIORITY priority)
 {
 	//add runs to the run manager using int indices
 	map<int,int> real_run_ids;
@@ -2032,7 +2034,12 @@ map<int,int> ParameterEnsemble::add_runs(RunManagerAbstract *run_mgr_ptr,const v
 				ss << n << ",";
 			throw_ensemble_error(ss.str());
 		}
-		run_id = run_mgr_ptr->add_run(pars_real);
+		//the name lets schedulers track run times per realization across batches
+		run_id = run_mgr_ptr->add_run(pars_real, rname);
+		if (rname == BASE_REAL_NAME)
+			run_mgr_ptr->set_run_priority(run_id, RunManagerAbstract::RUN_PRIORITY::HIGHEST);
+		else if (priority != RunManagerAbstract::RUN_PRIORITY::NORMAL)
+			run_mgr_ptr->set_run_priority(run_id, priority);
 		real_run_ids[idx]  = run_id;
 	}
 	return real_run_ids;
@@ -2098,9 +2105,15 @@ void ParameterEnsemble::from_binary(string file_name)
 
 void ParameterEnsemble::from_csv(string file_name)
 {
-	ifstream csv(file_name);
-	if (!csv.good())
+	CsvReader csv(pest_scenario_ptr->get_pestpp_options().get_ies_num_threads());
+	try
+	{
+		csv.open(file_name);
+	}
+	catch (exception &e)
+	{
 		throw runtime_error("error opening parameter csv " + file_name + " for reading");
+	}
 	bool csv_by_reals = pest_scenario_ptr->get_pestpp_options().get_ies_csv_by_reals();
 	//var_names = pest_scenario_ptr->get_ctl_ordered_adj_par_names();
 	var_names = pest_scenario_ptr->get_ctl_ordered_par_names();
@@ -2135,12 +2148,6 @@ void ParameterEnsemble::from_csv(string file_name)
 	if (missing.size() > 0)
 		throw_ensemble_error("ParameterEnsemble.from_csv() error: the following adjustable pars not in csv:",missing);
 
-	csv.close();
-	csv.open(file_name);
-	if (!csv.good())
-		throw runtime_error("error re-opening parameter csv " + file_name + " for reading");
-	string line;
-	getline(csv, line);
 	if (csv_by_reals)
 		Ensemble::read_csv_by_reals(num_reals, csv, header_info, index_info);
 	else
@@ -2427,20 +2434,28 @@ void ParameterEnsemble::to_csv_by_vars(ofstream &csv)
 {
 	vector<string> names = pest_scenario_ptr->get_ctl_ordered_par_names();
 	csv << "var_name";
-	int ireal = 0;
-	map<string, int> real_map;
-	for (int i = 0; i < real_names.size(); i++)
-		real_map[real_names[i]] = i;
-	map<string, int>::iterator end = real_map.end();
-	for (auto rname : org_real_names)
-	{
-		if (real_map.find(rname) == end)
-			continue;
-		ireal = real_map[rname];
+	vector<int> ireals = get_csv_real_idxs();
+	for (auto ireal : ireals)
 		csv << ',' << pest_utils::lower_cp(real_names[ireal]);
-	}
 	csv << endl;
 
+	//write a line per parameter from the ctl values of each realization
+	int num_threads = pest_scenario_ptr->get_pestpp_options().get_ies_num_threads();
+	Eigen::MatrixXd ctl_vals = get_ctl_vals(ireals, names);
+	CsvWriter::write_lines(csv, names.size(), num_threads, ireals.size() * 14, [&](int thread_id, int j, string &buf)
+	{
+		buf += pest_utils::lower_cp(names[j]);
+		for (int i = 0; i < ireals.size(); i++)
+		{
+			buf += ',';
+			CsvWriter::append_double(buf, ctl_vals(i, j));
+		}
+		buf += '\n';
+	});
+}
+
+Eigen::MatrixXd ParameterEnsemble::get_ctl_vals(const vector<int> &ireals, const vector<string> &names)
+{
 	//get the pars and transform to be in sync with ensemble trans status
 	Parameters pars = pest_scenario_ptr->get_ctl_parameters();
 	if (tstat == transStatus::NUM)
@@ -2452,33 +2467,67 @@ void ParameterEnsemble::to_csv_by_vars(ofstream &csv)
 		par_transform.active_ctl2model_ip(pars);
 	}
 
-	//for (int ireal = 0; ireal < reals.rows(); ireal++)
-	map<string, Parameters> tpar_map;
-	for (auto rname : org_real_names)
+	//transform each realization back to ctl values (each thread in its own copy of pars)
+	int num_threads = pest_scenario_ptr->get_pestpp_options().get_ies_num_threads();
+	vector<Parameters> thread_pars(max(1, num_threads), pars);
+	Eigen::MatrixXd ctl_vals(ireals.size(), names.size());
+	WorkQueue::for_each(ireals.size(), num_threads, 1, [&](int thread_id, int i)
 	{
-		if (real_map.find(rname) == end)
-			continue;
-		ireal = real_map[rname];
-		pars.update_without_clear(var_names, reals.row(ireal));
+		int ireal = ireals[i];
+		Parameters &tpars = thread_pars[thread_id];
+		tpars.update_without_clear(var_names, reals.row(ireal));
 		if (tstat == transStatus::MODEL)
-			par_transform.model2ctl_ip(pars);
+			par_transform.model2ctl_ip(tpars);
 		else if (tstat == transStatus::NUM)
-			par_transform.numeric2ctl_ip(pars);
-		replace_fixed(real_names[ireal], pars);
-		tpar_map[rname] = pars;
-	}
-	for (auto &name : names)
+			par_transform.numeric2ctl_ip(tpars);
+		replace_fixed(real_names[ireal], tpars);
+		for (int j = 0; j < names.size(); j++)
+			ctl_vals(i, j) = tpars.get_rec(names[j]);
+	});
+	return ctl_vals;
+}
+
+void ParameterEnsemble::to_dense(string file_name, bool append)
+{
+	//write the ctl values of every realization, in the same layout as to_binary()
+	vector<string> names = pest_scenario_ptr->get_ctl_ordered_par_names();
+	vector<int> ireals(real_names.size());
+	iota(ireals.begin(), ireals.end(), 0);
+	Eigen::MatrixXd ctl_vals = get_ctl_vals(ireals, names);
+	int num_threads = pest_scenario_ptr->get_pestpp_options().get_ies_num_threads();
+	if (append)
+		EnsembleBinary::append(file_name, real_names, names, ctl_vals, num_threads);
+	else
+		EnsembleBinary::write(file_name, real_names, names, ctl_vals, false, num_threads);
+}
+
+void ParameterEnsemble::from_dense(string file_name, int num_reals)
+{
+	//load a dense binary file, reading only the control file pars and, if num_reals > 0,
+	//only the first num_reals realizations
+	vector<string> names = pest_scenario_ptr->get_ctl_ordered_par_names();
+	map<string, int> header_info = Ensemble::from_dense(file_name, names, num_reals);
+
+	//make sure all adjustable parameters are present
+	vector<string> missing;
+	for (auto &p : pest_scenario_ptr->get_ctl_ordered_adj_par_names())
+		if (header_info.find(p) == header_info.end())
+			missing.push_back(p);
+	if (missing.size() > 0)
+		throw_ensemble_error("ParameterEnsemble.from_dense() error: the following adjustable pars not in file:", missing);
+
+	ParameterInfo pi = pest_scenario_ptr->get_ctl_parameter_info();
+	ParameterRec::TRAN_TYPE ft = ParameterRec::TRAN_TYPE::FIXED;
+	for (auto &name : var_names)
 	{
-		csv << pest_utils::lower_cp(name);
-		for (auto rname : org_real_names)
+		if (pi.get_parameter_rec_ptr(name)->tranform_type == ft)
 		{
-			if (real_map.find(rname) == end)
-				continue;
-			Parameters *tpars = &tpar_map[rname];
-			csv << ',' << tpars->get_rec(name);
+			fixed_names.push_back(name);
 		}
-		csv << endl;
 	}
+	fill_fixed(header_info);
+	save_fixed();
+	tstat = transStatus::CTL;
 }
 
 void ParameterEnsemble::to_csv_by_reals(ofstream &csv)
@@ -2500,30 +2549,28 @@ void ParameterEnsemble::to_csv_by_reals(ofstream &csv)
 		par_transform.active_ctl2model_ip(pars);
 	}
 
-	//for (int ireal = 0; ireal < reals.rows(); ireal++)
-	int ireal = 0;
-	map<string, int> real_map;
-	for (int i = 0; i < real_names.size(); i++)
-		real_map[real_names[i]] = i;
-	map<string, int>::iterator end = real_map.end();
-	for (auto rname : org_real_names)
+	//each thread transforms its realizations back to ctl values in its own copy of pars
+	vector<int> ireals = get_csv_real_idxs();
+	int num_threads = pest_scenario_ptr->get_pestpp_options().get_ies_num_threads();
+	vector<Parameters> thread_pars(max(1, num_threads), pars);
+	CsvWriter::write_lines(csv, ireals.size(), num_threads, names.size() * 14, [&](int thread_id, int i, string &buf)
 	{
-		if (real_map.find(rname) == end)
-			continue;
-		ireal = real_map[rname];
-		csv << pest_utils::lower_cp(real_names[ireal]);
-		//evec = reals.row(ireal);
-		//svec.assign(evec.data(), evec.data() + evec.size());
-		pars.update_without_clear(var_names, reals.row(ireal));
+		int ireal = ireals[i];
+		Parameters &tpars = thread_pars[thread_id];
+		buf += pest_utils::lower_cp(real_names[ireal]);
+		tpars.update_without_clear(var_names, reals.row(ireal));
 		if (tstat == transStatus::MODEL)
-			par_transform.model2ctl_ip(pars);
+			par_transform.model2ctl_ip(tpars);
 		else if (tstat == transStatus::NUM)
-			par_transform.numeric2ctl_ip(pars);
-		replace_fixed(real_names[ireal],pars);
+			par_transform.numeric2ctl_ip(tpars);
+		replace_fixed(real_names[ireal], tpars);
 		for (auto &name : names)
-			csv << ',' << pars[name];
-		csv << endl;
-	}
+		{
+			buf += ',';
+			CsvWriter::append_double(buf, tpars[name]);
+		}
+		buf += '\n';
+	});
 }
 
 void ParameterEnsemble::replace_fixed(string real_name,Parameters &pars)
@@ -2617,18 +2664,18 @@ void ObservationEnsemble::draw(int num_reals, Covariance &cov, PerformanceLog *p
 	//draw an obs ensemble using only nz obs names
 	var_names = pest_scenario_ptr->get_ctl_ordered_nz_obs_names();
 	Observations obs = pest_scenario_ptr->get_ctl_observations();
-	ObservationInfo oi = pest_scenario_ptr->get_ctl_observation_info();
+	const ObservationInfo &oi = pest_scenario_ptr->get_ctl_observation_info();
 	map<string, vector<string>> grouper;
 	vector<string> ogroups = pest_scenario_ptr->get_ctl_ordered_obs_group_names();
 	if (pest_scenario_ptr->get_pestpp_options().get_ies_group_draws())
 	{
-		for (auto group : ogroups)
+		//bucket the obs by group in one pass
+		unordered_set<string> sgroups(ogroups.begin(), ogroups.end());
+		for (auto &oname : var_names)
 		{
-			for (auto &oname : var_names)
-			{
-				if (oi.get_group(oname) == group)
-					grouper[group].push_back(oname);
-			}
+			string group = oi.get_group(oname);
+			if (sgroups.find(group) != sgroups.end())
+				grouper[group].push_back(oname);
 		}
 	}
 	Ensemble::draw(num_reals, cov, obs, pest_scenario_ptr->get_ctl_ordered_nz_obs_names(), grouper, plog, level);
@@ -2729,30 +2776,78 @@ vector<int> ObservationEnsemble::update_from_runs(map<int,int> &real_run_ids, Ru
 {
 	//update the obs ensemble in place from the run manager
 	set<int> failed_runs = run_mgr_ptr->get_failed_run_ids();
-	vector<int> failed_real_idxs;
-	Parameters pars = pest_scenario_ptr->get_ctl_parameters();
-	Observations obs = pest_scenario_ptr->get_ctl_observations();
-	string real_name;
-	int ireal = 0;
+	vector<int> failed_real_idxs, real_idxs, run_ids;
 	for (auto &real_run_id : real_run_ids)
 	{
 		if (failed_runs.find(real_run_id.second) != failed_runs.end())
 		{
 			failed_real_idxs.push_back(real_run_id.first);
-			//failed_real_idxs.push_back(ireal);
 		}
 
 		else
 		{
-			run_mgr_ptr->get_run(real_run_id.second, pars, obs);
-			//real_name = real_names[real_run_id.first];
-			update_from_obs(real_run_id.first, obs);
-			//update_from_obs(ireal, obs);
+			real_idxs.push_back(real_run_id.first);
+			run_ids.push_back(real_run_id.second);
+		}
+	}
+	if (run_ids.size() == 0)
+		return failed_real_idxs;
+
+	//read all the successful runs in one pass over the run storage
+	Eigen::MatrixXd obs_mat;
+	run_mgr_ptr->get_observations_matrix(run_ids, obs_mat);
+
+	//map the run storage obs order to var_names once instead of once per run
+	const vector<string> &rs_obs_names = run_mgr_ptr->get_obs_name_vec();
+	if (rs_obs_names == var_names)
+	{
+		for (int i = 0; i < real_idxs.size(); i++)
+			reals.row(real_idxs[i]) = obs_mat.row(i);
+	}
+	else
+	{
+		unordered_map<string, int> rs_obs_map;
+		for (int i = 0; i < rs_obs_names.size(); i++)
+			rs_obs_map[rs_obs_names[i]] = i;
+		vector<int> col_idxs;
+		vector<string> missing;
+		for (auto &name : var_names)
+		{
+			auto it = rs_obs_map.find(name);
+			if (it == rs_obs_map.end())
+			{
+				missing.push_back(name);
+				continue;
+			}
+			col_idxs.push_back(it->second);
 		}
+		if (missing.size() > 0)
+			throw_ensemble_error("ObservationEnsemble::update_from_runs(): the following obs are not in the run storage: ", missing);
+		for (int j = 0; j < col_idxs.size(); j++)
+			for (int i = 0; i < real_idxs.size(); i++)
+				reals(real_idxs[i], j) = obs_mat(i, col_idxs[j]);
 	}
 	return failed_real_idxs;
 }
 
+void ObservationEnsemble::to_dense(string file_name, bool append)
+{
+	Ensemble::to_dense(file_name, pest_scenario_ptr->get_pestpp_options().get_ies_dense_obs_float32(), append);
+}
+
+void ObservationEnsemble::from_dense(string file_name, int num_reals)
+{
+	//load the obs en from a dense binary file, reading only the control file obs
+	vector<string> names = pest_scenario_ptr->get_ctl_ordered_obs_names();
+	map<string, int> header_info = Ensemble::from_dense(file_name, names, num_reals);
+	vector<string> missing;
+	for (auto &o : pest_scenario_ptr->get_ctl_ordered_nz_obs_names())
+		if (header_info.find(o) == header_info.end())
+			missing.push_back(o);
+	if (missing.size() > 0)
+		throw_ensemble_error("ObservationEnsemble.from_dense() error: the following non-zero weighted obs not in file:", missing);
+}
+
 void ObservationEnsemble::from_binary(string file_name)
 {
 	//load obs en from binary jco-type file
@@ -2765,25 +2860,24 @@ void ObservationEnsemble::from_csv(string file_name)
 	//load the obs en from a csv file
 	var_names = pest_scenario_ptr->get_ctl_ordered_obs_names();
 	bool csv_by_reals = pest_scenario_ptr->get_pestpp_options().get_ies_csv_by_reals();
-	ifstream csv(file_name);
-	if (!csv.good())
+	CsvReader csv(pest_scenario_ptr->get_pestpp_options().get_ies_num_threads());
+	try
+	{
+		csv.open(file_name);
+	}
+	catch (exception &e)
+	{
 		throw runtime_error("error opening observation csv " + file_name + " for reading");
+	}
 	pair<map<string,int>, map<string, int>> p = prepare_csv(pest_scenario_ptr->get_ctl_ordered_nz_obs_names(), csv, false);
 
 	map<string, int> header_info = p.first, index_info = p.second;
-	//blast through the file to get number of reals
-	string line;
 	int num_reals;
 	if (csv_by_reals)
 		num_reals = index_info.size();
 	else
 		num_reals = header_info.size();
 	
-	csv.close();
-	csv.open(file_name);
-	if (!csv.good())
-		throw runtime_error("error re-opening observation csv " + file_name + " for reading");
-	getline(csv, line);
 	//Ensemble::read_csv(num_reals, csv,header_info,index_info);
 	if (csv_by_reals)
 		Ensemble::read_csv_by_reals(num_reals, csv, header_info, index_info);
@@ -2815,18 +2909,15 @@ DrawThread::DrawThread(PerformanceLog * _performance_log, Covariance & _cov,
 	//std_map = _std_map;
 	performance_log = _performance_log;
 	draws_ptr = _draws_ptr;
+	//build the name sets once so the threads can call cov.get() without updating them
+	cov.update_sets();
 }
 
 
-void DrawThread::work(int thread_id, int num_reals, int ies_verbose, map<string, int> idx_map, map<string,double> std_map)
+void DrawThread::work(int thread_id, int num_reals, int ies_verbose, const map<string, int> &idx_map, const map<string,double> &std_map, WorkQueue &queue)
 {
 	stringstream ss;
 
-	unique_lock<mutex> cov_guard(cov_lock,defer_lock);
-	unique_lock<mutex> draw_guard(draw_lock,defer_lock);
-	//unique_lock<mutex> grouper_guard(grouper_lock,defer_lock);
-	unique_lock<mutex> pfm_guard(pfm_lock,defer_lock);
-	unique_lock<mutex> key_guard(key_lock, defer_lock);
 	int count = 0;
 	string group;
 	vector<string> names;
@@ -2834,210 +2925,105 @@ void DrawThread::work(int thread_id, int num_reals, int ies_verbose, map<string,
 	vector<int> idx;
 	Eigen::MatrixXd block, proj;
 	RedSVD::RedSymEigen<Eigen::SparseMatrix<double>> eig;
-	while (true)
+	int begin, end;
+	//grouper and the maps are only read, so every thread shares them without locking.  cov.get()
+	//memoizes its name alignments, which its aligners guard with their own locks.  the groups
+	//are disjoint blocks of contiguous columns of draws, so each thread writes its own block
+	//without locking too
+	while (queue.next(begin, end))
 	{
-		//get the key for more work, or return if all work done
-		while (true)
+		for (int igroup = begin; igroup < end; igroup++)
 		{
-			if (key_guard.try_lock())
-			{
-				if (group_keys.size() == 0)
-				{
-					ss.str("");
-					ss << "draw thread: " << thread_id << " processed " << count << " groups";
-					if (ies_verbose > 1)
-					{
-						cout << ss.str() << endl;
-
-					}
-					while (true)
-					{
-						if (pfm_guard.try_lock())
-						{
-							performance_log->log_event(ss.str());
-							pfm_guard.unlock();
-							break;
-						}
-					}
-					key_guard.unlock();
-					return;
-				}
-			}
-			group = group_keys[group_keys.size() - 1];
-			group_keys.pop_back();
-			names = grouper[group];
+			group = group_keys[igroup];
+			names = grouper.at(group);
 			if (names.size() == 0)
 			{
 				ss.str("");
 				ss << "no entries for grouper key:" << group;
-				while (true)
-				{
-					if (pfm_guard.try_lock())
-					{
-						performance_log->log_event(ss.str());
-						pfm_guard.unlock();
-						break;
-					}
-				}
-				key_guard.unlock();
+				log_event(ss.str());
 				continue;
 			}
-			key_guard.unlock();
-			break;
-		}
-		
-		if (ies_verbose > 1)
-		{
-			ss.str("");
-			ss << "...processing " << group << " with " <<names.size() << " elements" << endl;
-			cout << ss.str();
-			while (true)
+			count++;
+
+			if (ies_verbose > 1)
 			{
-				if (pfm_guard.try_lock())
-				{
-					performance_log->log_event(ss.str());
-					pfm_guard.unlock();
-					break;
-				}
+				ss.str("");
+				ss << "...processing " << group << " with " << names.size() << " elements" << endl;
+				cout << ss.str();
+				log_event(ss.str());
 			}
-		}
 
-		//if there is only one par in the group
-		if (names.size() == 1)
-		{
-			ss.str("");
-			ss << "thread: " << thread_id << " - only one element in group " <<group << ", scaling by std";
-			while (true)
+			//if there is only one par in the group
+			if (names.size() == 1)
 			{
-				if (pfm_guard.try_lock())
-				{
-					performance_log->log_event(ss.str());
-					pfm_guard.unlock();
-					break;
-				}
+				ss.str("");
+				ss << "thread: " << thread_id << " - only one element in group " << group << ", scaling by std";
+				log_event(ss.str());
+				int j = idx_map.at(names[0]);
+				draws_ptr->col(j) *= std_map.at(names[0]);
+				continue;
 			}
-			int j = idx_map[names[0]];
-			while (true)
+
+			//get a sub cov
+			gcov = cov.get(names, false);
+
+			if (ies_verbose > 2)
 			{
-				if (draw_guard.try_lock())
-				{
-					draws_ptr->col(j) *= std_map[names[0]];
-					draw_guard.unlock();
-					break;
-				}
+				gcov.to_ascii(group + "_cov.dat");
 			}
-			
-			continue;
-		}
 
-		//get a sub cov
-		while (true)
-		{
-			if (cov_guard.try_lock())
+			idx.clear();
+			for (auto &n : names)
+				idx.push_back(idx_map.at(n));
+
+			if (idx.size() != idx[idx.size() - 1] - idx[0] + 1)
 			{
-				gcov = cov.get(names);
-				cov_guard.unlock();
-				break;
+				ss.str("");
+				ss << "thread: " << thread_id << " - DrawThread error: idx out of order for group: " << group;
+				log_event(ss.str());
+				throw runtime_error(ss.str());
 			}
-		}
-		
-		if (ies_verbose > 2)
-		{
-			gcov.to_ascii(group + "_cov.dat");
-		}
 
-		idx.clear();
-		for (auto n : names)
-			idx.push_back(idx_map[n]);
 
-		if (idx.size() != idx[idx.size() - 1] - idx[0] + 1)
-		{
+			double fac = gcov.e_ptr()->diagonal().minCoeff();
 			ss.str("");
-			ss << "thread: " << thread_id << " - DrawThread error: idx out of order for group: " << group;
-			while (true)
-			{
-				if (pfm_guard.try_lock())
-				{
-					performance_log->log_event(ss.str());
-					pfm_guard.unlock();
-					break;
-				}
-			}
-			throw runtime_error(ss.str());
-		}
+			ss << "thread: " << thread_id << " - min variance for group " << group << ": " << fac;
+			log_event(ss.str());
 
+			ss.str("");
+			ss << "thread: " << thread_id << " - Randomized Eigen decomposition of full cov for " << names.size() << " element matrix" << endl;
+			log_event(ss.str());
+			eig.compute(*gcov.e_ptr() * (1.0 / fac), names.size());
 
-		double fac = gcov.e_ptr()->diagonal().minCoeff();
-		ss.str("");
-		ss << "thread: " << thread_id <<  " - min variance for group " << group << ": " << fac;
-		while (true)
-		{
-			if (pfm_guard.try_lock())
-			{
-				performance_log->log_event(ss.str());
-				pfm_guard.unlock();
-				break;
-			}
-		}
-		/*while (true)
-		{
-			if (draw_guard.try_lock())
-			{
-				block = draws_ptr->block(0, idx[0], num_reals, idx.size());
-				draw_guard.unlock();
-				break;
-			}
-		}*/
-		
-		ss.str("");
-		ss << "thread: " << thread_id <<  " - Randomized Eigen decomposition of full cov for " << names.size() << " element matrix" << endl;
-		while (true)
-		{
-			if (pfm_guard.try_lock())
-			{
-				performance_log->log_event(ss.str());
-				pfm_guard.unlock();
-				break;
-			}
-		}
-		eig.compute(*gcov.e_ptr() * (1.0 / fac), names.size());
-		//RedSVD::RedSVD<Eigen::SparseMatrix<double>> svd;
-		//svd.compute(*gcov.e_ptr(),gcov.get_col_names().size());// , gi.second.size());
-		//cout << svd.singularValues() << endl;
-		//Eigen::JacobiSVD<Eigen::MatrixXd> svd(gcov.e_ptr()->toDense(), Eigen::ComputeFullU);
-		//svd.computeU();
-
-		proj = (eig.eigenvectors() * (fac *eig.eigenvalues()).cwiseSqrt().asDiagonal());
-		//proj = (svd.matrixU() * svd.singularValues().asDiagonal());
-
-		if (ies_verbose > 2)
-		{
-			ofstream f(group + "_evec.dat");
-			f << eig.eigenvectors() << endl;
-			//f << svd.matrixU() << endl;
-			f.close();
-			ofstream ff(group + "_sqrt_evals.dat");
-			ff << (fac * eig.eigenvalues()).cwiseSqrt() << endl;
-			//ff << svd.singularValues() << endl;
-			ff.close();
-			ofstream fff(group + "_proj.dat");
-			fff << proj << endl;
-			fff.close();
-		}
-		//cout << "block " << block.rows() << " , " << block.cols() << endl;
-		//cout << " proj " << proj.rows() << " , " << proj.cols() << endl;
-		while (true)
-		{
-			if (draw_guard.try_lock())
+			proj = (eig.eigenvectors() * (fac *eig.eigenvalues()).cwiseSqrt().asDiagonal());
+
+			if (ies_verbose > 2)
 			{
-				block = draws_ptr->block(0, idx[0], num_reals, idx.size());
-				draws_ptr->block(0, idx[0], num_reals, idx.size()) = (proj * block.transpose()).transpose();
-				draw_guard.unlock();
-				break;
+				ofstream f(group + "_evec.dat");
+				f << eig.eigenvectors() << endl;
+				f.close();
+				ofstream ff(group + "_sqrt_evals.dat");
+				ff << (fac * eig.eigenvalues()).cwiseSqrt() << endl;
+				ff.close();
+				ofstream fff(group + "_proj.dat");
+				fff << proj << endl;
+				fff.close();
 			}
+			block = draws_ptr->block(0, idx[0], num_reals, idx.size());
+			draws_ptr->block(0, idx[0], num_reals, idx.size()) = (proj * block.transpose()).transpose();
 		}
-		
-
 	}
+	ss.str("");
+	ss << "draw thread: " << thread_id << " processed " << count << " groups";
+	if (ies_verbose > 1)
+	{
+		cout << ss.str() << endl;
+	}
+	log_event(ss.str());
+}
 
+void DrawThread::log_event(const string &message)
+{
+	lock_guard<mutex> pfm_guard(pfm_lock);
+	performance_log->log_event(message);
 }
\ No newline at end of file
@@ -13,7 +13,11 @@
 #include "RunStorage.h"
 #include "covariance.h"
 #include "RunManagerAbstract.h"
+#include "WorkQueue.h"
+#include "EnsembleCsv.h"
+#include "EnsembleBinary.h"
 #include "PerformanceLog.h"
+#include "NameIndex.h"
 
 
 const string BASE_REAL_NAME = "BASE";
@@ -31,6 +35,8 @@ public:
 	void to_csv(string file_name);
 	void to_binary_old(string file_name, bool transposed=false);
 	void to_binary(string file_name, bool transposed=false);
+	//write to the dense binary format (see EnsembleBinary.h), or append the realizations to an existing file
+	void to_dense(string file_name, bool single_precision=false, bool append=false);
 	void from_eigen_mat(Eigen::MatrixXd mat, const vector<string> &_real_names, const vector<string> &_var_names);
 	pair<int, int> shape() { return pair<int, int>(reals.rows(), reals.cols()); }
 	void throw_ensemble_error(string message);
@@ -108,13 +114,18 @@ protected:
 	vector<string> real_names;	
 	vector<string> org_real_names;
 	map<string, int> var_map;
-	void read_csv_by_reals(int num_reals,ifstream &csv, map<string,int> &header_info, map<string,int> &index_info);
-	void read_csv_by_vars(int num_reals, ifstream &csv, map<string, int> &header_info, map<string, int> &index_info);
+	//memoized name alignment for get_eigen()
+	NameAligner var_aligner;
+	NameAligner real_aligner;
+	void read_csv_by_reals(int num_reals, CsvReader &csv, map<string,int> &header_info, map<string,int> &index_info);
+	void read_csv_by_vars(int num_reals, CsvReader &csv, map<string, int> &header_info, map<string, int> &index_info);
 	map<string,int> from_binary_old(string file_name, vector<string> &names,  bool transposed);
 	map<string, int> from_binary(string file_name, vector<string> &names, bool transposed);
-	pair<map<string, int>, map<string, int>> prepare_csv(const vector<string> &names, ifstream &csv, bool forgive);
+	map<string, int> from_dense(string file_name, const vector<string> &names, int num_reals);
+	pair<map<string, int>, map<string, int>> prepare_csv(const vector<string> &names, CsvReader &csv, bool forgive);
 	void to_csv_by_reals(ofstream &csv);
 	void to_csv_by_vars(ofstream &csv);
+	vector<int> get_csv_real_idxs();
 };
 
 class ParameterEnsemble : public Ensemble
@@ -137,6 +148,8 @@ public:
 	//void from_csv(string file_name,const vector<string> &ordered_names);
 	void from_csv(string file_name);
 	void from_binary(string file_name);
+	//read the first num_reals realizations (all if num_reals < 1) from a dense binary file
+	void from_dense(string file_name, int num_reals=-1);
 
 	void from_eigen_mat(Eigen::MatrixXd mat, const vector<string> &_real_names, const vector<string> &_var_names,
 		transStatus _tstat = transStatus::NUM);
@@ -150,11 +163,15 @@ public:
 	ParamTransformSeq get_par_transform() const { return par_transform; }
 	void transform_ip(transStatus to_tstat);
 	void set_pest_scenario(Pest *_pest_scenario);
-	map<int,int> add_runs(RunManagerAbstract *run_mgr_ptr,const vector<int> &real_idxs=vector<int>());
+	//queue one run per realization, with the realization name as the run info_txt.  the base
+	//realization is queued at the highest priority, the others at priority
+	map<int,int> add_runs(RunManagerAbstract *run_mgr_ptr,const vector<int> &real_idxs=vector<int>(),
+		RunManagerAbstract::RUN_PRIORITY priority=RunManagerAbstract::RUN_PRIORITY::NORMAL);
 
 	void draw(int num_reals, Parameters par, Covariance &cov, PerformanceLog *plog, int level, ofstream& frec);
 	Covariance get_diagonal_cov_matrix();
 	void to_binary(string filename);
+	void to_dense(string file_name, bool append=false);
 
 private:
 	ParamTransformSeq par_transform;
@@ -164,6 +181,8 @@ private:
 	vector<string> fixed_names;
 	map<pair<string, string>, double> fixed_map;
 	void replace_fixed(string real_name,Parameters &pars);
+	//ctl values of the ireals rows for names, with fixed/tied pars filled in
+	Eigen::MatrixXd get_ctl_vals(const vector<int> &ireals, const vector<string> &names);
 };
 
 class ObservationEnsemble : public Ensemble
@@ -177,12 +196,15 @@ public:
 
 	ObservationEnsemble() { ; }
 	void to_binary(string filename) { Ensemble::to_binary(filename, true); }
+	//values are stored as float32 if ies_dense_obs_float32
+	void to_dense(string file_name, bool append=false);
 	void update_from_obs(int row_idx, Observations &obs);
 	void update_from_obs(string real_name, Observations &obs);
 	//void from_csv(string &file_name, const vector<string> &ordered_names);
 	void from_csv(string file_name);
 	void from_eigen_mat(Eigen::MatrixXd mat, const vector<string> &_real_names, const vector<string> &_var_names);
 	void from_binary(string file_name);// { Ensemble::from_binary(file_name, true); }
+	void from_dense(string file_name, int num_reals=-1);
 	vector<int> update_from_runs(map<int,int> &real_run_ids, RunManagerAbstract *run_mgr_ptr);
 	void draw(int num_reals, Covariance &cov, PerformanceLog *plog, int level, ofstream& frec);
 	void initialize_without_noise(int num_reals);
@@ -196,7 +218,8 @@ public:
 	DrawThread(PerformanceLog *_performance_log, Covariance &_cov,Eigen::MatrixXd *_draws_ptr,
 		vector<string> &_group_keys, const map<string,vector<string>> &_grouper);
 	
-	void work(int thread_id, int num_reals, int ies_verbose, map<string, int> idx_map, map<string, double> std_map);
+	//draw the groups claimed from queue
+	void work(int thread_id, int num_reals, int ies_verbose, const map<string, int> &idx_map, const map<string, double> &std_map, WorkQueue &queue);
 
 
 private:
@@ -209,7 +232,9 @@ private:
 	//map<string, int> idx_map;
 	map<string, vector<string>> grouper;
 	//map<string, double> std_map;
-	mutex cov_lock, draw_lock, key_lock, pfm_lock;
+	//the inputs above are shared read-only; only logging locks
+	mutex pfm_lock;
+	void log_event(const string &message);
 };
 
 
@@ -0,0 +1,315 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+#include "EnsembleBinary.h"
+#include "WorkQueue.h"
+#include "utilities.h"
+
+using namespace std;
+
+const int EnsembleBinary::COL_BLOCK_SIZE;
+
+namespace
+{
+	const char DENSE_MAGIC[8] = { 'P','E','S','T','E','N','S','1' };
+	//rows packed per work item when writing a tile, and copied per work item when reading one
+	const int WRITE_ROW_CHUNK = 64;
+	const int READ_ROW_CHUNK = 64;
+
+	void write_int(ostream &out, int value)
+	{
+		int32_t v = value;
+		out.write((char*)&v, sizeof(v));
+	}
+
+	void write_name(ostream &out, const string &name)
+	{
+		string l = pest_utils::lower_cp(name);
+		write_int(out, l.size());
+		out.write(l.c_str(), l.size());
+	}
+
+	//bounds-checked cursor over the mapped file
+	class Cursor
+	{
+	public:
+		Cursor(const char *_base, size_t _size, size_t _pos) : pos(_pos), base(_base), size(_size) { ; }
+		bool read_int(int &value)
+		{
+			int32_t v;
+			if (pos + sizeof(v) > size)
+				return false;
+			memcpy(&v, base + pos, sizeof(v));
+			pos += sizeof(v);
+			value = v;
+			return true;
+		}
+		bool read_name(string &name)
+		{
+			int len;
+			if ((!read_int(len)) || (len < 0) || (pos + len > size))
+				return false;
+			name.assign(base + pos, len);
+			pest_utils::upper_ip(name);
+			pos += len;
+			return true;
+		}
+		size_t pos;
+	private:
+		const char *base;
+		size_t size;
+	};
+}
+
+EnsembleBinary::EnsembleBinary(int _num_threads) : num_threads(_num_threads), value_size(0), col_block(0)
+{
+}
+
+bool EnsembleBinary::is_dense(const string &filename)
+{
+	ifstream in(filename, ios::binary);
+	char magic[sizeof(DENSE_MAGIC)];
+	if (!in.read(magic, sizeof(magic)))
+		return false;
+	return memcmp(magic, DENSE_MAGIC, sizeof(magic)) == 0;
+}
+
+void EnsembleBinary::write(const string &filename, const vector<string> &real_names, const vector<string> &var_names,
+	const Eigen::MatrixXd &mat, bool single_precision, int num_threads)
+{
+	if ((mat.rows() != real_names.size()) || (mat.cols() != var_names.size()))
+		throw runtime_error("EnsembleBinary::write(): matrix shape does not match the real and var names");
+	ofstream out(filename, ios::binary);
+	if (!out.good())
+		throw runtime_error("error opening dense binary ensemble file " + filename + " for writing");
+	int value_size = single_precision ? sizeof(float) : sizeof(double);
+	out.write(DENSE_MAGIC, sizeof(DENSE_MAGIC));
+	write_int(out, value_size);
+	write_int(out, var_names.size());
+	write_int(out, COL_BLOCK_SIZE);
+	for (auto &name : var_names)
+		write_name(out, name);
+	vector<int> col_idxs(var_names.size());
+	iota(col_idxs.begin(), col_idxs.end(), 0);
+	write_block(out, real_names, mat, col_idxs, value_size, COL_BLOCK_SIZE, num_threads);
+	out.close();
+	if (!out)
+		throw runtime_error("error writing dense binary ensemble file " + filename);
+}
+
+void EnsembleBinary::append(const string &filename, const vector<string> &real_names, const vector<string> &var_names,
+	const Eigen::MatrixXd &mat, int num_threads)
+{
+	if ((mat.rows() != real_names.size()) || (mat.cols() != var_names.size()))
+		throw runtime_error("EnsembleBinary::append(): matrix shape does not match the real and var names");
+	EnsembleBinary existing;
+	existing.open(filename);
+	unordered_map<string, int> var_map;
+	for (int i = 0; i < var_names.size(); i++)
+		var_map[pest_utils::upper_cp(var_names[i])] = i;
+	if (var_map.size() != existing.var_names.size())
+		existing.throw_error("append(): number of vars does not match the file");
+	vector<int> col_idxs;
+	for (auto &name : existing.var_names)
+	{
+		unordered_map<string, int>::iterator it = var_map.find(name);
+		if (it == var_map.end())
+			existing.throw_error("append(): var '" + name + "' not in the realizations being appended");
+		col_idxs.push_back(it->second);
+	}
+	unordered_set<string> file_reals(existing.real_names.begin(), existing.real_names.end());
+	for (auto &name : real_names)
+		if (file_reals.find(pest_utils::upper_cp(name)) != file_reals.end())
+			existing.throw_error("append(): realization '" + name + "' is already in the file");
+	int value_size = existing.value_size, col_block = existing.col_block;
+	existing.close();
+
+	ofstream out(filename, ios::binary | ios::app);
+	if (!out.good())
+		throw runtime_error("error opening dense binary ensemble file " + filename + " for appending");
+	write_block(out, real_names, mat, col_idxs, value_size, col_block, num_threads);
+	out.close();
+	if (!out)
+		throw runtime_error("error appending to dense binary ensemble file " + filename);
+}
+
+void EnsembleBinary::write_block(ostream &out, const vector<string> &real_names, const Eigen::MatrixXd &mat,
+	const vector<int> &col_idxs, int value_size, int col_block, int num_threads)
+{
+	int n_real = real_names.size();
+	int n_var = col_idxs.size();
+	write_int(out, n_real);
+	for (auto &name : real_names)
+		write_name(out, name);
+	//pack one tile at a time so the buffer stays small.  each work item packs a run of rows,
+	//reading down the (contiguous) matrix columns and writing whole tile rows
+	vector<char> buf;
+	int num_chunks = (n_real + WRITE_ROW_CHUNK - 1) / WRITE_ROW_CHUNK;
+	for (int c0 = 0; c0 < n_var; c0 += col_block)
+	{
+		int tw = min(col_block, n_var - c0);
+		size_t row_bytes = (size_t)tw * value_size;
+		buf.resize(row_bytes * n_real);
+		WorkQueue::for_each(num_chunks, num_threads, 1, [&](int thread_id, int ichunk)
+		{
+			int r0 = ichunk * WRITE_ROW_CHUNK, r1 = min(r0 + WRITE_ROW_CHUNK, n_real);
+			for (int jj = 0; jj < tw; jj++)
+			{
+				const double *col = mat.col(col_idxs[c0 + jj]).data();
+				char *p = buf.data() + (size_t)jj * value_size;
+				if (value_size == sizeof(float))
+				{
+					for (int r = r0; r < r1; r++)
+					{
+						float v = (float)col[r];
+						memcpy(p + r * row_bytes, &v, sizeof(v));
+					}
+				}
+				else
+				{
+					for (int r = r0; r < r1; r++)
+						memcpy(p + r * row_bytes, &col[r], sizeof(double));
+				}
+			}
+		});
+		out.write(buf.data(), buf.size());
+	}
+}
+
+void EnsembleBinary::open(const string &_filename)
+{
+	close();
+	if (!is_dense(_filename))
+		throw runtime_error("file " + _filename + " is not a dense binary ensemble file");
+	file.open(_filename, MappedFile::Mode::READ_ONLY);
+	Cursor c(file.data(), file.size(), sizeof(DENSE_MAGIC));
+	int n_var;
+	if ((!c.read_int(value_size)) || (!c.read_int(n_var)) || (!c.read_int(col_block)))
+		throw_error("truncated header");
+	if ((value_size != sizeof(float)) && (value_size != sizeof(double)))
+		throw_error("unsupported value size in header");
+	if ((n_var < 0) || (col_block < 1))
+		throw_error("invalid header");
+	var_names.resize(n_var);
+	for (auto &name : var_names)
+		if (!c.read_name(name))
+			throw_error("truncated var names");
+
+	//walk the realization blocks - only the block headers are touched
+	size_t var_bytes = (size_t)n_var * value_size;
+	while (c.pos < file.size())
+	{
+		Block b;
+		if ((!c.read_int(b.num_reals)) || (b.num_reals < 0))
+			throw_error("invalid realization block header");
+		for (int i = 0; i < b.num_reals; i++)
+		{
+			string name;
+			if (!c.read_name(name))
+				throw_error("truncated realization names");
+			real_names.push_back(name);
+			real_locs.push_back(pair<int, int>(blocks.size(), i));
+		}
+		b.data_offset = c.pos;
+		size_t data_bytes = var_bytes * b.num_reals;
+		if (c.pos + data_bytes > file.size())
+		{
+			stringstream ss;
+			ss << "realization block " << blocks.size() + 1 << " is truncated";
+			throw_error(ss.str());
+		}
+		c.pos += data_bytes;
+		blocks.push_back(b);
+	}
+}
+
+Eigen::MatrixXd EnsembleBinary::read(const vector<int> &real_idxs, const vector<int> &var_idxs) const
+{
+	int n_var = var_names.size();
+	int num_tiles = (n_var + col_block - 1) / col_block;
+	//(col within tile, output col) for the requested vars in each tile
+	vector<vector<pair<int, int>>> tile_cols(num_tiles);
+	for (int j = 0; j < var_idxs.size(); j++)
+	{
+		int v = var_idxs[j];
+		if ((v < 0) || (v >= n_var))
+			throw_error("var index out of range");
+		tile_cols[v / col_block].push_back(pair<int, int>(v % col_block, j));
+	}
+	vector<int> tiles;
+	for (int t = 0; t < num_tiles; t++)
+		if (!tile_cols[t].empty())
+			tiles.push_back(t);
+	for (auto i : real_idxs)
+		if ((i < 0) || (i >= real_names.size()))
+			throw_error("realization index out of range");
+
+	//each work item copies one tile for a run of the requested realizations: the tile rows are
+	//read in order and the output matrix is filled a column at a time
+	Eigen::MatrixXd mat(real_idxs.size(), var_idxs.size());
+	const char *base = file.data();
+	int n_out = real_idxs.size();
+	int num_chunks = (n_out + READ_ROW_CHUNK - 1) / READ_ROW_CHUNK;
+	WorkQueue::for_each(tiles.size() * num_chunks, num_threads, 1, [&](int thread_id, int item)
+	{
+		int t = tiles[item / num_chunks];
+		int i0 = (item % num_chunks) * READ_ROW_CHUNK, i1 = min(i0 + READ_ROW_CHUNK, n_out);
+		int tw = min(col_block, n_var - t * col_block);
+		const char *rows[READ_ROW_CHUNK];
+		for (int i = i0; i < i1; i++)
+		{
+			const pair<int, int> &loc = real_locs[real_idxs[i]];
+			const Block &b = blocks[loc.first];
+			rows[i - i0] = base + b.data_offset +
+				((size_t)t * col_block * b.num_reals + (size_t)loc.second * tw) * value_size;
+		}
+		for (auto &tc : tile_cols[t])
+		{
+			double *out = mat.col(tc.second).data();
+			size_t offset = (size_t)tc.first * value_size;
+			if (value_size == sizeof(float))
+			{
+				float v;
+				for (int i = i0; i < i1; i++)
+				{
+					memcpy(&v, rows[i - i0] + offset, sizeof(float));
+					out[i] = v;
+				}
+			}
+			else
+			{
+				for (int i = i0; i < i1; i++)
+					memcpy(&out[i], rows[i - i0] + offset, sizeof(double));
+			}
+		}
+	});
+	return mat;
+}
+
+void EnsembleBinary::close()
+{
+	if (file.is_open())
+		file.close();
+	var_names.clear();
+	real_names.clear();
+	blocks.clear();
+	real_locs.clear();
+	value_size = 0;
+	col_block = 0;
+}
+
+void EnsembleBinary::throw_error(const string &message) const
+{
+	throw runtime_error("dense binary ensemble file " + file.get_filename() + ": " + message);
+}
+
+EnsembleBinary::~EnsembleBinary()
+{
+	close();
+}
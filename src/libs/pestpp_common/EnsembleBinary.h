@@ -0,0 +1,64 @@
+#ifndef ENSEMBLE_BINARY_H_
+#define ENSEMBLE_BINARY_H_
+
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "mapped_file.h"
+
+//dense binary ensemble file (".bin").  all integers are int32 and all values are native-endian:
+//  header: the 8 char magic "PESTENS1", value size (4 or 8), num vars, vars per column block,
+//          then the var names
+//  then one or more realization blocks, each holding the num reals, the real names and then,
+//  for each column block, a row-major (num reals x block vars) tile of values
+//names are stored as an int32 length followed by the chars.  new realization blocks are appended
+//to the end of an existing file without touching the rest of it.  reading a subset of the
+//realizations or vars only touches the tiles (and the rows within them) that hold them
+class EnsembleBinary
+{
+public:
+	static const int COL_BLOCK_SIZE = 1024;
+	EnsembleBinary(int _num_threads = -1);
+	//true if the file starts with the dense binary magic
+	static bool is_dense(const std::string &filename);
+	//write a new file, storing the values as float32 if single_precision
+	static void write(const std::string &filename, const std::vector<std::string> &real_names,
+		const std::vector<std::string> &var_names, const Eigen::MatrixXd &mat,
+		bool single_precision = false, int num_threads = -1);
+	//append a block of realizations to an existing file.  every var in the file must be in var_names
+	//(in any order) and the values are stored with the file's precision
+	static void append(const std::string &filename, const std::vector<std::string> &real_names,
+		const std::vector<std::string> &var_names, const Eigen::MatrixXd &mat, int num_threads = -1);
+
+	//map the file and index the realization blocks
+	void open(const std::string &_filename);
+	void close();
+	const std::vector<std::string> &get_var_names() const { return var_names; }
+	const std::vector<std::string> &get_real_names() const { return real_names; }
+	bool is_single_precision() const { return value_size == sizeof(float); }
+	//read the real_idxs rows and var_idxs columns (in the order given) into a dense matrix
+	Eigen::MatrixXd read(const std::vector<int> &real_idxs, const std::vector<int> &var_idxs) const;
+	~EnsembleBinary();
+private:
+	struct Block
+	{
+		size_t data_offset;
+		int num_reals;
+	};
+	int num_threads;
+	MappedFile file;
+	int value_size;
+	int col_block;
+	std::vector<std::string> var_names;
+	std::vector<std::string> real_names;
+	std::vector<Block> blocks;
+	//block index and row within that block for each realization
+	std::vector<std::pair<int, int>> real_locs;
+	static void write_block(std::ostream &out, const std::vector<std::string> &real_names, const Eigen::MatrixXd &mat,
+		const std::vector<int> &col_idxs, int value_size, int col_block, int num_threads);
+	void throw_error(const std::string &message) const;
+	EnsembleBinary(const EnsembleBinary &) = delete;
+	EnsembleBinary &operator=(const EnsembleBinary &) = delete;
+};
+
+#endif //ENSEMBLE_BINARY_H_
@@ -0,0 +1,198 @@
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include "EnsembleCsv.h"
+#include "WorkQueue.h"
+#include "model_interface.h"
+
+using namespace std;
+
+namespace
+{
+	//bytes of output formatted per batch by CsvWriter::write_lines()
+	const size_t csv_batch_bytes = 64 * 1024 * 1024;
+	//files smaller than this are indexed on the calling thread
+	const size_t csv_parallel_index_bytes = 1024 * 1024;
+
+	bool is_strip_char(char c)
+	{
+		return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+	}
+}
+
+CsvReader::CsvReader(int _num_threads) : num_threads(_num_threads)
+{
+}
+
+void CsvReader::open(const string &filename)
+{
+	close();
+	mf.open(filename, MappedFile::Mode::READ_ONLY);
+	mf.advise_sequential();
+	const char *data = mf.data();
+	size_t size = mf.size();
+
+	//find the newlines in parallel chunks - stitching the chunks back together in order
+	//gives every newline in the file in order
+	int num_chunks = 1;
+	if ((num_threads > 0) && (size >= csv_parallel_index_bytes))
+		num_chunks = num_threads * 4;
+	vector<vector<size_t>> newlines(num_chunks);
+	WorkQueue::for_each(num_chunks, (num_chunks > 1) ? num_threads : 0, 1, [&](int thread_id, int ichunk)
+	{
+		size_t begin = (size * ichunk) / num_chunks;
+		size_t end = (size * (ichunk + 1)) / num_chunks;
+		const char *p = data + begin, *e = data + end;
+		while (p < e)
+		{
+			const char *nl = static_cast<const char*>(memchr(p, '\n', e - p));
+			if (nl == nullptr)
+				break;
+			newlines[ichunk].push_back(nl - data);
+			p = nl + 1;
+		}
+	});
+	size_t num_nl = 0;
+	for (auto &nls : newlines)
+		num_nl += nls.size();
+	line_begin.reserve(num_nl + 1);
+	line_end.reserve(num_nl + 1);
+	size_t start = 0;
+	for (auto &nls : newlines)
+	{
+		for (auto nl : nls)
+		{
+			line_begin.push_back(start);
+			line_end.push_back(nl);
+			start = nl + 1;
+		}
+	}
+	//getline() only returns a last, unterminated line if it isn't empty
+	if (start < size)
+	{
+		line_begin.push_back(start);
+		line_end.push_back(size);
+	}
+}
+
+void CsvReader::close()
+{
+	mf.close();
+	line_begin.clear();
+	line_end.clear();
+}
+
+CsvField CsvReader::get_line(int i) const
+{
+	const char *b = mf.data() + line_begin[i];
+	const char *e = mf.data() + line_end[i];
+	while ((b < e) && (is_strip_char(*b)))
+		b++;
+	while ((e > b) && (is_strip_char(*(e - 1))))
+		e--;
+	return CsvField(b, e - b);
+}
+
+void CsvReader::split_line(int i, vector<CsvField> &fields) const
+{
+	fields.clear();
+	CsvField line = get_line(i);
+	const char *p = line.ptr, *e = line.ptr + line.len;
+	while (true)
+	{
+		const char *comma = static_cast<const char*>(memchr(p, ',', e - p));
+		if (comma == nullptr)
+		{
+			fields.push_back(CsvField(p, e - p));
+			break;
+		}
+		fields.push_back(CsvField(p, comma - p));
+		p = comma + 1;
+	}
+}
+
+bool CsvReader::parse_double(const CsvField &f, double &value)
+{
+	if (f.len == 0)
+		return false;
+	return OutputFileScanner::parse_double(f.ptr, f.len, value);
+}
+
+bool CsvReader::parse_double_strict(const CsvField &f, double &value)
+{
+	//istream >> double only takes [+-]digits[.digits][(e|E)[+-]digits], with at least
+	//one mantissa digit and one exponent digit, and convert_cp() rejects anything left over
+	const char *c = f.ptr, *e = f.ptr + f.len;
+	while ((c < e) && (isspace((unsigned char)*c)))
+		c++;
+	const char *start = c;
+	if ((c < e) && ((*c == '+') || (*c == '-')))
+		c++;
+	bool any_digit = false;
+	while ((c < e) && (isdigit((unsigned char)*c)))
+	{
+		c++;
+		any_digit = true;
+	}
+	if ((c < e) && (*c == '.'))
+	{
+		c++;
+		while ((c < e) && (isdigit((unsigned char)*c)))
+		{
+			c++;
+			any_digit = true;
+		}
+	}
+	if (!any_digit)
+		return false;
+	if ((c < e) && ((*c == 'e') || (*c == 'E')))
+	{
+		c++;
+		if ((c < e) && ((*c == '+') || (*c == '-')))
+			c++;
+		if ((c == e) || (!isdigit((unsigned char)*c)))
+			return false;
+		while ((c < e) && (isdigit((unsigned char)*c)))
+			c++;
+	}
+	if (c != e)
+		return false;
+	return OutputFileScanner::parse_double(start, e - start, value);
+}
+
+void CsvWriter::write_lines(ostream &out, int num_lines, int num_threads, size_t est_line_bytes,
+	const function<void(int, int, string&)> &format_line)
+{
+	if (num_lines == 0)
+		return;
+	int nt = max(1, num_threads);
+	int batch_lines = max((size_t)nt, csv_batch_bytes / max((size_t)1, est_line_bytes));
+	batch_lines = min(batch_lines, num_lines);
+	int chunk_lines = WorkQueue::get_chunk_size(batch_lines, nt, 4);
+	int num_chunks = (batch_lines + chunk_lines - 1) / chunk_lines;
+	vector<string> bufs(num_chunks);
+	for (int batch_start = 0; batch_start < num_lines; batch_start += batch_lines)
+	{
+		int batch_end = min(batch_start + batch_lines, num_lines);
+		int batch_chunks = (batch_end - batch_start + chunk_lines - 1) / chunk_lines;
+		WorkQueue::for_each(batch_chunks, (batch_chunks > 1) ? num_threads : 0, 1, [&](int thread_id, int ichunk)
+		{
+			string &buf = bufs[ichunk];
+			buf.clear();
+			int end = min(batch_start + (ichunk + 1) * chunk_lines, batch_end);
+			for (int i = batch_start + ichunk * chunk_lines; i < end; i++)
+				format_line(thread_id, i, buf);
+		});
+		for (int i = 0; i < batch_chunks; i++)
+			out.write(bufs[i].data(), bufs[i].size());
+	}
+}
+
+void CsvWriter::append_double(string &buf, double v)
+{
+	//the default ostream format is printf("%.6g")
+	char s[32];
+	int n = snprintf(s, sizeof(s), "%g", v);
+	buf.append(s, n);
+}
@@ -0,0 +1,62 @@
+#ifndef ENSEMBLE_CSV_H_
+#define ENSEMBLE_CSV_H_
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <functional>
+#include "mapped_file.h"
+
+//non-owning view of one line or one item of a memory-mapped csv file
+struct CsvField
+{
+	const char *ptr;
+	size_t len;
+	CsvField() : ptr(nullptr), len(0) { ; }
+	CsvField(const char *_ptr, size_t _len) : ptr(_ptr), len(_len) { ; }
+	std::string str() const { return std::string(ptr, len); }
+};
+
+//reads an ensemble csv file through a memory-mapped view.  the line index is built
+//in parallel chunks on open() and lines are handed out as views, so the callers can
+//parse different lines on different threads without copying them
+class CsvReader
+{
+public:
+	CsvReader(int _num_threads = 0);
+	//map the file and index its lines.  throws if the file can't be opened
+	void open(const std::string &filename);
+	void close();
+	int get_num_lines() const { return line_begin.size(); }
+	int get_num_threads() const { return num_threads; }
+	//line i with " \t\n\r" stripped from both ends - the same text as getline() followed by strip_ip()
+	CsvField get_line(int i) const;
+	//split line i on ',' keeping empty items - the same items as tokenize(line, tokens, ",", false)
+	void split_line(int i, std::vector<CsvField> &fields) const;
+	//stod()-compatible: leading whitespace is skipped and trailing characters are ignored.
+	//returns false where stod() would throw
+	static bool parse_double(const CsvField &f, double &value);
+	//convert_cp<double>()-compatible: after leading whitespace, the whole item must be a
+	//decimal number.  returns false where convert_cp() would throw
+	static bool parse_double_strict(const CsvField &f, double &value);
+private:
+	int num_threads;
+	MappedFile mf;
+	std::vector<size_t> line_begin;
+	std::vector<size_t> line_end;
+};
+
+//writes an ensemble csv file.  lines are formatted into per-chunk buffers on any number
+//of threads and the buffers are written out in order, a batch at a time
+class CsvWriter
+{
+public:
+	//format_line(thread_id, line, buffer) appends line (with its newline) to buffer.
+	//est_line_bytes sizes the batches so only a bounded amount of output is held in memory
+	static void write_lines(std::ostream &out, int num_lines, int num_threads, size_t est_line_bytes,
+		const std::function<void(int, int, std::string&)> &format_line);
+	//append v exactly as an ostream with the default format flags and precision prints it
+	static void append_double(std::string &buf, double v);
+};
+
+#endif //ENSEMBLE_CSV_H_
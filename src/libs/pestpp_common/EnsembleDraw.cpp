@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <unordered_map>
+#include <Eigen/Cholesky>
+#include <Eigen/Eigenvalues>
+#include <Eigen/QR>
+#include "EnsembleDraw.h"
+#include "WorkQueue.h"
+
+using namespace std;
+
+namespace
+{
+	const uint32_t PHILOX_M0 = 0xD2511F53;
+	const uint32_t PHILOX_M1 = 0xCD9E8D57;
+	const uint32_t PHILOX_W0 = 0x9E3779B9;
+	const uint32_t PHILOX_W1 = 0xBB67AE85;
+	const double TWO_PI = 6.283185307179586476925286766559;
+	const double TWO_M53 = 1.0 / 9007199254740992.0;
+
+	//counter streams: the standard normal draws, then one stream per group for the low rank draws
+	const uint32_t DRAW_STREAM = 0;
+	const uint32_t LOW_RANK_STREAM = 1;
+	//fixed key for the randomized eigen test matrix, so a low rank factor only depends on its block
+	const uint64_t FACTOR_KEY = 0x5DEECE66DULL;
+	const int LOW_RANK_OVERSAMPLE = 10;
+	const int LOW_RANK_POWER_ITERS = 2;
+
+	//rows transformed per batch, column pairs per work item when filling, the most rows per
+	//work item when applying a factor and columns per work item when scaling
+	const int FILL_BATCH = 256;
+	const int FILL_PAIRS_PER_ITEM = 8;
+	const int APPLY_ROW_CHUNK = 128;
+	const int SCALE_COLS_PER_ITEM = 128;
+	//keep the gathered block of an apply work item under this many values
+	const int APPLY_MAX_VALUES = 1 << 22;
+
+	//fill rows [row0, row0 + num_rows) of a pair of columns (col1 can be null) from the counters of pair.
+	//the uniforms for a batch of rows are made first and then transformed, so the transform runs over arrays
+	void fill_pair(const CounterRng &rng, double *col0, double *col1, int row0, int num_rows, uint32_t pair, uint32_t stream)
+	{
+		double u1[FILL_BATCH], u2[FILL_BATCH];
+		uint32_t w[4];
+		for (int b0 = 0; b0 < num_rows; b0 += FILL_BATCH)
+		{
+			int nb = min(FILL_BATCH, num_rows - b0);
+			for (int i = 0; i < nb; i++)
+			{
+				rng.block(row0 + b0 + i, pair, stream, 0, w);
+				//53 bit uniforms, u1 in (0, 1) so the log is finite
+				u1[i] = ((double)((((uint64_t)w[0] << 32) | w[1]) >> 11) + 0.5) * TWO_M53;
+				u2[i] = (double)((((uint64_t)w[2] << 32) | w[3]) >> 11) * TWO_M53;
+			}
+			for (int i = 0; i < nb; i++)
+				u1[i] = sqrt(-2.0 * log(u1[i]));
+			double *c0 = col0 + b0;
+			if (col1 == nullptr)
+			{
+				for (int i = 0; i < nb; i++)
+					c0[i] = u1[i] * cos(TWO_PI * u2[i]);
+			}
+			else
+			{
+				double *c1 = col1 + b0;
+				for (int i = 0; i < nb; i++)
+				{
+					double t = TWO_PI * u2[i];
+					c0[i] = u1[i] * cos(t);
+					c1[i] = u1[i] * sin(t);
+				}
+			}
+		}
+	}
+
+	void fill_normal(const CounterRng &rng, Eigen::MatrixXd &mat, int row0, uint32_t stream)
+	{
+		for (int j = 0; j < mat.cols(); j += 2)
+			fill_pair(rng, mat.col(j).data(), j + 1 < mat.cols() ? mat.col(j + 1).data() : nullptr,
+				row0, mat.rows(), j / 2, stream);
+	}
+
+	void hash_bytes(uint64_t &h, const void *data, size_t size)
+	{
+		const unsigned char *p = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			h ^= p[i];
+			h *= 1099511628211ULL;
+		}
+	}
+
+	//orthonormal basis for the columns of y
+	Eigen::MatrixXd orthonormalize(const Eigen::MatrixXd &y)
+	{
+		Eigen::HouseholderQR<Eigen::MatrixXd> qr(y);
+		return qr.householderQ() * Eigen::MatrixXd::Identity(y.rows(), y.cols());
+	}
+}
+
+CounterRng::CounterRng(uint64_t key) : k0((uint32_t)key), k1((uint32_t)(key >> 32))
+{
+}
+
+void CounterRng::block(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t out[4]) const
+{
+	uint32_t key0 = k0, key1 = k1;
+	for (int round = 0; round < 10; round++)
+	{
+		if (round > 0)
+		{
+			key0 += PHILOX_W0;
+			key1 += PHILOX_W1;
+		}
+		uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+		uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+		uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ key0;
+		uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ key1;
+		c1 = (uint32_t)p1;
+		c3 = (uint32_t)p0;
+		c0 = n0;
+		c2 = n2;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+struct EnsembleDraw::Factor
+{
+	enum class Method { CHOLESKY, EIGEN, LOW_RANK };
+	Method method;
+	//x = f * z for cholesky (lower triangular) and eigen, x = f * z_k + sd .* z for low rank
+	Eigen::MatrixXd f;
+	Eigen::VectorXd sd;
+	//size and names of the block this was factored from, so a hash match can be checked
+	int n;
+	const vector<string> *names;
+};
+
+EnsembleDraw::EnsembleDraw(uint64_t _key, int _num_threads, int _rank) : rng(_key), num_threads(_num_threads), rank(_rank)
+{
+}
+
+void EnsembleDraw::standard_normal(Eigen::MatrixXd &draws) const
+{
+	int num_rows = draws.rows(), num_cols = draws.cols();
+	int num_pairs = (num_cols + 1) / 2;
+	int num_items = (num_pairs + FILL_PAIRS_PER_ITEM - 1) / FILL_PAIRS_PER_ITEM;
+	WorkQueue::for_each(num_items, num_threads, 1, [&](int thread_id, int item)
+	{
+		int p1 = min(num_pairs, (item + 1) * FILL_PAIRS_PER_ITEM);
+		for (int p = item * FILL_PAIRS_PER_ITEM; p < p1; p++)
+		{
+			int j = 2 * p;
+			fill_pair(rng, draws.col(j).data(), j + 1 < num_cols ? draws.col(j + 1).data() : nullptr,
+				0, num_rows, p, DRAW_STREAM);
+		}
+	});
+}
+
+void EnsembleDraw::factor(const Eigen::SparseMatrix<double> &c, Factor &f) const
+{
+	int n = c.rows();
+	if ((rank > 0) && (n > rank))
+	{
+		//randomized eigen decomposition with a few power iterations for the leading rank
+		//eigen pairs, then a diagonal part that restores the variances the rank-k part misses
+		int l = min(n, rank + LOW_RANK_OVERSAMPLE);
+		Eigen::MatrixXd omega(n, l);
+		fill_normal(CounterRng(FACTOR_KEY), omega, 0, 0);
+		Eigen::MatrixXd q = orthonormalize(c * omega);
+		for (int i = 0; i < LOW_RANK_POWER_ITERS; i++)
+			q = orthonormalize(c * q);
+		Eigen::MatrixXd b = q.transpose() * (c * q);
+		Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(b);
+		//eigen values are in increasing order
+		f.method = Factor::Method::LOW_RANK;
+		f.f = q * es.eigenvectors().rightCols(rank) * es.eigenvalues().tail(rank).cwiseMax(0.0).cwiseSqrt().asDiagonal();
+		Eigen::VectorXd d = c.diagonal();
+		f.sd = (d - f.f.rowwise().squaredNorm()).cwiseMax(0.0).cwiseSqrt();
+		return;
+	}
+	Eigen::MatrixXd d(c);
+	Eigen::LLT<Eigen::MatrixXd> llt(d);
+	if (llt.info() == Eigen::Success)
+	{
+		f.method = Factor::Method::CHOLESKY;
+		f.f = llt.matrixL();
+		return;
+	}
+	//not positive definite - zero the negative eigen values
+	Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(d);
+	f.method = Factor::Method::EIGEN;
+	f.f = es.eigenvectors() * es.eigenvalues().cwiseMax(0.0).cwiseSqrt().asDiagonal();
+}
+
+void EnsembleDraw::apply_cov(Eigen::MatrixXd &draws, Covariance &cov, const vector<string> &draw_names,
+	const map<string, vector<string>> &grouper, PerformanceLog *plog) const
+{
+	int num_rows = draws.rows(), num_cols = draws.cols();
+	//the std of each column that is only scaled, -1 for the columns in a factored group
+	vector<double> col_scale(num_cols, -1.0);
+	stringstream ss;
+	if (cov.isdiagonal())
+	{
+		Eigen::VectorXd std = cov.e_ptr()->diagonal().cwiseSqrt();
+		for (int j = 0; j < num_cols; j++)
+			col_scale[j] = std(j);
+	}
+	else
+	{
+		struct Group
+		{
+			const vector<string> *names;
+			vector<int> cols;
+		};
+		vector<Group> groups;
+		if (grouper.size() == 0)
+		{
+			Group g;
+			g.names = &draw_names;
+			g.cols.resize(num_cols);
+			iota(g.cols.begin(), g.cols.end(), 0);
+			groups.push_back(g);
+		}
+		else
+		{
+			unordered_map<string, int> idx_map;
+			for (int j = 0; j < num_cols; j++)
+				idx_map[draw_names[j]] = j;
+			vector<bool> grouped(num_cols, false);
+			for (auto &gi : grouper)
+			{
+				if (gi.second.size() == 0)
+					continue;
+				Group g;
+				g.names = &gi.second;
+				for (auto &name : gi.second)
+				{
+					unordered_map<string, int>::iterator it = idx_map.find(name);
+					if (it == idx_map.end())
+						throw runtime_error("EnsembleDraw::apply_cov(): group " + gi.first + " var " + name + " not in draw names");
+					g.cols.push_back(it->second);
+					grouped[it->second] = true;
+				}
+				groups.push_back(g);
+			}
+			//anything not in a group is only scaled
+			const Eigen::SparseMatrix<double> *c = cov.e_ptr();
+			for (int j = 0; j < num_cols; j++)
+				if (!grouped[j])
+					col_scale[j] = sqrt(c->coeff(j, j));
+		}
+
+		//factor the groups, largest first
+		vector<int> order(groups.size());
+		iota(order.begin(), order.end(), 0);
+		stable_sort(order.begin(), order.end(), [&](int a, int b) { return groups[a].cols.size() > groups[b].cols.size(); });
+		vector<shared_ptr<const Factor>> factors(groups.size());
+		vector<int> cached(groups.size(), 0);
+		//factors by a hash of their block.  the cache only lives for this call, so nothing is
+		//held on to once the draw returns
+		mutex cache_lock;
+		unordered_multimap<uint64_t, shared_ptr<const Factor>> factor_cache;
+		const Eigen::SparseMatrix<double> *full_ptr = cov.e_ptr();
+		//index the names once so the threads can call cov.get() without checking them
+		if (grouper.size() > 0)
+			cov.update_sets();
+		plog->log_event("factoring cov blocks");
+		WorkQueue::for_each(order.size(), num_threads, 1, [&](int thread_id, int item)
+		{
+			int ig = order[item];
+			const Group &g = groups[ig];
+			Covariance gcov;
+			const Eigen::SparseMatrix<double> *c = full_ptr;
+			if (grouper.size() > 0)
+			{
+				gcov = cov.get(*g.names, false);
+				c = gcov.e_ptr();
+			}
+			int n = g.cols.size();
+			bool is_diag = true;
+			for (int k = 0; (k < c->outerSize()) && (is_diag); k++)
+				for (Eigen::SparseMatrix<double>::InnerIterator it(*c, k); it; ++it)
+					if ((it.row() != it.col()) && (it.value() != 0.0))
+					{
+						is_diag = false;
+						break;
+					}
+			if (is_diag)
+			{
+				for (int jj = 0; jj < n; jj++)
+					col_scale[g.cols[jj]] = sqrt(c->coeff(jj, jj));
+				return;
+			}
+
+			uint64_t h = 14695981039346656037ULL;
+			hash_bytes(h, &rank, sizeof(rank));
+			hash_bytes(h, &n, sizeof(n));
+			for (auto &name : *g.names)
+				hash_bytes(h, name.c_str(), name.size() + 1);
+			for (int k = 0; k < c->outerSize(); k++)
+				for (Eigen::SparseMatrix<double>::InnerIterator it(*c, k); it; ++it)
+				{
+					int idx[2] = { (int)it.row(), (int)it.col() };
+					double v = it.value();
+					hash_bytes(h, idx, sizeof(idx));
+					hash_bytes(h, &v, sizeof(v));
+				}
+			{
+				lock_guard<mutex> lg(cache_lock);
+				auto range = factor_cache.equal_range(h);
+				for (auto it = range.first; it != range.second; ++it)
+				{
+					//don't trust the hash alone
+					if ((it->second->n != n) || (*it->second->names != *g.names))
+						continue;
+					factors[ig] = it->second;
+					cached[ig] = 1;
+					return;
+				}
+			}
+			shared_ptr<Factor> f = make_shared<Factor>();
+			factor(*c, *f);
+			f->n = n;
+			f->names = g.names;
+			factors[ig] = f;
+			lock_guard<mutex> lg(cache_lock);
+			factor_cache.insert(make_pair(h, f));
+		});
+		int counts[3] = { 0, 0, 0 };
+		for (auto &f : factors)
+			if (f)
+				counts[(int)f->method]++;
+		ss << "cov blocks: " << groups.size() << ", cholesky: " << counts[0] << ", eigen: " << counts[1]
+			<< ", low rank: " << counts[2] << ", from cache: " << accumulate(cached.begin(), cached.end(), 0);
+		plog->log_event(ss.str());
+
+		//apply the factors: each work item is a run of rows of one group
+		vector<pair<int, int>> items;
+		vector<int> chunk_rows(groups.size(), 0);
+		for (int ig = 0; ig < groups.size(); ig++)
+		{
+			if (!factors[ig])
+				continue;
+			chunk_rows[ig] = max(1, min(APPLY_ROW_CHUNK, APPLY_MAX_VALUES / (int)groups[ig].cols.size()));
+			for (int i0 = 0; i0 < num_rows; i0 += chunk_rows[ig])
+				items.push_back(pair<int, int>(ig, i0));
+		}
+		plog->log_event("applying cov block factors");
+		if (num_threads > 0)
+			Eigen::setNbThreads(1);
+		WorkQueue::for_each(items.size(), num_threads, 1, [&](int thread_id, int item)
+		{
+			int ig = items[item].first, i0 = items[item].second;
+			const Group &g = groups[ig];
+			const Factor &f = *factors[ig];
+			int r = min(chunk_rows[ig], num_rows - i0), n = g.cols.size();
+			Eigen::MatrixXd b(r, n);
+			for (int jj = 0; jj < n; jj++)
+				memcpy(b.col(jj).data(), draws.col(g.cols[jj]).data() + i0, r * sizeof(double));
+			Eigen::MatrixXd x;
+			if (f.method == Factor::Method::CHOLESKY)
+				x.noalias() = b * f.f.triangularView<Eigen::Lower>().transpose();
+			else if (f.method == Factor::Method::EIGEN)
+				x.noalias() = b * f.f.transpose();
+			else
+			{
+				Eigen::MatrixXd zk(r, f.f.cols());
+				fill_normal(rng, zk, i0, LOW_RANK_STREAM + ig);
+				x.noalias() = zk * f.f.transpose();
+				x += b * f.sd.asDiagonal();
+			}
+			for (int jj = 0; jj < n; jj++)
+				memcpy(draws.col(g.cols[jj]).data() + i0, x.col(jj).data(), r * sizeof(double));
+		});
+	}
+
+	plog->log_event("scaling by std");
+	int num_items = (num_cols + SCALE_COLS_PER_ITEM - 1) / SCALE_COLS_PER_ITEM;
+	WorkQueue::for_each(num_items, num_threads, 1, [&](int thread_id, int item)
+	{
+		int j1 = min(num_cols, (item + 1) * SCALE_COLS_PER_ITEM);
+		for (int j = item * SCALE_COLS_PER_ITEM; j < j1; j++)
+			if (col_scale[j] >= 0.0)
+				draws.col(j) *= col_scale[j];
+	});
+}
@@ -0,0 +1,53 @@
+#ifndef ENSEMBLE_DRAW_H_
+#define ENSEMBLE_DRAW_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "covariance.h"
+#include "PerformanceLog.h"
+
+//philox4x32-10 counter-based generator.  each 128 bit counter is mapped to four random
+//32 bit words through a keyed bijection, so a value depends only on the key and its counter
+//and not on the order (or the thread) it was made in
+class CounterRng
+{
+public:
+	CounterRng(uint64_t key = 0);
+	void block(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t out[4]) const;
+private:
+	uint32_t k0;
+	uint32_t k1;
+};
+
+//draws multivariate normal realizations in parallel:
+//  - the standard normal draw for realization i and var j is fixed by the key and (i, j): vars
+//    are taken in pairs and each pair shares one counter through the Box-Muller transform, so
+//    any number of threads gives the same ensemble
+//  - a non-diagonal cov is applied one group (block) at a time.  each block is factored by
+//    Cholesky, falling back to an eigen decomposition (negative eigen values zeroed) if it is
+//    not positive definite.  with rank > 0, blocks with more than rank vars are approximated
+//    as a rank-k part from a randomized eigen decomposition plus a diagonal part that keeps the
+//    block variances.  within one apply_cov(), blocks with the same names and contents are
+//    factored once
+class EnsembleDraw
+{
+public:
+	EnsembleDraw(uint64_t _key, int _num_threads, int _rank = 0);
+	//fill draws with standard normal values
+	void standard_normal(Eigen::MatrixXd &draws) const;
+	//correlate the standard normal draws.  cov must be aligned with draw_names.  each group in
+	//grouper is a block of cov - an empty grouper means one block holding every var
+	void apply_cov(Eigen::MatrixXd &draws, Covariance &cov, const std::vector<std::string> &draw_names,
+		const std::map<std::string, std::vector<std::string>> &grouper, PerformanceLog *plog) const;
+private:
+	struct Factor;
+	CounterRng rng;
+	int num_threads;
+	int rank;
+	void factor(const Eigen::SparseMatrix<double> &c, Factor &f) const;
+};
+
+#endif //ENSEMBLE_DRAW_H_
@@ -1,5 +1,7 @@
 #include <random>
 #include <map>
+#include <set>
+#include <algorithm>
 #include <iomanip>
 #include <mutex>
 #include <thread>
@@ -13,6 +15,9 @@
 #include "RedSVD-h.h"
 #include "SVDPackage.h"
 #include "eigen_tools.h"
+#include "WorkQueue.h"
+
+const int L2PhiHandler::PHI_TILE_SIZE;
 
 
 L2PhiHandler::L2PhiHandler(Pest *_pest_scenario, FileManager *_file_manager,
@@ -136,113 +141,269 @@ Eigen::VectorXd L2PhiHandler::get_q_vector()
 	return q;
 }
 
-map<string, double> L2PhiHandler::get_obs_group_contrib(Eigen::VectorXd &phi_vec)
+void L2PhiHandler::set_layout_segments(PhiLayout &layout, const vector<string> &var_groups)
 {
-	map<string, double> group_phi_map;
-	double sum;
-	for (auto &og : obs_group_idx_map)
+	//counting sort of the columns by group
+	unordered_map<string, int> group_idxs;
+	for (int k = 0; k < layout.groups.size(); k++)
+		group_idxs[layout.groups[k]] = k;
+	vector<int> var_segs(var_groups.size());
+	for (int j = 0; j < var_groups.size(); j++)
 	{
-		sum = 0.0;
-		for (auto i : og.second)
-			sum += phi_vec[i];
-		group_phi_map[og.first] = sum;
+		unordered_map<string, int>::iterator it = group_idxs.find(var_groups[j]);
+		if (it == group_idxs.end())
+		{
+			it = group_idxs.insert(pair<string, int>(var_groups[j], layout.groups.size())).first;
+			layout.groups.push_back(var_groups[j]);
+		}
+		var_segs[j] = it->second;
+	}
+	int num_segs = layout.groups.size();
+	layout.seg_starts.assign(num_segs + 1, 0);
+	for (auto k : var_segs)
+		layout.seg_starts[k + 1]++;
+	for (int k = 0; k < num_segs; k++)
+		layout.seg_starts[k + 1] += layout.seg_starts[k];
+	layout.seg_cols.resize(var_segs.size());
+	vector<int> next = layout.seg_starts;
+	for (int j = 0; j < var_segs.size(); j++)
+		layout.seg_cols[next[var_segs[j]]++] = j;
+
+	layout.tile_starts.clear();
+	layout.tile_segs.clear();
+	for (int k = 0; k < num_segs; k++)
+	{
+		for (int t = layout.seg_starts[k]; t < layout.seg_starts[k + 1]; t += PHI_TILE_SIZE)
+		{
+			layout.tile_starts.push_back(t);
+			layout.tile_segs.push_back(k);
+		}
 	}
+	layout.tile_starts.push_back(layout.seg_cols.size());
+	layout.en_var_names.clear();
+	layout.en_cols.clear();
+}
 
-	return group_phi_map;
+void L2PhiHandler::update_obs_layout()
+{
+	vector<string> names = oe_base->get_var_names();
+	if ((names == obs_layout.var_names) && (obs_layout.seg_starts.size() > 0))
+		return;
+	const ObservationInfo* oi = pest_scenario->get_ctl_observation_info_ptr();
+	const Observations &obs = pest_scenario->get_ctl_observations();
+	set<string> lt(lt_obs_names.begin(), lt_obs_names.end()), gt(gt_obs_names.begin(), gt_obs_names.end());
+	obs_weights.resize(names.size());
+	obs_vals.resize(names.size());
+	obs_ineq.assign(names.size(), 0);
+	vector<string> var_groups;
+	for (int j = 0; j < names.size(); j++)
+	{
+		obs_weights[j] = oi->get_weight(names[j]);
+		obs_vals[j] = obs.get_rec(names[j]);
+		if (lt.find(names[j]) != lt.end())
+			obs_ineq[j] = -1;
+		else if (gt.find(names[j]) != gt.end())
+			obs_ineq[j] = 1;
+		var_groups.push_back(oi->get_group(names[j]));
+	}
+	obs_layout.var_names = names;
+	obs_layout.groups = pest_scenario->get_ctl_ordered_obs_group_names();
+	set_layout_segments(obs_layout, var_groups);
 }
 
-map<string, double> L2PhiHandler::get_par_group_contrib(Eigen::VectorXd &phi_vec)
+void L2PhiHandler::update_par_layout()
 {
-	map<string, double> group_phi_map;
-	double sum;
-	for (auto &pg : par_group_idx_map)
+	vector<string> names = pe_base->get_var_names();
+	if ((names == par_layout.var_names) && (par_layout.seg_starts.size() > 0))
+		return;
+	const ParameterInfo &pi = pest_scenario->get_ctl_parameter_info();
+	vector<string> var_groups;
+	for (auto &name : names)
+		var_groups.push_back(pi.get_parameter_rec_ptr(name)->group);
+	par_layout.var_names = names;
+	par_layout.groups = pest_scenario->get_ctl_ordered_par_group_names();
+	set_layout_segments(par_layout, var_groups);
+}
+
+const vector<int> &L2PhiHandler::get_en_cols(Ensemble &en, PhiLayout &layout)
+{
+	vector<string> en_names = en.get_var_names();
+	if ((en_names == layout.en_var_names) && (layout.en_cols.size() == layout.var_names.size()))
+		return layout.en_cols;
+	unordered_map<string, int> en_idxs;
+	for (int i = 0; i < en_names.size(); i++)
+		en_idxs[en_names[i]] = i;
+	vector<int> cols;
+	vector<string> missing;
+	for (auto &name : layout.var_names)
 	{
-		sum = 0.0;
-		for (auto i : pg.second)
-			sum += phi_vec[i];
-		group_phi_map[pg.first] = sum;
+		unordered_map<string, int>::iterator it = en_idxs.find(name);
+		if (it == en_idxs.end())
+			missing.push_back(name);
+		else
+			cols.push_back(it->second);
 	}
-	return group_phi_map;
+	if (missing.size() > 0)
+		en.throw_ensemble_error("L2PhiHandler error: the following vars were not found:", missing);
+	layout.en_cols = cols;
+	layout.en_var_names = en_names;
+	return layout.en_cols;
 }
 
-void L2PhiHandler::update(ObservationEnsemble & oe, ParameterEnsemble & pe)
+vector<int> L2PhiHandler::get_base_rows(Ensemble &en, Ensemble *base)
 {
-	//build up obs group and par group idx maps for group reporting
-	obs_group_idx_map.clear();
-	vector<string> nnz_obs = oe_base->get_var_names();
-	ObservationInfo oinfo = pest_scenario->get_ctl_observation_info();
-	vector<int> idx;
+	vector<string> base_names = base->get_real_names();
+	unordered_map<string, int> base_idxs;
+	for (int i = 0; i < base_names.size(); i++)
+		base_idxs[base_names[i]] = i;
+	vector<int> rows;
+	vector<string> missing;
+	for (auto &name : en.get_real_names())
+	{
+		unordered_map<string, int>::iterator it = base_idxs.find(name);
+		if (it == base_idxs.end())
+			missing.push_back(name);
+		else
+			rows.push_back(it->second);
+	}
+	if (missing.size() > 0)
+		base->throw_ensemble_error("L2PhiHandler error: the following realization names were not found:", missing);
+	return rows;
+}
 
-	/*for (auto& og : pest_scenario->get_ctl_ordered_obs_group_names())
+void L2PhiHandler::calc_obs_phi(ObservationEnsemble &oe, Eigen::VectorXd &meas_vec, Eigen::VectorXd *actual_vec,
+	Eigen::MatrixXd *group_mat)
+{
+	update_obs_layout();
+	int num_reals = oe.shape().first;
+	int num_segs = obs_layout.groups.size();
+	int num_tiles = obs_layout.tile_segs.size();
+	meas_vec = Eigen::VectorXd::Zero(num_reals);
+	if (actual_vec)
+		*actual_vec = Eigen::VectorXd::Zero(num_reals);
+	if (group_mat)
+		*group_mat = Eigen::MatrixXd::Zero(num_reals, num_segs);
+	if (num_tiles == 0)
+		return;
+	const vector<int> &cols = get_en_cols(oe, obs_layout);
+	vector<int> base_rows = get_base_rows(oe, oe_base);
+	const Eigen::MatrixXd &vals = *oe.get_eigen_ptr(), &base_vals = *oe_base->get_eigen_ptr();
+
+	//each tile sums into its own column so the result doesn't depend on the thread count
+	bool do_actual = (actual_vec != nullptr) || (group_mat != nullptr);
+	Eigen::MatrixXd tile_meas(num_reals, num_tiles), tile_actual;
+	if (do_actual)
+		tile_actual.resize(num_reals, num_tiles);
+	WorkQueue::for_each(num_tiles, pest_scenario->get_pestpp_options().get_ies_num_threads(), 1, [&](int thread_id, int itile)
 	{
-		idx.clear();
-		for (int i = 0; i < nnz_obs.size(); i++)
+		double *m = tile_meas.col(itile).data();
+		double *a = do_actual ? tile_actual.col(itile).data() : nullptr;
+		for (int i = 0; i < num_reals; i++)
+			m[i] = 0.0;
+		if (do_actual)
+			for (int i = 0; i < num_reals; i++)
+				a[i] = 0.0;
+		for (int k = obs_layout.tile_starts[itile]; k < obs_layout.tile_starts[itile + 1]; k++)
 		{
-			if (oinfo.get_group(nnz_obs[i]) == og)
+			int j = obs_layout.seg_cols[k];
+			const double *v = vals.col(cols[j]).data(), *b = base_vals.col(j).data();
+			double w = obs_weights[j], ov = obs_vals[j], r;
+			int ineq = obs_ineq[j];
+			for (int i = 0; i < num_reals; i++)
 			{
-				idx.push_back(i);
+				r = v[i] - b[base_rows[i]];
+				if (((ineq < 0) && (r < 0.0)) || ((ineq > 0) && (r > 0.0)))
+					r = 0.0;
+				r *= w;
+				m[i] += r * r;
+			}
+			if (!do_actual)
+				continue;
+			for (int i = 0; i < num_reals; i++)
+			{
+				r = v[i] - ov;
+				if (((ineq < 0) && (r < 0.0)) || ((ineq > 0) && (r > 0.0)))
+					r = 0.0;
+				r *= w;
+				a[i] += r * r;
 			}
 		}
-		if (idx.size() > 0)
-			obs_group_idx_map[og] = idx;
-	}*/
-	for (auto& og : pest_scenario->get_ctl_ordered_obs_group_names())
-		obs_group_idx_map[og] = vector<int>();
+	});
+	meas_vec = tile_meas.rowwise().sum();
+	if (actual_vec)
+		*actual_vec = tile_actual.rowwise().sum();
+	if (group_mat)
+		for (int t = 0; t < num_tiles; t++)
+			group_mat->col(obs_layout.tile_segs[t]) += tile_actual.col(t);
+}
+
+void L2PhiHandler::calc_par_phi(ParameterEnsemble &pe, Eigen::VectorXd &regul_vec, Eigen::MatrixXd &group_mat)
+{
+	pe_base->transform_ip(ParameterEnsemble::transStatus::NUM);
+	pe.transform_ip(ParameterEnsemble::transStatus::NUM);
+	update_par_layout();
+	int num_reals = pe.shape().first;
+	int num_tiles = par_layout.tile_segs.size();
+	regul_vec = Eigen::VectorXd::Zero(num_reals);
+	group_mat = Eigen::MatrixXd::Zero(num_reals, par_layout.groups.size());
+	if (num_tiles == 0)
+		return;
+	const vector<int> &cols = get_en_cols(pe, par_layout);
+	vector<int> base_rows = get_base_rows(pe, pe_base);
+	const Eigen::MatrixXd &vals = *pe.get_eigen_ptr(), &base_vals = *pe_base->get_eigen_ptr();
 
-	for (int i = 0; i < nnz_obs.size(); i++)
+	Eigen::MatrixXd tile_regul(num_reals, num_tiles);
+	WorkQueue::for_each(num_tiles, pest_scenario->get_pestpp_options().get_ies_num_threads(), 1, [&](int thread_id, int itile)
 	{
-		obs_group_idx_map[oinfo.get_group(nnz_obs[i])].push_back(i);
-	}
-	
-	
+		double *g = tile_regul.col(itile).data();
+		for (int i = 0; i < num_reals; i++)
+			g[i] = 0.0;
+		for (int k = par_layout.tile_starts[itile]; k < par_layout.tile_starts[itile + 1]; k++)
+		{
+			int j = par_layout.seg_cols[k];
+			const double *v = vals.col(cols[j]).data(), *b = base_vals.col(j).data();
+			double inv_var = parcov_inv_diag[j], r;
+			for (int i = 0; i < num_reals; i++)
+			{
+				r = v[i] - b[base_rows[i]];
+				g[i] += r * r * inv_var;
+			}
+		}
+	});
+	regul_vec = tile_regul.rowwise().sum();
+	for (int t = 0; t < num_tiles; t++)
+		group_mat.col(par_layout.tile_segs[t]) += tile_regul.col(t);
+}
+
+void L2PhiHandler::update(ObservationEnsemble & oe, ParameterEnsemble & pe)
+{
 	//update the various phi component vectors
+	vector<string> oe_real_names = oe.get_real_names();
+	Eigen::VectorXd meas_vec, actual_vec;
+	calc_obs_phi(oe, meas_vec, &actual_vec, &obs_group_phi);
 	meas.clear();
-	obs_group_phi_map.clear();
-	Eigen::VectorXd q = get_q_vector();
-	map<string, Eigen::VectorXd> meas_map = calc_meas(oe, q);
-	for (auto &pv : meas_map)
+	actual.clear();
+	for (int i = 0; i < oe_real_names.size(); i++)
 	{
-		meas[pv.first] = pv.second.sum();
-
+		meas[oe_real_names[i]] = meas_vec[i];
+		actual[oe_real_names[i]] = actual_vec[i];
 	}
+	group_oreal_names = oe_real_names;
+
 	if (org_reg_factor != 0.0)
 	{
-		par_group_idx_map.clear();
-		vector<string> pars = pe_base->get_var_names();
-		ParameterInfo pi = pest_scenario->get_ctl_parameter_info();
-		for (auto& pg : pest_scenario->get_ctl_ordered_par_group_names())
-		{
-			idx.clear();
-			for (int i = 0; i < pars.size(); i++)
-			{
-				if (pi.get_parameter_rec_ptr(pars[i])->group == pg)
-					idx.push_back(i);
-			}
-			if (idx.size() > 0)
-				par_group_idx_map[pg] = idx;
-		}
+		Eigen::VectorXd regul_vec;
+		calc_par_phi(pe, regul_vec, par_group_phi);
 		regul.clear();
-		map<string, Eigen::VectorXd> reg_map = calc_regul(pe);//, *reg_factor);
-		//for (auto &pv : calc_regul(pe))
-		string name;
 		//big assumption - if oe is a diff shape, then this
 		//must be a subset, so just use the first X rows of pe
-		for (int i = 0; i < oe.shape().first; i++)
-		{
-			//name = preal_names[i];
-			name = pe.get_real_names()[i];
-			//cout << name << endl;
-			regul[name] = reg_map[name].sum();
-			par_group_phi_map[name] = get_par_group_contrib(reg_map[name]);
-		}
+		vector<string> pe_real_names = pe.get_real_names();
+		int num_reals = min(oe.shape().first, pe.shape().first);
+		for (int i = 0; i < num_reals; i++)
+			regul[pe_real_names[i]] = regul_vec[i];
+		group_preal_names.assign(pe_real_names.begin(), pe_real_names.begin() + num_reals);
 	}
 	
-	actual.clear();
-	for (auto &pv : calc_actual(oe, q))
-	{
-		actual[pv.first] = pv.second.sum();
-		obs_group_phi_map[pv.first] = get_obs_group_contrib(pv.second);
-	}
  	composite.clear();
 	composite = calc_composite(meas, regul);
 }
@@ -609,30 +770,50 @@ void L2PhiHandler::prepare_csv(ofstream & csv,vector<string> &names)
 void L2PhiHandler::write_group_csv(int iter_num, int total_runs, ofstream &csv, vector<double> extra)
 {
 	//csv << "iteration,total_runs,realiation";
+	unordered_map<string, int> orows, prows;
+	for (int i = 0; i < group_oreal_names.size(); i++)
+		orows[group_oreal_names[i]] = i;
+	for (int i = 0; i < group_preal_names.size(); i++)
+		prows[group_preal_names[i]] = i;
+	//group phi column of each group, in control file order (-1 if the group has no vars)
+	vector<int> ogroup_cols, pgroup_cols;
+	for (auto &name : pest_scenario->get_ctl_ordered_obs_group_names())
+	{
+		vector<string>::iterator it = find(obs_layout.groups.begin(), obs_layout.groups.end(), name);
+		ogroup_cols.push_back((it == obs_layout.groups.end()) ? -1 : it - obs_layout.groups.begin());
+	}
+	for (auto &name : pest_scenario->get_ctl_ordered_par_group_names())
+	{
+		vector<string>::iterator it = find(par_layout.groups.begin(), par_layout.groups.end(), name);
+		pgroup_cols.push_back((it == par_layout.groups.end()) ? -1 : it - par_layout.groups.begin());
+	}
 	string oreal, preal;
+	unordered_map<string, int>::iterator oit, pit;
 	for (int ireal = 0; ireal < oreal_names.size(); ireal++)
 	{
 		oreal = oreal_names[ireal];
 		preal = preal_names[ireal];
-		if (obs_group_phi_map.find(oreal) == obs_group_phi_map.end())
+		oit = orows.find(oreal);
+		if (oit == orows.end())
 			continue;
 
 		csv << iter_num << ',' << total_runs << ',' << pest_utils::lower_cp(oreal) << ',' << pest_utils::lower_cp(preal);
 		for (auto &e : extra)
 			csv << ',' << e;
 
-		for (auto &name : pest_scenario->get_ctl_ordered_obs_group_names())
-			if (obs_group_phi_map[oreal].find(name) == obs_group_phi_map[oreal].end())
+		for (auto c : ogroup_cols)
+			if ((c < 0) || (c >= obs_group_phi.cols()))
 				csv << ',' << 0.0;
 			else
-				csv  << ',' << obs_group_phi_map[oreal][name];
+				csv << ',' << obs_group_phi(oit->second, c);
 		if (org_reg_factor != 0.0)
 		{
-			for (auto& name : pest_scenario->get_ctl_ordered_par_group_names())
-				if (par_group_phi_map[preal].find(name) == par_group_phi_map[preal].end())
+			pit = prows.find(preal);
+			for (auto c : pgroup_cols)
+				if ((pit == prows.end()) || (c < 0) || (c >= par_group_phi.cols()))
 					csv << ',' << 0.0;
 				else
-					csv << ',' << par_group_phi_map[preal][name];
+					csv << ',' << par_group_phi(pit->second, c);
 		}
 		csv << endl;;
 		csv.flush();
@@ -656,18 +837,19 @@ void L2PhiHandler::prepare_group_csv(ofstream &csv, vector<string> extra)
 
 vector<int> L2PhiHandler::get_idxs_greater_than(double bad_phi, double bad_phi_sigma, ObservationEnsemble &oe)
 {
+	Eigen::VectorXd meas_vec;
+	calc_obs_phi(oe, meas_vec);
 	map<string, double> _meas;
-	Eigen::VectorXd q = get_q_vector();
-	for (auto &pv : calc_meas(oe, q))
-		_meas[pv.first] = pv.second.sum();
+	vector<string> names = oe.get_real_names();
+	for (int i = 0; i < names.size(); i++)
+		_meas[names[i]] = meas_vec[i];
 	double mean = calc_mean(&_meas);
 	double std = calc_std(&_meas);
 	vector<int> idxs;
-	vector<string> names = oe.get_real_names();
 	for (int i = 0; i < names.size(); i++)
 	{
 		
-		if ((_meas[names[i]] > bad_phi) || (_meas[names[i]] > mean + (std * bad_phi_sigma)))
+		if ((meas_vec[i] > bad_phi) || (meas_vec[i] > mean + (std * bad_phi_sigma)))
 		{
 			if (names[i] == BASE_REAL_NAME)
 				cout << "...not dropping 'base' real even though phi is 'bad'" << endl;
@@ -678,76 +860,6 @@ vector<int> L2PhiHandler::get_idxs_greater_than(double bad_phi, double bad_phi_s
 	return idxs;
 }
 
-map<string, Eigen::VectorXd> L2PhiHandler::calc_meas(ObservationEnsemble & oe, Eigen::VectorXd &q_vec)
-{
-	map<string, Eigen::VectorXd> phi_map;
-	Eigen::VectorXd oe_base_vec, oe_vec, diff, w_vec;
-	//Eigen::VectorXd q = get_q_vector();
-	vector<string> act_obs_names = pest_scenario->get_ctl_ordered_nz_obs_names();
-	vector<string> base_real_names = oe_base->get_real_names(), oe_real_names = oe.get_real_names();
-	vector<string>::iterator start = base_real_names.begin(), end = base_real_names.end();
-
-	
-	double phi;
-	string rname;
-
-	if (act_obs_names.size() == 0)
-	{
-		for (auto name : oe.get_real_names())
-			phi_map[name] = Eigen::VectorXd();
-		return phi_map;
-	}
-
-	Eigen::MatrixXd resid = get_obs_resid(oe);
-	ObservationInfo oi = pest_scenario->get_ctl_observation_info();
-	vector<string> names = oe_base->get_var_names();
-	w_vec.resize(names.size());
-	for (int i=0;i<names.size();i++)
-	{
-		w_vec(i) = oi.get_weight(names[i]);
-	}
-	
-	assert(oe_real_names.size() == resid.rows());
-	for (int i = 0; i<resid.rows(); i++)
-	{
-		rname = oe_real_names[i];
-		if (find(start, end, rname) == end)
-			continue;
-		diff = resid.row(i);
-		
-		diff = diff.cwiseProduct(w_vec);
-		
-		phi = (diff.cwiseProduct(diff)).sum();
-		phi_map[rname] = diff.cwiseProduct(diff);
-	}
-	return phi_map;
-}
-
-map<string, Eigen::VectorXd> L2PhiHandler::calc_regul(ParameterEnsemble & pe)
-{
-	map<string, Eigen::VectorXd> phi_map;
-	vector<string> real_names = pe.get_real_names();
-	pe_base->transform_ip(ParameterEnsemble::transStatus::NUM);
-	pe.transform_ip(ParameterEnsemble::transStatus::NUM);
-	Eigen::MatrixXd diff_mat = get_par_resid(pe);
-
-
-	Eigen::VectorXd diff;
-	for (int i = 0; i < real_names.size(); i++)
-	{
-		diff = diff_mat.row(i);
-		diff = diff.cwiseProduct(diff);
-		//cout << diff << endl;
-		diff = diff.cwiseProduct(parcov_inv_diag);
-		//cout << diff << endl;
-		//cout << parcov_inv_diag << endl;
-		//phi_map[real_names[i]] = _reg_fac * diff;
-		phi_map[real_names[i]] = diff;
-		
-	}
-	return phi_map;
-}
-
 
 void L2PhiHandler::apply_ineq_constraints(Eigen::MatrixXd &resid, vector<string> &names)
 {
@@ -800,32 +912,6 @@ void L2PhiHandler::apply_ineq_constraints(Eigen::MatrixXd &resid, vector<string>
 }
 
 
-map<string, Eigen::VectorXd> L2PhiHandler::calc_actual(ObservationEnsemble & oe, Eigen::VectorXd &q_vec)
-{
-	map<string, Eigen::VectorXd> phi_map;
-	Eigen::MatrixXd resid = get_actual_obs_resid(oe);
-	vector<string> base_real_names = oe_base->get_real_names(), oe_real_names = oe.get_real_names();
-	vector<string>::iterator start = base_real_names.begin(), end = base_real_names.end();
-	double phi;
-	string rname;
-
-	Eigen::MatrixXd oe_reals = oe.get_eigen(vector<string>(), oe_base->get_var_names());
-	Eigen::VectorXd diff;
-	for (int i = 0; i<oe.shape().first; i++)
-	{
-		rname = oe_real_names[i];
-		if (find(start, end, rname) == end)
-			continue;
-		//diff = (oe_vec - obs_val_vec).cwiseProduct(q);
-		diff = resid.row(i);
-		diff = diff.cwiseProduct(q_vec);
-		//phi = (diff.cwiseProduct(diff)).sum();
-		phi_map[rname] = diff.cwiseProduct(diff);
-	}
-	return phi_map;
-}
-
-
 map<string, double> L2PhiHandler::calc_composite(map<string, double> &_meas, map<string, double> &_regul)
 {
 	map<string, double> phi_map;
@@ -2,6 +2,7 @@
 #define ENSEMBLEMETHODUTILS_H_
 
 #include <map>
+#include <unordered_map>
 #include <random>
 #include <mutex>
 #include <thread>
@@ -64,9 +65,12 @@ private:
 	void prepare_csv(ofstream &csv,vector<string> &names);
 	void prepare_group_csv(ofstream &csv, vector<string> extra = vector<string>());
 
-	map<string, Eigen::VectorXd> calc_meas(ObservationEnsemble &oe, Eigen::VectorXd &_q_vec);
-	map<string, Eigen::VectorXd> calc_regul(ParameterEnsemble &pe);// , double _reg_fac);
-	map<string, Eigen::VectorXd> calc_actual(ObservationEnsemble &oe, Eigen::VectorXd &_q_vec);
+	//fused pass over oe: the meas (and, if given, the actual and actual-by-obs-group) phi of
+	//each realization, aligned by row with oe
+	void calc_obs_phi(ObservationEnsemble &oe, Eigen::VectorXd &meas_vec, Eigen::VectorXd *actual_vec = nullptr,
+		Eigen::MatrixXd *group_mat = nullptr);
+	//the regul phi of each realization and its par group contributions, aligned by row with pe
+	void calc_par_phi(ParameterEnsemble &pe, Eigen::VectorXd &regul_vec, Eigen::MatrixXd &group_mat);
 	map<string, double> calc_composite(map<string,double> &_meas, map<string,double> &_regul);
 	//map<string, double>* get_phi_map(PhiHandler::phiType &pt);
 	void write_csv(int iter_num, int total_runs,ofstream &csv, phiType pt,
@@ -91,12 +95,35 @@ private:
 	vector<string> lt_obs_names;
 	vector<string> gt_obs_names;
 
-	map<string, vector<int>> obs_group_idx_map;
-	map<string, vector<int>> par_group_idx_map;
-	map<string, map<string, double>> obs_group_phi_map, par_group_phi_map;
-
-	map<string, double> get_obs_group_contrib(Eigen::VectorXd &phi_vec);
-	map<string, double> get_par_group_contrib(Eigen::VectorXd &phi_vec);
+	//column layout of the phi calcs, rebuilt when the oe_base (pe_base) var names change.  the
+	//columns are stored sorted by group: segment k holds seg_cols[seg_starts[k]..seg_starts[k+1])
+	//and is cut into tiles of at most PHI_TILE_SIZE columns - the units of work of a phi pass
+	struct PhiLayout
+	{
+		vector<string> var_names;
+		vector<string> groups;
+		vector<int> seg_cols;
+		vector<int> seg_starts;
+		vector<int> tile_starts;
+		vector<int> tile_segs;
+		//var column in the last ensemble seen, cached by that ensemble's var names
+		vector<string> en_var_names;
+		vector<int> en_cols;
+	};
+	static const int PHI_TILE_SIZE = 256;
+	PhiLayout obs_layout, par_layout;
+	Eigen::VectorXd obs_weights, obs_vals;
+	//-1 for less-than and 1 for greater-than inequality obs, 0 otherwise
+	vector<int> obs_ineq;
+	void update_obs_layout();
+	void update_par_layout();
+	void set_layout_segments(PhiLayout &layout, const vector<string> &var_groups);
+	const vector<int> &get_en_cols(Ensemble &en, PhiLayout &layout);
+	vector<int> get_base_rows(Ensemble &en, Ensemble *base);
+
+	//group phis from the last update, aligned by row with the realization names
+	vector<string> group_oreal_names, group_preal_names;
+	Eigen::MatrixXd obs_group_phi, par_group_phi;
 
 };
 
@@ -1,6 +1,8 @@
 #include <random>
 #include <map>
 #include <iomanip>
+#include <limits>
+#include <set>
 #include <mutex>
 #include <thread>
 #include "Ensemble.h"
@@ -14,6 +16,7 @@
 #include "SVDPackage.h"
 #include "eigen_tools.h"
 #include "EnsembleMethodUtils.h"
+#include "EnsembleStore.h"
 
 
 
@@ -95,6 +98,10 @@ bool IterEnsembleSmoother::initialize_pe(Covariance &cov)
 	else
 	{
 		string par_ext = pest_utils::lower_cp(par_csv).substr(par_csv.size() - 3, par_csv.size());
+		//with ies_num_reals passed, only the leading realizations are read from a dense binary file
+		int num_reals_to_read = -1;
+		if (pp_args.find("IES_NUM_REALS") != pp_args.end())
+			num_reals_to_read = pest_scenario.get_pestpp_options().get_ies_num_reals();
 		performance_log->log_event("processing par csv " + par_csv);
 		if (par_ext.compare("csv") == 0)
 		{
@@ -130,9 +137,26 @@ bool IterEnsembleSmoother::initialize_pe(Covariance &cov)
 				throw_ies_error(string("error processing par jcb"));
 			}
 		}
+		else if (par_ext.compare("bin") == 0)
+		{
+			message(1, "loading par ensemble from dense binary file", par_csv);
+			try
+			{
+				pe.from_dense(par_csv, num_reals_to_read);
+			}
+			catch (const exception &e)
+			{
+				ss << "error processing par dense binary file: " << e.what();
+				throw_ies_error(ss.str());
+			}
+			catch (...)
+			{
+				throw_ies_error(string("error processing par dense binary file"));
+			}
+		}
 		else
 		{
-			ss << "unrecognized par csv extension " << par_ext << ", looking for csv, jcb, or jco";
+			ss << "unrecognized par csv extension " << par_ext << ", looking for csv, jcb, jco, or bin";
 			throw_ies_error(ss.str());
 		}
 
@@ -277,6 +301,10 @@ bool IterEnsembleSmoother::initialize_oe(Covariance &cov)
 	else
 	{
 		string obs_ext = pest_utils::lower_cp(obs_csv).substr(obs_csv.size() - 3, obs_csv.size());
+		//with ies_num_reals passed, only the leading realizations are read from a dense binary file
+		int num_reals_to_read = -1;
+		if (pp_args.find("IES_NUM_REALS") != pp_args.end())
+			num_reals_to_read = pest_scenario.get_pestpp_options().get_ies_num_reals();
 		performance_log->log_event("processing obs csv " + obs_csv);
 		if (obs_ext.compare("csv") == 0)
 		{
@@ -313,9 +341,26 @@ bool IterEnsembleSmoother::initialize_oe(Covariance &cov)
 				throw_ies_error(string("error processing obs binary file"));
 			}
 		}
+		else if (obs_ext.compare("bin") == 0)
+		{
+			message(1, "loading obs ensemble from dense binary file", obs_csv);
+			try
+			{
+				oe.from_dense(obs_csv, num_reals_to_read);
+			}
+			catch (const exception &e)
+			{
+				ss << "error processing obs dense binary file: " << e.what();
+				throw_ies_error(ss.str());
+			}
+			catch (...)
+			{
+				throw_ies_error(string("error processing obs dense binary file"));
+			}
+		}
 		else
 		{
-			ss << "unrecognized obs ensemble extension " << obs_ext << ", looking for csv, jcb, or jco";
+			ss << "unrecognized obs ensemble extension " << obs_ext << ", looking for csv, jcb, jco, or bin";
 			throw_ies_error(ss.str());
 		}
 		if (pp_args.find("IES_NUM_REALS") != pp_args.end())
@@ -588,9 +633,26 @@ void IterEnsembleSmoother::initialize_restart()
 			throw_ies_error(string("error processing restart obs binary file"));
 		}
 	}
+	else if (obs_ext.compare("bin") == 0)
+	{
+		message(1, "loading restart obs ensemble from dense binary file", obs_restart_csv);
+		try
+		{
+			oe.from_dense(obs_restart_csv);
+		}
+		catch (const exception &e)
+		{
+			ss << "error processing restart obs dense binary file: " << e.what();
+			throw_ies_error(ss.str());
+		}
+		catch (...)
+		{
+			throw_ies_error(string("error processing restart obs dense binary file"));
+		}
+	}
 	else
 	{
-		ss << "unrecognized restart obs ensemble extension " << obs_ext << ", looking for csv, jcb, or jco";
+		ss << "unrecognized restart obs ensemble extension " << obs_ext << ", looking for csv, jcb, jco, or bin";
 		throw_ies_error(ss.str());
 	}
 	if (par_restart_csv.size() > 0)
@@ -630,9 +692,26 @@ void IterEnsembleSmoother::initialize_restart()
 				throw_ies_error(string("error processing restart par binary file"));
 			}
 		}
+		else if (par_ext.compare("bin") == 0)
+		{
+			message(1, "loading restart par ensemble from dense binary file", par_restart_csv);
+			try
+			{
+				pe.from_dense(par_restart_csv);
+			}
+			catch (const exception &e)
+			{
+				ss << "error processing restart par dense binary file: " << e.what();
+				throw_ies_error(ss.str());
+			}
+			catch (...)
+			{
+				throw_ies_error(string("error processing restart par dense binary file"));
+			}
+		}
 		else
 		{
-			ss << "unrecognized restart par ensemble extension " << par_ext << ", looking for csv, jcb, or jco";
+			ss << "unrecognized restart par ensemble extension " << par_ext << ", looking for csv, jcb, jco, or bin";
 			throw_ies_error(ss.str());
 		}
 		if (pe.shape().first != oe.shape().first)
@@ -715,7 +794,12 @@ void IterEnsembleSmoother::initialize_restart()
 				Observations obs = pest_scenario.get_ctl_observations();
 				oe_base.replace(base_par_idx, obs, BASE_REAL_NAME);
 				ss.str("");
-				if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+				if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+				{
+					ss << file_manager.get_base_filename() << ".obs+noise.bin";
+					oe_base.to_dense(ss.str());
+				}
+				else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 				{
 					ss << file_manager.get_base_filename() << ".obs+noise.jcb";
 					oe_base.to_binary(ss.str());
@@ -1221,7 +1305,12 @@ void IterEnsembleSmoother::initialize()
 	message(2, "checking for denormal values in pe");
 	pe.check_for_normal("initial transformed parameter ensemble");
 	ss.str("");
-	if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+	if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+	{
+		ss << file_manager.get_base_filename() << ".0.par.bin";
+		pe.to_dense(ss.str());
+	}
+	else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 	{
 		ss << file_manager.get_base_filename() << ".0.par.jcb";
 		pe.to_binary(ss.str());
@@ -1235,7 +1324,12 @@ void IterEnsembleSmoother::initialize()
 	message(2, "checking for denormal values in base oe");
 	oe.check_for_normal("obs+noise observation ensemble");
 	ss.str("");
-	if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+	if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+	{
+		ss << file_manager.get_base_filename() << ".obs+noise.bin";
+		oe.to_dense(ss.str());
+	}
+	else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 	{
 		ss << file_manager.get_base_filename() << ".obs+noise.jcb";
 		oe.to_binary(ss.str());
@@ -1359,7 +1453,12 @@ void IterEnsembleSmoother::initialize()
 	}
 	
 	ss.str("");
-	if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+	if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+	{
+		ss << file_manager.get_base_filename() << ".0.obs.bin";
+		oe.to_dense(ss.str());
+	}
+	else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 	{
 		ss << file_manager.get_base_filename() << ".0.obs.jcb";
 		oe.to_binary(ss.str());
@@ -1871,16 +1970,15 @@ bool IterEnsembleSmoother::should_terminate()
 LocalUpgradeThread::LocalUpgradeThread(PerformanceLog *_performance_log, unordered_map<string, Eigen::VectorXd> &_par_resid_map, unordered_map<string, Eigen::VectorXd> &_par_diff_map,
 	unordered_map<string, Eigen::VectorXd> &_obs_resid_map, unordered_map<string, Eigen::VectorXd> &_obs_diff_map,
 	Localizer &_localizer, unordered_map<string, double> &_parcov_inv_map, unordered_map<string, double> &_weight_map,
-	ParameterEnsemble &_pe_upgrade, unordered_map<string,pair<vector<string>,vector<string>>> &_cases,
+	vector<ParameterEnsemble> &_pe_upgrades, unordered_map<string,pair<vector<string>,vector<string>>> &_cases,
 	unordered_map<string, Eigen::VectorXd> &_Am_map, Localizer::How &_how): par_resid_map(_par_resid_map),
 	par_diff_map(_par_diff_map), obs_resid_map(_obs_resid_map),obs_diff_map(_obs_diff_map),localizer(_localizer),
-	pe_upgrade(_pe_upgrade),cases(_cases), parcov_inv_map(_parcov_inv_map), weight_map(_weight_map), Am_map(_Am_map)
+	pe_upgrades(_pe_upgrades),cases(_cases), parcov_inv_map(_parcov_inv_map), weight_map(_weight_map), Am_map(_Am_map)
 {
 	performance_log = _performance_log;
 	how = _how;
 	parcov_inv_map = _parcov_inv_map;
 	weight_map = _weight_map;
-	count = 0;
 
 	for (auto &c : cases)
 	{
@@ -1893,7 +1991,7 @@ LocalUpgradeThread::LocalUpgradeThread(PerformanceLog *_performance_log, unorder
 }
 
 
-void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
+void LocalUpgradeThread::work(int thread_id, int iter, const vector<double> &cur_lams, WorkQueue &queue)
 {
 	class local_utils
 	{
@@ -1917,7 +2015,7 @@ void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
 
 			for (int j = 0; j < names.size(); j++)
 			{
-				mat.col(j) = emap[names[j]];
+				mat.col(j) = emap.at(names[j]);
 			}
 
 			return mat;
@@ -1954,33 +2052,19 @@ void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
 	};
 	
 	stringstream ss;
-	
-	
-	unique_lock<mutex> ctrl_guard(ctrl_lock, defer_lock);
-	int maxsing, num_reals, verbose_level, pcount=0,t_count;
-	double eigthresh;
-	bool use_approx;
-	bool use_prior_scaling;
+
+	//the settings, the fast-look maps and the localizer are only read from here on,
+	//so every thread shares them without locking
+	int maxsing = pe_upgrades[0].get_pest_scenario_ptr()->get_svd_info().maxsing;
+	double eigthresh = pe_upgrades[0].get_pest_scenario_ptr()->get_svd_info().eigthresh;
+	bool use_approx = pe_upgrades[0].get_pest_scenario_ptr()->get_pestpp_options().get_ies_use_approx();
+	bool use_prior_scaling = pe_upgrades[0].get_pest_scenario_ptr()->get_pestpp_options().get_ies_use_prior_scaling();
+	int num_reals = pe_upgrades[0].shape().first;
+	int verbose_level = pe_upgrades[0].get_pest_scenario_ptr()->get_pestpp_options().get_ies_verbose_level();
 	bool use_localizer = false;
-	bool loc_by_obs = true;
-
-	while (true)
-	{
-		if (ctrl_guard.try_lock())
-		{
-			maxsing = pe_upgrade.get_pest_scenario_ptr()->get_svd_info().maxsing;
-			eigthresh = pe_upgrade.get_pest_scenario_ptr()->get_svd_info().eigthresh;
-			use_approx = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_use_approx();
-			use_prior_scaling = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_use_prior_scaling();
-			num_reals = pe_upgrade.shape().first;
-			verbose_level = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_verbose_level();
-			ctrl_guard.unlock();
-			//if (pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_localize_how()[0] == 'P')
-			if (how == Localizer::How::PARAMETERS)
-				loc_by_obs = false;
-			break;
-		}
-	}
+	bool loc_by_obs = (how != Localizer::How::PARAMETERS);
+	int pcount = 0, t_count;
+
 	ofstream f_thread;
 	if (verbose_level > 2)
 	{
@@ -1990,315 +2074,232 @@ void LocalUpgradeThread::work(int thread_id, int iter, double cur_lam)
 		ss.str("");
 	}
 	Eigen::MatrixXd par_resid, par_diff, Am;
-	Eigen::MatrixXd obs_resid, obs_diff, loc;
+	Eigen::MatrixXd obs_resid, obs_diff;
+	//localizer values for the rows of par_diff (by obs) or obs_diff (by par)
+	Eigen::VectorXd loc;
 	Eigen::DiagonalMatrix<double, Eigen::Dynamic> weights, parcov_inv;
 	vector<string> par_names, obs_names;
-	while (true)
-	{
-		unique_lock<mutex> next_guard(next_lock, defer_lock);
-		par_names.clear();
-		obs_names.clear();
-		use_localizer = false;
-		//the end condition
-		//the end condition
-		while (true)
-		{	
-			if (next_guard.try_lock())
-			{
-				if (count == keys.size())
-				{
-					if (verbose_level > 1)
-					{
-						cout << "upgrade thread: " << thread_id << " processed " << pcount << " upgrade parts" << endl;
-					}
-					if (f_thread.good())
-						f_thread.close();
-					return;
-				}
-				string k = keys[count];
-				pair<vector<string>, vector<string>> p = cases.at(k);
-				par_names = p.second;
-				obs_names = p.first;
-				if (localizer.get_use())
-				{
-					if ((loc_by_obs) && (par_names.size() == 1) && (k == par_names[0]))
-						use_localizer = true;
-					else if ((!loc_by_obs) && (obs_names.size() == 1) && (k == obs_names[0]))
-					{
-						use_localizer = true;
-						//loc_by_obs = false;
-					}
-				}
-				if (count % 1000 == 0)
-				{
-					ss.str("");
-					ss << "upgrade thread progress: " << count << " of " << total << " parts done";
-					if (verbose_level > 1)
-						cout << ss.str() << endl;
-					performance_log->log_event(ss.str());
-				}
-				count++;
-				t_count = count;
-				pcount++;
-				next_guard.unlock();
-				break;
-			}
-		}
-		
-
-		if (verbose_level > 2)
+	//the upgrades of the cases in the current chunk, added to pe_upgrades once per chunk
+	vector<pair<vector<string>, vector<Eigen::MatrixXd>>> chunk_upgrades;
+	int begin, end;
+	while (queue.next(begin, end))
+	{
+		chunk_upgrades.clear();
+		for (int icase = begin; icase < end; icase++)
 		{
-			f_thread << t_count << "," << iter;
-			for (auto name : par_names)
-				f_thread << "," << name;
-			for (auto name : obs_names)
-				f_thread << "," << name;
-			f_thread << endl;
-		}
-
-		par_resid.resize(0, 0);
-		par_diff.resize(0, 0);
-		obs_resid.resize(0, 0);
-		obs_diff.resize(0, 0);
-		loc.resize(0, 0);
-		Am.resize(0, 0);
-		weights.resize(0);
-		parcov_inv.resize(0);
-		Am.resize(0, 0);
-
-		unique_lock<mutex> obs_diff_guard(obs_diff_lock, defer_lock);
-		unique_lock<mutex> obs_resid_guard(obs_resid_lock, defer_lock);
-		unique_lock<mutex> par_diff_guard(par_diff_lock, defer_lock);
-		unique_lock<mutex> par_resid_guard(par_resid_lock, defer_lock);
-		unique_lock<mutex> loc_guard(loc_lock, defer_lock);
-		unique_lock<mutex> weight_guard(weight_lock, defer_lock);
-		unique_lock<mutex> parcov_guard(parcov_lock, defer_lock);
-		unique_lock<mutex> am_guard(am_lock, defer_lock);
-
-		while (true)
-		{
-			if (((use_approx) || (par_resid.rows() > 0)) &&
-				(weights.size() > 0) &&
-				(parcov_inv.size() > 0) &&
-				(par_diff.rows() > 0) &&
-				(obs_resid.rows() > 0) &&
-				(obs_diff.rows() > 0) &&
-				((!use_localizer) || (loc.rows() > 0)) && 
-				((use_approx) || (Am.rows() > 0)))
-				break;
-			if ((use_localizer) && (loc.rows() == 0) && (loc_guard.try_lock()))
-			{
-				if (loc_by_obs)
-					loc = localizer.get_localizing_par_hadamard_matrix(num_reals, obs_names[0], par_names);
-				else
-					loc = localizer.get_localizing_obs_hadamard_matrix(num_reals, par_names[0], obs_names);
-				loc_guard.unlock();
-			}
-			if ((obs_diff.rows() == 0) && (obs_diff_guard.try_lock()))
-			{
-				//piggy back here for thread safety
-				//if (pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_svd_pack() == PestppOptions::SVD_PACK::PROPACK)
-				//	use_propack = true;
-				obs_diff = local_utils::get_matrix_from_map(num_reals, obs_names, obs_diff_map);
-				obs_diff_guard.unlock();
-			}
-			if ((obs_resid.rows() == 0) && (obs_resid_guard.try_lock()))
-			{
-				obs_resid = local_utils::get_matrix_from_map(num_reals, obs_names, obs_resid_map);
-				obs_resid_guard.unlock();
-			}
-			if ((par_diff.rows() == 0) && (par_diff_guard.try_lock()))
-			{
-				par_diff = local_utils::get_matrix_from_map(num_reals, par_names, par_diff_map);
-				par_diff_guard.unlock();
-			}
-			if ((par_resid.rows() == 0) && (par_resid_guard.try_lock()))
+			string k = keys[icase];
+			const pair<vector<string>, vector<string>> &p = cases.at(k);
+			par_names = p.second;
+			obs_names = p.first;
+			use_localizer = false;
+			if (localizer.get_use())
 			{
-				par_resid = local_utils::get_matrix_from_map(num_reals, par_names, par_resid_map);
-				par_resid_guard.unlock();
+				if ((loc_by_obs) && (par_names.size() == 1) && (k == par_names[0]))
+					use_localizer = true;
+				else if ((!loc_by_obs) && (obs_names.size() == 1) && (k == obs_names[0]))
+					use_localizer = true;
 			}
-			if ((weights.rows() == 0) && (weight_guard.try_lock()))
+			if (icase % 1000 == 0)
 			{
-				weights = local_utils::get_matrix_from_map(obs_names, weight_map);
-				weight_guard.unlock();
+				ss.str("");
+				ss << "upgrade thread progress: " << icase << " of " << total << " parts done";
+				if (verbose_level > 1)
+					cout << ss.str() << endl;
+				lock_guard<mutex> pfm_guard(pfm_lock);
+				performance_log->log_event(ss.str());
 			}
-			if ((parcov_inv.rows() == 0) && (parcov_guard.try_lock()))
+			t_count = icase + 1;
+			pcount++;
+
+			if (verbose_level > 2)
 			{
-				parcov_inv = local_utils::get_matrix_from_map(par_names, parcov_inv_map);
-				parcov_guard.unlock();
+				f_thread << t_count << "," << iter;
+				for (auto name : par_names)
+					f_thread << "," << name;
+				for (auto name : obs_names)
+					f_thread << "," << name;
+				f_thread << endl;
 			}
-			if ((!use_approx) && (Am.rows() == 0) && (am_guard.try_lock()))
-			{
-				//Am = local_utils::get_matrix_from_map(num_reals, par_names, Am_map).transpose();
-				int am_cols = Am_map[par_names[0]].size();
-				Am.resize(par_names.size(),am_cols);
-				Am.setZero();
 
+			if (use_localizer)
+			{
+				if (loc_by_obs)
+					loc = localizer.get_localizing_par_vector(obs_names[0], par_names);
+				else
+					loc = localizer.get_localizing_obs_vector(par_names[0], obs_names);
+			}
+			obs_diff = local_utils::get_matrix_from_map(num_reals, obs_names, obs_diff_map);
+			obs_resid = local_utils::get_matrix_from_map(num_reals, obs_names, obs_resid_map);
+			par_diff = local_utils::get_matrix_from_map(num_reals, par_names, par_diff_map);
+			par_resid = local_utils::get_matrix_from_map(num_reals, par_names, par_resid_map);
+			weights = local_utils::get_matrix_from_map(obs_names, weight_map);
+			parcov_inv = local_utils::get_matrix_from_map(par_names, parcov_inv_map);
+			if (!use_approx)
+			{
+				int am_cols = Am_map.at(par_names[0]).size();
+				Am.resize(par_names.size(), am_cols);
 				for (int j = 0; j < par_names.size(); j++)
 				{
-					Am.row(j) = Am_map[par_names[j]];
+					Am.row(j) = Am_map.at(par_names[j]);
 				}
-				am_guard.unlock();
 			}
-		}
-		
-		par_diff.transposeInPlace();
-		obs_diff.transposeInPlace();
-		obs_resid.transposeInPlace();
-		par_resid.transposeInPlace();
+			par_diff.transposeInPlace();
+			obs_diff.transposeInPlace();
+			obs_resid.transposeInPlace();
+			par_resid.transposeInPlace();
 
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_resid", obs_resid);
-		Eigen::MatrixXd scaled_residual = weights * obs_resid;
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_resid", obs_resid);
+			Eigen::MatrixXd scaled_residual = weights * obs_resid;
 		
 		
 
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "par_resid", par_resid);
-		Eigen::MatrixXd scaled_par_resid;
-		if ((!use_approx) && (iter > 1))
-		{
-			if (use_prior_scaling)
-			{
-				scaled_par_resid = parcov_inv * par_resid;
-			}
-			else
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "par_resid", par_resid);
+			Eigen::MatrixXd scaled_par_resid;
+			if ((!use_approx) && (iter > 1))
 			{
-				scaled_par_resid = par_resid;
+				if (use_prior_scaling)
+				{
+					scaled_par_resid = parcov_inv * par_resid;
+				}
+				else
+				{
+					scaled_par_resid = par_resid;
+				}
 			}
-		}
 
-		stringstream ss;
+			stringstream ss;
 
-		double scale = (1.0 / (sqrt(double(num_reals - 1))));
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_diff", obs_diff);
+			double scale = (1.0 / (sqrt(double(num_reals - 1))));
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_diff", obs_diff);
 
-		if (use_localizer)
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "loc", loc);
-		if (use_localizer)
-		{
-			if (loc_by_obs)
-				par_diff = par_diff.cwiseProduct(loc);
-			else	
-				obs_diff = obs_diff.cwiseProduct(loc);
+			if ((use_localizer) && (verbose_level > 2))
+			{
+				Eigen::MatrixXd loc_mat = loc;
+				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "loc", loc_mat);
+			}
+			if (use_localizer)
+			{
+				if (loc_by_obs)
+					par_diff = loc.asDiagonal() * par_diff;
+				else	
+					obs_diff = loc.asDiagonal() * obs_diff;
 
-		}
+			}
 		
-		obs_diff = scale * (weights * obs_diff);
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "par_diff", par_diff);
-		if (use_prior_scaling)
-			par_diff = scale * parcov_inv * par_diff;
-		else
-			par_diff = scale * par_diff;
+			obs_diff = scale * (weights * obs_diff);
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "par_diff", par_diff);
+			if (use_prior_scaling)
+				par_diff = scale * parcov_inv * par_diff;
+			else
+				par_diff = scale * par_diff;
 
 
-		//performance_log->log_event("SVD of obs diff");
-		Eigen::MatrixXd ivec, upgrade_1, s, V, Ut;
+			//performance_log->log_event("SVD of obs diff");
+			Eigen::MatrixXd ivec, upgrade_1, s, V, Ut;
 		
 		
-		SVD_REDSVD rsvd;
-		rsvd.solve_ip(obs_diff, s, Ut, V, eigthresh, maxsing);
+			SVD_REDSVD rsvd;
+			rsvd.solve_ip(obs_diff, s, Ut, V, eigthresh, maxsing);
 		
-		Ut.transposeInPlace();
-		obs_diff.resize(0, 0);
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "Ut", Ut);
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "s", s);
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "V", V);
+			Ut.transposeInPlace();
+			obs_diff.resize(0, 0);
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "Ut", Ut);
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "s", s);
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "V", V);
 
-		Eigen::MatrixXd s2 = s.cwiseProduct(s);
+			Eigen::MatrixXd s2 = s.cwiseProduct(s);
 
-		ivec = ((Eigen::VectorXd::Ones(s2.size()) * (cur_lam + 1.0)) + s2).asDiagonal().inverse();
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "ivec", ivec);
-		Eigen::MatrixXd X1 = Ut * scaled_residual;
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X1", X1);
-		Eigen::MatrixXd X2 = ivec * X1;
-		X1.resize(0, 0);
+			//everything up to here, and the terms below that do not involve ivec, is the same
+			//for every lambda - form them once and reuse them for each lambda
+			Eigen::MatrixXd X1 = Ut * scaled_residual;
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X1", X1);
+			Eigen::MatrixXd x6;
+			if ((!use_approx) && (iter > 1))
+			{
+				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "Am",Am);
+				Eigen::MatrixXd x4 = Am.transpose() * scaled_par_resid;
+				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X4", x4);
 
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X2", X2);
-		Eigen::MatrixXd X3 = V * s.asDiagonal() * X2;
-		X2.resize(0, 0);
+				par_resid.resize(0, 0);
 
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X3", X3);
-		if (use_prior_scaling)
-		{
-			upgrade_1 = -1.0 * parcov_inv * par_diff * X3;
-		}
-		else
-		{
-			upgrade_1 = -1.0 * par_diff * X3;
-		}
-		upgrade_1.transposeInPlace();
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_1",upgrade_1);
-		X3.resize(0, 0);
+				Eigen::MatrixXd x5 = Am * x4;
+				x4.resize(0, 0);
+				Am.resize(0, 0);
 
+				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X5", x5);
+				x6 = par_diff.transpose() * x5;
+				x5.resize(0, 0);
+				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X6", x6);
+			}
 
-		Eigen::MatrixXd upgrade_2;
-		if ((!use_approx) && (iter > 1))
-		{
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "Am",Am);
-			Eigen::MatrixXd x4 = Am.transpose() * scaled_par_resid;
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X4", x4);
-			
-			par_resid.resize(0, 0);
+			vector<Eigen::MatrixXd> upgrades;
+			upgrades.reserve(cur_lams.size());
+			for (auto cur_lam : cur_lams)
+			{
+				ivec = ((Eigen::VectorXd::Ones(s2.size()) * (cur_lam + 1.0)) + s2).asDiagonal().inverse();
+				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "ivec", ivec);
+				Eigen::MatrixXd X2 = ivec * X1;
 
-			Eigen::MatrixXd x5 = Am * x4;
-			x4.resize(0, 0);
-			Am.resize(0, 0);
+				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X2", X2);
+				Eigen::MatrixXd X3 = V * s.asDiagonal() * X2;
+				X2.resize(0, 0);
 
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X5", x5);
-			Eigen::MatrixXd x6 = par_diff.transpose() * x5;
-			x5.resize(0, 0);
+				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X3", X3);
+				if (use_prior_scaling)
+				{
+					upgrade_1 = -1.0 * parcov_inv * par_diff * X3;
+				}
+				else
+				{
+					upgrade_1 = -1.0 * par_diff * X3;
+				}
+				upgrade_1.transposeInPlace();
+				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_1",upgrade_1);
+				X3.resize(0, 0);
 
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X6", x6);
-			Eigen::MatrixXd x7 = V * ivec *V.transpose() * x6;
-			x6.resize(0, 0);
+				Eigen::MatrixXd upgrade_2;
+				if ((!use_approx) && (iter > 1))
+				{
+					Eigen::MatrixXd x7 = V * ivec *V.transpose() * x6;
 
-			if (use_prior_scaling)
-			{
-				upgrade_2 = -1.0 * parcov_inv * par_diff * x7;
-			}
-			else
-			{
-				upgrade_2 = -1.0 * (par_diff * x7);
-			}
-			x7.resize(0, 0);
+					if (use_prior_scaling)
+					{
+						upgrade_2 = -1.0 * parcov_inv * par_diff * x7;
+					}
+					else
+					{
+						upgrade_2 = -1.0 * (par_diff * x7);
+					}
+					x7.resize(0, 0);
 
-			upgrade_1 = upgrade_1 + upgrade_2.transpose();
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_2", upgrade_2);
-			upgrade_2.resize(0, 0);
+					upgrade_1 = upgrade_1 + upgrade_2.transpose();
+					local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_2", upgrade_2);
+					upgrade_2.resize(0, 0);
 
-		}
-		
-		unique_lock<mutex> put_guard(put_lock, defer_lock);
-		while (true)
-		{
-			if (put_guard.try_lock())
-			{
-				pe_upgrade.add_2_cols_ip(par_names, upgrade_1);
-				put_guard.unlock();
-				break;
+				}
+				upgrades.push_back(upgrade_1);
 			}
+			chunk_upgrades.push_back(make_pair(par_names, upgrades));
 		}
-	}
 
-}
-
-
-
-void upgrade_thread_function(int id, int iter,double cur_lam, LocalUpgradeThread &worker, exception_ptr &eptr)
-{
-	try
-	{
-		worker.work(id, iter, cur_lam);
+		lock_guard<mutex> put_guard(put_lock);
+		for (auto &cu : chunk_upgrades)
+		{
+			for (size_t i = 0; i < cu.second.size(); i++)
+				pe_upgrades[i].add_2_cols_ip(cu.first, cu.second[i]);
+		}
 	}
-	catch (...)
+	if (verbose_level > 1)
 	{
-		eptr = current_exception();
+		cout << "upgrade thread: " << thread_id << " processed " << pcount << " upgrade parts" << endl;
 	}
-	
-	return;
+	if (f_thread.good())
+		f_thread.close();
 }
 
 
-ParameterEnsemble IterEnsembleSmoother::calc_localized_upgrade_threaded(double cur_lam, unordered_map<string, pair<vector<string>, vector<string>>> &loc_map)
+
+vector<ParameterEnsemble> IterEnsembleSmoother::calc_localized_upgrade_threaded(const vector<double> &cur_lams, unordered_map<string, pair<vector<string>, vector<string>>> &loc_map)
 {
 	stringstream ss;
 	
@@ -2416,96 +2417,28 @@ ParameterEnsemble IterEnsembleSmoother::calc_localized_upgrade_threaded(double c
 		}
 	}
 	mat.resize(0, 0);
-	// clear the upgrade ensemble
+	// clear the upgrade ensemble and make one for each lambda
 	pe_upgrade.set_zeros();
+	vector<ParameterEnsemble> pe_upgrades(cur_lams.size(), pe_upgrade);
+	pe_upgrade = ParameterEnsemble();
 	Localizer::How _how = localizer.get_how();
 	LocalUpgradeThread worker(performance_log, par_resid_map, par_diff_map, obs_resid_map, obs_diff_map,
-		localizer, parcov_inv_map, weight_map, pe_upgrade, loc_map, Am_map, _how);
+		localizer, parcov_inv_map, weight_map, pe_upgrades, loc_map, Am_map, _how);
 
-	if ((num_threads < 1) || (loc_map.size() == 1))
-	//if (num_threads < 1)
-	{
-		worker.work(0, iter, cur_lam);
-	}
-	else
+	int upgrade_threads = num_threads;
+	if (loc_map.size() == 1)
+		upgrade_threads = 0;
+	WorkQueue queue(loc_map.size(), WorkQueue::get_chunk_size(loc_map.size(), upgrade_threads));
+	if (upgrade_threads > 0)
 	{
 		Eigen::setNbThreads(1);
-		vector<thread> threads;
-		vector<exception_ptr> exception_ptrs;
 		message(2, "launching threads");
-		
-		for (int i = 0; i <num_threads; i++)
-		{
-			exception_ptrs.push_back(exception_ptr());
-		}
-
-		for (int i = 0; i < num_threads; i++)
-		{
-			//threads.push_back(thread(&LocalUpgradeThread::work, &worker, i, iter, cur_lam));
-			
-			threads.push_back(thread(upgrade_thread_function, i, iter, cur_lam, std::ref(worker),std::ref( exception_ptrs[i])));
-			
-		}
-		message(2, "waiting to join threads");
-		//for (auto &t : threads)
-		//	t.join();
-		ss.str("");
-		int num_exp = 0;
-
-		for (int i = 0; i < num_threads; ++i)
-		{
-			bool found = false;
-			if (exception_ptrs[i])
-			{
-				found = true;
-				num_exp++;
-				try
-				{
-					rethrow_exception(exception_ptrs[i]);
-				}
-				catch (const std::exception& e)
-				{
-					//ss.str("");
-					ss << " thread " << i << "raised an exception: " << e.what();
-					//throw runtime_error(ss.str());
-				}
-				catch (...)
-				{
-					//ss.str("");
-					ss << " thread " << i << "raised an exception";
-					//throw runtime_error(ss.str());
-				}
-			}
-			threads[i].join();
-			if ((exception_ptrs[i]) && (!found))
-			{
-				num_exp++;
-				try
-				{
-					rethrow_exception(exception_ptrs[i]);
-				}
-				catch (const std::exception& e)
-				{
-					//ss.str("");
-					ss << " thread " << i << "raised an exception: " << e.what();
-					//throw runtime_error(ss.str());
-				}
-				catch (...)
-				{
-					//ss.str("");
-					ss << " thread " << i << "raised an exception: ";
-					//throw runtime_error(ss.str());
-				}
-			}
-		}
-		if (num_exp > 0)
-		{
-			throw runtime_error(ss.str());
-		}
-		message(2, "threaded localized upgrade calculation done");
 	}
+	queue.run(upgrade_threads, [&](int thread_id) { worker.work(thread_id, iter, cur_lams, queue); });
+	if (upgrade_threads > 0)
+		message(2, "threaded localized upgrade calculation done");
 	
-	return pe_upgrade;
+	return pe_upgrades;
 }
 
 
@@ -2650,16 +2583,42 @@ bool IterEnsembleSmoother::solve_new()
 	}
 
 
+	//each local solve is factored once and then gives the upgrade for every lambda
+	vector<double> cur_lams;
 	for (auto &lam_mult : lam_mults)
+		cur_lams.push_back(last_best_lam * lam_mult);
+	message(1, "starting upgrade calcs for lambdas", cur_lams);
+	message(2, "see .log file for more details");
+	vector<ParameterEnsemble> pe_upgrades = calc_localized_upgrade_threaded(cur_lams, loc_map);
+
+	//pick the subset before the lambda ensembles are built so that, with ies_lambda_en_mmap,
+	//only the subset rows of each lambda ensemble are held in memory.  the full lambda
+	//ensembles go to a memory-mapped scratch file and the rest of the best one is paged
+	//back in only when the remaining realizations are run
+	set_subset_idx(pe.shape().first);
+	EnsembleStore lam_store;
+	vector<int> lam_blocks;
+	if ((pest_scenario.get_pestpp_options().get_ies_lambda_en_mmap()) && (use_subset) && (subset_size < pe.shape().first))
 	{
 		ss.str("");
-		double cur_lam = last_best_lam * lam_mult;
-		ss << "starting calcs for lambda" << cur_lam;
-		message(1, "starting lambda calcs for lambda", cur_lam);
-		message(2, "see .log file for more details");
-		ParameterEnsemble pe_upgrade;
-		
-		pe_upgrade = calc_localized_upgrade_threaded(cur_lam, loc_map);
+		ss << file_manager.get_base_filename() << "." << iter << ".lambda_en.mmap";
+		lam_store.open(ss.str());
+		message(1, "storing lambda ensembles in memory-mapped file " + ss.str());
+	}
+
+	bool pipeline = pest_scenario.get_pestpp_options().get_ies_pipeline_lambdas();
+	vector<LambdaRuns> lam_runs;
+	if (pipeline)
+	{
+		message(1, "pipelining lambda runs");
+		performance_log->log_event("queuing lambda ensembles as they are built");
+		run_mgr_ptr->reinitialize();
+	}
+	for (size_t ilam = 0; ilam < cur_lams.size(); ilam++)
+	{
+		ss.str("");
+		double cur_lam = cur_lams[ilam];
+		ParameterEnsemble &pe_upgrade = pe_upgrades[ilam];
 
 		for (auto sf : pest_scenario.get_pestpp_options().get_lambda_scale_vec())
 		{
@@ -2671,27 +2630,49 @@ bool IterEnsembleSmoother::solve_new()
 				pe_lam_scale.enforce_limits(performance_log, pest_scenario.get_pestpp_options().get_ies_enforce_chglim());
 			}
 
-			pe_lams.push_back(pe_lam_scale);
 			lam_vals.push_back(cur_lam);
 			scale_vals.push_back(sf);
-			if (!pest_scenario.get_pestpp_options().get_ies_save_lambda_en())
-				continue;
-			ss.str("");
-			ss << file_manager.get_base_filename() << "." << iter << "." << cur_lam << ".lambda." << sf << ".scale.par";
+			if (pest_scenario.get_pestpp_options().get_ies_save_lambda_en())
+			{
+				ss.str("");
+				ss << file_manager.get_base_filename() << "." << iter << "." << cur_lam << ".lambda." << sf << ".scale.par";
 
-			if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+				if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+				{
+					ss << ".bin";
+					pe_lam_scale.to_dense(ss.str());
+				}
+				else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+				{
+					ss << ".jcb";
+					pe_lam_scale.to_binary(ss.str());
+				}
+				else
+				{
+					ss << ".csv";
+					pe_lam_scale.to_csv(ss.str());
+				}
+				frec << "lambda, scale value " << cur_lam << ',' << sf << " pars saved to " << ss.str() << endl;
+			}
+			if (lam_store.is_open())
 			{
-				ss << ".jcb";
-				pe_lam_scale.to_binary(ss.str());
+				lam_blocks.push_back(lam_store.add(*pe_lam_scale.get_eigen_ptr()));
+				pe_lam_scale.keep_rows(subset_idxs);
 			}
-			else
+			pe_lams.push_back(pe_lam_scale);
+			if (pipeline)
 			{
-				ss << ".csv";
-				pe_lam_scale.to_csv(ss.str());
+				//hand the new runs out and check on those already out while the next one is built
+				LambdaRuns lr;
+				lr.real_run_ids = queue_lambda_runs(pe_lams.back());
+				lr.canceled = false;
+				lam_runs.push_back(lr);
+				poll_lambda_runs(pe_lams, lam_vals, scale_vals, lam_runs, 0.0);
 			}
-			frec << "lambda, scale value " << cur_lam << ',' << sf << " pars saved to " << ss.str() << endl;
-
 		}
+		//the upgrade isn't needed once its lambda ensembles are stored
+		if (lam_store.is_open())
+			pe_upgrade = ParameterEnsemble();
 
 		ss.str("");
 		message(1, "finished calcs for lambda:", cur_lam);
@@ -2704,13 +2685,16 @@ bool IterEnsembleSmoother::solve_new()
 		throw_ies_error("ies_debug_upgrade_only is true, exiting");
 	}
 
-	vector<map<int, int>> real_run_ids_lams;
 	int best_idx = -1;
 	double best_mean = 1.0e+30, best_std = 1.0e+30;
 	double mean, std;
 
 	message(0, "running lambda ensembles");
-	vector<ObservationEnsemble> oe_lams = run_lambda_ensembles(pe_lams, lam_vals, scale_vals);
+	vector<ObservationEnsemble> oe_lams;
+	if (pipeline)
+		oe_lams = finish_lambda_runs(pe_lams, lam_vals, scale_vals, lam_runs);
+	else
+		oe_lams = run_lambda_ensembles(pe_lams, lam_vals, scale_vals);
 
 	message(0, "evaluting lambda ensembles");
 	message(1, "last mean: ", last_best_mean);
@@ -2731,7 +2715,12 @@ bool IterEnsembleSmoother::solve_new()
 			ss.str("");
 			ss << file_manager.get_base_filename() << "." << iter << "." << lam_vals[i] << ".lambda." << scale_vals[i] << ".scale.obs";
 
-			if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+			if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+			{
+				ss << ".bin";
+				oe_lams[i].to_dense(ss.str());
+			}
+			else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 			{
 				ss << ".jcb";
 				oe_lams[i].to_binary(ss.str());
@@ -2839,6 +2828,19 @@ bool IterEnsembleSmoother::solve_new()
 			{
 				oe_keep_names.push_back(oe_names[i]);
 			}
+		if (lam_store.is_open())
+		{
+			//pe_lams[best_idx] only holds the subset, so page in the realizations that still need to be run
+			map<string, int> pe_idx_map;
+			for (int i = 0; i < pe_names.size(); i++)
+				pe_idx_map[pe_names[i]] = i;
+			vector<int> keep_idxs;
+			for (auto &name : pe_keep_names)
+				keep_idxs.push_back(pe_idx_map.at(name));
+			performance_log->log_event("paging in remaining realizations of best lambda ensemble");
+			remaining_pe_lam.from_eigen_mat(lam_store.get_rows(lam_blocks[best_idx], keep_idxs), pe_keep_names,
+				pe.get_var_names(), pe.get_trans_status());
+		}
 		message(0, "phi summary for best lambda, scale fac: ", vector<double>({ lam_vals[best_idx],scale_vals[best_idx] }));
 		ph.update(oe_lams[best_idx], pe_lams[best_idx]);
 		ph.report(true);
@@ -3002,7 +3004,12 @@ void IterEnsembleSmoother::report_and_save()
 	cout << "   number of model runs:            " << run_mgr_ptr->get_total_runs() << endl;
 
 	stringstream ss;
-	if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+	if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+	{
+		ss << file_manager.get_base_filename() << "." << iter << ".obs.bin";
+		oe.to_dense(ss.str());
+	}
+	else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 	{
 		ss << file_manager.get_base_filename() << "." << iter << ".obs.jcb";
 		oe.to_binary(ss.str());
@@ -3015,7 +3022,12 @@ void IterEnsembleSmoother::report_and_save()
 	frec << "      current obs ensemble saved to " << ss.str() << endl;
 	cout << "      current obs ensemble saved to " << ss.str() << endl;
 	ss.str("");
-	if (pest_scenario.get_pestpp_options().get_ies_save_binary())
+	if (pest_scenario.get_pestpp_options().get_ies_save_dense())
+	{
+		ss << file_manager.get_base_filename() << "." << iter << ".par.bin";
+		pe.to_dense(ss.str());
+	}
+	else if (pest_scenario.get_pestpp_options().get_ies_save_binary())
 	{
 		ss << file_manager.get_base_filename() << "." << iter << ".par.jcb";
 		pe.to_binary(ss.str());
@@ -3181,33 +3193,14 @@ void IterEnsembleSmoother::set_subset_idx(int size)
 
 vector<ObservationEnsemble> IterEnsembleSmoother::run_lambda_ensembles(vector<ParameterEnsemble> &pe_lams, vector<double> &lam_vals, vector<double> &scale_vals)
 {
-	ofstream &frec = file_manager.rec_ofstream();
 	stringstream ss;
 	ss << "queuing " << pe_lams.size() << " ensembles";
 	performance_log->log_event(ss.str());
 	run_mgr_ptr->reinitialize();
 	
-	set_subset_idx(pe_lams[0].shape().first);
 	vector<map<int, int>> real_run_ids_vec;
-	//ParameterEnsemble pe_lam;
-	//for (int i=0;i<pe_lams.size();i++)
 	for (auto &pe_lam : pe_lams)
-	{
-		try
-		{
-			real_run_ids_vec.push_back(pe_lam.add_runs(run_mgr_ptr,subset_idxs));
-		}
-		catch (const exception &e)
-		{
-			stringstream ss;
-			ss << "run_ensemble() error queueing runs: " << e.what();
-			throw_ies_error(ss.str());
-		}
-		catch (...)
-		{
-			throw_ies_error(string("run_ensembles() error queueing runs"));
-		}
-	}
+		real_run_ids_vec.push_back(queue_lambda_runs(pe_lam));
 	performance_log->log_event("making runs");
 	try
 	{
@@ -3226,89 +3219,264 @@ vector<ObservationEnsemble> IterEnsembleSmoother::run_lambda_ensembles(vector<Pa
 	}
 
 	performance_log->log_event("processing runs");
-	vector<int> failed_real_indices;
 	vector<ObservationEnsemble> obs_lams;
-	//ObservationEnsemble _oe = oe;//copy
-	//if (subset_size < pe_lams[0].shape().first)
-	//	_oe.keep_rows(subset_idxs);
-	map<int, int> real_run_ids;
-	//for (auto &real_run_ids : real_run_ids_vec)
 	for (int i=0;i<pe_lams.size();i++)
+		obs_lams.push_back(process_lambda_runs(pe_lams[i], real_run_ids_vec[i], lam_vals[i], scale_vals[i]));
+	return obs_lams;
+}
+
+map<int, int> IterEnsembleSmoother::queue_lambda_runs(ParameterEnsemble &pe_lam)
+{
+	map<int, int> real_run_ids;
+	try
 	{
-		ObservationEnsemble _oe = oe;//copy
-		vector<double> rep_vals{ lam_vals[i],scale_vals[i] };
-		real_run_ids = real_run_ids_vec[i];
-		//if using subset, reset the real_idx in real_run_ids to be just simple counter
-		//if (subset_size < pe_lams[0].shape().first)
-		if ((use_subset) && (subset_size < pe_lams[i].shape().first))
+		//lambda test runs decide the upgrade, so they go ahead of anything else queued
+		if (pe_lam.shape().first < pe.shape().first)
 		{
-			_oe.keep_rows(subset_idxs);
-			int ireal = 0;
-			map<int, int> temp;
-			for (auto &rri : real_run_ids)
-			{
-				temp[ireal] = rri.second;
-				ireal++;
-			}
+			//lambda ensembles held as just the subset rows (ies_lambda_en_mmap) are run by their
+			//local row index and the run ids are then keyed back to the full ensemble index
+			vector<int> sorted_subset_idxs = subset_idxs, local_subset_idxs;
+			sort(sorted_subset_idxs.begin(), sorted_subset_idxs.end());
+			for (auto idx : subset_idxs)
+				local_subset_idxs.push_back(lower_bound(sorted_subset_idxs.begin(), sorted_subset_idxs.end(), idx) - sorted_subset_idxs.begin());
+			for (auto &rri : pe_lam.add_runs(run_mgr_ptr, local_subset_idxs, RunManagerAbstract::RUN_PRIORITY::HIGH))
+				real_run_ids[sorted_subset_idxs[rri.first]] = rri.second;
+		}
+		else
+			real_run_ids = pe_lam.add_runs(run_mgr_ptr,subset_idxs,RunManagerAbstract::RUN_PRIORITY::HIGH);
+	}
+	catch (const exception &e)
+	{
+		stringstream ss;
+		ss << "run_ensemble() error queueing runs: " << e.what();
+		throw_ies_error(ss.str());
+	}
+	catch (...)
+	{
+		throw_ies_error(string("run_ensembles() error queueing runs"));
+	}
+	return real_run_ids;
+}
 
-			real_run_ids = temp;
+ObservationEnsemble IterEnsembleSmoother::process_lambda_runs(ParameterEnsemble &pe_lam, map<int, int> real_run_ids, double lam_val, double scale_val)
+{
+	vector<int> failed_real_indices;
+	ObservationEnsemble _oe = oe;//copy
+	vector<double> rep_vals{ lam_val,scale_val };
+	//if using subset, reset the real_idx in real_run_ids to be just simple counter
+	if ((use_subset) && (subset_size < pe.shape().first))
+	{
+		_oe.keep_rows(subset_idxs);
+		int ireal = 0;
+		map<int, int> temp;
+		for (auto &rri : real_run_ids)
+		{
+			temp[ireal] = rri.second;
+			ireal++;
 		}
 
-		try
+		real_run_ids = temp;
+	}
+
+	try
+	{
+		failed_real_indices = _oe.update_from_runs(real_run_ids, run_mgr_ptr);
+	}
+	catch (const exception &e)
+	{
+		stringstream ss;
+		ss << "error processing runs for lambda,scale: " << lam_val << ',' << scale_val << ':' << e.what();
+		throw_ies_error(ss.str());
+	}
+	catch (...)
+	{
+		stringstream ss;
+		ss << "error processing runs for lambda,scale: " << lam_val << ',' << scale_val;
+		throw_ies_error(ss.str());
+	}
+
+	if (pest_scenario.get_pestpp_options().get_ies_debug_fail_subset())
+		failed_real_indices.push_back(real_run_ids.size()-1);
+
+	if (failed_real_indices.size() > 0)
+	{
+		stringstream ss;
+		vector<string> par_real_names = pe.get_real_names();
+		vector<string> obs_real_names = oe.get_real_names();
+		vector<string> failed_par_names, failed_obs_names;
+		string oname, pname;
+		ss << "the following par:obs realization runs failed for lambda,scale " << lam_val << ',' << scale_val << "-->";
+		for (auto &i : failed_real_indices)
 		{
-			failed_real_indices = _oe.update_from_runs(real_run_ids, run_mgr_ptr);
+			pname = par_real_names[subset_idxs[i]];
+			oname = obs_real_names[subset_idxs[i]];
+			failed_par_names.push_back(pname);
+			failed_obs_names.push_back(oname);
+			ss << pname << ":" << oname << ',';
 		}
-		catch (const exception &e)
+		string s = ss.str();
+		message(1,s);
+		if (failed_real_indices.size() == _oe.shape().first)
 		{
-			stringstream ss;
-			ss << "error processing runs for lambda,scale: " << lam_vals[i] << ',' << scale_vals[i] << ':' << e.what();
-			throw_ies_error(ss.str());
+			message(0, "WARNING: all realizations failed for lambda, scale :", rep_vals);
+			_oe = ObservationEnsemble();
+
 		}
-		catch (...)
+		else
 		{
-			stringstream ss;
-			ss << "error processing runs for lambda,scale: " << lam_vals[i] << ',' << scale_vals[i];
-			throw_ies_error(ss.str());
+			performance_log->log_event("dropping failed realizations");
+			_oe.drop_rows(failed_obs_names);
+			pe_lam.drop_rows(failed_par_names);
 		}
 
-		if (pest_scenario.get_pestpp_options().get_ies_debug_fail_subset())
-			failed_real_indices.push_back(real_run_ids.size()-1);
-
-		if (failed_real_indices.size() > 0)
-		{
-			stringstream ss;
-			vector<string> par_real_names = pe.get_real_names();
-			vector<string> obs_real_names = oe.get_real_names();
-			vector<string> failed_par_names, failed_obs_names;
-			string oname, pname;
-			ss << "the following par:obs realization runs failed for lambda,scale " << lam_vals[i] << ',' << scale_vals[i] << "-->";
-			for (auto &i : failed_real_indices)
-			{
-				pname = par_real_names[subset_idxs[i]];
-				oname = obs_real_names[subset_idxs[i]];
-				failed_par_names.push_back(pname);
-				failed_obs_names.push_back(oname);
-				ss << pname << ":" << oname << ',';
-			}
-			string s = ss.str();
-			message(1,s);
-			if (failed_real_indices.size() == _oe.shape().first)
-			{
-				message(0, "WARNING: all realizations failed for lambda, scale :", rep_vals);
-				_oe = ObservationEnsemble();
+	}
+	return _oe;
+}
 
-			}
-			else
-			{
-				performance_log->log_event("dropping failed realizations");
-				//_oe.drop_rows(failed_real_indices);
-				//pe_lams[i].drop_rows(failed_real_indices);
-				_oe.drop_rows(failed_obs_names);
-				pe_lams[i].drop_rows(failed_par_names);
-			}
+bool IterEnsembleSmoother::poll_lambda_runs(vector<ParameterEnsemble> &pe_lams, vector<double> &lam_vals, vector<double> &scale_vals,
+	vector<LambdaRuns> &lam_runs, double max_sec)
+{
+	RunManagerAbstract::RUN_UNTIL_COND cond;
+	try
+	{
+		cond = run_mgr_ptr->run_until(RunManagerAbstract::RUN_UNTIL_COND::TIME, 0, max_sec);
+	}
+	catch (const exception &e)
+	{
+		stringstream ss;
+		ss << "error running ensembles: " << e.what();
+		throw_ies_error(ss.str());
+	}
+	catch (...)
+	{
+		throw_ies_error(string("error running ensembles"));
+	}
+	bool done = (cond == RunManagerAbstract::RUN_UNTIL_COND::NORMAL);
+	if ((!done) && (pest_scenario.get_pestpp_options().get_ies_pipeline_cancel_fac() > 0.0))
+		cancel_lambda_runs(pe_lams, lam_vals, scale_vals, lam_runs);
+	return done;
+}
 
+void IterEnsembleSmoother::cancel_lambda_runs(vector<ParameterEnsemble> &pe_lams, vector<double> &lam_vals, vector<double> &scale_vals,
+	vector<LambdaRuns> &lam_runs)
+{
+	//phi of the finished runs - only lambdas with newly finished runs are recalculated.  the
+	//phi handler is copied so the lambda evaluation is unaffected
+	L2PhiHandler lam_ph = ph;
+	L2PhiHandler::phiType pt = L2PhiHandler::phiType::COMPOSITE;
+	vector<string> par_real_names = pe.get_real_names(), obs_real_names = oe.get_real_names();
+	vector<string> obs_names = oe.get_var_names();
+	for (int i = 0; i < lam_runs.size(); i++)
+	{
+		LambdaRuns &lr = lam_runs[i];
+		if (lr.canceled)
+			continue;
+		map<int, int> part_run_ids;
+		vector<int> finished_idxs;
+		vector<string> pnames, onames;
+		for (auto &rri : lr.real_run_ids)
+		{
+			if (!run_mgr_ptr->run_finished(rri.second))
+				continue;
+			part_run_ids[finished_idxs.size()] = rri.second;
+			finished_idxs.push_back(rri.first);
+			pnames.push_back(par_real_names[rri.first]);
+			onames.push_back(obs_real_names[rri.first]);
 		}
-		obs_lams.push_back(_oe);
+		if ((finished_idxs.size() == 0) || (finished_idxs.size() == lr.phis.size()))
+			continue;
+		ObservationEnsemble oe_part(&pest_scenario, &rand_gen, oe.get_eigen(onames, vector<string>()), onames, obs_names);
+		ParameterEnsemble pe_part(&pest_scenario, &rand_gen, pe_lams[i].get_eigen(pnames, vector<string>()), pnames, pe_lams[i].get_var_names());
+		pe_part.set_trans_status(pe_lams[i].get_trans_status());
+		oe_part.update_from_runs(part_run_ids, run_mgr_ptr);
+		lam_ph.update(oe_part, pe_part);
+		map<string, double> *phi_map = lam_ph.get_phi_map(pt);
+		lr.phis.clear();
+		for (int j = 0; j < finished_idxs.size(); j++)
+		{
+			map<string, double>::iterator it = phi_map->find(onames[j]);
+			if (it != phi_map->end())
+				lr.phis[finished_idxs[j]] = it->second;
+		}
+	}
+
+	//the leader is the lambda with the lowest mean phi over at least half of its runs.  a
+	//lambda is canceled when, over the realizations both have finished, its mean phi is more
+	//than ies_pipeline_cancel_fac times the leader's
+	double cancel_fac = pest_scenario.get_pestpp_options().get_ies_pipeline_cancel_fac();
+	int leader = -1;
+	double leader_mean = numeric_limits<double>::max();
+	for (int i = 0; i < lam_runs.size(); i++)
+	{
+		LambdaRuns &lr = lam_runs[i];
+		int min_count = max(2, (int)lr.real_run_ids.size() / 2);
+		if ((lr.canceled) || (lr.phis.size() < min_count))
+			continue;
+		double sum = 0.0;
+		for (auto &p : lr.phis)
+			sum += p.second;
+		if (sum / lr.phis.size() < leader_mean)
+		{
+			leader_mean = sum / lr.phis.size();
+			leader = i;
+		}
+	}
+	if (leader == -1)
+		return;
+	vector<int> outstanding = run_mgr_ptr->get_outstanding_run_ids();
+	set<int> outstanding_set(outstanding.begin(), outstanding.end());
+	map<int, double> &leader_phis = lam_runs[leader].phis;
+	for (int i = 0; i < lam_runs.size(); i++)
+	{
+		LambdaRuns &lr = lam_runs[i];
+		if ((i == leader) || (lr.canceled))
+			continue;
+		vector<int> cancel_ids;
+		for (auto &rri : lr.real_run_ids)
+			if (outstanding_set.find(rri.second) != outstanding_set.end())
+				cancel_ids.push_back(rri.second);
+		if (cancel_ids.size() == 0)
+			continue;
+		double sum = 0.0, leader_sum = 0.0;
+		int count = 0;
+		for (auto &p : lr.phis)
+		{
+			map<int, double>::iterator it = leader_phis.find(p.first);
+			if (it == leader_phis.end())
+				continue;
+			sum += p.second;
+			leader_sum += it->second;
+			count++;
+		}
+		int min_count = max(2, (int)lr.real_run_ids.size() / 2);
+		if ((count < min_count) || (sum <= cancel_fac * leader_sum))
+			continue;
+		for (auto id : cancel_ids)
+			run_mgr_ptr->cancel_run(id);
+		lr.canceled = true;
+		stringstream ss;
+		ss << "canceling " << cancel_ids.size() << " remaining runs for lambda,scale " << lam_vals[i] << ',' << scale_vals[i]
+			<< ": mean phi " << sum / count << " vs " << leader_sum / count << " for lambda,scale "
+			<< lam_vals[leader] << ',' << scale_vals[leader] << " over " << count << " realizations";
+		message(1, ss.str());
+	}
+}
+
+vector<ObservationEnsemble> IterEnsembleSmoother::finish_lambda_runs(vector<ParameterEnsemble> &pe_lams, vector<double> &lam_vals, vector<double> &scale_vals,
+	vector<LambdaRuns> &lam_runs)
+{
+	performance_log->log_event("making runs");
+	bool done = false;
+	while (!done)
+		done = poll_lambda_runs(pe_lams, lam_vals, scale_vals, lam_runs, 1.0);
+	performance_log->log_event("processing runs");
+	vector<ObservationEnsemble> obs_lams;
+	for (int i = 0; i < pe_lams.size(); i++)
+	{
+		if (lam_runs[i].canceled)
+			obs_lams.push_back(ObservationEnsemble());
+		else
+			obs_lams.push_back(process_lambda_runs(pe_lams[i], lam_runs[i].real_run_ids, lam_vals[i], scale_vals[i]));
 	}
 	return obs_lams;
 }
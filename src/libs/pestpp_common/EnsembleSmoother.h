@@ -17,6 +17,7 @@
 #include "ObjectiveFunc.h"
 #include "Localizer.h"
 #include "EnsembleMethodUtils.h"
+#include "WorkQueue.h"
 
 
 
@@ -27,7 +28,7 @@ public:
 	LocalUpgradeThread(PerformanceLog *_performance_log, unordered_map<string, Eigen::VectorXd> &_par_resid_map, unordered_map<string, Eigen::VectorXd> &_par_diff_map,
 		unordered_map<string, Eigen::VectorXd> &_obs_resid_map, unordered_map<string, Eigen::VectorXd> &_obs_diff_map,
 		Localizer &_localizer, unordered_map<string, double> &_parcov_inv_map,
-		unordered_map<string, double> &_weight_map, ParameterEnsemble &_pe_upgrade,
+		unordered_map<string, double> &_weight_map, vector<ParameterEnsemble> &_pe_upgrades,
 		unordered_map<string, pair<vector<string>, vector<string>>> &_cases,
 		unordered_map<string, Eigen::VectorXd> &_Am_map, Localizer::How &_how);
 
@@ -35,21 +36,23 @@ public:
 	//Eigen::MatrixXd get_matrix_from_map(int num_reals, vector<string> &names, map<string, Eigen::VectorXd> &emap);
 
 
-	void work(int thread_id, int iter, double cur_lam);
+	//solve each local case claimed from queue once and accumulate its upgrade for every
+	//lambda in cur_lams into the matching entry of pe_upgrades
+	void work(int thread_id, int iter, const vector<double> &cur_lams, WorkQueue &queue);
 
 
 private:
 	PerformanceLog * performance_log;
 	Localizer::How how;
 	vector<string> keys;
-	int count, total;
+	int total;
 	//double eigthresh, cur_lam;
 	//int maxsing, num_reals,iter, thread_id;
 	//bool use_approx, use_prior_scaling;
 
 	unordered_map<string, pair<vector<string>, vector<string>>> &cases;
 
-	ParameterEnsemble &pe_upgrade;
+	vector<ParameterEnsemble> &pe_upgrades;
 	//PhiHandler &ph;
 	Localizer &localizer;
 	unordered_map<string, double> &parcov_inv_map;
@@ -58,10 +61,8 @@ private:
 	unordered_map<string, Eigen::VectorXd> &par_resid_map, &par_diff_map, &Am_map;
 	unordered_map<string, Eigen::VectorXd> &obs_resid_map, &obs_diff_map;
 
-	mutex ctrl_lock, weight_lock, loc_lock, parcov_lock;
-	mutex obs_resid_lock, obs_diff_lock, par_resid_lock;
-	mutex par_diff_lock, am_lock, put_lock;
-	mutex next_lock;
+	//the inputs above are shared read-only; only logging and adding to pe_upgrades lock
+	mutex pfm_lock, put_lock;
 	
 };
 
@@ -132,10 +133,32 @@ private:
 	//bool solve_old();
 	bool solve_new();
 
-	ParameterEnsemble calc_localized_upgrade_threaded(double cur_lam, unordered_map<string, pair<vector<string>, vector<string>>> &loc_map);
+	//one upgrade ensemble per lambda in cur_lams
+	vector<ParameterEnsemble> calc_localized_upgrade_threaded(const vector<double> &cur_lams, unordered_map<string, pair<vector<string>, vector<string>>> &loc_map);
 
 	vector<int> run_ensemble(ParameterEnsemble &_pe, ObservationEnsemble &_oe, const vector<int> &real_idxs=vector<int>());
 	vector<ObservationEnsemble> run_lambda_ensembles(vector<ParameterEnsemble> &pe_lams, vector<double> &lam_vals, vector<double> &scale_vals);
+	//queue the subset runs of a lambda ensemble and return their run ids keyed by full ensemble index
+	map<int, int> queue_lambda_runs(ParameterEnsemble &pe_lam);
+	//collect the subset runs of a lambda ensemble.  failed realizations are dropped from pe_lam too
+	ObservationEnsemble process_lambda_runs(ParameterEnsemble &pe_lam, map<int, int> real_run_ids, double lam_val, double scale_val);
+
+	//ies_pipeline_lambdas: the lambda runs are queued as each lambda ensemble is built and the
+	//subset phi is tracked as the runs come back, so clearly worse lambdas can be canceled
+	struct LambdaRuns
+	{
+		map<int, int> real_run_ids;
+		//composite phi of the finished runs, keyed by full ensemble index
+		map<int, double> phis;
+		bool canceled;
+	};
+	//give the run manager up to max_sec, then check on the lambdas.  true once all runs are done
+	bool poll_lambda_runs(vector<ParameterEnsemble> &pe_lams, vector<double> &lam_vals, vector<double> &scale_vals,
+		vector<LambdaRuns> &lam_runs, double max_sec);
+	void cancel_lambda_runs(vector<ParameterEnsemble> &pe_lams, vector<double> &lam_vals, vector<double> &scale_vals,
+		vector<LambdaRuns> &lam_runs);
+	vector<ObservationEnsemble> finish_lambda_runs(vector<ParameterEnsemble> &pe_lams, vector<double> &lam_vals, vector<double> &scale_vals,
+		vector<LambdaRuns> &lam_runs);
 	
 	void report_and_save();
 	void save_mat(string prefix, Eigen::MatrixXd &mat);
@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include "EnsembleStore.h"
+
+using namespace std;
+
+EnsembleStore::EnsembleStore()
+{
+}
+
+void EnsembleStore::open(const string &_filename)
+{
+	close();
+	file.open(_filename, MappedFile::Mode::READ_WRITE);
+	file.resize(0);
+}
+
+int EnsembleStore::add(const Eigen::MatrixXd &mat)
+{
+	if (!file.is_open())
+		throw runtime_error("EnsembleStore::add() error: store not open");
+	Block b;
+	b.offset = file.size();
+	b.rows = mat.rows();
+	b.cols = mat.cols();
+	file.resize(b.offset + (size_t)b.rows * b.cols * sizeof(double));
+	if ((b.rows > 0) && (b.cols > 0))
+	{
+		//eigen is column-major, the store is realization-major
+		double *ptr = reinterpret_cast<double*>(file.data() + b.offset);
+		Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>(ptr, b.rows, b.cols) = mat;
+	}
+	blocks.push_back(b);
+	return blocks.size() - 1;
+}
+
+const EnsembleStore::Block &EnsembleStore::get_block(int block) const
+{
+	if ((block < 0) || (block >= blocks.size()))
+	{
+		stringstream ss;
+		ss << "EnsembleStore error: block " << block << " not in store (" << blocks.size() << " blocks)";
+		throw runtime_error(ss.str());
+	}
+	return blocks[block];
+}
+
+int EnsembleStore::get_num_rows(int block) const
+{
+	return get_block(block).rows;
+}
+
+Eigen::MatrixXd EnsembleStore::get_rows(int block, const vector<int> &row_idxs) const
+{
+	const Block &b = get_block(block);
+	Eigen::MatrixXd mat(row_idxs.size(), b.cols);
+	if (b.cols == 0)
+		return mat;
+	const double *ptr = reinterpret_cast<const double*>(file.data() + b.offset);
+	for (int i = 0; i < row_idxs.size(); i++)
+	{
+		if ((row_idxs[i] < 0) || (row_idxs[i] >= b.rows))
+		{
+			stringstream ss;
+			ss << "EnsembleStore::get_rows() error: row " << row_idxs[i] << " not in block " << block << " (" << b.rows << " rows)";
+			throw runtime_error(ss.str());
+		}
+		mat.row(i) = Eigen::Map<const Eigen::RowVectorXd>(ptr + (size_t)row_idxs[i] * b.cols, b.cols);
+	}
+	return mat;
+}
+
+void EnsembleStore::close()
+{
+	if (!file.is_open())
+		return;
+	string filename = file.get_filename();
+	file.close();
+	blocks.clear();
+	remove(filename.c_str());
+}
+
+EnsembleStore::~EnsembleStore()
+{
+	close();
+}
@@ -0,0 +1,40 @@
+#ifndef ENSEMBLE_STORE_H_
+#define ENSEMBLE_STORE_H_
+
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "mapped_file.h"
+
+//scratch storage for realization matrices in a memory-mapped file.  each matrix
+//is stored as a block of realization rows, so pulling a handful of realizations
+//back out only touches the pages that hold them and the OS is free to drop the rest.
+//the file is removed when the store is destroyed
+class EnsembleStore
+{
+public:
+	EnsembleStore();
+	void open(const std::string &_filename);
+	bool is_open() const { return file.is_open(); }
+	//append a block and return its index
+	int add(const Eigen::MatrixXd &mat);
+	int get_num_rows(int block) const;
+	//copy the rows row_idxs of block into a dense matrix
+	Eigen::MatrixXd get_rows(int block, const std::vector<int> &row_idxs) const;
+	void close();
+	~EnsembleStore();
+private:
+	struct Block
+	{
+		size_t offset;
+		int rows;
+		int cols;
+	};
+	MappedFile file;
+	std::vector<Block> blocks;
+	const Block &get_block(int block) const;
+	EnsembleStore(const EnsembleStore &) = delete;
+	EnsembleStore &operator=(const EnsembleStore &) = delete;
+};
+
+#endif //ENSEMBLE_STORE_H_
@@ -21,6 +21,7 @@
 #include <vector>
 #include <fstream>
 #include <iomanip>
+#include <algorithm>
 #include "Jacobian.h"
 #include "Transformable.h"
 #include "ParamTransformSeq.h"
@@ -35,12 +36,13 @@
 #include "debug.h"
 #include "eigen_tools.h"
 #include "Pest.h"
+#include "WorkQueue.h"
 
 using namespace std;
 using namespace pest_utils;
 using namespace Eigen;
 
-Jacobian::Jacobian(FileManager &_file_manager) : file_manager(_file_manager)
+Jacobian::Jacobian(FileManager &_file_manager) : file_manager(_file_manager), num_threads(-1)
 {
 }
 
@@ -318,7 +320,6 @@ bool Jacobian::process_runs(ParamTransformSeq &par_transform,
   base_sim_obs_names = run_manager.get_obs_name_vec();
 	vector<string> prior_info_name = prior_info.get_keys();
 	base_sim_obs_names.insert(base_sim_obs_names.end(), prior_info_name.begin(), prior_info_name.end());
-	std::vector<Eigen::Triplet<double> > triplet_list;
 
 	JacobianRun base_run;
 	int i_run = 0;
@@ -335,72 +336,201 @@ bool Jacobian::process_runs(ParamTransformSeq &par_transform,
 		++i_run;
 	}
 
-	// process the parameter pertubation runs
+	// group the parameter pertubation runs into columns - the runs of a parameter are consecutive
 	int nruns = run_manager.get_nruns();
-	int icol = 0;
 	int r_status;
 	string cur_par_name;
-	string par_name_next;
-	int run_status_next;
-	double par_value_next;
 	double cur_numeric_par_value;
-	list<JacobianRun> run_list;
-	base_numeric_par_names.clear();
+	vector<DerivativeColumn> cols;
 	for(; i_run<nruns; ++i_run)
 	{
-		run_list.push_back(JacobianRun());
-				run_manager. get_info(i_run, r_status, cur_par_name, cur_numeric_par_value);
-		run_manager.get_model_parameters(i_run,  run_list.back().ctl_pars);
-			bool success = run_manager.get_observations_vec(i_run, run_list.back().obs_vec);
-			if ((debug_fail) && (i_run == 1))
+		run_manager.get_info(i_run, r_status, cur_par_name, cur_numeric_par_value);
+		if ((cols.empty()) || (cols.back().par_name != cur_par_name))
+		{
+			cols.push_back(DerivativeColumn());
+			cols.back().par_name = cur_par_name;
+		}
+		cols.back().run_ids.push_back(i_run);
+		cols.back().info_values.push_back(cur_numeric_par_value);
+	}
+
+	//the perturbed value of a run is its info value.  the prior information is differenced on the
+	//ctl values of the runs, which only need to hold the values that differ from the base run
+	auto load_runs = [&](vector<DerivativeColumn> &block_cols, int beg, int end)
+	{
+		Parameters ctl_pars;
+		for (int c = beg; c < end; ++c)
+		{
+			DerivativeColumn &col = block_cols[c];
+			for (int k = 0; k < col.runs.size(); ++k)
 			{
-		
-				file_manager.rec_ofstream() << "NOTE: 'GLM_DEBUG_DER_FAIL' is true, failing jco run for parameter '" << cur_par_name << "'" << endl;
-				success = false;
+				JacobianRun &run = col.runs[k];
+				int idx = find(col.run_ids.begin(), col.run_ids.end(), col.good_run_ids[k]) - col.run_ids.begin();
+				run.numeric_derivative_par = col.info_values[idx];
+				if (prior_info.size() == 0)
+					continue;
+				run_manager.get_model_parameters(col.good_run_ids[k], ctl_pars);
+				par_transform.model2ctl_ip(ctl_pars);
+				for (auto &p : ctl_pars)
+				{
+					if (p.second != base_run.ctl_pars.get_rec(p.first))
+						run.ctl_pars.insert(p.first, p.second);
+				}
 			}
-		if (success)
+		}
+	};
+	auto column_failed = [&](const DerivativeColumn &col)
+	{
+		failed_parameter_names.insert(col.par_name);
+		throw(PestError("Error: All runs for parameter: " + col.par_name
+			+ " failed.  Cannot compute the Jacobian"));
+	};
+	calc_derivative_columns(run_manager, cols, base_run, group_info, prior_info, splitswh_flag, debug_fail,
+		load_runs, column_failed);
+	// clean up
+	run_manager.free_memory();
+	return true;
+}
+
+void Jacobian::calc_derivative_columns(RunManagerAbstract &run_manager, vector<DerivativeColumn> &cols, const JacobianRun &base_run,
+	const ParameterGroupInfo &group_info, const PriorInformation &prior_info, bool splitswh_flag, bool debug_fail,
+	const function<void(vector<DerivativeColumn>&, int, int)> &load_runs,
+	const function<void(const DerivativeColumn&)> &column_failed)
+{
+	int n_obs = run_manager.get_obs_name_vec().size();
+	PriorInfoRows pi_rows;
+	pi_rows.first_row = n_obs;
+	for (int irow = n_obs; irow < base_sim_obs_names.size(); ++irow)
+	{
+		int k = pi_rows.recs.size();
+		pi_rows.recs.push_back(&(prior_info.find(base_sim_obs_names[irow])->second));
+		for (auto &atom : pi_rows.recs.back()->get_atoms())
 		{
-			par_transform.model2ctl_ip(run_list.back().ctl_pars);
-			run_list.back().numeric_derivative_par = cur_numeric_par_value;
+			vector<int> &rows = pi_rows.rows_by_par[atom.par_name];
+			if ((rows.empty()) || (rows.back() != k))
+				rows.push_back(k);
+			if (pi_rows.base_pars.find(atom.par_name) == pi_rows.base_pars.end())
+				pi_rows.base_pars.insert(atom.par_name, base_run.ctl_pars.get_rec(atom.par_name));
 		}
-		else
+	}
+
+	//per-thread copies of the base run: its obs and a scratch set of the prior information parameters
+	JacobianRun base_obs_run(base_run.obs_vec);
+	vector<JacobianRun> thread_base_runs(max(1, num_threads), base_obs_run);
+	vector<Parameters> thread_pi_pars(max(1, num_threads), pi_rows.base_pars);
+
+	//the matrix is filled directly in column (CSC) order from these
+	vector<int> col_starts(1, 0);
+	vector<int> inner;
+	vector<double> values;
+	base_numeric_par_names.clear();
+
+	size_t row_bytes = max(1, n_obs) * sizeof(double);
+	Eigen::MatrixXd obs_block;
+	int block_beg = 0;
+	while (block_beg < cols.size())
+	{
+		//a block of whole columns whose runs fit in obs_block_bytes
+		vector<int> block_ids;
+		int block_end = block_beg;
+		while ((block_end < cols.size()) && ((block_end == block_beg) ||
+			((block_ids.size() + cols[block_end].run_ids.size()) * row_bytes <= obs_block_bytes)))
 		{
-			run_list.pop_back();
+			block_ids.insert(block_ids.end(), cols[block_end].run_ids.begin(), cols[block_end].run_ids.end());
+			++block_end;
 		}
+		vector<int> status = run_manager.get_observations_matrix(block_ids, obs_block);
 
-		// read information associated with the next model run;
-		if (i_run+1<nruns)
+		//keep the successful runs, recording the obs block row of each
+		vector<vector<int>> block_rows(block_end - block_beg);
+		int irow = 0;
+		for (int c = block_beg; c < block_end; ++c)
 		{
-			run_manager.get_info(i_run+1, run_status_next, par_name_next, par_value_next);
+			DerivativeColumn &col = cols[c];
+			col.good_run_ids.clear();
+			col.runs.clear();
+			for (auto run_id : col.run_ids)
+			{
+				bool success = status[irow] > 0;
+				if ((debug_fail) && (run_id == 1))
+				{
+					file_manager.rec_ofstream() << "NOTE: 'GLM_DEBUG_DER_FAIL' is true, failing jco run for parameter '" << col.par_name << "'" << endl;
+					success = false;
+				}
+				if (success)
+				{
+					col.good_run_ids.push_back(run_id);
+					col.runs.push_back(JacobianRun());
+					block_rows[c - block_beg].push_back(irow);
+				}
+				++irow;
+			}
+			if (col.runs.empty())
+				column_failed(col);
 		}
+		load_runs(cols, block_beg, block_end);
 
-		if (i_run + 1 >= nruns || (cur_par_name != par_name_next))
+		vector<vector<int>> col_rows(block_end - block_beg);
+		vector<vector<double>> col_values(block_end - block_beg);
+		int n_items = (block_end - block_beg + col_chunk_size - 1) / col_chunk_size;
+		WorkQueue::for_each(n_items, num_threads, 1, [&](int thread_id, int item)
 		{
-			if (!run_list.empty())
+			int i_beg = item * col_chunk_size;
+			int i_end = min(i_beg + col_chunk_size, block_end - block_beg);
+			//copy the simulated values of the runs, which are neighboring rows of the obs block
+			for (int i = i_beg; i < i_end; ++i)
+			{
+				for (auto &run : cols[block_beg + i].runs)
+					run.obs_vec.resize(n_obs);
+			}
+			for (int j = 0; j < n_obs; ++j)
 			{
-				base_numeric_par_names.push_back(cur_par_name);
-				double base_numeric_par_value = base_numeric_parameters.get_rec(cur_par_name);
-				base_run.numeric_derivative_par = base_numeric_par_value;
-				run_list.push_front(base_run);
-				std::vector<Eigen::Triplet<double> > tmp_triplet_vec = calc_derivative(cur_par_name, base_numeric_par_value, icol, run_list, group_info, prior_info, splitswh_flag);
-				triplet_list.insert(triplet_list.end(), tmp_triplet_vec.begin(), tmp_triplet_vec.end());
-				icol++;
-				run_list.clear();
+				for (int i = i_beg; i < i_end; ++i)
+				{
+					vector<JacobianRun> &runs = cols[block_beg + i].runs;
+					for (int k = 0; k < runs.size(); ++k)
+						runs[k].obs_vec[j] = obs_block(block_rows[i][k], j);
+				}
 			}
-			else
+			JacobianRun &base = thread_base_runs[thread_id];
+			vector<const JacobianRun*> run_ptrs;
+			for (int i = i_beg; i < i_end; ++i)
 			{
-				failed_parameter_names.insert(cur_par_name);
-				throw(PestError("Error: All runs for parameter: " + cur_par_name
-					+ " failed.  Cannot compute the Jacobian"));
+				DerivativeColumn &col = cols[block_beg + i];
+				if (col.runs.empty())
+					continue;
+				base.numeric_derivative_par = base_numeric_parameters.get_rec(col.par_name);
+				run_ptrs.clear();
+				run_ptrs.push_back(&base);
+				for (auto &run : col.runs)
+					run_ptrs.push_back(&run);
+				calc_derivative(col.par_name, base.numeric_derivative_par, run_ptrs, group_info, pi_rows,
+					thread_pi_pars[thread_id], splitswh_flag, col_rows[i], col_values[i]);
+				col.runs.clear();
 			}
+		});
+
+		for (int c = block_beg; c < block_end; ++c)
+		{
+			if (cols[c].good_run_ids.empty())
+				continue;
+			base_numeric_par_names.push_back(cols[c].par_name);
+			inner.insert(inner.end(), col_rows[c - block_beg].begin(), col_rows[c - block_beg].end());
+			values.insert(values.end(), col_values[c - block_beg].begin(), col_values[c - block_beg].end());
+			col_starts.push_back(inner.size());
 		}
+		block_beg = block_end;
 	}
+
 	matrix.resize(base_sim_obs_names.size(), base_numeric_par_names.size());
-	matrix.setZero();
-	matrix.setFromTriplets(triplet_list.begin(), triplet_list.end());
-	// clean up
-	run_manager.free_memory();
-	return true;
+	matrix.reserve(values.size());
+	for (int jcol = 0; jcol < base_numeric_par_names.size(); ++jcol)
+	{
+		matrix.startVec(jcol);
+		for (int k = col_starts[jcol]; k < col_starts[jcol + 1]; ++k)
+			matrix.insertBack(inner[k], jcol) = values[k];
+	}
+	matrix.finalize();
 }
 
 bool Jacobian::get_derivative_parameters(const string &par_name, Parameters &numeric_pars, ParamTransformSeq &par_transform, 
@@ -456,128 +586,149 @@ bool Jacobian::get_derivative_parameters(const string &par_name, Parameters &num
 }
 
 
-std::vector<Eigen::Triplet<double> >  Jacobian::calc_derivative(const string &numeric_par_name, double base_numeric_par_value, int jcol, list<JacobianRun> &run_list,
-	const ParameterGroupInfo &group_info, const PriorInformation &prior_info, bool splitswh_flag)
+void Jacobian::calc_derivative(const string &numeric_par_name, double base_numeric_par_value, vector<const JacobianRun*> &runs,
+	const ParameterGroupInfo &group_info, const PriorInfoRows &pi_rows, Parameters &pi_pars, bool splitswh_flag,
+	vector<int> &col_rows, vector<double> &col_values) const
 {
 	const ParameterGroupRec *g_rec;
 	double del_par;
 	double del_obs;
 	double der;
-	int irow;
-	Parameters::const_iterator par_iter;
-	std::vector<Eigen::Triplet<double> > triplet_list;
 
-	// sort run_list the parameter numeric_par_name;
-	auto compare = [](const JacobianRun &a, const JacobianRun &b)
-	{return a.numeric_derivative_par > b.numeric_derivative_par; };
-	run_list.sort(compare);
-	auto &run_first = run_list.front();
-	auto  &run_last = run_list.back();
+	// sort runs by the parameter numeric_par_name;
+	auto compare = [](const JacobianRun *a, const JacobianRun *b)
+	{return a->numeric_derivative_par > b->numeric_derivative_par; };
+	stable_sort(runs.begin(), runs.end(), compare);
+	const JacobianRun &run_first = *runs.front();
+	const JacobianRun &run_last = *runs.back();
 
 	//p_rec = group_info.get_parameter_rec_ptr(*par_name);
 	g_rec = group_info.get_group_rec_ptr(numeric_par_name);
 	double splitthresh = g_rec->splitthresh;
 	double splitreldiff = g_rec->splitreldiff;
 
-	irow = 0;
+	// Central Difference Parabola
+	// Solve Ac = o for c to get the equation for a parabola where:
+	//        | p0**2  p0  1 |               | c0 |            | o0 |
+	//   A =  | p1**2  p1  1 |          c =  | c1 |        y = | o1 |
+	//        | p2**2  p2  1 |               | c2 |            | o2 |
+	// then compute the derivative as:
+	//   dy/dx = 2 * c0 * base_numeric_par_value + c1
+	// A is the same for every observation, so it is only factored once
+	bool parabolic = (runs.size() == 3 && g_rec->dermthd == "PARABOLIC");
+	Eigen::ColPivHouseholderQR<MatrixXd> a_qr;
+	if (parabolic)
+	{
+		MatrixXd a_mat(3, 3);
+		for (int i = 0; i < 3; ++i)
+		{
+			double par_value = runs[i]->numeric_derivative_par;
+			a_mat(i, 0) = par_value*par_value; a_mat(i, 1) = par_value; a_mat(i, 2) = 1;
+		}
+		a_qr.compute(a_mat);
+	}
+
 	vector<double> sen_vec;
-	for (auto &iobs_name : base_sim_obs_names)
+	VectorXd c(3), y(3);
+	for (int irow = 0; irow < pi_rows.first_row; ++irow)
 	{
-		// Check if this is not prior infomation
-		if (prior_info.find(iobs_name) == prior_info.end())
+		//Apply Split threshold on derivative if applicable
+		bool success = false;
+		if (runs.size() == 3 && splitswh_flag == true && splitswh_flag)
 		{
-			//Apply Split threshold on derivative if applicable
-			bool success = false;
-			if (run_list.size() == 3 && splitswh_flag == true && splitswh_flag)
+			sen_vec.clear();
+			for (int i = 1; i < runs.size(); ++i)
 			{
-				sen_vec.clear();
-				list<JacobianRun>::const_iterator iter_run = run_list.begin();
-				list<JacobianRun>::const_iterator run_2 = run_list.begin();
-				for (++iter_run; iter_run != run_list.end(); ++iter_run)
-				{
-					list<JacobianRun>::const_iterator run_1 = run_2;
-					run_2 = iter_run;
-					del_par = run_2->numeric_derivative_par - run_1->numeric_derivative_par;
-					del_obs = run_2->obs_vec[irow] - run_1->obs_vec[irow];
-					sen_vec.push_back(del_obs / del_par);
-				}
-				std::sort(sen_vec.begin(), sen_vec.end(), [](double a, double b) {
-					return std::abs(a) < std::abs(b);});
-				if (abs(sen_vec.back()) >= splitthresh &&
-					abs(sen_vec.back() - sen_vec.front()) / sen_vec.front() > splitreldiff )
-				{
-					success = true;
-					if (sen_vec.front() != 0)
-					{
-						triplet_list.push_back(Eigen::Triplet<double>(irow, jcol, sen_vec.front() ));
-					}
-				}
+				del_par = runs[i]->numeric_derivative_par - runs[i - 1]->numeric_derivative_par;
+				del_obs = runs[i]->obs_vec[irow] - runs[i - 1]->obs_vec[irow];
+				sen_vec.push_back(del_obs / del_par);
 			}
-
-			if (run_list.size() == 3 && g_rec->dermthd == "PARABOLIC" && !success)
+			std::sort(sen_vec.begin(), sen_vec.end(), [](double a, double b) {
+				return std::abs(a) < std::abs(b);});
+			if (abs(sen_vec.back()) >= splitthresh &&
+				abs(sen_vec.back() - sen_vec.front()) / sen_vec.front() > splitreldiff )
 			{
-				// Central Difference Parabola
-				// Solve Ac = o for c to get the equation for a parabola where:
-				//        | p0**2  p0  1 |               | c0 |            | o0 |
-				//   A =  | p1**2  p1  1 |          c =  | c1 |        y = | o1 |
-				//        | p2**2  p2  1 |               | c2 |            | o2 |
-				// then compute the derivative as:
-				//   dy/dx = 2 * c0 * base_numeric_par_value + c1
-				auto &run2 = (*(++run_list.begin()));
-				MatrixXd a_mat(3,3);
-				VectorXd c(3), y(3);
-				// assemble A matrix
-				int i=0;
-				for (auto &irun_pair : run_list)
-				{
-					// assemble A matrix
-					double par_value = irun_pair.numeric_derivative_par;
-					a_mat(i,0) = par_value*par_value; a_mat(i,1) = par_value; a_mat(i,2) = 1;
-					// assemble y vector
-					y(i) =  irun_pair.obs_vec[irow];
-					++i;
-				}
-				c = a_mat.colPivHouseholderQr().solve(y);
-				//derivative is calculated around "base_numeric_par_value"
-				der = 2.0 * c(0) *  base_numeric_par_value + c(1);
-				if (der != 0)
+				success = true;
+				if (sen_vec.front() != 0)
 				{
-					triplet_list.push_back(Eigen::Triplet<double>(irow, jcol, der));
+					col_rows.push_back(irow);
+					col_values.push_back(sen_vec.front());
 				}
 			}
-			else if (!success)
+		}
+
+		if (parabolic && !success)
+		{
+			for (int i = 0; i < 3; ++i)
+				y(i) = runs[i]->obs_vec[irow];
+			c = a_qr.solve(y);
+			//derivative is calculated around "base_numeric_par_value"
+			der = 2.0 * c(0) *  base_numeric_par_value + c(1);
+			if (der != 0)
 			{
-				// Forward Difference and Central Difference Outer
-				del_par = run_last.numeric_derivative_par - run_first.numeric_derivative_par;
-				del_obs = run_last.obs_vec[irow] - run_first.obs_vec[irow];
-				if (del_obs != 0)
-				{
-					triplet_list.push_back(Eigen::Triplet<double>(irow, jcol, del_obs / del_par));
-				}
+				col_rows.push_back(irow);
+				col_values.push_back(der);
 			}
 		}
-		else
+		else if (!success)
 		{
-			// Prior Information allways calculated using outer model runs even for central difference
+			// Forward Difference and Central Difference Outer
 			del_par = run_last.numeric_derivative_par - run_first.numeric_derivative_par;
-			double del_prior_info;
-
-			const PriorInformationRec *pi_rec;
-			const Parameters &ctl_pars_1 = run_first.ctl_pars;
-			const Parameters &ctl_pars_2 = run_last.ctl_pars;
-			const auto prior_info_it = prior_info.find(iobs_name);
-			if (prior_info_it != prior_info.end())
+			del_obs = run_last.obs_vec[irow] - run_first.obs_vec[irow];
+			if (del_obs != 0)
 			{
-				pi_rec = &(prior_info_it->second);
-				del_prior_info = pi_rec->calc_residual(ctl_pars_2) - pi_rec->calc_residual(ctl_pars_1);
-				if (del_prior_info != 0) {
-					triplet_list.push_back(Eigen::Triplet<double>(irow, jcol, del_prior_info / del_par));
-				}
+				col_rows.push_back(irow);
+				col_values.push_back(del_obs / del_par);
 			}
 		}
-		++irow;
 	}
-	return triplet_list;
+
+	if (pi_rows.recs.empty())
+		return;
+	// Prior Information allways calculated using outer model runs even for central difference.
+	// only the equations with a parameter that differs from the base run can change
+	vector<int> rows;
+	for (auto run : { &run_first, &run_last })
+	{
+		for (auto &p : run->ctl_pars)
+		{
+			auto it = pi_rows.rows_by_par.find(p.first);
+			if (it != pi_rows.rows_by_par.end())
+				rows.insert(rows.end(), it->second.begin(), it->second.end());
+		}
+	}
+	sort(rows.begin(), rows.end());
+	rows.erase(unique(rows.begin(), rows.end()), rows.end());
+	vector<double> res_first(rows.size()), res_last(rows.size());
+	auto calc_residuals = [&](const JacobianRun &run, vector<double> &res)
+	{
+		for (auto &p : run.ctl_pars)
+		{
+			auto it = pi_pars.find(p.first);
+			if (it != pi_pars.end())
+				it->second = p.second;
+		}
+		for (int k = 0; k < rows.size(); ++k)
+			res[k] = pi_rows.recs[rows[k]]->calc_residual(pi_pars);
+		for (auto &p : run.ctl_pars)
+		{
+			auto it = pi_pars.find(p.first);
+			if (it != pi_pars.end())
+				it->second = pi_rows.base_pars.get_rec(p.first);
+		}
+	};
+	calc_residuals(run_first, res_first);
+	calc_residuals(run_last, res_last);
+	del_par = run_last.numeric_derivative_par - run_first.numeric_derivative_par;
+	for (int k = 0; k < rows.size(); ++k)
+	{
+		double del_prior_info = res_last[k] - res_first[k];
+		if (del_prior_info != 0)
+		{
+			col_rows.push_back(pi_rows.first_row + rows[k]);
+			col_values.push_back(del_prior_info / del_par);
+		}
+	}
 }
 
 
@@ -731,6 +882,7 @@ Jacobian& Jacobian::operator=(const Jacobian &rhs)
 	base_sim_observations = rhs.base_sim_observations;
 	matrix = rhs.matrix;
 	file_manager = rhs.file_manager;
+	num_threads = rhs.num_threads;
 	return *this;
 }
 void Jacobian::transform(const ParamTransformSeq &par_trans, void(ParamTransformSeq::*meth_prt)(Jacobian &jac) const)
@@ -24,6 +24,7 @@
 #include<vector>
 #include<set>
 #include<list>
+#include<functional>
 #include<Eigen/Dense>
 #include<Eigen/Sparse>
 #include "Transformable.h"
@@ -37,6 +38,7 @@ class RunManagerAbstract;
 class ModelRun;
 class FileManager;
 class PriorInformation;
+class PriorInformationRec;
 
 class JacobianRun{
 public:
@@ -110,6 +112,8 @@ public:
 
 	void set_base_numeric_pars(Parameters _base_numeric_pars);
 	void set_base_sim_obs(Observations _base_sim_obs);
+	//threads used to difference the columns in process_runs().  < 1 differences them on the calling thread
+	void set_num_threads(int _num_threads) { num_threads = _num_threads; }
 
 protected:
 
@@ -123,9 +127,43 @@ protected:
 	//const vector<string> &ctl_file_ordered_pi_names;
 	Eigen::SparseMatrix<double> matrix;
 	FileManager &file_manager;  // filemanger used to get name of jaobian file
-
-	virtual std::vector<Eigen::Triplet<double> > calc_derivative(const string &numeric_par_name, double base_numeric_par_value, int jcol, list<JacobianRun> &run_list, const ParameterGroupInfo &group_info,
-		const PriorInformation &prior_info, bool splitswh_flag);
+	int num_threads;
+
+	//the runs of one derivative parameter.  run_ids and info_values are set by process_runs();
+	//good_run_ids and runs (one per successful run, without obs_vec) by calc_derivative_columns()
+	class DerivativeColumn
+	{
+	public:
+		string par_name;
+		vector<int> run_ids;
+		vector<double> info_values;
+		vector<int> good_run_ids;
+		vector<JacobianRun> runs;
+	};
+	//the prior information rows (they follow the observation rows), the rows each parameter
+	//appears in and the ctl values of those parameters in the base run
+	class PriorInfoRows
+	{
+	public:
+		int first_row;
+		vector<const PriorInformationRec*> recs;
+		unordered_map<string, vector<int>> rows_by_par;
+		Parameters base_pars;
+	};
+	//difference the runs of each column and fill matrix.  the simulated values are bulk-read a block
+	//of whole columns at a time and the columns of a block are differenced in parallel.  load_runs(cols,
+	//beg, end) is called on each block to set numeric_derivative_par and ctl_pars of the runs; the ctl_pars
+	//of a run only need to hold the values that differ from base_run.  column_failed() is called on a
+	//column with no successful runs, which is left out of the matrix
+	void calc_derivative_columns(RunManagerAbstract &run_manager, vector<DerivativeColumn> &cols, const JacobianRun &base_run,
+		const ParameterGroupInfo &group_info, const PriorInformation &prior_info, bool splitswh_flag, bool debug_fail,
+		const std::function<void(vector<DerivativeColumn>&, int, int)> &load_runs,
+		const std::function<void(const DerivativeColumn&)> &column_failed);
+	//difference the runs of one parameter (the base run included) and append the non-zero entries of
+	//the column to col_rows and col_values in row order.  pi_pars is a scratch copy of pi_rows.base_pars
+	virtual void calc_derivative(const string &numeric_par_name, double base_numeric_par_value, vector<const JacobianRun*> &runs,
+		const ParameterGroupInfo &group_info, const PriorInfoRows &pi_rows, Parameters &pi_pars, bool splitswh_flag,
+		vector<int> &col_rows, vector<double> &col_values) const;
 	virtual bool forward_diff(const string &par_name, const Parameters &pest_parameters,
 		const ParameterGroupInfo &group_info, const ParameterInfo &ctl_par_info, const ParamTransformSeq &par_trans,
 		double &new_par, set<string> &out_of_bound_par);
@@ -138,6 +176,11 @@ protected:
 		vector<double> &delta_numeric_par_vec, bool phiredswh_flag, set<string> &out_of_bound_par);
 	virtual unordered_map<string, int> get_par2col_map() const;
 	virtual unordered_map<string, int> get_obs2row_map() const;
+	//storage for the simulated values of one block of columns in calc_derivative_columns()
+	static const size_t obs_block_bytes = 128 * 1024 * 1024;
+	//columns differenced per work item.  their runs are neighboring rows of the obs block, so the
+	//simulated values are copied out of it a short row tile at a time
+	static const int col_chunk_size = 16;
 };
 
 #endif /* JACOBIAN_H_ */
@@ -231,11 +231,6 @@ bool Jacobian_1to1::process_runs(ParamTransformSeq &par_transform,
        base_sim_obs_names = run_manager.get_obs_name_vec();
 	vector<string> prior_info_name = prior_info.get_keys();
 	base_sim_obs_names.insert(base_sim_obs_names.end(), prior_info_name.begin(), prior_info_name.end());
-	std::vector<Eigen::Triplet<double> > triplet_list;
-
-	unordered_map<string, int> par2col_map = get_par2col_map();
-	unordered_map<string, int>::iterator found;
-	unordered_map<string, int>::iterator not_found = par2col_map.end();
 
 	JacobianRun base_run;
 	int i_run = 0;
@@ -272,130 +267,69 @@ bool Jacobian_1to1::process_runs(ParamTransformSeq &par_transform,
 
 		
 
-	// process the parameter pertubation runs
-	int nruns = run_manager.get_nruns();
-	base_numeric_par_names.clear();
-	int icol = 0;
+	// process the parameter pertubation runs.  as before, only the first run of each parameter is
+	// differenced against the base run
 	int r_status;
-	vector<string>par_name_vec;
 	string cur_par_name;
-	string par_name_next;
-	int run_status_next;
-	double par_value_next;
 	double cur_numeric_par_value;
-	list<JacobianRun> run_list;
-	
-	//for(; i_run<nruns; ++i_run)
-	//{
-	//	run_list.push_back(JacobianRun());
-	//	run_manager. get_info(i_run, r_status, cur_par_name, cur_numeric_par_value);
-	//	run_manager.get_model_parameters(i_run,  run_list.back().ctl_pars);
-	//    bool success = run_manager.get_observations_vec(i_run, run_list.back().obs_vec);
-	//	run_list.back().numeric_derivative_par = cur_numeric_par_value;
-	//	/*if ((debug_fail) && (i_run == 1))
-	//	{
-	//		file_manager.rec_ofstream() << "NOTE: 'GLM_DEBUG_DER_FAIL' is true, failing jco run for parameter '" << cur_par_name << "'" << endl;
-	//		success = false;
-	//	}*/
-	//	if (success)
-	//	{
-	//		par_transform.model2ctl_ip(run_list.back().ctl_pars);
-	//		// get the updated parameter value which reflects roundoff errors
-	//		
-	//		par_name_vec.clear();
-	//		par_name_vec.push_back(cur_par_name);
-	//		Parameters numeric_pars(run_list.back().ctl_pars, par_name_vec);
-	//		par_transform.ctl2numeric_ip(numeric_pars);
-	//		run_list.back().numeric_derivative_par = numeric_pars.get_rec(cur_par_name);
-	//	}
-	//	else
-	//	{
-	//		run_list.pop_back();
-	//	}
-
-	//	// read information associated with the next model run;
-	//	if (i_run+1<nruns)
-	//	{
-	//		run_manager.get_info(i_run+1, run_status_next, par_name_next, par_value_next);
-	//	}
-
-	//	if( i_run+1>=nruns || (cur_par_name !=par_name_next) )
-	//	{
-	//		if (!run_list.empty())
-	//		{
-	//			base_numeric_par_names.push_back(cur_par_name);
-	//			base_run.numeric_derivative_par = base_numeric_parameters.get_rec(cur_par_name);
-	//			double cur_numeric_value = base_run.numeric_derivative_par;
-	//			run_list.push_front(base_run);
-	//			std::vector<Eigen::Triplet<double> > tmp_triplet_vec = calc_derivative(cur_par_name, cur_numeric_value, icol, run_list, group_info, prior_info, splitswh_flag);
-	//			triplet_list.insert( triplet_list.end(), tmp_triplet_vec.begin(), tmp_triplet_vec.end() );
-	//			icol++;
-	//		}
-	//		else
-	//		{
-	//			failed_parameter_names.insert(cur_par_name);
-	//			failed_ctl_parameters.insert(cur_par_name, cur_numeric_par_value);
-	//		}
-	//		run_list.clear();
-	//	}
-	//}
-
-	//for(; i_run<nruns; ++i_run)
-	for (auto par_run : par_run_map)
+	vector<DerivativeColumn> cols;
+	for (auto &par_run : par_run_map)
+	{
+		run_manager.get_info(par_run.second[0], r_status, cur_par_name, cur_numeric_par_value);
+		cols.push_back(DerivativeColumn());
+		cols.back().par_name = par_run.first;
+		cols.back().run_ids.push_back(par_run.second[0]);
+		cols.back().info_values.push_back(cur_numeric_par_value);
+	}
+
+	// the runs only differ from the base run in the perturbed parameter, so only its value is read.
+	// the values are transformed together (the ctl <-> model transforms act on each parameter on its
+	// own), with the numeric value taken from the ctl value to reflect roundoff errors
+	unordered_map<string, int> par_idx_map;
+	const vector<string> &run_par_names = run_manager.get_par_name_vec();
+	for (int i = 0; i < run_par_names.size(); ++i)
+		par_idx_map[run_par_names[i]] = i;
+	auto load_runs = [&](vector<DerivativeColumn> &block_cols, int beg, int end)
 	{
-		run_list.push_back(JacobianRun());
-		for (auto rid : par_run.second)
+		vector<int> run_ids, par_idxs;
+		for (int c = beg; c < end; ++c)
 		{
-			run_manager.get_info(par_run.second[0], r_status, cur_par_name, cur_numeric_par_value);
-			run_manager.get_model_parameters(par_run.second[0], run_list.back().ctl_pars);
-			bool success = run_manager.get_observations_vec(par_run.second[0], run_list.back().obs_vec);
-			run_list.back().numeric_derivative_par = cur_numeric_par_value;
-			/*if ((debug_fail) && (i_run == 1))
+			for (auto run_id : block_cols[c].good_run_ids)
 			{
-				file_manager.rec_ofstream() << "NOTE: 'GLM_DEBUG_DER_FAIL' is true, failing jco run for parameter '" << cur_par_name << "'" << endl;
-				success = false;
-			}*/
-			if (success)
-			{
-				par_transform.model2ctl_ip(run_list.back().ctl_pars);
-				// get the updated parameter value which reflects roundoff errors
-
-				par_name_vec.clear();
-				par_name_vec.push_back(cur_par_name);
-				Parameters numeric_pars(run_list.back().ctl_pars, par_name_vec);
-				par_transform.ctl2numeric_ip(numeric_pars);
-				run_list.back().numeric_derivative_par = numeric_pars.get_rec(cur_par_name);
-			}
-			else
-			{
-				run_list.pop_back();
+				run_ids.push_back(run_id);
+				par_idxs.push_back(par_idx_map.at(block_cols[c].par_name));
 			}
 		}
-
-		
-		if (!run_list.empty())
+		vector<double> model_values = run_manager.get_parameter_values(run_ids, par_idxs);
+		Parameters ctl_pars;
+		int i = 0;
+		for (int c = beg; c < end; ++c)
 		{
-			base_numeric_par_names.push_back(cur_par_name);
-			base_run.numeric_derivative_par = base_numeric_parameters.get_rec(cur_par_name);
-			double cur_numeric_value = base_run.numeric_derivative_par;
-			run_list.push_front(base_run);
-			std::vector<Eigen::Triplet<double> > tmp_triplet_vec = calc_derivative(cur_par_name, cur_numeric_value, icol, run_list, group_info, prior_info, splitswh_flag);
-			triplet_list.insert(triplet_list.end(), tmp_triplet_vec.begin(), tmp_triplet_vec.end());
-			icol++;
+			if (!block_cols[c].runs.empty())
+				ctl_pars.insert(block_cols[c].par_name, model_values[i++]);
 		}
-		else
+		par_transform.model2ctl_ip(ctl_pars);
+		Parameters numeric_pars(ctl_pars);
+		par_transform.ctl2numeric_ip(numeric_pars);
+		for (int c = beg; c < end; ++c)
 		{
-			failed_parameter_names.insert(cur_par_name);
-			failed_ctl_parameters.insert(cur_par_name, cur_numeric_par_value);
+			DerivativeColumn &col = block_cols[c];
+			for (auto &run : col.runs)
+			{
+				run.numeric_derivative_par = numeric_pars.get_rec(col.par_name);
+				if (prior_info.size() > 0)
+					run.ctl_pars.insert(col.par_name, ctl_pars.get_rec(col.par_name));
+			}
 		}
-		run_list.clear();
-		
-
-	}
+	};
+	auto column_failed = [&](const DerivativeColumn &col)
+	{
+		failed_parameter_names.insert(col.par_name);
+		failed_ctl_parameters.insert(col.par_name, col.info_values[0]);
+	};
+	calc_derivative_columns(run_manager, cols, base_run, group_info, prior_info, splitswh_flag, false,
+		load_runs, column_failed);
 	par_run_map.clear();
-	matrix.resize(base_sim_obs_names.size(), base_numeric_par_names.size());
-	matrix.setZero();
-	matrix.setFromTriplets(triplet_list.begin(), triplet_list.end());
 	// clean up
 	ofstream &fout_restart = file_manager.get_ofstream("rst");
 	run_manager.free_memory();
@@ -112,9 +112,10 @@ void Localizer::process_mat(PerformanceLog *performance_log, bool forgive_missin
 	for (int i=0;i<mat.nrow();i++)
 	{
 		o = row_names[i];
+		//obs_map.size() rather than i: it is the row index once the missing rows are dropped
 		if (obs_names.find(o) != obs_names.end())
 		{
-			obs2row_map[o] = i;
+			obs2row_map[o] = obs_map.size();
 			obs_map.push_back(vector<string>{o});
 			if (dup_check.find(o) != dup_check.end())
 				dups.push_back(o);
@@ -127,7 +128,7 @@ void Localizer::process_mat(PerformanceLog *performance_log, bool forgive_missin
 				throw runtime_error("Localizer::process_mat() error: listed observation group '" + o + "' has no non-zero weight observations");
 			for (auto &oo : obgnme_map[o])
 			{
-				obs2row_map[oo] = i;
+				obs2row_map[oo] = obs_map.size() - 1;
 				if (dup_check.find(oo) != dup_check.end())
 					dups.push_back(oo);
 				dup_check.emplace(oo);
@@ -187,9 +188,10 @@ void Localizer::process_mat(PerformanceLog *performance_log, bool forgive_missin
 	for (int i=0;i<mat.ncol();++i)
 	{
 		p = col_names[i];
+		//par_map.size() rather than i: it is the col index once the missing cols are dropped
 		if (par_names.find(p) != par_names.end())
 		{
-			par2col_map[p] = i;
+			par2col_map[p] = par_map.size();
 			par_map.push_back(vector<string>{p});
 			if (dup_check.find(p) != dup_check.end())
 				dups.push_back(p);
@@ -202,7 +204,7 @@ void Localizer::process_mat(PerformanceLog *performance_log, bool forgive_missin
 				throw runtime_error("Localizer::process_mat() error:  listed parameter group '" + p + "' has no adjustable parameters");
 			for (auto &pp : pargp_map[p])
 			{
-				par2col_map[pp] = i;
+				par2col_map[pp] = par_map.size() - 1;
 				if (dup_check.find(pp) != dup_check.end())
 					dups.push_back(pp);
 				dup_check.emplace(pp);
@@ -254,6 +256,16 @@ void Localizer::process_mat(PerformanceLog *performance_log, bool forgive_missin
 	}
 
 
+	//name lookups for the localizing vectors
+	row_name2idx.clear();
+	col_name2idx.clear();
+	row_names = mat.get_row_names();
+	for (int i = 0; i < row_names.size(); i++)
+		row_name2idx[row_names[i]] = i;
+	col_names = mat.get_col_names();
+	for (int i = 0; i < col_names.size(); i++)
+		col_name2idx[col_names[i]] = i;
+
 	//map all the nz locations in the matrix
 	map<int, vector<int>> idx_map;
 	vector<string> vobs, vpar;
@@ -451,58 +463,20 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::get_local
 	}
 
 	//here we go...
-	vector<int> par_indices;
-	for (int jpar = 0; jpar < npar; jpar++)
-		par_indices.push_back(jpar);
 	vector<Eigen::Triplet<double>> triplets;
-	AutoAdaLocThread worker(performance_log, &f_out, iter, ies_verbose, npar, nobs, par_indices, pe_diff, oe_diff, par_std, obs_std, par_names, obs_names, triplets,sigma_dist,listed_obs);
+	AutoAdaLocThread worker(performance_log, &f_out, iter, ies_verbose, npar, nobs, pe_diff, oe_diff, par_std, obs_std, par_names, obs_names, triplets,sigma_dist,listed_obs);
 
 	int num_threads = pe.get_pest_scenario_ptr()->get_pestpp_options().get_ies_num_threads();
-
-	if (num_threads < 1)
-		worker.work(0);
-	else
+	//each chunk is one tile of parameters
+	WorkQueue queue(npar, min(AutoAdaLocThread::par_tile, WorkQueue::get_chunk_size(npar, num_threads)));
+	if (num_threads > 0)
 	{
 		Eigen::setNbThreads(1);
-		vector<thread> threads;
-		vector<exception_ptr> exception_ptrs;
 		performance_log->log_event("launching autoadaloc threads");
-
-		for (int i = 0; i < num_threads; i++)
-		{
-			exception_ptrs.push_back(exception_ptr());
-		}
-
-		for (int i = 0; i < num_threads; i++)
-		{
-			//threads.push_back(thread(&LocalUpgradeThread::work, &worker, i, iter, cur_lam));
-
-			threads.push_back(thread(aal_upgrade_thread_function, i, std::ref(worker), std::ref(exception_ptrs[i])));
-
-		}
-		performance_log->log_event("waiting to join threads");
-		//for (auto &t : threads)
-		//	t.join();
-		for (int i = 0; i < num_threads; ++i)
-		{
-			if (exception_ptrs[i])
-			{
-				try
-				{
-					rethrow_exception(exception_ptrs[i]);
-				}
-				catch (const std::exception& e)
-				{
-					ss.str("");
-					ss << "thread " << i << "raised an exception: " << e.what();
-					throw runtime_error(ss.str());
-				}
-			}
-			threads[i].join();
-		}
-		performance_log->log_event("threaded localized upgrade calculation done");
-
 	}
+	queue.run(num_threads, [&](int thread_id) { worker.work(thread_id, queue); });
+	if (num_threads > 0)
+		performance_log->log_event("threaded localized upgrade calculation done");
 
 	if (triplets.size() == 0)
 	{
@@ -588,25 +562,12 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::get_local
 
 
 
-void aal_upgrade_thread_function(int id, AutoAdaLocThread &worker, exception_ptr &eptr)
-{
-	try
-	{
-		worker.work(id);
-	}
-	catch (...)
-	{
-		eptr = current_exception();
-	}
+const int AutoAdaLocThread::par_tile;
+const int AutoAdaLocThread::obs_tile;
 
-	return;
-}
-
-
-
-AutoAdaLocThread::AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, int _npar, int _nobs, vector<int> &_par_indices,
+AutoAdaLocThread::AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, int _npar, int _nobs,
 	Eigen::MatrixXd &_pe_diff, Eigen::MatrixXd &_oe_diff, Eigen::ArrayXd &_par_std, Eigen::ArrayXd &_obs_std, vector<string> &_par_names, vector<string> &_obs_names,
-	vector<Eigen::Triplet<double>> &_triplets, double _sigma_dist,map<string,set<string>> &_list_obs): pe_diff(_pe_diff), oe_diff(_oe_diff), par_indices(_par_indices), par_std(_par_std), obs_std(_obs_std),par_names(_par_names),
+	vector<Eigen::Triplet<double>> &_triplets, double _sigma_dist,map<string,set<string>> &_list_obs): pe_diff(_pe_diff), oe_diff(_oe_diff), par_std(_par_std), obs_std(_obs_std),par_names(_par_names),
 	obs_names(_obs_names),triplets(_triplets), list_obs(_list_obs)
 {
 	iter = _iter;
@@ -620,273 +581,218 @@ AutoAdaLocThread::AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_
 	for (int i = 0; i < obs_names.size(); i++)
 		idx2obs[i] = obs_names[i];
 
+	//the real DFT rows 0..nreals/2: the power spectrum of a real vector is symmetric, so
+	//each of these rows except the first (and the middle one for even nreals) stands for two
+	int nreals = pe_diff.rows();
+	int nfreq = (nreals / 2) + 1;
+	const double pi = 3.14159265358979323846;
+	dft_re.resize(nfreq, nreals);
+	dft_im.resize(nfreq, nreals);
+	Eigen::VectorXd weights(nfreq);
+	for (int k = 0; k < nfreq; k++)
+	{
+		for (int r = 0; r < nreals; r++)
+		{
+			double angle = 2.0 * pi * double((k * r) % nreals) / double(nreals);
+			dft_re(k, r) = cos(angle);
+			dft_im(k, r) = sin(angle);
+		}
+		weights[k] = (((k == 0) || (2 * k == nreals)) ? 1.0 : 2.0) / double(nreals);
+	}
+
+	obs_ss.resize(nreals, nobs);
+	for (int iobs = 0; iobs < nobs; iobs++)
+	{
+		if (obs_std[iobs] == 0.0)
+			obs_ss.col(iobs).setZero();
+		else
+			obs_ss.col(iobs) = oe_diff.col(iobs) * (1.0 / obs_std[iobs]);
+	}
+	obs_sum = obs_ss.colwise().sum();
+	obs_pow = weights.asDiagonal() * ((dft_re * obs_ss).cwiseAbs2() + (dft_im * obs_ss).cwiseAbs2());
 }
 
-void AutoAdaLocThread::work(int thread_id)
+void AutoAdaLocThread::work(int thread_id, WorkQueue &queue)
 {
-
+	//each par/obs pair is screened by comparing its correlation coefficient cc to the
+	//correlations with every other circular shift of the obs realizations (the background).
+	//for a tile of pars and obs, cc is one matrix product of the standardized anomalies.  the
+	//background mean follows from the column sums (the correlations over all nreals shifts
+	//sum to the product of the sums) and the background variance from the power spectra
+	//(by Parseval, the squared correlations over all shifts sum to the spectral product
+	//divided by nreals), so each tile takes two matrix products rather than nreals of them.
 	stringstream ss;
-	int jpar, pcount = 0, nreals = pe_diff.rows();
-	double cc, bg_cc, bg_mean, bg_std, thres, t;
-	double sign;
+	int pcount = 0, nreals = pe_diff.rows();
 	double scale = 1.0 / double(nreals - 1);
-	double pstd, ostd;
-	//vector<Eigen::Triplet<double>> triplets, ones;
-	Eigen::VectorXd par_ss, obs_ss, obs_ss_shift;
-
-	par_ss.resize(nreals);
-	obs_ss.resize(nreals);
-	obs_ss_shift.resize(nreals);
+	double bg_scale = scale / double(nreals - 1);
+	double t;
+	Eigen::MatrixXd par_ss, par_pow, cc, ss_all;
+	Eigen::RowVectorXd par_sum;
+	Eigen::ArrayXXd bg_mean, bg_std, sign, thres, kept;
+	Eigen::VectorXd obs_ss_shift(nreals);
 	Eigen::ArrayXd bg_cc_vec(nreals - 1);
-	set<string> sobs;
-	unique_lock<mutex> par_indices_guard(par_indices_lock, defer_lock);
-	unique_lock<mutex> oe_diff_gaurd(oe_diff_lock, defer_lock);
-	unique_lock<mutex> f_out_guard(f_out_lock, defer_lock);
-	unique_lock<mutex> triplets_guard(triplets_lock, defer_lock);
-	unique_lock<mutex>pfm_guard(pfm_lock, defer_lock);
-	unique_lock<mutex>par_names_guard(par_names_lock, defer_lock);
-	bool use_list_obs = true;
-	while (true)
-	{
-
-		while (true)
+	//the kept triplets and the verbose output are collected per thread and handed over
+	//once per chunk (output) or once per thread (triplets)
+	vector<Eigen::Triplet<double>> thread_triplets;
+	stringstream f_ss;
+	set<string> no_sobs;
+	vector<const set<string>*> sobs;
+	vector<bool> no_obs;
+	bool use_list_obs = list_obs.size() > 0;
+	int begin, end;
+	while (queue.next(begin, end))
+	{
+		if ((begin / 10000) != (end / 10000))
 		{
-			if (par_indices_guard.try_lock())
-			{
-				if (par_indices.size() == 0)
-				{
-					ss.str("");
-					ss << "autoadaloc thread: " << thread_id << " processed " << pcount << " parameters ";
-					if (ies_verbose > 1)
-					{
-						cout << ss.str() << endl;
-					}
-					while (true)
-					{
-						if (pfm_guard.try_lock())
-						{
-							performance_log->log_event(ss.str());
-							pfm_guard.unlock();
-							break;
-						}
-					}
-					par_indices_guard.unlock();
-					return;
-				}
-				if (par_indices.size() % 10000 == 0)
-				{
-					ss.str("");
-					ss << "autoadaloc iter " << iter << " progress: " << par_indices.size() << " of " << npar << " parameters done";
-					while (true)
-					{
-						if (pfm_guard.try_lock())
-						{
-							performance_log->log_event(ss.str());
-							pfm_guard.unlock();
-							break;
-						}
-					}
-					if (ies_verbose > 1)
-						cout << ss.str() << endl;
-				}
-				
-				jpar = par_indices[par_indices.size() - 1];
-				par_indices.pop_back();
-				if (par_std[jpar] == 0.0)
-				{
-					par_indices_guard.unlock();
-					continue;
-				}
-				par_ss = pe_diff.col(jpar) * (1.0 / par_std[jpar]);
-				
-				if (list_obs.size() > 0)
-				{
-					sobs = list_obs[par_names[jpar]];
-					use_list_obs = true;
-				}
-				else
-				{
-					use_list_obs = false;
-				}
-				pcount++;
-				par_indices_guard.unlock();
-				break;
-			}
+			ss.str("");
+			ss << "autoadaloc iter " << iter << " progress: " << end - (end % 10000) << " of " << npar << " parameters done";
+			if (ies_verbose > 1)
+				cout << ss.str() << endl;
+			lock_guard<mutex> pfm_guard(pfm_lock);
+			performance_log->log_event(ss.str());
 		}
-
-		
-		string oname;
-		bool no_obs = true;
-		for (int iobs = 0; iobs < nobs; iobs++)
+		int bpar = end - begin;
+		par_ss.resize(nreals, bpar);
+		sobs.assign(bpar, &no_sobs);
+		no_obs.assign(bpar, true);
+		for (int j = 0; j < bpar; j++)
 		{
-			while (true)
-			{
-				/*if (oe_diff_gaurd.try_lock())
-				{
-					if (obs_std[iobs] == 0.0)
-					{
-						oe_diff_gaurd.unlock();
-						continue;
-					}
-					string oname = obs_names[iobs];
-					if ((sobs.size() > 0) && (sobs.find(oname) == sobs.end()))
-					{
-						oe_diff_gaurd.unlock();
-						continue;
-					}
-					obs_ss = oe_diff.col(iobs) * (1.0 / obs_std[iobs]);
-					oe_diff_gaurd.unlock();
-					break;*/
-				if (oe_diff_gaurd.try_lock())
-				{
-					
-					obs_ss = oe_diff.col(iobs);
-					oname = obs_names[iobs];
-					oe_diff_gaurd.unlock();
-					break;
-				}
-
-			}
-			if (obs_std[iobs] == 0.0) 
+			int jpar = begin + j;
+			if (par_std[jpar] == 0.0)
 			{
+				par_ss.col(j).setZero();
 				continue;
 			}
-			
-			if ((use_list_obs) && (sobs.size() == 0))
-				continue;
-
-			if ((sobs.size() > 0) && (sobs.find(oname) == sobs.end()))
+			par_ss.col(j) = pe_diff.col(jpar) * (1.0 / par_std[jpar]);
+			if (use_list_obs)
 			{
-				continue;
-			}
-			obs_ss = obs_ss * (1.0 / obs_std[iobs]);
-			cc = (par_ss.transpose() * obs_ss)[0] * scale;
-			obs_ss_shift = 1.0 * obs_ss; //force a copy
-			for (int ireal = 0; ireal < nreals - 1; ireal++)
-			{
-
-				//obs_ss_shift.transpose() = obs_ss_shift.transpose() * perm;
-				//circular shift
-				t = obs_ss_shift[nreals - 1];
-				for (int i = nreals - 1; i > 0; i--)
-					obs_ss_shift[i] = obs_ss_shift[i - 1];
-				obs_ss_shift[0] = t;
-
-				//bg_cc = (par_ss.transpose() * obs_ss_shift)[0] * scale;
-				bg_cc_vec[ireal] = (par_ss.transpose() * obs_ss_shift)[0] * scale;
-				//cout << ireal << " " << par_names[jpar] << " " << obs_names[iobs] << " " << cc << " " << bg_cc << endl;
+				map<string, set<string>>::const_iterator found = list_obs.find(par_names[jpar]);
+				if (found != list_obs.end())
+					sobs[j] = &found->second;
 			}
+			pcount++;
+		}
+		par_sum = par_ss.colwise().sum();
+		par_pow = (dft_re * par_ss).cwiseAbs2() + (dft_im * par_ss).cwiseAbs2();
 
-			//cout << par_names[jpar] << " " << obs_names[iobs] << " " << cc << " " << bg_cc << endl; 
-			(cc < 0.0) ? sign = -1. : sign = 1.;
-
-			bg_mean = bg_cc_vec.mean();
-			bg_std = sqrt((bg_cc_vec - bg_mean).pow(2).sum() / (nreals - 1));
+		for (int ob = 0; ob < nobs; ob += obs_tile)
+		{
+			int bobs = min(obs_tile, nobs - ob);
+			cc = par_ss.transpose() * obs_ss.middleCols(ob, bobs);
+			ss_all = par_pow.transpose() * obs_pow.middleCols(ob, bobs);
+			bg_mean = ((par_sum.transpose() * obs_sum.segment(ob, bobs)) - cc).array() * bg_scale;
+			bg_std = (((ss_all - cc.cwiseAbs2()).array() * (scale * bg_scale)) - bg_mean.square()).max(0.0).sqrt();
+			cc *= scale;
+			sign = (cc.array() < 0.0).select(-1.0, Eigen::ArrayXXd::Ones(bpar, bobs));
 			thres = bg_mean + (sign * sigma_dist * bg_std);
-			if (ies_verbose > 1)
+			kept = ((sign * cc.array()) - (sign * thres) > 0.0).cast<double>();
+
+			for (int j = 0; j < bpar; j++)
 			{
-				
-				while (true)
+				int jpar = begin + j;
+				if (par_std[jpar] == 0.0)
+					continue;
+				if ((use_list_obs) && (sobs[j]->size() == 0))
+					continue;
+				for (int i = 0; i < bobs; i++)
 				{
-					if (f_out_guard.try_lock())
+					int iobs = ob + i;
+					if (obs_std[iobs] == 0.0)
+						continue;
+					if ((sobs[j]->size() > 0) && (sobs[j]->find(obs_names[iobs]) == sobs[j]->end()))
+						continue;
+					if (ies_verbose > 1)
 					{
-						*f_out << obs_names[iobs] << "," << par_names[jpar] << "," << cc << "," << bg_mean << "," << bg_std << "," << thres << "," << (((sign * cc) - (sign * thres)) > 0.0);
-						for (int i = 0; i < nreals - 1; i++)
-							*f_out << "," << bg_cc_vec[i];
-						*f_out << endl;
-						f_out_guard.unlock();
-						break;
-
+						//the individual background correlations are only needed for the output
+						obs_ss_shift = obs_ss.col(iobs);
+						for (int ireal = 0; ireal < nreals - 1; ireal++)
+						{
+							//circular shift
+							t = obs_ss_shift[nreals - 1];
+							for (int r = nreals - 1; r > 0; r--)
+								obs_ss_shift[r] = obs_ss_shift[r - 1];
+							obs_ss_shift[0] = t;
+							bg_cc_vec[ireal] = (par_ss.col(j).transpose() * obs_ss_shift)[0] * scale;
+						}
+						f_ss << obs_names[iobs] << "," << par_names[jpar] << "," << cc(j, i) << "," << bg_mean(j, i) << "," << bg_std(j, i) << "," << thres(j, i) << "," << (kept(j, i) > 0.0);
+						for (int r = 0; r < nreals - 1; r++)
+							f_ss << "," << bg_cc_vec[r];
+						f_ss << endl;
 					}
-				}
-				
-			}
-			if (((sign * cc) - (sign * thres)) > 0.0)
-			{
-				//cout << par_names[jpar] << " " << obs_names[iobs] << " " << cc << " " << bg_mean << " " << bg_std << " " << thres << " kept " << endl;
-				while (true)
-				{
-					if (triplets_guard.try_lock())
+					if (kept(j, i) > 0.0)
 					{
-						triplets.push_back(Eigen::Triplet<double>(iobs, jpar, cc));
-						triplets_guard.unlock();
-						break;
+						thread_triplets.push_back(Eigen::Triplet<double>(iobs, jpar, cc(j, i)));
+						no_obs[j] = false;
 					}
 				}
-				no_obs = false;
-				
 			}
-			
-
 		}
-		if (no_obs)
+		for (int j = 0; j < bpar; j++)
 		{
-			string pname;
-			while (true)
-			{
-				if (par_names_guard.try_lock())
-				{
-					pname = par_names[jpar];
-					par_names_guard.unlock();
-					break;
-				}
-			}
+			if ((!no_obs[j]) || (par_std[begin + j] == 0.0))
+				continue;
 			ss.str("");
-
-			ss << "autoadaloc warning: parameter " << pname << " is completely localized -it maps to no observations";
-			while (true)
-			{
-				if (pfm_guard.try_lock())
-				{
-					performance_log->log_event(ss.str());
-					pfm_guard.unlock();
-					break;
-				}
-			}
+			ss << "autoadaloc warning: parameter " << par_names[begin + j] << " is completely localized -it maps to no observations";
+			lock_guard<mutex> pfm_guard(pfm_lock);
+			performance_log->log_event(ss.str());
+		}
+		if (ies_verbose > 1)
+		{
+			lock_guard<mutex> f_out_guard(f_out_lock);
+			*f_out << f_ss.str();
+			f_ss.str("");
 		}
 	}
+	{
+		lock_guard<mutex> triplets_guard(triplets_lock);
+		triplets.insert(triplets.end(), thread_triplets.begin(), thread_triplets.end());
+	}
+	ss.str("");
+	ss << "autoadaloc thread: " << thread_id << " processed " << pcount << " parameters ";
+	if (ies_verbose > 1)
+	{
+		cout << ss.str() << endl;
+	}
+	lock_guard<mutex> pfm_guard(pfm_lock);
+	performance_log->log_event(ss.str());
 }
 
 
-Eigen::MatrixXd Localizer::get_localizing_obs_hadamard_matrix(int num_reals, string col_name, vector<string> &obs_names)
+Eigen::VectorXd Localizer::get_localizing_obs_vector(const string &col_name, const vector<string> &obs_names)
 {
-
-	vector<double> values;
-	vector<string> mat_cols = mat.get_col_names();
-	vector<string>::iterator it = find(mat_cols.begin(), mat_cols.end(), col_name);
-	if (it == mat_cols.end())
-		throw runtime_error("Localizer::get_localizing_obs_hadamard_matrix() error: col_name not found in localizer matrix: " + col_name);
-	int idx = it - mat_cols.begin();
-	Eigen::VectorXd mat_vec = mat.e_ptr()->col(idx);
-	int col_idx;
-	Eigen::MatrixXd loc(obs_names.size(), num_reals);
-	for (int i=0;i<obs_names.size();i++)
+	unordered_map<string, int>::const_iterator found = col_name2idx.find(col_name);
+	if (found == col_name2idx.end())
+		throw runtime_error("Localizer::get_localizing_obs_vector() error: col_name not found in localizer matrix: " + col_name);
+	int col_idx = found->second;
+	const Eigen::SparseMatrix<double> *m = mat.e_ptr();
+	Eigen::VectorXd loc(obs_names.size());
+	unordered_map<string, int>::const_iterator end = obs2row_map.end();
+	for (int i = 0; i < obs_names.size(); i++)
 	{
-		col_idx = obs2row_map[obs_names[i]];
-		loc.row(i).setConstant(mat_vec[col_idx]);
+		found = obs2row_map.find(obs_names[i]);
+		if (found == end)
+			throw runtime_error("Localizer::get_localizing_obs_vector() error: obs name not found in localizer matrix: " + obs_names[i]);
+		loc[i] = m->coeff(found->second, col_idx);
 	}
 	return loc;
-
 }
 
 
-Eigen::MatrixXd Localizer::get_localizing_par_hadamard_matrix(int num_reals, string row_name, vector<string> &par_names)
+Eigen::VectorXd Localizer::get_localizing_par_vector(const string &row_name, const vector<string> &par_names)
 {
-
-	vector<double> values;
-	vector<string> mat_rows = mat.get_row_names();
-	vector<string>::iterator it = find(mat_rows.begin(), mat_rows.end(), row_name);
-	if (it == mat_rows.end())
-		throw runtime_error("Localizer::get_localizing_par_hadamard_matrix() error: row_name not found in localizer matrix: " + row_name);
-	int idx = it - mat_rows.begin();
-	Eigen::VectorXd mat_vec = mat.e_ptr()->row(idx);
-	int col_idx;
-	Eigen::MatrixXd loc(par_names.size(), num_reals);
-	for (int i = 0; i<par_names.size(); i++)
+	unordered_map<string, int>::const_iterator found = row_name2idx.find(row_name);
+	if (found == row_name2idx.end())
+		throw runtime_error("Localizer::get_localizing_par_vector() error: row_name not found in localizer matrix: " + row_name);
+	int row_idx = found->second;
+	const Eigen::SparseMatrix<double> *m = mat.e_ptr();
+	Eigen::VectorXd loc(par_names.size());
+	unordered_map<string, int>::const_iterator end = par2col_map.end();
+	for (int i = 0; i < par_names.size(); i++)
 	{
-		col_idx = par2col_map[par_names[i]];
-		loc.row(i).setConstant(mat_vec[col_idx]);
+		found = par2col_map.find(par_names[i]);
+		if (found == end)
+			throw runtime_error("Localizer::get_localizing_par_vector() error: par name not found in localizer matrix: " + par_names[i]);
+		loc[i] = m->coeff(row_idx, found->second);
 	}
 	return loc;
-
 }
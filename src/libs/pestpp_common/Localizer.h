@@ -14,12 +14,13 @@
 #include "RunManagerAbstract.h"
 #include "PerformanceLog.h"
 #include "Ensemble.h"
+#include "WorkQueue.h"
 
 class AutoAdaLocThread
 {
 public:
 
-	AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, int _npar, int _nobs, vector<int> &_par_indices,
+	AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, int _npar, int _nobs,
 		Eigen::MatrixXd &_pe_diff, Eigen::MatrixXd &_oe_diff, Eigen::ArrayXd &_par_std, Eigen::ArrayXd &_obs_std, vector<string> &_par_names, vector<string> &_obs_names,
 		vector<Eigen::Triplet<double>> &_triplets, double _sigma_dist, map<string,set<string>> &_list_obs);
 
@@ -27,7 +28,11 @@ public:
 	//Eigen::MatrixXd get_matrix_from_map(int num_reals, vector<string> &names, map<string, Eigen::VectorXd> &emap);
 
 
-	void work(int thread_id);
+	//test the parameters claimed from queue against every observation, one tile of
+	//parameters and obs_tile observations at a time
+	void work(int thread_id, WorkQueue &queue);
+	static const int par_tile = 128;
+	static const int obs_tile = 2048;
 
 
 private:
@@ -35,7 +40,6 @@ private:
 	int nzero_par, nzero_obs;
 	double sigma_dist;
 	Eigen::MatrixXd &pe_diff, &oe_diff;
-	vector<int> &par_indices;
 	Eigen::ArrayXd &par_std, &obs_std;
 	vector<string> &par_names, &obs_names;
 	vector<Eigen::Triplet<double>> &triplets;
@@ -43,9 +47,13 @@ private:
 	ofstream *f_out;
 	map<string, set<string>> list_obs;
 	map<int, string> idx2obs;
-	mutex pe_diff_lock, oe_diff_lock, par_indices_lock, pfm_lock;
-	mutex f_out_lock, par_names_lock, obs_names_lock;
-	mutex triplets_lock;
+	//the standardized obs anomalies (zero for zero-std obs), their column sums and their
+	//power spectra (rows of the half DFT, weighted to stand for the full one), and the half
+	//DFT itself - built once and shared read-only by the threads
+	Eigen::MatrixXd obs_ss, obs_pow, dft_re, dft_im;
+	Eigen::RowVectorXd obs_sum;
+	//the inputs above are shared read-only; only the outputs lock
+	mutex pfm_lock, f_out_lock, triplets_lock;
 };
 
 
@@ -59,8 +67,11 @@ public:
 	bool initialize(PerformanceLog *performance_log, bool forgive_missing=false);
 	unordered_map<string, pair<vector<string>, vector<string>>> get_localizer_map(int iter, ObservationEnsemble &oe, ParameterEnsemble &pe, PerformanceLog *performance_log);// { return localizer_map; }
 	void set_pest_scenario(Pest *_pest_scenario_ptr) { pest_scenario_ptr = _pest_scenario_ptr; }
-	Eigen::MatrixXd get_localizing_obs_hadamard_matrix(int num_reals,string col_name,vector<string> &obs_names);
-	Eigen::MatrixXd get_localizing_par_hadamard_matrix(int num_reals, string row_name, vector<string> &par_names);
+	//the localizer value of each of obs_names in the column col_name (or of each of par_names
+	//in the row row_name), read from the sparse localizer matrix.  the upgrade applies it as
+	//a diagonal scaling of the rows of the obs (or par) diff matrix
+	Eigen::VectorXd get_localizing_obs_vector(const string &col_name, const vector<string> &obs_names);
+	Eigen::VectorXd get_localizing_par_vector(const string &row_name, const vector<string> &par_names);
 	How get_how() { return how; }
 	bool get_use() { return use; }
 	bool get_autoadaloc() { return autoadaloc; }
@@ -77,11 +88,11 @@ private:
 	string filename;
 	unordered_map<string,pair<vector<string>, vector<string>>> localizer_map;
 	map<string, set<string>> listed_obs;
-	map<string, int> obs2row_map, par2col_map;
+	//localizer matrix row/col index of each obs/par, and of each row/col name
+	unordered_map<string, int> obs2row_map, par2col_map;
+	unordered_map<string, int> row_name2idx, col_name2idx;
 
 	void process_mat(PerformanceLog *performance_log, bool forgive_missing=false);	
 };
 
-void aal_upgrade_thread_function(int id, AutoAdaLocThread &worker, exception_ptr &eptr);
-
 #endif
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include "NameIndex.h"
+
+using namespace std;
+
+const int NameAligner::MAX_PERMS;
+
+NameAligner::NameAligner(const NameAligner &rhs)
+{
+	lock_guard<mutex> g(rhs.lock);
+	index = rhs.index;
+	perms = rhs.perms;
+}
+
+NameAligner& NameAligner::operator=(const NameAligner &rhs)
+{
+	if (this == &rhs)
+		return *this;
+	shared_ptr<const Index> rhs_index;
+	vector<shared_ptr<const Perm>> rhs_perms;
+	{
+		lock_guard<mutex> g(rhs.lock);
+		rhs_index = rhs.index;
+		rhs_perms = rhs.perms;
+	}
+	lock_guard<mutex> g(lock);
+	index = rhs_index;
+	perms = rhs_perms;
+	return *this;
+}
+
+void NameAligner::reset(const vector<string> &names)
+{
+	get_index(names, true);
+}
+
+shared_ptr<const NameAligner::Index> NameAligner::get_index(const vector<string> &names, bool check_names)
+{
+	{
+		lock_guard<mutex> g(lock);
+		if ((index) && (index->names.size() == names.size()) && ((!check_names) || (index->names == names)))
+			return index;
+	}
+	//hash outside the lock - if two threads race here they build the same index
+	shared_ptr<Index> new_index = make_shared<Index>();
+	new_index->names = names;
+	new_index->pos_by_name.reserve(names.size());
+	//the last of any repeated names wins, as with a name-to-index map
+	for (int i = 0; i < names.size(); i++)
+		new_index->pos_by_name[names[i]] = i;
+	lock_guard<mutex> g(lock);
+	index = new_index;
+	perms.clear();
+	return new_index;
+}
+
+shared_ptr<const vector<int>> NameAligner::positions(const vector<string> &names, const vector<string> &req_names,
+	vector<string> &missing, bool check_names)
+{
+	shared_ptr<const Index> idx = get_index(names, check_names);
+	{
+		lock_guard<mutex> g(lock);
+		for (int i = 0; i < perms.size(); i++)
+		{
+			if (perms[i]->req_names != req_names)
+				continue;
+			shared_ptr<const Perm> p = perms[i];
+			perms.erase(perms.begin() + i);
+			perms.insert(perms.begin(), p);
+			return shared_ptr<const vector<int>>(p, &p->positions);
+		}
+	}
+
+	shared_ptr<Perm> p = make_shared<Perm>();
+	p->positions.resize(req_names.size());
+	unordered_map<string, int>::const_iterator end = idx->pos_by_name.end();
+	int num_missing = 0;
+	for (int i = 0; i < req_names.size(); i++)
+	{
+		unordered_map<string, int>::const_iterator it = idx->pos_by_name.find(req_names[i]);
+		if (it == end)
+		{
+			p->positions[i] = -1;
+			missing.push_back(req_names[i]);
+			num_missing++;
+		}
+		else
+			p->positions[i] = it->second;
+	}
+	//lists with missing names are an error for the callers, so they are not worth keeping
+	if (num_missing == 0)
+	{
+		p->req_names = req_names;
+		lock_guard<mutex> g(lock);
+		//only keep it if the names have not changed since
+		if (index == idx)
+		{
+			perms.insert(perms.begin(), p);
+			if (perms.size() > MAX_PERMS)
+				perms.pop_back();
+		}
+	}
+	return shared_ptr<const vector<int>>(p, &p->positions);
+}
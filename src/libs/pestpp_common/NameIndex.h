@@ -0,0 +1,46 @@
+#ifndef NAME_INDEX_H_
+#define NAME_INDEX_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//aligns requested name lists against the names of one object (the rows or cols of a Mat, the
+//vars or realizations of an Ensemble).  the object's names are hashed once per change and the
+//positions for each requested list are memoized, so aligning against a list seen before is a
+//compare of the lists.  copies share the (immutable) index and positions.  calls are guarded by
+//a lock, so threads can share one object that they only read
+class NameAligner
+{
+public:
+	NameAligner() {}
+	NameAligner(const NameAligner &rhs);
+	NameAligner& operator=(const NameAligner &rhs);
+	//positions in names of each of req_names, -1 for those not found (which are also added to
+	//missing).  with check_names false the names are trusted to be the same as the last call
+	std::shared_ptr<const std::vector<int>> positions(const std::vector<std::string> &names,
+		const std::vector<std::string> &req_names, std::vector<std::string> &missing, bool check_names = true);
+	//index names now, so later calls can skip the check
+	void reset(const std::vector<std::string> &names);
+private:
+	struct Index
+	{
+		std::vector<std::string> names;
+		std::unordered_map<std::string, int> pos_by_name;
+	};
+	struct Perm
+	{
+		std::vector<std::string> req_names;
+		std::vector<int> positions;
+	};
+	static const int MAX_PERMS = 8;
+	mutable std::mutex lock;
+	std::shared_ptr<const Index> index;
+	//most recently used first
+	std::vector<std::shared_ptr<const Perm>> perms;
+	std::shared_ptr<const Index> get_index(const std::vector<std::string> &names, bool check_names);
+};
+
+#endif //NAME_INDEX_H_
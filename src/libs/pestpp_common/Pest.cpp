@@ -330,6 +330,12 @@ void Pest::check_inputs(ostream &f_rec, bool forgive)
 
 void Pest::check_io(ofstream& f_rec)
 {
+	if (pestpp_options.get_model_plugin().size() > 0)
+	{
+		//the plugin replaces the template and instruction files, so there is nothing to check
+		f_rec << "model_plugin '" << pestpp_options.get_model_plugin() << "' in use, skipping model interface file checks" << endl;
+		return;
+	}
 	ModelInterface mi(model_exec_info.tplfile_vec,model_exec_info.inpfile_vec,
 		model_exec_info.insfile_vec,model_exec_info.outfile_vec,model_exec_info.comline_vec);
 
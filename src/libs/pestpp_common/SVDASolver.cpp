@@ -481,6 +481,8 @@ ModelRun SVDASolver::iteration_upgrd(RunManagerAbstract &run_manager, Terminatio
 		ofstream& fout_rec = file_manager.rec_ofstream();
 		int i_update_vec = 0;
 		
+		//the normal matrix decompositions are shared by every lambda
+		begin_upgrade_cache();
 		for (double i_lambda : lambda_vec)
 		{
 			prf_message.str("");
@@ -536,6 +538,7 @@ ModelRun SVDASolver::iteration_upgrd(RunManagerAbstract &run_manager, Terminatio
 
 
 		}
+		end_upgrade_cache();
 		file_manager.close_file("fpr");
 		RestartController::write_upgrade_runs_built(fout_restart);
 	}
@@ -22,11 +22,61 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <Eigen/Eigenvalues>
+#include <Eigen/QR>
 #include "RedSVD-h.h"
+#include "EnsembleDraw.h"
+#include "WorkQueue.h"
 
 
 using namespace Eigen;
 
+namespace
+{
+	//key of the test vectors: block b of a randomized solve is drawn with RSVD_KEY + b
+	const uint64_t RSVD_KEY = 0x2545F4914F6CDD1DULL;
+
+	//columns per work item when a block of vectors is split over threads.  it is fixed, so the
+	//products (and the result) do not depend on the number of threads
+	const int RSVD_COLS_PER_ITEM = 8;
+	//a block stops the basis once its largest singular value is this far below the threshold, so
+	//the values just above the threshold are resolved by the blocks before it
+	const double RSVD_STOP_FAC = 0.1;
+
+	//call work(begin, end) over chunks of the columns [0, num_cols)
+	void for_col_chunks(int num_cols, int num_threads, const std::function<void(int, int)> &work)
+	{
+		int num_items = (num_cols + RSVD_COLS_PER_ITEM - 1) / RSVD_COLS_PER_ITEM;
+		WorkQueue::for_each(num_items, num_threads, 1, [&](int thread_id, int item)
+		{
+			work(item * RSVD_COLS_PER_ITEM, std::min(num_cols, (item + 1) * RSVD_COLS_PER_ITEM));
+		});
+	}
+
+	//y -= q(qt y), once for each pass
+	void project_out(const MatrixXd &q, MatrixXd &y, int num_passes, int num_threads)
+	{
+		if (q.cols() == 0)
+			return;
+		for_col_chunks(y.cols(), num_threads, [&](int begin, int end)
+		{
+			for (int i = 0; i < num_passes; i++)
+			{
+				MatrixXd c = q.transpose() * y.middleCols(begin, end - begin);
+				y.middleCols(begin, end - begin) -= q * c;
+			}
+		});
+	}
+
+	MatrixXd orthonormalize(const MatrixXd &y)
+	{
+		HouseholderQR<MatrixXd> qr(y);
+		return qr.householderQ() * MatrixXd::Identity(y.rows(), y.cols());
+	}
+}
+
 SVDPackage::SVDPackage(std::string _descritpion, int _n_max_sing, double _eign_thres) : description(_descritpion), n_max_sing(_n_max_sing), eign_thres(_eign_thres)
 {
 	performance_log = nullptr;
@@ -56,6 +106,17 @@ double SVDPackage::get_eign_thres()
 	return eign_thres;
 }
 
+void SVDPackage::solve_normal_ip(const Eigen::SparseMatrix<double>& J, const Eigen::SparseMatrix<double>& Q, const Eigen::SparseMatrix<double>* reg,
+	Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double>& U, Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc)
+{
+	if (performance_log)
+		performance_log->log_event("forming JtQJ matrix");
+	Eigen::SparseMatrix<double> JtQJ = J.transpose() * Q * J;
+	if (reg)
+		JtQJ = JtQJ + *reg;
+	solve_ip(JtQJ, Sigma, U, VT, Sigma_trunc);
+}
+
 void SVD_REDSVD::solve_ip(Eigen::SparseMatrix<double>& A, Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double>& U,
 	Eigen::SparseMatrix<double>& Vt, Eigen::VectorXd &Sigma_trunc)
 {
@@ -285,3 +346,187 @@ void SVD_EIGEN::solve_ip(Eigen::SparseMatrix<double>& A, Eigen::VectorXd &Sigma,
 	Vt = Eigen::SparseMatrix<double>(Vt.topRows(num_sing_used));
 	U = Eigen::SparseMatrix<double>(U.leftCols(num_sing_used));
 }
+
+
+void SVD_RANDOMIZED::solve_ip(Eigen::SparseMatrix<double>& A, Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double>& U,
+	Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc)
+{
+	solve_ip(A, Sigma, U, VT, Sigma_trunc, eign_thres);
+}
+
+void SVD_RANDOMIZED::solve_ip(Eigen::SparseMatrix<double>& A, Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double>& U,
+	Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc, double _eigen_thres)
+{
+	Eigen::SparseMatrix<double> At = A.transpose();
+	if ((A.rows() != A.cols()) || ((A - At).norm() > 1.0e-10 * A.norm()))
+	{
+		if (performance_log)
+			performance_log->log_event("matrix is not symmetric, using Eigen JacobiSVD instead of randomized SVD");
+		SVD_EIGEN svd(n_max_sing, eign_thres);
+		svd.set_performance_log(performance_log);
+		svd.solve_ip(A, Sigma, U, VT, Sigma_trunc, _eigen_thres);
+		return;
+	}
+	Operator apply = [&](const MatrixXd &x, MatrixXd &y)
+	{
+		y.resize(x.rows(), x.cols());
+		for_col_chunks(x.cols(), num_threads, [&](int begin, int end)
+		{
+			y.middleCols(begin, end - begin) = A * x.middleCols(begin, end - begin);
+		});
+	};
+	solve_sym(A.rows(), A.rows(), apply, _eigen_thres, Sigma, U, VT, Sigma_trunc);
+}
+
+void SVD_RANDOMIZED::solve_normal_ip(const Eigen::SparseMatrix<double>& J, const Eigen::SparseMatrix<double>& Q, const Eigen::SparseMatrix<double>* reg,
+	Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double>& U, Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc)
+{
+	//Q holds the squared weights, so Q^(1/2)J is J with its rows scaled.  a Q with off-diagonal
+	//entries is applied as is, between J and Jt
+	bool is_diag = true;
+	VectorXd q_sqrt = VectorXd::Zero(Q.rows());
+	for (int j = 0; j < Q.outerSize(); j++)
+		for (Eigen::SparseMatrix<double>::InnerIterator it(Q, j); it; ++it)
+		{
+			if (it.row() != it.col())
+				is_diag = false;
+			else
+				q_sqrt[j] = std::sqrt(std::abs(it.value()));
+		}
+	Eigen::SparseMatrix<double> qj;
+	if (is_diag)
+		qj = q_sqrt.asDiagonal() * J;
+	const Eigen::SparseMatrix<double> &B = (is_diag) ? qj : J;
+	Operator apply = [&](const MatrixXd &x, MatrixXd &y)
+	{
+		y.resize(x.rows(), x.cols());
+		for_col_chunks(x.cols(), num_threads, [&](int begin, int end)
+		{
+			int w = end - begin;
+			MatrixXd t = B * x.middleCols(begin, w);
+			if (!is_diag)
+				t = (Q * t).eval();
+			y.middleCols(begin, w) = B.transpose() * t;
+			if (reg)
+				y.middleCols(begin, w) += *reg * x.middleCols(begin, w);
+		});
+	};
+	//without the prior, the rank is at most the number of obs
+	int max_rank = (reg) ? J.cols() : std::min(J.rows(), J.cols());
+	solve_sym(J.cols(), max_rank, apply, eign_thres, Sigma, U, VT, Sigma_trunc);
+}
+
+void SVD_RANDOMIZED::solve_sym(int n, int max_rank, const Operator &apply, double _eigen_thres, Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double>& U,
+	Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc)
+{
+	if (performance_log)
+		performance_log->log_event("starting randomized SVD");
+	if (n == 0)
+	{
+		Sigma.resize(0);
+		Sigma_trunc.resize(0);
+		U.resize(0, 0);
+		VT.resize(0, 0);
+		return;
+	}
+	int b = std::max(1, std::min(block_size, n));
+	//the basis only has to hold the leading n_max_sing vectors (and never more than the rank),
+	//plus one block of oversampling
+	int max_basis = std::min(n, std::min(max_rank, n_max_sing) + b);
+	MatrixXd q(n, 0), aq(n, 0), y, t;
+	double sigma_max = 0.0, block_max = 0.0;
+	int num_blocks = 0;
+	while (q.cols() < max_basis)
+	{
+		int nb = std::min(b, max_basis - (int)q.cols());
+		//the range of A^(power_iters + 1) applied to gaussian test vectors, less the basis so far
+		y.resize(n, nb);
+		EnsembleDraw(RSVD_KEY + num_blocks, std::max(0, num_threads)).standard_normal(y);
+		for (int i = 0; i <= power_iters; i++)
+		{
+			if (i > 0)
+				y = orthonormalize(t);
+			apply(y, t);
+			project_out(q, t, 1, num_threads);
+		}
+		y = orthonormalize(t);
+		project_out(q, y, 2, num_threads);
+		y = orthonormalize(y);
+		apply(y, t);
+		//the block holds the leading part of what the basis misses, so its largest ritz value is
+		//an estimate of the largest singular value left
+		MatrixXd tb = y.transpose() * t;
+		SelfAdjointEigenSolver<MatrixXd> es(0.5 * (tb + tb.transpose()), EigenvaluesOnly);
+		block_max = es.eigenvalues().cwiseAbs().maxCoeff();
+		sigma_max = std::max(sigma_max, block_max);
+		int k = q.cols();
+		q.conservativeResize(n, k + nb);
+		q.rightCols(nb) = y;
+		aq.conservativeResize(n, k + nb);
+		aq.rightCols(nb) = t;
+		num_blocks++;
+		//stop once a block finds nothing left above the threshold
+		if (block_max <= RSVD_STOP_FAC * _eigen_thres * sigma_max)
+			break;
+	}
+	int k = q.cols();
+	std::stringstream ss;
+	ss << "randomized SVD basis of " << k << " vectors from " << num_blocks << " blocks, largest singular value left about " << block_max;
+	if (performance_log)
+		performance_log->log_event(ss.str());
+
+	//rayleigh-ritz: the eigen pairs of qt A q, ordered by magnitude
+	MatrixXd tk(k, k);
+	for_col_chunks(k, num_threads, [&](int begin, int end)
+	{
+		tk.middleCols(begin, end - begin) = q.transpose() * aq.middleCols(begin, end - begin);
+	});
+	tk = (0.5 * (tk + tk.transpose())).eval();
+	SelfAdjointEigenSolver<MatrixXd> es(tk);
+	std::vector<int> order(k);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](int i, int j) { return std::abs(es.eigenvalues()[i]) > std::abs(es.eigenvalues()[j]); });
+	VectorXd Sigma_full(k);
+	for (int i = 0; i < k; i++)
+		Sigma_full[i] = std::abs(es.eigenvalues()[order[i]]);
+
+	int kmax = (Sigma_full.size() < n_max_sing) ? Sigma_full.size() : n_max_sing;
+	int num_sing_used = 0;
+	double eig_ratio;
+	for (int i_sing = 0; i_sing < kmax; ++i_sing)
+	{
+		eig_ratio = Sigma_full[i_sing] / Sigma_full[0];
+		if (eig_ratio > _eigen_thres)
+		{
+			++num_sing_used;
+		}
+		else
+		{
+			break;
+		}
+	}
+	ss.str("");
+	ss << "triming randomized SVD components to " << num_sing_used << " elements";
+	if (performance_log)
+		performance_log->log_event(ss.str());
+
+	MatrixXd w(k, num_sing_used);
+	for (int i = 0; i < num_sing_used; i++)
+		w.col(i) = es.eigenvectors().col(order[i]);
+	MatrixXd v(n, num_sing_used);
+	for_col_chunks(num_sing_used, num_threads, [&](int begin, int end)
+	{
+		v.middleCols(begin, end - begin) = q * w.middleCols(begin, end - begin);
+	});
+	//a negative eigen value goes into the sign of the left singular vector
+	MatrixXd u = v;
+	for (int i = 0; i < num_sing_used; i++)
+		if (es.eigenvalues()[order[i]] < 0.0)
+			u.col(i) = -u.col(i);
+	Sigma = Sigma_full.head(num_sing_used);
+	Sigma_trunc = Sigma_full.tail(k - num_sing_used);
+	U = u.sparseView();
+	VT = v.transpose().sparseView();
+	if (performance_log)
+		performance_log->log_event("done randomized SVD");
+}
@@ -19,6 +19,7 @@
 
 #ifndef SVDPACKAGE_H_
 #define SVDPACKAGE_H_
+#include <functional>
 #include <string>
 #include<Eigen/Dense>
 #include<Eigen/Sparse>
@@ -31,6 +32,10 @@ public:
 	SVDPackage(const SVDPackage &rhs) : description(rhs.description), n_max_sing(rhs.n_max_sing), eign_thres(rhs.eign_thres), performance_log(rhs.performance_log) {}
 	virtual void solve_ip(Eigen::SparseMatrix<double>& A, Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double> & U, Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc) = 0;
 	virtual void solve_ip(Eigen::SparseMatrix<double>& A, Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double> & U, Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc, double _eigen_thres) = 0;
+	//decompose the normal matrix Jt * Q * J (+ reg, if not null).  the default forms the normal matrix
+	//and calls solve_ip() - packages that can work from J and Q directly override this
+	virtual void solve_normal_ip(const Eigen::SparseMatrix<double>& J, const Eigen::SparseMatrix<double>& Q, const Eigen::SparseMatrix<double>* reg,
+		Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double>& U, Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc);
 	virtual void set_max_sing(int _n_max_sing);
 	virtual int get_max_sing();
 	virtual void set_eign_thres(double _eign_thres);
@@ -76,4 +81,36 @@ public:
 	virtual ~SVD_REDSVD(void) {}
 };
 
+//adaptive randomized eigen decomposition for symmetric (normal) matrices.  the basis of a
+//randomized range finder is grown one block of gaussian test vectors at a time, each with a few
+//power iterations, until a block finds no singular value above eign_thres (relative to the
+//largest), or the basis holds n_max_sing vectors (or the rank) plus one block.  the normal matrix
+//is only applied to blocks of vectors, as Jt(Q^(1/2)(Q^(1/2)(J x))), so it is never formed.
+//blocks are split over num_threads threads (none if < 1) in fixed chunks of columns and the test
+//vectors are counter based, so the result does not depend on the number of threads
+class SVD_RANDOMIZED : public SVDPackage
+{
+public:
+	SVD_RANDOMIZED(int _n_max_sing = 1000, double _eign_thres = 1.0e-7, int _block_size = 16, int _power_iters = 2, int _num_threads = -1)
+		: SVDPackage("adaptive randomized SVD", _n_max_sing, _eign_thres), block_size(_block_size), power_iters(_power_iters), num_threads(_num_threads) {}
+	SVD_RANDOMIZED(const SVD_RANDOMIZED &rhs) : SVDPackage(rhs), block_size(rhs.block_size), power_iters(rhs.power_iters), num_threads(rhs.num_threads) {}
+	virtual void solve_ip(Eigen::SparseMatrix<double>& A, Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double>& U,
+		Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc);
+	//A must be symmetric - others are passed to SVD_EIGEN
+	virtual void solve_ip(Eigen::SparseMatrix<double>& A, Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double>& U,
+		Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc, double _eigen_thres);
+	virtual void solve_normal_ip(const Eigen::SparseMatrix<double>& J, const Eigen::SparseMatrix<double>& Q, const Eigen::SparseMatrix<double>* reg,
+		Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double>& U, Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc);
+	virtual SVD_RANDOMIZED *clone() const { return new SVD_RANDOMIZED(*this); }
+	virtual ~SVD_RANDOMIZED(void) {}
+private:
+	int block_size;
+	int power_iters;
+	int num_threads;
+	//Y = A * X for the symmetric n by n operator A
+	typedef std::function<void(const Eigen::MatrixXd&, Eigen::MatrixXd&)> Operator;
+	void solve_sym(int n, int max_rank, const Operator &apply, double _eigen_thres, Eigen::VectorXd &Sigma, Eigen::SparseMatrix<double>& U,
+		Eigen::SparseMatrix<double>& VT, Eigen::VectorXd &Sigma_trunc);
+};
+
 #endif //SVDPACKAGE_H_
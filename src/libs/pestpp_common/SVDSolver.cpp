@@ -104,6 +104,7 @@ SVDSolver::SVDSolver(Pest &_pest_scenario, FileManager &_file_manager, Objective
 {
 	svd_package = new SVD_REDSVD();
 	glm_normal_form = pest_scenario.get_pestpp_options().get_glm_normal_form();
+	glm_lambda_shared_svd = pest_scenario.get_pestpp_options().get_glm_lambda_shared_svd();
 
 }
 
@@ -120,6 +121,13 @@ void SVDSolver::set_svd_package(PestppOptions::SVD_PACK _svd_pack)
 		svd_package = new SVD_REDSVD;
 
 	}
+	else if (_svd_pack == PestppOptions::RANDOMIZED)
+	{
+		const PestppOptions &ppo = pest_scenario.get_pestpp_options();
+		delete svd_package;
+		svd_package = new SVD_RANDOMIZED(svd_info.maxsing, svd_info.eigthresh, ppo.get_glm_rsvd_block_size(),
+			ppo.get_glm_rsvd_power_iters(), ppo.get_num_svd_threads());
+	}
 
 	svd_package->set_max_sing(svd_info.maxsing);
 	svd_package->set_eign_thres(svd_info.eigthresh);
@@ -379,9 +387,6 @@ void SVDSolver::calc_lambda_upgrade_vec_JtQJ(const Jacobian &jacobian, const QSq
 	par_transform.active_ctl2numeric_ip(pars_nf);
 	vector<string> numeric_par_names = pars_nf.get_keys();
 
-	//get the dss map to zero out insen pars
-	map<string, double> dss = pest_scenario.calc_par_dss(jacobian, par_transform);
-
 	//Compute effect of frozen parameters on the residuals vector
 	Parameters delta_freeze_pars = prev_frozen_active_ctl_pars;
 	Parameters base_freeze_pars(base_active_ctl_pars, delta_freeze_pars.get_keys());
@@ -390,138 +395,91 @@ void SVDSolver::calc_lambda_upgrade_vec_JtQJ(const Jacobian &jacobian, const QSq
 	delta_freeze_pars -= base_freeze_pars;
 	VectorXd del_residuals = calc_residual_corrections(jacobian, delta_freeze_pars, obs_name_vec);
 	VectorXd corrected_residuals = Residuals + del_residuals;
-	VectorXd Sigma;
-	VectorXd Sigma_trunc;
-	Eigen::SparseMatrix<double> U;
-	Eigen::SparseMatrix<double> Vt;
 	// the last boolean arguement is an instruction to compute the square weights
-	Eigen::SparseMatrix<double> q_mat = Q_sqrt.get_sparse_matrix(obs_name_vec, regul, true);
+	Eigen::SparseMatrix<double> q_mat_local;
+	const Eigen::SparseMatrix<double> *q_mat_ptr = &q_mat_local;
+	if (upgrade_cache.on)
+	{
+		if (!upgrade_cache.have_q_mat)
+		{
+			upgrade_cache.q_mat = Q_sqrt.get_sparse_matrix(obs_name_vec, regul, true);
+			upgrade_cache.have_q_mat = true;
+		}
+		q_mat_ptr = &upgrade_cache.q_mat;
+	}
+	else
+		q_mat_local = Q_sqrt.get_sparse_matrix(obs_name_vec, regul, true);
+	const Eigen::SparseMatrix<double> &q_mat = *q_mat_ptr;
 	// removed this line when true added to end of the previous call to get_sparce_matrix
 	//q_mat = (q_mat * q_mat).eval();
-	Eigen::SparseMatrix<double> jac = jacobian.get_matrix(obs_name_vec, numeric_par_names);
-	
-	performance_log->log_event("forming JtQJ matrix");
-	Eigen::SparseMatrix<double> JtQJ = jac.transpose() * q_mat * jac;
-	
-	Eigen::VectorXd upgrade_vec;
-	stringstream info_str;
-	//PestppOptions::GLMNormalForm mar_mat = pest_scenario.get_pestpp_options().get_glm_normal_form();
-	if (glm_normal_form == PestppOptions::GLMNormalForm::DIAG)
-	{
-		
-		Eigen::SparseMatrix<double> S;
-		//Compute Scaling Matrix Sii
-		performance_log->log_event("commencing to scale JtQJ matrix- first SVD...");
-		svd_package->solve_ip(JtQJ, Sigma, U, Vt, Sigma_trunc, 0.0);
-		VectorXd Sigma_inv_sqrt = Sigma.array().inverse().sqrt();
-		S = Vt.transpose() * Sigma_inv_sqrt.asDiagonal() * U.transpose();
-		VectorXd S_diag = S.diagonal();
-		MatrixXd S_tmp = S_diag.asDiagonal();
-		S = S_tmp.sparseView();
-		
-		stringstream info_str1;
-		info_str1 << "S info: " << "rows = " << S.rows() << ": cols = " << S.cols() << ": size = " << S.size() << ": nonzeros = " << S.nonZeros();
-		performance_log->log_event(info_str1.str());
-		performance_log->log_event("JS");
-		
-		Eigen::SparseMatrix<double> JS = jac * S;
-		performance_log->log_event("JS.transpose() * q_mat * JS + lambda * S.transpose() * S");
-		
-		JtQJ = JS.transpose() * q_mat * JS + lambda * S.transpose() * S;
-		
-		info_str.str("");
-		info_str << "S info: " << "rows = " << S.rows() << ": cols = " << S.cols() << ": size = " << S.size() << ": nonzeros = " << S.nonZeros();
-		performance_log->log_event(info_str.str());
-
-		// Returns truncated Sigma, U and Vt arrays with small singular parameters trimed off
-		performance_log->log_event("commencing SVD factorization of lambda-scaled JtQJ");
-		svd_package->solve_ip(JtQJ, Sigma, U, Vt, Sigma_trunc);
-		performance_log->log_event("SVD factorization complete");
 
-		output_file_writer.write_svd(Sigma, Vt, lambda, prev_frozen_active_ctl_pars, Sigma_trunc);
+	std::shared_ptr<NormalSolve> ns = get_normal_solve(jacobian, q_mat, obs_name_vec, numeric_par_names, base_numeric_pars);
+	const Eigen::SparseMatrix<double> &jac = ns->jac;
+	Eigen::VectorXd innovation = jac.transpose() * (q_mat * corrected_residuals);
+	if (glm_normal_form == PestppOptions::GLMNormalForm::PRIOR)
+		innovation = innovation + ns->reg_innovation;
 
+	Eigen::VectorXd upgrade_vec;
+	if (lambda_shared_svd())
+	{
+		//lambda only rescales the singular values of the normal matrix
+		VectorXd Sigma;
+		if (glm_normal_form == PestppOptions::GLMNormalForm::DIAG)
+			//marquardt without scaling: (JtQJ + lambda I) shares the singular vectors of JtQJ
+			Sigma = ns->Sigma.array() + lambda;
+		else
+			//Only add lambda to singular values above the threshhold
+			Sigma = ns->Sigma.array() + (ns->Sigma.cwiseProduct(ns->Sigma).array() * lambda).sqrt();
+		output_file_writer.write_svd(Sigma, ns->Vt, lambda, prev_frozen_active_ctl_pars, ns->Sigma_trunc);
 		VectorXd Sigma_inv = Sigma.array().inverse();
-		performance_log->log_event("commencing linear algebra multiplication to compute ugrade");
 
-		info_str << "Vt info: " << "rows = " << Vt.rows() << ": cols = " << Vt.cols() << ": size = " << Vt.size() << ": nonzeros = " << Vt.nonZeros();
-		performance_log->log_event(info_str.str());
-		info_str.str("");
-		info_str << "U info: " << "rows = " << U.rows() << ": cols = " << U.cols() << ": size = " << U.size() << ": nonzeros = " << U.nonZeros();
-		performance_log->log_event(info_str.str());
-		info_str.str("");
-		info_str << "jac info: " << "rows = " << jac.rows() << ": cols = " << jac.cols() << ": size = " << jac.size() << ": nonzeros = " << jac.nonZeros();
-		performance_log->log_event(info_str.str());
-		
-		upgrade_vec = S * (Vt.transpose() * (Sigma_inv.asDiagonal() * (U.transpose() * ((jac * S).transpose()* (q_mat  * (corrected_residuals))))));
-		
+		performance_log->log_event("commencing linear algebra multiplication to compute ugrade");
+		upgrade_vec = ns->Vt.transpose() * (Sigma_inv.asDiagonal() * (ns->U.transpose() * innovation));
 	}
-	else if ((glm_normal_form == PestppOptions::GLMNormalForm::IDENT) ||
-		(glm_normal_form == PestppOptions::GLMNormalForm::PRIOR))
+	else
 	{
-		JtQJ = jac.transpose() * q_mat * jac;
-		Eigen::VectorXd innovation = jac.transpose() * (q_mat * corrected_residuals);
-		
-		if (glm_normal_form == PestppOptions::GLMNormalForm::IDENT)
+		VectorXd Sigma;
+		VectorXd Sigma_trunc;
+		Eigen::SparseMatrix<double> U;
+		Eigen::SparseMatrix<double> Vt;
+		Eigen::SparseMatrix<double> JtQJ;
+		if (glm_normal_form == PestppOptions::GLMNormalForm::DIAG)
 		{
-			//nothing to do here
+			performance_log->log_event("JS.transpose() * q_mat * JS + lambda * S.transpose() * S");
+			JtQJ = ns->normal + lambda * ns->S.transpose() * ns->S;
 		}
-		
-		else if (glm_normal_form == PestppOptions::GLMNormalForm::PRIOR)
+		else
 		{
-			
-			//work up the inverse prior par cov
-			Covariance prior_inv = parcov.get(numeric_par_names);
-			prior_inv.inv_ip();
-			
-			
 			//form the regularized normal matrix
-			Eigen::MatrixXd lamb = (Eigen::MatrixXd::Ones(JtQJ.rows(), JtQJ.cols()) * (lambda + 1.0));
-			
-			lamb = lamb + prior_inv.e_ptr()->toDense();
+			Eigen::MatrixXd lamb = (Eigen::MatrixXd::Ones(ns->normal.rows(), ns->normal.cols()) * (lambda + 1.0));
+			lamb = lamb + ns->prior_inv;
 			for (int i = 0; i < numeric_par_names.size(); i++)
 			{
-				if (abs(dss[numeric_par_names[i]]) < 1.0e-6)
+				if (ns->sen(i) == 0.0)
 				{
 					lamb.col(i).setZero();
 					lamb.row(i).setZero();
 				}
 			}
-			lamb = lamb + JtQJ.toDense();
+			lamb = lamb + ns->normal.toDense();
 			JtQJ = lamb.sparseView();
-
-			//augment innovations with prior-scaled penalty
-			Parameters initial_numeric_pars = par_transform.ctl2numeric_cp(pest_scenario.get_ctl_parameters());
-			Eigen::VectorXd reg_innovation = *prior_inv.e_ptr() * (base_numeric_pars.get_data_eigen_vec(numeric_par_names) -
-				initial_numeric_pars.get_data_eigen_vec(numeric_par_names));
-			innovation = innovation + reg_innovation;
 		}
-
-		performance_log->log_event("commencing SVD factorization - using identity lambda scaling");
+		performance_log->log_event("commencing SVD factorization of lambda-scaled JtQJ");
 		svd_package->solve_ip(JtQJ, Sigma, U, Vt, Sigma_trunc);
 		performance_log->log_event("SVD factorization complete");
-		//Only add lambda to singular values above the threshhold
-		Sigma = Sigma.array() + (Sigma.cwiseProduct(Sigma).array() * lambda).sqrt();
+		if (glm_normal_form == PestppOptions::GLMNormalForm::PRIOR)
+			//Only add lambda to singular values above the threshhold
+			Sigma = Sigma.array() + (Sigma.cwiseProduct(Sigma).array() * lambda).sqrt();
 		output_file_writer.write_svd(Sigma, Vt, lambda, prev_frozen_active_ctl_pars, Sigma_trunc);
 		VectorXd Sigma_inv = Sigma.array().inverse();
 
 		performance_log->log_event("commencing linear algebra multiplication to compute ugrade");
-		stringstream info_str;
-		info_str << "Vt info: " << "rows = " << Vt.rows() << ": cols = " << Vt.cols() << ": size = " << Vt.size() << ": nonzeros = " << Vt.nonZeros();
-		performance_log->log_event(info_str.str());
-		info_str.str("");
-		info_str << "U info: " << "rows = " << U.rows() << ": cols = " << U.cols() << ": size = " << U.size() << ": nonzeros = " << U.nonZeros();
-		performance_log->log_event(info_str.str());
-		info_str.str("");
-		info_str << "jac info: " << "rows = " << jac.rows() << ": cols = " << jac.cols() << ": size = " << jac.size() << ": nonzeros = " << jac.nonZeros();
-		performance_log->log_event(info_str.str());
-		//upgrade_vec = Vt.transpose() * (Sigma_inv.asDiagonal() * (U.transpose() * (jac.transpose() * (q_mat  * corrected_residuals))));
-		upgrade_vec = Vt.transpose() * (Sigma_inv.asDiagonal() * (U.transpose() * innovation));
-
+		if (glm_normal_form == PestppOptions::GLMNormalForm::DIAG)
+			upgrade_vec = ns->S * (Vt.transpose() * (Sigma_inv.asDiagonal() * (U.transpose() * (ns->JS.transpose() * (q_mat * corrected_residuals)))));
+		else
+			upgrade_vec = Vt.transpose() * (Sigma_inv.asDiagonal() * (U.transpose() * innovation));
 	}
 
-	else
-		throw runtime_error("unrecognized marquardt scaling type");
-
 	// scale the upgrade vector using the technique described in the PEST manual
 	if (pest_scenario.get_pestpp_options().get_jac_scale())
 	{
@@ -580,6 +538,101 @@ void SVDSolver::calc_lambda_upgrade_vec_JtQJ(const Jacobian &jacobian, const QSq
 
 
 
+bool SVDSolver::lambda_shared_svd() const
+{
+	//ident is exact with one decomposition, the other forms only share it when asked to
+	return (glm_normal_form == PestppOptions::GLMNormalForm::IDENT) || (glm_lambda_shared_svd);
+}
+
+void SVDSolver::begin_upgrade_cache()
+{
+	upgrade_cache.clear();
+	upgrade_cache.on = true;
+}
+
+void SVDSolver::end_upgrade_cache()
+{
+	upgrade_cache.clear();
+	upgrade_cache.on = false;
+}
+
+std::shared_ptr<SVDSolver::NormalSolve> SVDSolver::get_normal_solve(const Jacobian &jacobian, const Eigen::SparseMatrix<double> &q_mat,
+	const vector<string> &obs_name_vec, const vector<string> &numeric_par_names, const Parameters &base_numeric_pars)
+{
+	if (upgrade_cache.on)
+	{
+		auto it = upgrade_cache.solves.find(numeric_par_names);
+		if (it != upgrade_cache.solves.end())
+		{
+			performance_log->log_event("reusing normal matrix decomposition");
+			return it->second;
+		}
+	}
+	std::shared_ptr<NormalSolve> ns = std::make_shared<NormalSolve>();
+	ns->jac = jacobian.get_matrix(obs_name_vec, numeric_par_names);
+
+	Eigen::SparseMatrix<double> reg;
+	if (glm_normal_form == PestppOptions::GLMNormalForm::PRIOR)
+	{
+		//work up the inverse prior par cov
+		Covariance prior_inv = parcov.get(numeric_par_names);
+		prior_inv.inv_ip();
+
+		//the prior part of the normal matrix, leaving out insensitive pars
+		map<string, double> dss = pest_scenario.calc_par_dss(jacobian, par_transform);
+		ns->sen.resize(numeric_par_names.size());
+		for (int i = 0; i < numeric_par_names.size(); i++)
+			ns->sen(i) = (abs(dss[numeric_par_names[i]]) < 1.0e-6) ? 0.0 : 1.0;
+		if (lambda_shared_svd())
+		{
+			reg = ns->sen.asDiagonal() * (*prior_inv.e_ptr());
+			reg = reg * ns->sen.asDiagonal();
+		}
+		else
+			ns->prior_inv = prior_inv.e_ptr()->toDense();
+
+		//augment innovations with prior-scaled penalty
+		Parameters initial_numeric_pars = par_transform.ctl2numeric_cp(pest_scenario.get_ctl_parameters());
+		ns->reg_innovation = *prior_inv.e_ptr() * (base_numeric_pars.get_data_eigen_vec(numeric_par_names) -
+			initial_numeric_pars.get_data_eigen_vec(numeric_par_names));
+	}
+
+	if (lambda_shared_svd())
+	{
+		performance_log->log_event("commencing SVD factorization of JtQJ");
+		svd_package->solve_normal_ip(ns->jac, q_mat, (glm_normal_form == PestppOptions::GLMNormalForm::PRIOR) ? &reg : nullptr,
+			ns->Sigma, ns->U, ns->Vt, ns->Sigma_trunc);
+		performance_log->log_event("SVD factorization complete");
+	}
+	else if (glm_normal_form == PestppOptions::GLMNormalForm::DIAG)
+	{
+		performance_log->log_event("forming JtQJ matrix");
+		Eigen::SparseMatrix<double> JtQJ = ns->jac.transpose() * q_mat * ns->jac;
+		VectorXd Sigma;
+		VectorXd Sigma_trunc;
+		Eigen::SparseMatrix<double> U;
+		Eigen::SparseMatrix<double> Vt;
+		//Compute Scaling Matrix Sii
+		performance_log->log_event("commencing to scale JtQJ matrix- first SVD...");
+		svd_package->solve_ip(JtQJ, Sigma, U, Vt, Sigma_trunc, 0.0);
+		VectorXd Sigma_inv_sqrt = Sigma.array().inverse().sqrt();
+		ns->S = Vt.transpose() * Sigma_inv_sqrt.asDiagonal() * U.transpose();
+		VectorXd S_diag = ns->S.diagonal();
+		MatrixXd S_tmp = S_diag.asDiagonal();
+		ns->S = S_tmp.sparseView();
+		ns->JS = ns->jac * ns->S;
+		ns->normal = ns->JS.transpose() * q_mat * ns->JS;
+	}
+	else
+	{
+		performance_log->log_event("forming JtQJ matrix");
+		ns->normal = ns->jac.transpose() * q_mat * ns->jac;
+	}
+	if (upgrade_cache.on)
+		upgrade_cache.solves[numeric_par_names] = ns;
+	return ns;
+}
+
 void SVDSolver::calc_upgrade_vec(double i_lambda, Parameters &prev_frozen_active_ctl_pars, QSqrtMatrix &Q_sqrt,
 	const DynamicRegularization &regul, VectorXd &residuals_vec, vector<string> &obs_names_vec,
 	const Parameters &base_run_active_ctl_pars, Parameters &upgrade_active_ctl_pars,
@@ -1014,14 +1067,19 @@ ModelRun SVDSolver::iteration_upgrd(RunManagerAbstract &run_manager, Termination
 		Parameters frozen_active_ctl_pars = failed_jac_pars;
 		Pest::LimitType limit_type;
 		
+		//the jacobian and weights are fixed from here on (apart from the dynamic weight adjustment),
+		//so the normal matrix decompositions are shared by every lambda
+		begin_upgrade_cache();
 		//use call to calc_upgrade_vec to compute frozen parameters
 		test_upgrade_to_find_freeze_pars(0.0, frozen_active_ctl_pars, Q_sqrt, *regul_scheme_ptr, residuals_vec,
 			obs_names_vec, base_run_active_ctl_par,
 			tmp_new_par);
 		if (regul_scheme_ptr->get_use_dynamic_reg())
 		{
+			end_upgrade_cache();
 			dynamic_weight_adj(base_run, jacobian, Q_sqrt, residuals_vec, obs_names_vec,
 				base_run_active_ctl_par, frozen_active_ctl_pars);
+			begin_upgrade_cache();
 		}
 		
 		//Build model runs
@@ -1124,6 +1182,7 @@ ModelRun SVDSolver::iteration_upgrd(RunManagerAbstract &run_manager, Termination
 				save_frozen_pars(fout_frz, frozen_active_ctl_pars, run_id);
 			}*/
 		}
+		end_upgrade_cache();
 		file_manager.close_file("fpr");
 		RestartController::write_upgrade_runs_built(fout_restart);
 	}
@@ -22,6 +22,7 @@
 #include <map>
 #include <set>
 #include <iomanip>
+#include <memory>
 #include <Eigen/Dense>
 #include "Transformable.h"
 #include "ParamTransformSeq.h"
@@ -104,10 +105,43 @@ protected:
 		vector<string> par_name_vec;
 		Parameters frozen_numeric_pars;
 	};
+	//the lambda-independent part of the upgrade solve for one set of (not frozen) numeric pars.
+	//when the lambdas share one decomposition (see lambda_shared_svd()) the normal matrix is
+	//decomposed once and each lambda only rescales its singular values.  otherwise only the parts
+	//of the normal matrix that don't depend on lambda are kept and each lambda is decomposed
+	class NormalSolve {
+	public:
+		Eigen::SparseMatrix<double> jac;
+		Eigen::VectorXd reg_innovation;
+		Eigen::VectorXd Sigma;
+		Eigen::VectorXd Sigma_trunc;
+		Eigen::SparseMatrix<double> U;
+		Eigen::SparseMatrix<double> Vt;
+		//diag: the marquardt scaling matrix and Jt*Q*J in scaled terms
+		Eigen::SparseMatrix<double> S;
+		Eigen::SparseMatrix<double> JS;
+		//diag: (JS)t*Q*(JS), prior: Jt*Q*J
+		Eigen::SparseMatrix<double> normal;
+		//prior: the inverse prior par cov and a 0/1 flag for the sensitive pars
+		Eigen::MatrixXd prior_inv;
+		Eigen::VectorXd sen;
+	};
+	//the weights matrix and the normal solves (by par set) of the current lambda search.  only
+	//filled between begin_upgrade_cache() and end_upgrade_cache(), while the jacobian and weights are fixed
+	class UpgradeCache {
+	public:
+		bool on;
+		bool have_q_mat;
+		Eigen::SparseMatrix<double> q_mat;
+		map<vector<string>, std::shared_ptr<NormalSolve>> solves;
+		UpgradeCache() : on(false), have_q_mat(false) {}
+		void clear() { have_q_mat = false; q_mat.resize(0, 0); solves.clear(); }
+	};
 	std::mt19937* rand_gen_ptr;
 	Covariance& parcov;
 	Pest &pest_scenario;
 	PestppOptions::GLMNormalForm glm_normal_form;
+	bool glm_lambda_shared_svd;
 	const static string svd_solver_type_name;
 	SVDPackage *svd_package;
 	//MarquardtMatrix mar_mat;
@@ -134,6 +168,7 @@ protected:
 	std::vector<double> lambda_scale_vec;
 	bool terminate_local_iteration;
 	bool der_forgive;
+	UpgradeCache upgrade_cache;
 		
 	virtual Parameters limit_parameters_freeze_all_ip(const Parameters &init_active_ctl_pars,
 		Parameters &upgrade_active_ctl_pars, const Parameters &frozen_active_ctl_pars = Parameters());
@@ -149,6 +184,11 @@ protected:
 		Parameters &new_ctl_pars);
 	
 	
+	bool lambda_shared_svd() const;
+	void begin_upgrade_cache();
+	void end_upgrade_cache();
+	std::shared_ptr<NormalSolve> get_normal_solve(const Jacobian &jacobian, const Eigen::SparseMatrix<double> &q_mat,
+		const vector<string> &obs_name_vec, const vector<string> &numeric_par_names, const Parameters &base_numeric_pars);
 	Eigen::VectorXd calc_residual_corrections(const Jacobian &jacobian, const Parameters &del_numeric_pars,
 							   const vector<string> obs_name_vec);
 	void dynamic_weight_adj(const ModelRun &base_run, const Jacobian &jacobian, QSqrtMatrix &Q_sqrt,
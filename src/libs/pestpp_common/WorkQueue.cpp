@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <exception>
+#include <mutex>
+#include "WorkQueue.h"
+
+using namespace std;
+
+WorkQueue::WorkQueue(int _num_items, int _chunk_size) : num_items(_num_items), next_item(0)
+{
+	chunk_size = max(1, _chunk_size);
+}
+
+bool WorkQueue::next(int &begin, int &end)
+{
+	begin = next_item.fetch_add(chunk_size);
+	if (begin >= num_items)
+		return false;
+	end = min(begin + chunk_size, num_items);
+	return true;
+}
+
+void WorkQueue::stop()
+{
+	next_item.store(num_items);
+}
+
+int WorkQueue::get_chunk_size(int num_items, int num_threads, int chunks_per_thread)
+{
+	return max(1, num_items / (max(1, num_threads) * max(1, chunks_per_thread)));
+}
+
+void WorkQueue::run(int num_threads, const function<void(int)> &work)
+{
+	if (num_threads < 1)
+	{
+		work(0);
+		return;
+	}
+	vector<exception_ptr> exception_ptrs(num_threads);
+	vector<thread> threads;
+	for (int i = 0; i < num_threads; i++)
+	{
+		threads.push_back(thread([this, i, &work, &exception_ptrs]()
+		{
+			try
+			{
+				work(i);
+			}
+			catch (...)
+			{
+				exception_ptrs[i] = current_exception();
+				stop();
+			}
+		}));
+	}
+	for (auto &t : threads)
+		t.join();
+
+	stringstream ss;
+	int num_exp = 0;
+	for (int i = 0; i < num_threads; i++)
+	{
+		if (!exception_ptrs[i])
+			continue;
+		num_exp++;
+		try
+		{
+			rethrow_exception(exception_ptrs[i]);
+		}
+		catch (const std::exception& e)
+		{
+			ss << " thread " << i << " raised an exception: " << e.what();
+		}
+		catch (...)
+		{
+			ss << " thread " << i << " raised an exception";
+		}
+	}
+	if (num_exp > 0)
+		throw runtime_error(ss.str());
+}
+
+void WorkQueue::for_each(int num_items, int num_threads, int chunk_size, const function<void(int, int)> &work)
+{
+	if (num_threads < 1)
+	{
+		for (int i = 0; i < num_items; i++)
+			work(0, i);
+		return;
+	}
+	WorkQueue queue(num_items, chunk_size);
+	mutex error_lock;
+	int error_item = num_items;
+	exception_ptr error_ptr;
+	queue.run(num_threads, [&](int thread_id)
+	{
+		int begin, end;
+		while (queue.next(begin, end))
+		{
+			for (int i = begin; i < end; i++)
+			{
+				try
+				{
+					work(thread_id, i);
+				}
+				catch (...)
+				{
+					//chunks are handed out in order, so once this is recorded any chunk
+					//still unclaimed only holds larger items
+					lock_guard<mutex> g(error_lock);
+					if (i < error_item)
+					{
+						error_item = i;
+						error_ptr = current_exception();
+					}
+					queue.stop();
+					break;
+				}
+			}
+		}
+	});
+	if (error_ptr)
+		rethrow_exception(error_ptr);
+}
@@ -0,0 +1,35 @@
+#ifndef WORK_QUEUE_H_
+#define WORK_QUEUE_H_
+
+#include <atomic>
+#include <functional>
+
+//hands out the indices [0, num_items) in chunks to any number of worker threads.
+//chunks are claimed from an atomic counter, so idle threads never spin on a lock
+//and a thread that finishes early just claims the next chunk
+class WorkQueue
+{
+public:
+	WorkQueue(int _num_items, int _chunk_size = 1);
+	//claim the next chunk [begin, end); returns false once every item has been claimed
+	bool next(int &begin, int &end);
+	//stop handing out chunks - used when a thread fails so the others wind down
+	void stop();
+	int get_num_items() { return num_items; }
+	//a chunk size that gives each of num_threads threads about chunks_per_thread chunks
+	static int get_chunk_size(int num_items, int num_threads, int chunks_per_thread = 8);
+	//run work(thread_id) on num_threads threads and join them.  with num_threads < 1,
+	//work(0) is called on the calling thread.  if any thread throws, the queue is
+	//stopped and the messages from all failed threads are rethrown as one runtime_error
+	void run(int num_threads, const std::function<void(int)> &work);
+	//call work(thread_id, item) for every item in [0, num_items) on num_threads threads.
+	//if any call throws, the exception from the smallest item is rethrown as-is, which
+	//is the one a serial loop over the items would have stopped at
+	static void for_each(int num_items, int num_threads, int chunk_size, const std::function<void(int, int)> &work);
+private:
+	int num_items;
+	int chunk_size;
+	std::atomic<int> next_item;
+};
+
+#endif //WORK_QUEUE_H_
@@ -25,7 +25,7 @@ using namespace std;
 Constraints::Constraints(Pest& _pest_scenario, FileManager* _file_mgr_ptr, OutputFileWriter& _of_wr, PerformanceLog& _pfm)
 	:pest_scenario(_pest_scenario), file_mgr_ptr(_file_mgr_ptr), of_wr(_of_wr), pfm(_pfm), jco(*_file_mgr_ptr, _of_wr)
 {
-	;
+	jco.set_num_threads(_pest_scenario.get_pestpp_options().get_num_jco_threads());
 }
 
 
@@ -7,6 +7,8 @@
 #include <vector>
 #include <random>
 #include <iterator>
+#include <cstring>
+#include <cstdint>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 #include <Eigen/IterativeLinearSolvers>
@@ -75,12 +77,8 @@ Mat::Mat(vector<string> _row_names, vector<string> _col_names,
 
 void Mat::update_sets()
 {
-	row_set.clear();
-	//row_set.emplace(row_names.begin(), row_names.end());
-	row_set = set<string>(row_names.begin(), row_names.end());
-	col_set.clear();
-	//col_set.emplace(col_names.begin(), col_names.end());
-	col_set = set<string>(col_names.begin(), col_names.end());
+	row_aligner.reset(row_names);
+	col_aligner.reset(col_names);
 }
 
 
@@ -779,21 +777,9 @@ Mat Mat::get(const vector<string> &new_row_names, const vector<string> &new_col_
 	//check that every row and col name is listed
 	if (new_row_names.size() == 0) throw runtime_error("Mat::get() error: new_row_names is empty");
 	if (new_col_names.size() == 0) throw runtime_error("Mat::get() error: new_col_names is empty");
-	vector<string> row_not_found;
-	
-	if (update)
-		update_sets();
-	set<string>::iterator end = row_set.end();
-	for (auto &n : new_row_names)
-		if (row_set.find(n) == end)
-			row_not_found.push_back(n);
-
-	vector<string> col_not_found;
-	//set<string> col_set(col_names.begin(), col_names.end());
-	end = col_set.end();
-	for (auto &n : new_col_names)
-		if (col_set.find(n) == end)
-			col_not_found.push_back(n);
+	vector<string> row_not_found, col_not_found;
+	shared_ptr<const vector<int>> row_pos = row_aligner.positions(row_names, new_row_names, row_not_found, update);
+	shared_ptr<const vector<int>> col_pos = col_aligner.positions(col_names, new_col_names, col_not_found, update);
 	if (row_not_found.size() != 0)
 	{
 		cout << "Mat::get() error: the following row names were not found:" << endl;
@@ -818,46 +804,27 @@ Mat Mat::get(const vector<string> &new_row_names, const vector<string> &new_col_
 
 	int nrow = new_row_names.size();
 	int ncol = new_col_names.size();
-	int irow_new;
-	int icol_new;
-
-	unordered_map<string, int> row_name2new_index_map;
-	unordered_map<string, int> col_name2new_index_map;
 
-	// Build mapping of parameter names to column number in new matrix to be returned
-	icol_new = 0;
-	for (vector<string>::const_iterator b = new_col_names.begin(), e = new_col_names.end();
-		b != e; ++b, ++icol_new) {
-		col_name2new_index_map[(*b)] = icol_new;
-	}
+	// old index to new index for rows and cols - the last of any repeated new names wins
+	vector<int> new_row_idx(max((int)row_names.size(), (int)matrix.rows()), -1);
+	vector<int> new_col_idx(max((int)col_names.size(), (int)matrix.cols()), -1);
+	for (int i = 0; i < nrow; ++i)
+		new_row_idx[(*row_pos)[i]] = i;
+	for (int j = 0; j < ncol; ++j)
+		new_col_idx[(*col_pos)[j]] = j;
 
-	// Build mapping of observation names to row  number in new matrix to be returned
-	irow_new = 0;
-	for (vector<string>::const_iterator b = new_row_names.begin(), e = new_row_names.end();
-		b != e; ++b, ++irow_new) {
-		row_name2new_index_map[(*b)] = irow_new;
-	}
-
-	unordered_map<string, int>::const_iterator found_col;
-	unordered_map<string, int>::const_iterator found_row;
-	unordered_map<string, int>::const_iterator not_found_col_map = col_name2new_index_map.end();
-	unordered_map<string, int>::const_iterator not_found_row_map = row_name2new_index_map.end();
-
-	const string *row_name;
-	const string *col_name;
 	std::vector<Eigen::Triplet<double> > triplet_list;
+	int irow_new, icol_new;
 	for (int icol = 0; icol<matrix.outerSize(); ++icol)
 	{
+		icol_new = new_col_idx[icol];
+		if (icol_new < 0)
+			continue;
 		for (Eigen::SparseMatrix<double>::InnerIterator it(matrix, icol); it; ++it)
 		{
-			col_name = &col_names[it.col()];
-			row_name = &row_names[it.row()];
-			found_col = col_name2new_index_map.find(*col_name);
-			found_row = row_name2new_index_map.find(*row_name);
-			if (found_col != not_found_col_map && found_row != not_found_row_map)
-			{
-				triplet_list.push_back(Eigen::Triplet<double>(found_row->second, found_col->second, it.value()));
-			}
+			irow_new = new_row_idx[it.row()];
+			if (irow_new >= 0)
+				triplet_list.push_back(Eigen::Triplet<double>(irow_new, icol_new, it.value()));
 		}
 	}
 	//if (triplet_list.size() == 0)
@@ -917,14 +884,7 @@ bool Mat::isdiagonal()
 void Mat::drop_cols(const vector<string> &drop_col_names)
 {
 	vector<string> missing_col_names;
-	const set<string> snames(col_names.begin(), col_names.end());
-	set<string>::const_iterator send = snames.end();
-	for (auto &name : drop_col_names)
-	{
-		//if (find(col_names.begin(), col_names.end(), name) == col_names.end())
-		if (snames.find(name) == send)
-			missing_col_names.push_back(name);
-	}
+	shared_ptr<const vector<int>> drop_pos = col_aligner.positions(col_names, drop_col_names, missing_col_names);
 
 	if (missing_col_names.size() != 0)
 	{
@@ -934,20 +894,13 @@ void Mat::drop_cols(const vector<string> &drop_col_names)
 		cout << endl;
 		throw runtime_error("Mat::drop_cols() error: atleast one drop col name not found");
 	}
+	vector<bool> drop(col_names.size(), false);
+	for (auto i : *drop_pos)
+		drop[i] = true;
 	vector<string> new_col_names;
-	if (drop_col_names.size() == 0)
-		new_col_names = col_names;
-	else
-	{
-		const set<string> snames(drop_col_names.begin(), drop_col_names.end());
-		set<string>::const_iterator send = snames.end();
-		for (auto &name : col_names)
-		{
-			//if (find(drop_col_names.begin(), drop_col_names.end(), name) == drop_col_names.end())
-			if (snames.find(name) == send)
-				new_col_names.push_back(name);
-		}
-	}
+	for (int i = 0; i < col_names.size(); i++)
+		if (!drop[i])
+			new_col_names.push_back(col_names[i]);
 	Mat new_mat = get(row_names, new_col_names);
 	matrix = new_mat.get_matrix();
 	col_names = new_col_names;
@@ -958,15 +911,7 @@ void Mat::drop_rows(const vector<string> &drop_row_names)
 {
 
 	vector<string> missing_row_names;
-	const set<string> snames(row_names.begin(), row_names.end());
-	set<string>::const_iterator send = snames.end();
-
-	for (auto &name : drop_row_names)
-	{
-		//if (find(row_names.begin(), row_names.end(), name) == row_names.end())
-		if (snames.find(name) == send)
-			missing_row_names.push_back(name);
-	}
+	shared_ptr<const vector<int>> drop_pos = row_aligner.positions(row_names, drop_row_names, missing_row_names);
 
 	if (missing_row_names.size() != 0)
 	{
@@ -977,20 +922,13 @@ void Mat::drop_rows(const vector<string> &drop_row_names)
 		throw runtime_error("Mat::drop_rows() error: atleast one drop row name not found");
 	}
 
+	vector<bool> drop(row_names.size(), false);
+	for (auto i : *drop_pos)
+		drop[i] = true;
 	vector<string> new_row_names;
-	if (drop_row_names.size() == 0)
-		new_row_names = row_names;
-	else
-	{
-		const set<string> snames(drop_row_names.begin(), drop_row_names.end());
-		set<string>::const_iterator send = snames.end();
-		for (auto &name : row_names)
-		{
-			//if (find(drop_row_names.begin(), drop_row_names.end(), name) == drop_row_names.end())
-			if (snames.find(name) == send)
-				new_row_names.push_back(name);
-		}
-	}
+	for (int i = 0; i < row_names.size(); i++)
+		if (!drop[i])
+			new_row_names.push_back(row_names[i]);
 	if (new_row_names.size() == 0)
 		matrix = Eigen::SparseMatrix<double>();
 	else
@@ -1734,3 +1672,228 @@ vector<double> Covariance::standard_normal(default_random_engine gen)
 	}
 	return sn_vec;
 }
+
+shared_ptr<const CovarianceFactor> Covariance::get_factor()
+{
+	size_t stamp = matrix_stamp();
+	if ((factor) && (stamp == factor_stamp))
+		return factor;
+	shared_ptr<CovarianceFactor> f = make_shared<CovarianceFactor>();
+	f->compute(matrix);
+	factor = f;
+	factor_stamp = stamp;
+	return factor;
+}
+
+Eigen::MatrixXd Covariance::solve(const Eigen::MatrixXd &rhs)
+{
+	return get_factor()->solve(rhs);
+}
+
+double Covariance::quad_form(const Eigen::VectorXd &x)
+{
+	if (x.size() != matrix.cols())
+		throw runtime_error("Covariance::quad_form() error: vector length does not match the matrix");
+	Eigen::VectorXd cx = matrix * x;
+	return x.dot(cx);
+}
+
+double Covariance::inv_quad_form(const Eigen::VectorXd &x)
+{
+	return get_factor()->inv_quad_form(x);
+}
+
+size_t Covariance::matrix_stamp()
+{
+	//fnv style mix over the shape, the structure and the value bits - cheap next to a solve
+	//and it catches every way Mat has of changing the matrix in place
+	matrix.makeCompressed();
+	uint64_t h = 14695981039346656037ULL;
+	auto mix = [&h](uint64_t w) { h = (h ^ w) * 1099511628211ULL; };
+	mix(matrix.rows());
+	mix(matrix.cols());
+	mix(matrix.nonZeros());
+	for (int i = 0; i <= matrix.outerSize(); i++)
+		mix(matrix.outerIndexPtr()[i]);
+	const int *inner = matrix.innerIndexPtr();
+	const double *values = matrix.valuePtr();
+	uint64_t w;
+	for (int i = 0; i < matrix.nonZeros(); i++)
+	{
+		mix(inner[i]);
+		memcpy(&w, &values[i], sizeof(w));
+		mix(w);
+	}
+	return (size_t)h;
+}
+
+
+//-----------------------------------------
+//covariance factorization
+//-----------------------------------------
+const int CovarianceFactor::BLOCK_SIZE;
+
+void CovarianceFactor::compute(const Eigen::SparseMatrix<double> &mat)
+{
+	if (mat.rows() != mat.cols())
+		throw runtime_error("CovarianceFactor::compute() error: matrix is not square");
+	int n = mat.rows();
+	bool is_diag = true;
+	for (int k = 0; (k < mat.outerSize()) && (is_diag); ++k)
+		for (Eigen::SparseMatrix<double>::InnerIterator it(mat, k); it; ++it)
+			if ((it.row() != it.col()) && (it.value() != 0.0))
+			{
+				is_diag = false;
+				break;
+			}
+	if (is_diag)
+	{
+		diag = mat.diagonal();
+		for (int i = 0; i < n; i++)
+			if (diag[i] <= 0.0)
+			{
+				stringstream ss;
+				ss << "CovarianceFactor::compute() error: non-positive diagonal entry " << diag[i] << " at index " << i;
+				throw runtime_error(ss.str());
+			}
+		type = FactorType::DIAGONAL;
+		return;
+	}
+	//dense factors are much faster than a simplicial one that fills in anyway
+	if ((double)mat.nonZeros() > 0.25 * (double)n * (double)n)
+	{
+		compute(Eigen::MatrixXd(mat.toDense()));
+		return;
+	}
+	sparse_ldlt.compute(mat);
+	if (sparse_ldlt.info() != Eigen::Success)
+		throw runtime_error("CovarianceFactor::compute() error: sparse LDLT factorization failed");
+	type = FactorType::SPARSE_LDLT;
+}
+
+void CovarianceFactor::compute(const Eigen::MatrixXd &mat)
+{
+	if (mat.rows() != mat.cols())
+		throw runtime_error("CovarianceFactor::compute() error: matrix is not square");
+	llt.compute(mat);
+	if (llt.info() == Eigen::Success)
+	{
+		type = FactorType::DENSE_LLT;
+		return;
+	}
+	llt = Eigen::LLT<Eigen::MatrixXd>();
+	ldlt.compute(mat);
+	if (ldlt.info() != Eigen::Success)
+		throw runtime_error("CovarianceFactor::compute() error: dense LDLT factorization failed");
+	type = FactorType::DENSE_LDLT;
+}
+
+int CovarianceFactor::size() const
+{
+	switch (type)
+	{
+	case FactorType::DIAGONAL:
+		return diag.size();
+	case FactorType::DENSE_LLT:
+		return llt.matrixLLT().rows();
+	case FactorType::DENSE_LDLT:
+		return ldlt.rows();
+	default:
+		return sparse_ldlt.rows();
+	}
+}
+
+Eigen::MatrixXd CovarianceFactor::solve(const Eigen::MatrixXd &rhs) const
+{
+	if (rhs.rows() != size())
+		throw runtime_error("CovarianceFactor::solve() error: rhs rows do not match the factor");
+	switch (type)
+	{
+	case FactorType::DIAGONAL:
+		return diag.cwiseInverse().asDiagonal() * rhs;
+	case FactorType::DENSE_LLT:
+		return llt.solve(rhs);
+	case FactorType::DENSE_LDLT:
+		return ldlt.solve(rhs);
+	default:
+		return sparse_ldlt.solve(rhs);
+	}
+}
+
+double CovarianceFactor::inv_quad_form(const Eigen::VectorXd &x) const
+{
+	return inv_quad_forms(x)[0];
+}
+
+Eigen::VectorXd CovarianceFactor::inv_quad_forms(const Eigen::MatrixXd &x) const
+{
+	if (x.rows() != size())
+		throw runtime_error("CovarianceFactor::inv_quad_forms() error: rows do not match the factor");
+	if (type == FactorType::DIAGONAL)
+		return (diag.cwiseInverse().asDiagonal() * x.cwiseAbs2()).colwise().sum().transpose();
+	if (type == FactorType::DENSE_LLT)
+	{
+		//x^T (LL^T)^-1 x = ||L^-1 x||^2
+		Eigen::MatrixXd w = x;
+		llt.matrixL().solveInPlace(w);
+		return w.colwise().squaredNorm().transpose();
+	}
+	return x.cwiseProduct(solve(x)).colwise().sum().transpose();
+}
+
+Eigen::MatrixXd CovarianceFactor::inv_congruence(const Eigen::MatrixXd &x) const
+{
+	if (x.rows() != size())
+		throw runtime_error("CovarianceFactor::inv_congruence() error: rows do not match the factor");
+	Eigen::MatrixXd w;
+	if (type == FactorType::DIAGONAL)
+		w = diag.cwiseSqrt().cwiseInverse().asDiagonal() * x;
+	else if (type == FactorType::DENSE_LLT)
+	{
+		w = x;
+		llt.matrixL().solveInPlace(w);
+	}
+	else
+		return x.transpose() * solve(x);
+	//w^T w through the symmetric rank update, then mirrored
+	Eigen::MatrixXd result = Eigen::MatrixXd::Zero(x.cols(), x.cols());
+	result.selfadjointView<Eigen::Lower>().rankUpdate(w.transpose());
+	for (int j = 1; j < result.cols(); j++)
+		result.col(j).head(j) = result.row(j).head(j).transpose();
+	return result;
+}
+
+Eigen::VectorXd CovarianceFactor::inv_diagonal() const
+{
+	int n = size();
+	if (type == FactorType::DIAGONAL)
+		return diag.cwiseInverse();
+	Eigen::VectorXd result(n);
+	for (int j0 = 0; j0 < n; j0 += BLOCK_SIZE)
+	{
+		int b = min(BLOCK_SIZE, n - j0);
+		if (type == FactorType::DENSE_LLT)
+		{
+			//L^-1 e_i is zero above i, so only the trailing block of L is needed
+			Eigen::MatrixXd w = Eigen::MatrixXd::Identity(n - j0, b);
+			llt.matrixLLT().bottomRightCorner(n - j0, n - j0).triangularView<Eigen::Lower>().solveInPlace(w);
+			result.segment(j0, b) = w.colwise().squaredNorm().transpose();
+		}
+		else
+		{
+			Eigen::MatrixXd e = Eigen::MatrixXd::Zero(n, b);
+			e.middleRows(j0, b).setIdentity();
+			Eigen::MatrixXd w = solve(e);
+			result.segment(j0, b) = w.middleRows(j0, b).diagonal();
+		}
+	}
+	return result;
+}
+
+Eigen::MatrixXd CovarianceFactor::inverse() const
+{
+	int n = size();
+	if (type == FactorType::DIAGONAL)
+		return Eigen::MatrixXd(diag.cwiseInverse().asDiagonal());
+	return solve(Eigen::MatrixXd::Identity(n, n));
+}
@@ -4,14 +4,52 @@
 #include <sstream>
 #include <vector>
 #include <random>
+#include <memory>
+#include<Eigen/Dense>
 #include<Eigen/Sparse>
+#include<Eigen/SparseCholesky>
 
 #include "Pest.h"
 #include "logger.h"
 #include "FileManager.h"
+#include "NameIndex.h"
 
 using namespace std;
 
+//factorization of a symmetric positive definite matrix (a covariance or a precision) for solves
+//and quadratic forms without forming its inverse.  a diagonal matrix is kept as a vector, a
+//dense (or mostly dense) one is factored by dense LLT and anything else by sparse LDLT.  a dense
+//matrix that is not positive definite falls back to a pivoted LDLT
+class CovarianceFactor
+{
+public:
+	enum class FactorType { DIAGONAL, DENSE_LLT, DENSE_LDLT, SPARSE_LDLT };
+	CovarianceFactor() : type(FactorType::DIAGONAL) { ; }
+	void compute(const Eigen::SparseMatrix<double> &mat);
+	void compute(const Eigen::MatrixXd &mat);
+	FactorType get_type() const { return type; }
+	int size() const;
+	//A^-1 rhs
+	Eigen::MatrixXd solve(const Eigen::MatrixXd &rhs) const;
+	//x^T A^-1 x
+	double inv_quad_form(const Eigen::VectorXd &x) const;
+	//x_k^T A^-1 x_k for each column x_k of x
+	Eigen::VectorXd inv_quad_forms(const Eigen::MatrixXd &x) const;
+	//x^T A^-1 x for a matrix x
+	Eigen::MatrixXd inv_congruence(const Eigen::MatrixXd &x) const;
+	//diagonal of A^-1 from blocks of solves against the identity
+	Eigen::VectorXd inv_diagonal() const;
+	//A^-1 - only for callers that need the explicit matrix
+	Eigen::MatrixXd inverse() const;
+private:
+	static const int BLOCK_SIZE = 256;
+	FactorType type;
+	Eigen::VectorXd diag;
+	Eigen::LLT<Eigen::MatrixXd> llt;
+	Eigen::LDLT<Eigen::MatrixXd> ldlt;
+	Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> sparse_ldlt;
+};
+
 class Mat
 {
 public:
@@ -101,8 +139,8 @@ protected:
 	Eigen::SparseMatrix<double> lower_chol;
 	vector<string> row_names;
 	vector<string> col_names;
-	set<string> row_set;
-	set<string> col_set;
+	NameAligner row_aligner;
+	NameAligner col_aligner;
 	int icode = 2;
 	MatType mattype;
 
@@ -145,9 +183,21 @@ public:
 	vector<double> standard_normal(default_random_engine gen);
 	void cholesky();
 
+	//factorization of the matrix, cached until the matrix changes
+	shared_ptr<const CovarianceFactor> get_factor();
+	//cov^-1 rhs
+	Eigen::MatrixXd solve(const Eigen::MatrixXd &rhs);
+	//x^T cov x
+	double quad_form(const Eigen::VectorXd &x);
+	//x^T cov^-1 x
+	double inv_quad_form(const Eigen::VectorXd &x);
 
 private:
 	Eigen::SparseMatrix<double> lower_cholesky;
+	shared_ptr<const CovarianceFactor> factor;
+	//fingerprint of the matrix the cached factor was computed from
+	size_t factor_stamp = 0;
+	size_t matrix_stamp();
 };
 
 ostream& operator<< (std::ostream &os, Mat mat);
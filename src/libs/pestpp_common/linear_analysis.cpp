@@ -389,7 +389,6 @@ pair<ParameterEnsemble,map<int,int>> LinearAnalysis::draw_fosm_reals(RunManagerA
 	set<string> args = pest_scenario.get_pestpp_options().get_passed_args();
 	ofstream& fout_rec = file_manager.rec_ofstream();
 	map<int, int> run_map;
-	Covariance cov = posterior_parameter_matrix();
 	//check for missing adjustable pars
 	/*vector<string> adj_names = pest_scenario.get_ctl_ordered_adj_par_names();
 	set<string> sadj_names(adj_names.begin(), adj_names.end());
@@ -413,8 +412,7 @@ pair<ParameterEnsemble,map<int,int>> LinearAnalysis::draw_fosm_reals(RunManagerA
 		pfm.log_event("drawing, saving and queuing FOSM parameter realizations");
 		bool binary = pest_scenario.get_pestpp_options().get_ies_save_binary();
 		int num_reals = pest_scenario.get_pestpp_options().get_glm_num_reals();
-		
-		
+		Covariance cov = posterior_parameter_matrix();
 
 		pe.draw(num_reals, optimum_run.get_ctl_pars(), cov, &pfm, 1, file_manager.rec_ofstream());
 		stringstream ss;
@@ -728,6 +726,7 @@ LinearAnalysis::LinearAnalysis(Mat &_jacobian, Pest &_pest_scenario, FileManager
 		}
 	}
 	R_sv = -999, G_sv = -999, ImR_sv = -999, V1_sv = -999;
+	post_obs_space = false;
 }
 
 void  LinearAnalysis::set_parcov(Mat& _parcov)
@@ -834,42 +833,57 @@ map<string, double> LinearAnalysis::posterior_parameter_variance()
 double LinearAnalysis::posterior_parameter_variance(string &par_name)
 {
 	//pfm.log_event("posterior_parameter_variance");
-	if (posterior.nrow() == 0) calc_posterior();
-	int ipar = find(posterior.rn_ptr()->begin(), posterior.rn_ptr()->end(), par_name) - posterior.rn_ptr()->begin();
-	if (ipar == posterior.nrow())
+	if (!post_factor) calc_posterior();
+	int ipar = find(parcov.rn_ptr()->begin(), parcov.rn_ptr()->end(), par_name) - parcov.rn_ptr()->begin();
+	if (ipar == parcov.nrow())
 		throw_error("linear_analysis::posterior_parameter_variance() error: parameter: " + par_name + " not found");
-	const Eigen::SparseMatrix<double>* ptr = posterior.e_ptr();
-	double val;
-	try
+	if (post_var.size() == 0)
 	{
-		val = ptr->diagonal()[ipar];
-	}
-	catch (exception &e)
-	{
-		stringstream ss;
-		ss << ipar;
-		throw_error("linear_analysis::posterior_parameter_variance() error accessing parameter variance at index " + ss.str() + " : " + string(e.what()));
+		pfm.log_event("LinearAnalysis::posterior_parameter_variance() posterior diagonal");
+		try
+		{
+			if (posterior.nrow() > 0)
+				post_var = posterior.e_ptr()->diagonal();
+			else if (post_obs_space)
+			{
+				int npar = parcov.nrow();
+				post_var.resize(npar);
+				for (int j0 = 0; j0 < npar; j0 += 256)
+				{
+					int b = min(256, npar - j0);
+					Eigen::MatrixXd e = Eigen::MatrixXd::Zero(npar, b);
+					e.middleRows(j0, b).setIdentity();
+					post_var.segment(j0, b) = posterior_quad_forms(e);
+				}
+			}
+			else
+				post_var = post_factor->inv_diagonal();
+		}
+		catch (exception &e)
+		{
+			throw_error("linear_analysis::posterior_parameter_variance() error calculating posterior diagonal : " + string(e.what()));
+		}
 	}
-	return val;
+	return post_var[ipar];
 }
 
 
 Mat LinearAnalysis::posterior_parameter_matrix()
 {
-	if (posterior.nrow() == 0) calc_posterior();
+	if (posterior.nrow() == 0) form_posterior();
 	return posterior;
 }
 
 Mat* LinearAnalysis::posterior_parameter_ptr()
 {
-	if (posterior.nrow() == 0) calc_posterior();
+	if (posterior.nrow() == 0) form_posterior();
 	Mat* ptr = &posterior;
 	return ptr;
 }
 
 Covariance LinearAnalysis::posterior_parameter_covariance_matrix()
 {
-	if (posterior.nrow() == 0) calc_posterior();
+	if (posterior.nrow() == 0) form_posterior();
 	return posterior;
 }
 
@@ -916,13 +930,12 @@ double LinearAnalysis::posterior_prediction_variance(string &pred_name)
 		throw_error("linear_analysis::prior_pred_variance() error: pred:" + pred_name + " not found in predicitons");
 	if (p_iter->second.e_ptr()->nonZeros() == 0)
 		return 0.0;
-	if (posterior.nrow() == 0) calc_posterior();
+	if (!post_factor) calc_posterior();
 	double val;
 	try
 	{
-
-		Eigen::SparseMatrix<double> result = (*p_iter->second.transpose().e_ptr() * *posterior.e_ptr() * *p_iter->second.e_ptr());
-		val = result.valuePtr()[0];
+		Eigen::MatrixXd y = p_iter->second.e_ptr()->toDense();
+		val = posterior_quad_forms(y)[0];
 	}
 	catch (exception &e)
 	{
@@ -934,16 +947,49 @@ double LinearAnalysis::posterior_prediction_variance(string &pred_name)
 
 map<string, double> LinearAnalysis::posterior_prediction_variance()
 {
-	pfm.log_event("LinearAnalysis::prior_prediction_variance");
+	pfm.log_event("LinearAnalysis::posterior_prediction_variance");
 	map<string, double> result;
+	//all the predictions go through the posterior factor together
+	vector<string> names;
 	for (auto &pred : predictions)
 	{
-		string pname(pred.first);
-		result[pname] = posterior_prediction_variance(pname);
+		if (pred.second.e_ptr()->nonZeros() == 0)
+			result[pred.first] = 0.0;
+		else
+			names.push_back(pred.first);
+	}
+	if (names.size() == 0)
+		return result;
+	if (!post_factor) calc_posterior();
+	try
+	{
+		Eigen::MatrixXd y(parcov.nrow(), names.size());
+		for (int i = 0; i < names.size(); i++)
+			y.col(i) = predictions[names[i]].e_ptr()->toDense();
+		Eigen::VectorXd vars = posterior_quad_forms(y);
+		for (int i = 0; i < names.size(); i++)
+			result[names[i]] = vars[i];
+	}
+	catch (exception &e)
+	{
+		throw_error("linear_analysis::posterior_prediction_variance() error calculating variance : " + string(e.what()));
 	}
 	return result;
 }
 
+Eigen::VectorXd LinearAnalysis::posterior_quad_forms(const Eigen::MatrixXd &y)
+{
+	if (!post_factor) calc_posterior();
+	if (!post_obs_space)
+		return post_factor->inv_quad_forms(y);
+	//y^T (C - C J^T (J C J^T + Q)^-1 J C) y
+	Eigen::MatrixXd cy = *parcov.e_ptr() * y;
+	Eigen::MatrixXd jcy = *jacobian.e_ptr() * cy;
+	Eigen::VectorXd vars = y.cwiseProduct(cy).colwise().sum().transpose() - post_factor->inv_quad_forms(jcy);
+	//the difference can come out a roundoff-sized negative for a well-informed y
+	return vars.cwiseMax(0.0);
+}
+
 void LinearAnalysis::calc_posterior()
 {
 	pfm.log_event("LinearAnalysis::calc_posterior");
@@ -956,37 +1002,75 @@ void LinearAnalysis::calc_posterior()
 		throw_error("linear_analysis::calc_posterior() error in align() : " + string(e.what()));
 	}
 
-	pfm.log_event("LinearAnalysis::prior_prediction_variance()::invert obscov");
+	posterior = Covariance();
+	post_var.resize(0);
 	try
 	{
-		obscov.inv_ip(pfm);
+		Eigen::MatrixXd jco = jacobian.e_ptr()->toDense();
+		int nobs = jco.rows(), npar = jco.cols();
+		shared_ptr<CovarianceFactor> f = make_shared<CovarianceFactor>();
+		//the par-space form needs C^-1, which is only formed for a diagonal prior
+		post_obs_space = (nobs < npar) || (!parcov.isdiagonal());
+		if (post_obs_space)
+		{
+			//the lower triangle of J C J^T a block of columns at a time, then mirrored
+			pfm.log_event("LinearAnalysis::calc_posterior() form JCJt + obscov");
+			const int block = 256;
+			Eigen::MatrixXd s(nobs, nobs);
+			for (int j0 = 0; j0 < nobs; j0 += block)
+			{
+				int b = min(block, nobs - j0);
+				Eigen::MatrixXd cjt = *parcov.e_ptr() * jco.middleRows(j0, b).transpose();
+				s.block(j0, j0, nobs - j0, b).noalias() = jco.bottomRows(nobs - j0) * cjt;
+			}
+			for (int j = 1; j < nobs; j++)
+				s.col(j).head(j) = s.row(j).head(j).transpose();
+			const Eigen::SparseMatrix<double>* q = obscov.e_ptr();
+			for (int k = 0; k < q->outerSize(); ++k)
+				for (Eigen::SparseMatrix<double>::InnerIterator it(*q, k); it; ++it)
+					s(it.row(), it.col()) += it.value();
+			pfm.log_event("LinearAnalysis::calc_posterior() factor JCJt + obscov");
+			f->compute(s);
+		}
+		else
+		{
+			pfm.log_event("LinearAnalysis::calc_posterior() form JtQ^-1J");
+			Eigen::MatrixXd p = obscov.get_factor()->inv_congruence(jco);
+			jco.resize(0, 0);
+			pfm.log_event("LinearAnalysis::calc_posterior() add inverse of prior parcov");
+			p.diagonal() += parcov.get_factor()->inv_diagonal();
+			pfm.log_event("LinearAnalysis::calc_posterior() factor posterior precision");
+			f->compute(p);
+		}
+		post_factor = f;
 	}
 	catch (exception &e)
 	{
-		throw_error("linear_analysis::calc_posterior() error inverting obscov : " + string(e.what()));
+		throw_error("linear_analysis::calc_posterior() error calculating posterior : " + string(e.what()));
 	}
-	
 
+}
+
+void LinearAnalysis::form_posterior()
+{
+	if (!post_factor) calc_posterior();
+	pfm.log_event("LinearAnalysis::form_posterior");
 	try
 	{
-		pfm.log_event("LinearAnalysis::calc_posterior() form JtQJ");
-		Covariance JtQJ(*parcov.rn_ptr(), (*jacobian.transpose().e_ptr() * *obscov.e_ptr() *
-			*jacobian.e_ptr()));
-		
-		pfm.log_event("LinearAnalysis::calc_posterior() invert prior parcov");
-		Covariance parcov_inv = parcov.inv();
-
-		pfm.log_event("LinearAnalysis::calc_posterior() form posterior parcov");
-		posterior = Covariance(*parcov.rn_ptr(), (*JtQJ.e_ptr() + *parcov_inv.e_ptr()));
-		
-		pfm.log_event("LinearAnalysis::calc_posterior() invert posterior parcov");
-		posterior.inv_ip(pfm);
+		Eigen::MatrixXd post;
+		if (post_obs_space)
+		{
+			Eigen::MatrixXd jc = jacobian.e_ptr()->toDense() * *parcov.e_ptr();
+			post = parcov.e_ptr()->toDense() - post_factor->inv_congruence(jc);
+		}
+		else
+			post = post_factor->inverse();
+		posterior = Covariance(*parcov.rn_ptr(), post.sparseView());
 	}
 	catch (exception &e)
 	{
-		throw_error("linear_analysis::calc_posterior() error calculating posterior : " + string(e.what()));
+		throw_error("linear_analysis::form_posterior() error forming posterior : " + string(e.what()));
 	}
-
 }
 
 
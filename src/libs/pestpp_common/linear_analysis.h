@@ -116,12 +116,22 @@ private:
 	Mat omitted_jacobian;
 	Covariance parcov;
 	Covariance obscov;
+	//explicit posterior - only formed for callers that want the matrix
 	Covariance posterior;
+	//factor behind the posterior: of J C J^T + Q when there are fewer obs than pars or the prior
+	//is not diagonal (applied through the woodbury identity), otherwise of the posterior
+	//precision J^T Q^-1 J + C^-1
+	shared_ptr<CovarianceFactor> post_factor;
+	bool post_obs_space;
+	Eigen::VectorXd post_var;
 	map<string, Mat> predictions;
 	map<string,Mat> omitted_predictions;
 	Covariance omitted_parcov;
 
 	void calc_posterior();
+	void form_posterior();
+	//posterior variance of y_k^T p for each column y_k of y
+	Eigen::VectorXd posterior_quad_forms(const Eigen::MatrixXd &y);
 	void svd();
 	void build_normal();
 	void build_R(int sv);
@@ -370,6 +370,8 @@ PestppOptions::ARG_STATUS PestppOptions::assign_value_by_key(string key, const s
 		}
 		else if (value == "REDSVD")
 			svd_pack = REDSVD;
+		else if ((value == "RANDOMIZED") || (value == "RSVD"))
+			svd_pack = RANDOMIZED;
 		else if ((value == "EIGEN") || (value == "JACOBI"))
 			svd_pack = EIGEN;
 		else
@@ -545,6 +547,18 @@ PestppOptions::ARG_STATUS PestppOptions::assign_value_by_key(string key, const s
 		else if (value == "PRIOR")
 			glm_normal_form = GLMNormalForm::PRIOR;
 	}
+	else if (key == "GLM_LAMBDA_SHARED_SVD")
+	{
+		glm_lambda_shared_svd = pest_utils::parse_string_arg_to_bool(value);
+	}
+	else if (key == "GLM_RSVD_BLOCK_SIZE")
+	{
+		convert_ip(value, glm_rsvd_block_size);
+	}
+	else if (key == "GLM_RSVD_POWER_ITERS")
+	{
+		convert_ip(value, glm_rsvd_power_iters);
+	}
 
 	else if (key == "GLM_DEBUG_DER_FAIL")
 	{
@@ -804,6 +818,14 @@ PestppOptions::ARG_STATUS PestppOptions::assign_value_by_key(string key, const s
 	{
 		ies_group_draws = pest_utils::parse_string_arg_to_bool(value);
 	}
+	else if (key == "IES_LEGACY_DRAWS")
+	{
+		ies_legacy_draws = pest_utils::parse_string_arg_to_bool(value);
+	}
+	else if (key == "IES_DRAW_RANK")
+	{
+		convert_ip(value, ies_draw_rank);
+	}
 	else if (key == "IES_ENFORCE_BOUNDS")
 	{
 		ies_enforce_bounds = pest_utils::parse_string_arg_to_bool(value);
@@ -814,6 +836,17 @@ PestppOptions::ARG_STATUS PestppOptions::assign_value_by_key(string key, const s
 		passed_args.insert("SAVE_BINARY");
 		ies_save_binary = pest_utils::parse_string_arg_to_bool(value);
 	}
+	else if ((key == "IES_SAVE_DENSE") || (key == "SAVE_DENSE"))
+	{
+		passed_args.insert("IES_SAVE_DENSE");
+		passed_args.insert("SAVE_DENSE");
+		ies_save_dense = pest_utils::parse_string_arg_to_bool(value);
+	}
+	else if (key == "IES_DENSE_OBS_FLOAT32")
+	{
+		passed_args.insert("IES_DENSE_OBS_FLOAT32");
+		ies_dense_obs_float32 = pest_utils::parse_string_arg_to_bool(value);
+	}
 	else if (key == "PAR_SIGMA_RANGE")
 	{
 		convert_ip(value, par_sigma_range);
@@ -845,6 +878,18 @@ PestppOptions::ARG_STATUS PestppOptions::assign_value_by_key(string key, const s
 		passed_args.insert("IES_SAVE_LAMBDA_ENSEMBLES");
 		ies_save_lambda_en = pest_utils::parse_string_arg_to_bool(value);
 	}
+	else if (key == "IES_LAMBDA_EN_MMAP")
+	{
+		ies_lambda_en_mmap = pest_utils::parse_string_arg_to_bool(value);
+	}
+	else if (key == "IES_PIPELINE_LAMBDAS")
+	{
+		ies_pipeline_lambdas = pest_utils::parse_string_arg_to_bool(value);
+	}
+	else if (key == "IES_PIPELINE_CANCEL_FAC")
+	{
+		convert_ip(value, ies_pipeline_cancel_fac);
+	}
 	
 	else if (key == "IES_SUBSET_HOW")
 	{
@@ -964,7 +1009,7 @@ PestppOptions::ARG_STATUS PestppOptions::assign_value_by_key(string key, const s
 	}
 	
 	
-	else if (!assign_value_by_key_continued(key, value))
+	else if (!assign_value_by_key_continued(key, value, org_value))
 	{
 
 		//throw PestParsingError(line, "Invalid key word \"" + key +"\"");
@@ -974,7 +1019,7 @@ PestppOptions::ARG_STATUS PestppOptions::assign_value_by_key(string key, const s
 }
 
 
-bool PestppOptions::assign_value_by_key_continued(const string& key, const string& value)
+bool PestppOptions::assign_value_by_key_continued(const string& key, const string& value, const string& org_value)
 {
 	// This method was added as a workaround for a compiler limit of at most 128 nesting levels (MSVC); no more else if blocks could be added to assign_value_by_key()
 	if (key == "PANTHER_AGENT_RESTART_ON_ERROR")
@@ -1018,6 +1063,41 @@ bool PestppOptions::assign_value_by_key_continued(const string& key, const strin
 		check_tplins = pest_utils::parse_string_arg_to_bool(value);
 		return true;
 	}
+	else if (key == "NUM_TPL_INS_THREADS")
+	{
+		convert_ip(value, num_tpl_ins_threads);
+		return true;
+	}
+	else if (key == "NUM_JCO_THREADS")
+	{
+		convert_ip(value, num_jco_threads);
+		return true;
+	}
+	else if (key == "NUM_SVD_THREADS")
+	{
+		convert_ip(value, num_svd_threads);
+		return true;
+	}
+	else if (key == "MODEL_PLUGIN")
+	{
+		model_plugin = org_value;
+		return true;
+	}
+	else if (key == "MODEL_PLUGIN_CONFIG")
+	{
+		model_plugin_config = org_value;
+		return true;
+	}
+	else if (key == "MODEL_PLUGIN_BATCH_SIZE")
+	{
+		convert_ip(value, model_plugin_batch_size);
+		return true;
+	}
+	else if (key == "NUM_LOCAL_WORKERS")
+	{
+		convert_ip(value, num_local_workers);
+		return true;
+	}
 	else if (key == "FILL_TPL_ZEROS")
 	{
 		fill_tpl_zeros = pest_utils::parse_string_arg_to_bool(value);
@@ -1033,6 +1113,31 @@ bool PestppOptions::assign_value_by_key_continued(const string& key, const strin
 		panther_echo = pest_utils::parse_string_arg_to_bool(value);
 		return true;
 	}
+	else if (key == "PANTHER_PAYLOAD_CODEC")
+	{
+		panther_payload_codec = pest_utils::parse_string_arg_to_bool(value);
+		return true;
+	}
+	else if (key == "PANTHER_SCHEDULE_POLICY")
+	{
+		panther_schedule_policy = value;
+		return true;
+	}
+	else if (key == "RUN_STORAGE_MMAP")
+	{
+		run_storage_mmap = pest_utils::parse_string_arg_to_bool(value);
+		return true;
+	}
+	else if (key == "RUN_STORAGE_COMMIT_NRUNS")
+	{
+		convert_ip(value, run_storage_commit_nruns);
+		return true;
+	}
+	else if (key == "RUN_STORAGE_COMMIT_SECS")
+	{
+		convert_ip(value, run_storage_commit_secs);
+		return true;
+	}
 
 	return false;
 }
@@ -1050,6 +1155,8 @@ void PestppOptions::summary(ostream& os) const
 		os << "redsvd" << endl;
 	if (svd_pack == EIGEN)
 		os << "eigen" << endl;
+	if (svd_pack == RANDOMIZED)
+		os << "randomized" << endl;
 	os << "lambda_scale_fac: ";
 	for (auto s : lambda_scale_vec)
 		os << s << ",";
@@ -1071,12 +1178,24 @@ void PestppOptions::summary(ostream& os) const
 	os << "check_tplins: " << check_tplins << endl;
 	os << "fill_tpl_zeros: " << fill_tpl_zeros << endl;
 	os << "additional_ins_delimiters: " << additional_ins_delimiters << endl;
+	os << "num_tpl_ins_threads: " << num_tpl_ins_threads << endl;
+	os << "num_jco_threads: " << num_jco_threads << endl;
+	os << "num_svd_threads: " << num_svd_threads << endl;
+	os << "model_plugin: " << model_plugin << endl;
+	os << "model_plugin_config: " << model_plugin_config << endl;
+	os << "model_plugin_batch_size: " << model_plugin_batch_size << endl;
+	os << "num_local_workers: " << num_local_workers << endl;
 	os << "random_seed: " << random_seed << endl;
 	
 	os << "panther_agent_restart_on_error: " << panther_agent_restart_on_error << endl;
 	os << "panther_agent_no_ping_timeout_secs: " << panther_agent_no_ping_timeout_secs << endl;
 	os << "panther_debug_loop: " << panther_debug_loop << endl;
 	os << "panther_echo: " << panther_echo << endl;
+	os << "panther_payload_codec: " << panther_payload_codec << endl;
+	os << "panther_schedule_policy: " << panther_schedule_policy << endl;
+	os << "run_storage_mmap: " << run_storage_mmap << endl;
+	os << "run_storage_commit_nruns: " << run_storage_commit_nruns << endl;
+	os << "run_storage_commit_secs: " << run_storage_commit_secs << endl;
 
 	os << endl;
 
@@ -1110,6 +1229,9 @@ void PestppOptions::summary(ostream& os) const
 	else if (glm_normal_form == GLMNormalForm::PRIOR)
 		norm_str = "PRIOR";
 	os << "glm_normal_form: " << norm_str << endl;
+	os << "glm_lambda_shared_svd: " << glm_lambda_shared_svd << endl;
+	os << "glm_rsvd_block_size: " << glm_rsvd_block_size << endl;
+	os << "glm_rsvd_power_iters: " << glm_rsvd_power_iters << endl;
 	os << "glm_debug_der_fail: " << glm_debug_der_fail << endl;
 	os << "glm_debug_lamb_fail: " << glm_debug_lamb_fail << endl;
 	os << "glm_debug_real_fail: " << glm_debug_real_fail << endl;
@@ -1184,13 +1306,20 @@ void PestppOptions::summary(ostream& os) const
 	os << "ies_include_base: " << ies_include_base << endl;
 	os << "ies_use_empirical_prior: " << ies_use_empirical_prior << endl;
 	os << "ies_group_draws: " << ies_group_draws << endl;
+	os << "ies_legacy_draws: " << ies_legacy_draws << endl;
+	os << "ies_draw_rank: " << ies_draw_rank << endl;
 	os << "ies_enforce_bounds: " << ies_enforce_bounds << endl;
 	os << "ies_save_binary: " << ies_save_binary << endl;
+	os << "ies_save_dense: " << ies_save_dense << endl;
+	os << "ies_dense_obs_float32: " << ies_dense_obs_float32 << endl;
 	os << "ies_localizer: " << ies_localizer << endl;
 	os << "ies_accept_phi_fac: " << ies_accept_phi_fac << endl;
 	os << "ies_lambda_inc_fac: " << ies_lambda_inc_fac << endl;
 	os << "ies_lambda_dec_fac: " << ies_lambda_dec_fac << endl;
 	os << "ies_save_lambda_ensembles: " << ies_save_lambda_en << endl;
+	os << "ies_lambda_en_mmap: " << ies_lambda_en_mmap << endl;
+	os << "ies_pipeline_lambdas: " << ies_pipeline_lambdas << endl;
+	os << "ies_pipeline_cancel_fac: " << ies_pipeline_cancel_fac << endl;
 	os << "ies_subset_how: " << ies_subset_how << endl;
 	os << "ies_localize_how: " << ies_localize_how << endl;
 	os << "ies_num_threads: " << ies_num_threads << endl;
@@ -1254,6 +1383,9 @@ void PestppOptions::set_defaults()
 	set_uncert_flag(true);
 	set_glm_num_reals(0);
 	set_glm_normal_form(GLMNormalForm::DIAG);
+	set_glm_lambda_shared_svd(false);
+	set_glm_rsvd_block_size(16);
+	set_glm_rsvd_power_iters(2);
 	set_glm_debug_der_fail(false);
 	set_glm_debug_lamb_fail(false);
 	set_glm_debug_real_fail(false);
@@ -1308,14 +1440,21 @@ void PestppOptions::set_defaults()
 	set_ies_include_base(true);
 	set_ies_use_empirical_prior(false);
 	set_ies_group_draws(true);
+	set_ies_legacy_draws(true);
+	set_ies_draw_rank(0);
 	set_ies_enforce_bounds(true);
 	set_par_sigma_range(4.0);
 	set_ies_save_binary(false);
+	set_ies_save_dense(false);
+	set_ies_dense_obs_float32(false);
 	set_ies_localizer("");
 	set_ies_accept_phi_fac(1.05);
 	set_ies_lambda_inc_fac(10.0);
 	set_ies_lambda_dec_fac(0.75);
 	set_ies_save_lambda_en(false);
+	set_ies_lambda_en_mmap(false);
+	set_ies_pipeline_lambdas(false);
+	set_ies_pipeline_cancel_fac(2.0);
 	set_ies_subset_how("RANDOM");
 	set_ies_localize_how("PARAMETERS");
 	set_ies_num_threads(-1);
@@ -1357,12 +1496,25 @@ void PestppOptions::set_defaults()
 	set_check_tplins(true);
 	set_fill_tpl_zeros(false);
 	set_additional_ins_delimiters("");
+	set_num_tpl_ins_threads(10);
+	set_num_jco_threads(-1);
+	set_num_svd_threads(-1);
+	set_model_plugin("");
+	set_model_plugin_config("");
+	set_model_plugin_batch_size(1000);
+	set_num_local_workers(1);
 
 	set_panther_agent_restart_on_error(false);
 	set_panther_agent_no_ping_timeout_secs(-1);
 	set_panther_debug_loop(false);
 	set_panther_debug_fail_freeze(false);
 	set_panther_echo(true);
+	set_panther_payload_codec(false);
+	set_panther_schedule_policy("FIFO");
+
+	set_run_storage_mmap(false);
+	set_run_storage_commit_nruns(100);
+	set_run_storage_commit_secs(5.0);
 }
 
 ostream& operator<< (ostream &os, const ParameterInfo& val)
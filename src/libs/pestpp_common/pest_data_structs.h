@@ -185,7 +185,7 @@ public:
 
 class PestppOptions {
 public:
-	enum SVD_PACK { EIGEN, PROPACK, REDSVD };
+	enum SVD_PACK { EIGEN, PROPACK, REDSVD, RANDOMIZED };
 	enum MAT_INV { Q12J, JTQJ };
 	enum GLOBAL_OPT { NONE, OPT_DE };
 	enum GLMNormalForm { IDENT,DIAG, PRIOR };
@@ -196,7 +196,7 @@ public:
 	map<string,ARG_STATUS> parse_plusplus_line(const string &line);
 	vector<string> notfound_args;
 	ARG_STATUS assign_value_by_key(string key, const string org_value);
-	bool assign_value_by_key_continued(const string& key, const string& value);
+	bool assign_value_by_key_continued(const string& key, const string& value, const string& org_value);
 	int get_max_n_super() const { return max_n_super; }
 	double get_super_eigthres() const { return super_eigthres; }
 	int get_n_iter_base() const { return n_iter_base; }
@@ -251,6 +251,12 @@ public:
 	void set_glm_num_reals(int _glm_num_reals) { glm_num_reals = _glm_num_reals; }
 	GLMNormalForm get_glm_normal_form() const { return glm_normal_form;}
 	void set_glm_normal_form(GLMNormalForm form) { glm_normal_form = form; }
+	bool get_glm_lambda_shared_svd() const { return glm_lambda_shared_svd; }
+	void set_glm_lambda_shared_svd(bool _flag) { glm_lambda_shared_svd = _flag; }
+	int get_glm_rsvd_block_size() const { return glm_rsvd_block_size; }
+	void set_glm_rsvd_block_size(int _size) { glm_rsvd_block_size = _size; }
+	int get_glm_rsvd_power_iters() const { return glm_rsvd_power_iters; }
+	void set_glm_rsvd_power_iters(int _iters) { glm_rsvd_power_iters = _iters; }
 	bool get_glm_debug_der_fail() const { return glm_debug_der_fail; }
 	void set_glm_debug_der_fail(bool _flag) { glm_debug_der_fail = _flag;}
 	bool get_glm_debug_lamb_fail() const { return glm_debug_lamb_fail; }
@@ -358,6 +364,10 @@ public:
 	void set_ies_use_empirical_prior(bool _ies_use_empirical_prior) { ies_use_empirical_prior = _ies_use_empirical_prior; }
 	bool get_ies_group_draws() const { return ies_group_draws; }
 	void set_ies_group_draws(bool _ies_group_draws) { ies_group_draws = _ies_group_draws; }
+	bool get_ies_legacy_draws() const { return ies_legacy_draws; }
+	void set_ies_legacy_draws(bool _ies_legacy_draws) { ies_legacy_draws = _ies_legacy_draws; }
+	int get_ies_draw_rank() const { return ies_draw_rank; }
+	void set_ies_draw_rank(int _ies_draw_rank) { ies_draw_rank = _ies_draw_rank; }
 	bool get_ies_enforce_bounds() const { return ies_enforce_bounds; }
 	void set_ies_enforce_bounds(bool _ies_enforce_bounds) { ies_enforce_bounds = _ies_enforce_bounds; }
 
@@ -365,6 +375,10 @@ public:
 	void set_par_sigma_range(double _par_sigma_range) { par_sigma_range = _par_sigma_range; }
 	bool get_ies_save_binary() const { return ies_save_binary; }
 	void set_ies_save_binary(bool _ies_save_binary) { ies_save_binary = _ies_save_binary; }
+	bool get_ies_save_dense() const { return ies_save_dense; }
+	void set_ies_save_dense(bool _flag) { ies_save_dense = _flag; }
+	bool get_ies_dense_obs_float32() const { return ies_dense_obs_float32; }
+	void set_ies_dense_obs_float32(bool _flag) { ies_dense_obs_float32 = _flag; }
 	string get_ies_localizer() const { return ies_localizer; }
 	void set_ies_localizer(string _ies_localizer) { ies_localizer = _ies_localizer; }
 	double get_ies_accept_phi_fac() const { return ies_accept_phi_fac; }
@@ -375,6 +389,12 @@ public:
 	void set_ies_lambda_dec_fac(double _dec_fac) { ies_lambda_dec_fac = _dec_fac; }
 	bool get_ies_save_lambda_en() const { return ies_save_lambda_en; }
 	void set_ies_save_lambda_en(bool _ies_save_lambda_en) { ies_save_lambda_en = _ies_save_lambda_en; }
+	bool get_ies_lambda_en_mmap() const { return ies_lambda_en_mmap; }
+	void set_ies_lambda_en_mmap(bool _flag) { ies_lambda_en_mmap = _flag; }
+	bool get_ies_pipeline_lambdas() const { return ies_pipeline_lambdas; }
+	void set_ies_pipeline_lambdas(bool _flag) { ies_pipeline_lambdas = _flag; }
+	double get_ies_pipeline_cancel_fac() const { return ies_pipeline_cancel_fac; }
+	void set_ies_pipeline_cancel_fac(double _fac) { ies_pipeline_cancel_fac = _fac; }
 	string get_ies_subset_how() const { return ies_subset_how; }
 	void set_ies_subset_how(string _ies_subset_how) { ies_subset_how = _ies_subset_how; }
 	void set_ies_localize_how(string _how) { ies_localize_how = _how; }
@@ -450,6 +470,20 @@ public:
 	bool get_fill_tpl_zeros() const { return fill_tpl_zeros; }
 	void set_additional_ins_delimiters(string _delims) { additional_ins_delimiters = _delims; }
 	string get_additional_ins_delimiters() const { return additional_ins_delimiters; }
+	void set_num_tpl_ins_threads(int _num) { num_tpl_ins_threads = _num; }
+	int get_num_tpl_ins_threads() const { return num_tpl_ins_threads; }
+	void set_num_jco_threads(int _num) { num_jco_threads = _num; }
+	int get_num_jco_threads() const { return num_jco_threads; }
+	void set_num_svd_threads(int _num) { num_svd_threads = _num; }
+	int get_num_svd_threads() const { return num_svd_threads; }
+	void set_model_plugin(string _filename) { model_plugin = _filename; }
+	string get_model_plugin() const { return model_plugin; }
+	void set_model_plugin_config(string _config) { model_plugin_config = _config; }
+	string get_model_plugin_config() const { return model_plugin_config; }
+	void set_model_plugin_batch_size(int _size) { model_plugin_batch_size = _size; }
+	int get_model_plugin_batch_size() const { return model_plugin_batch_size; }
+	void set_num_local_workers(int _num) { num_local_workers = _num; }
+	int get_num_local_workers() const { return num_local_workers; }
 	void set_random_seed(int seed) { random_seed = seed; }
 	int get_random_seed()const { return random_seed; }
 	bool get_glm_iter_mc() const { return glm_iter_mc; }
@@ -466,6 +500,17 @@ public:
 	
 	bool get_panther_echo() const { return panther_echo; }
 	void set_panther_echo(bool _flag) { panther_echo = _flag; }
+	bool get_panther_payload_codec() const { return panther_payload_codec; }
+	void set_panther_payload_codec(bool _flag) { panther_payload_codec = _flag; }
+	string get_panther_schedule_policy() const { return panther_schedule_policy; }
+	void set_panther_schedule_policy(const string &_policy) { panther_schedule_policy = _policy; }
+
+	bool get_run_storage_mmap() const { return run_storage_mmap; }
+	void set_run_storage_mmap(bool _flag) { run_storage_mmap = _flag; }
+	int get_run_storage_commit_nruns() const { return run_storage_commit_nruns; }
+	void set_run_storage_commit_nruns(int _nruns) { run_storage_commit_nruns = _nruns; }
+	double get_run_storage_commit_secs() const { return run_storage_commit_secs; }
+	void set_run_storage_commit_secs(double _secs) { run_storage_commit_secs = _secs; }
 
 	void set_forgive_unknown_args(bool _flag) { forgive_unknown_args = _flag; }
 	bool get_forgive_unknown_args() const { return forgive_unknown_args; }
@@ -487,6 +532,9 @@ private:
 	int max_reg_iter;
 	int glm_num_reals;
 	GLMNormalForm glm_normal_form;
+	bool glm_lambda_shared_svd;
+	int glm_rsvd_block_size;
+	int glm_rsvd_power_iters;
 	bool glm_debug_der_fail;
 	bool glm_debug_lamb_fail;
 	bool glm_debug_real_fail;
@@ -512,6 +560,13 @@ private:
 	bool check_tplins;
 	bool fill_tpl_zeros;
 	string additional_ins_delimiters;
+	int num_tpl_ins_threads;
+	int num_jco_threads;
+	int num_svd_threads;
+	string model_plugin;
+	string model_plugin_config;
+	int model_plugin_batch_size;
+	int num_local_workers;
 
 	int random_seed;
 
@@ -569,15 +624,22 @@ private:
 	bool ies_include_base;
 	bool ies_use_empirical_prior;
 	bool ies_group_draws;
+	bool ies_legacy_draws;
+	int ies_draw_rank;
 	//bool ies_num_reals_passed;
 	bool ies_enforce_bounds;
 	double par_sigma_range;
 	bool ies_save_binary;
+	bool ies_save_dense;
+	bool ies_dense_obs_float32;
 	string ies_localizer;
 	double ies_accept_phi_fac;
 	double ies_lambda_inc_fac;
 	double ies_lambda_dec_fac;
 	bool ies_save_lambda_en;
+	bool ies_lambda_en_mmap;
+	bool ies_pipeline_lambdas;
+	double ies_pipeline_cancel_fac;
 	set<string> passed_args;
 	map<string, string> arg_map;
 	string ies_subset_how;
@@ -613,6 +675,12 @@ private:
 	bool panther_debug_loop;
 	bool panther_debug_fail_freeze;
 	bool panther_echo;
+	bool panther_payload_codec;
+	string panther_schedule_policy;
+
+	bool run_storage_mmap;
+	int run_storage_commit_nruns;
+	double run_storage_commit_secs;
 };
 //ostream& operator<< (ostream &os, const PestppOptions& val);
 ostream& operator<< (ostream &os, const ObservationInfo& val);
@@ -235,6 +235,16 @@ bool RunManagerAbstract::get_observations_vec(int run_id, vector<double> &data_v
 	return success;
 }
 
+vector<int> RunManagerAbstract::get_observations_matrix(const vector<int> &run_ids, Eigen::MatrixXd &obs_mat)
+{
+	return file_stor.get_observations_matrix(run_ids, obs_mat);
+}
+
+vector<double> RunManagerAbstract::get_parameter_values(const vector<int> &run_ids, const vector<int> &par_idxs)
+{
+	return file_stor.get_parameter_values(run_ids, par_idxs);
+}
+
  Observations RunManagerAbstract::get_obs_template(double value) const
  {
 	Observations ret_obs;
@@ -285,6 +295,17 @@ bool RunManagerAbstract::get_observations_vec(int run_id, vector<double> &data_v
 	 file_stor.update_run_failed(run_id);
  }
 
+ void RunManagerAbstract::cancel_run(int run_id)
+ {
+	 if (file_stor.get_run_status(run_id) < 1)
+		 file_stor.set_run_canceled(run_id);
+ }
+
+ bool RunManagerAbstract::run_canceled(int run_id)
+ {
+	 return file_stor.get_run_status(run_id) == -100;
+ }
+
  const RunStorage& RunManagerAbstract::get_runstorage_ref() const
  {
 	 return file_stor;
@@ -37,6 +37,7 @@ class RunManagerAbstract
 {
 public:
 	enum class RUN_UNTIL_COND { NORMAL, NO_OPS, TIME, NO_OPS_OR_TIME };
+	enum class RUN_PRIORITY { NORMAL, HIGH, HIGHEST };
 	RunManagerAbstract(const std::vector<std::string> _comline_vec,
 		const std::vector<std::string> _tplfile_vec, const std::vector<std::string> _inpfile_vec,
 		const std::vector<std::string> _insfile_vec, const std::vector<std::string> _outfile_vec,
@@ -65,6 +66,11 @@ public:
 	virtual const std::set<int> get_failed_run_ids();
 	virtual bool get_model_parameters(int run_num, Parameters &pars);
 	virtual bool get_observations_vec(int run_id, std::vector<double> &data_vec);
+	//bulk-read the simulated values of several runs (one row per run, columns in get_obs_name_vec() order).
+	//Returns the run status of each row.
+	virtual std::vector<int> get_observations_matrix(const std::vector<int> &run_ids, Eigen::MatrixXd &obs_mat);
+	//read single parameter values: entry i is parameter par_idxs[i] (in get_par_name_vec() order) of run run_ids[i]
+	virtual std::vector<double> get_parameter_values(const std::vector<int> &run_ids, const std::vector<int> &par_idxs);
 	virtual Observations get_obs_template(double value = -9999.0) const;
 	virtual int get_total_runs(void) const {return total_runs;}
 	virtual int get_num_good_runs(void);
@@ -80,6 +86,14 @@ public:
 	//virtual Observations get_init_run_obs() { return init_run_obs; }
 	virtual std::vector<double> get_init_sim() { return init_sim;  }
 	virtual void set_init_sim(std::vector<double> _init_sim) { init_sim = _init_sim; }
+	virtual void set_run_storage_mmap(bool _use_mmap, int _commit_nruns, double _commit_secs) { file_stor.set_mmap(_use_mmap, _commit_nruns, _commit_secs); }
+	//hint to run managers that queue runs: higher priority runs are handed out first.  ignored by default
+	virtual void set_run_priority(int run_id, RUN_PRIORITY priority) {}
+	//drop a queued run that is no longer needed.  it is flagged as canceled in the run storage
+	//(run_status=-100) so it is neither run nor counted as failed.  a run that already finished
+	//is left alone.  run managers that hand runs out also pull it from their queue and kill it
+	virtual void cancel_run(int run_id);
+	bool run_canceled(int run_id);
 
 protected:
 	int total_runs;
@@ -24,6 +24,8 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cstring>
+#include <thread>
 #include "RunStorage.h"
 #include "Serialization.h"
 #include "Transformable.h"
@@ -35,10 +37,44 @@ using namespace std;
 
 const double RunStorage::no_data = -9999.0;
 
-RunStorage::RunStorage(const string &_filename) :filename(_filename), run_byte_size(0)
+RunStorage::RunStorage(const string &_filename) :filename(_filename), run_byte_size(0),
+	use_mmap(false), commit_nruns(100), commit_secs(5.0), mmap_nruns(0), mmap_committed_nruns(0)
 {
 }
 
+void RunStorage::set_mmap(bool _use_mmap, int _commit_nruns, double _commit_secs)
+{
+	commit_nruns = max(1, _commit_nruns);
+	commit_secs = _commit_secs;
+	if (_use_mmap == use_mmap)
+		return;
+	if (use_mmap)
+	{
+		//switching back to the stream-based engine
+		bool was_open = mmap_file.is_open();
+		mmap_close(true);
+		use_mmap = false;
+		if (was_open)
+		{
+			buf_stream.open(filename.c_str(), ios_base::out | ios_base::in | ios_base::binary);
+			if (!buf_stream.good())
+			{
+				throw PestFileError(filename);
+			}
+		}
+	}
+	else
+	{
+		use_mmap = true;
+		if (buf_stream.is_open())
+		{
+			buf_stream.flush();
+			buf_stream.close();
+			mmap_open();
+		}
+	}
+}
+
 void RunStorage::reset(const vector<string> &_par_names, const vector<string> &_obs_names, const string &_filename)
 {
 	par_names = _par_names;
@@ -46,6 +82,8 @@ void RunStorage::reset(const vector<string> &_par_names, const vector<string> &_
 	// a file needs to exist before it can be opened it with read and write
 	// permission.   So open it with write permission to crteate it, close
 	// and then reopen it with read and write permisssion.
+	//any staged runs belong to the file that is about to be overwritten
+	mmap_close(false);
 	if (_filename.size() > 0)
 	{
 		filename = _filename;
@@ -54,6 +92,7 @@ void RunStorage::reset(const vector<string> &_par_names, const vector<string> &_
 	{
 		buf_stream.close();
 	}
+	remove(get_journal_filename().c_str());
 	buf_stream.open(filename.c_str(), ios_base::out |  ios_base::binary);
         buf_stream.close();
 	buf_stream.open(filename.c_str(), ios_base::out | ios_base::in | ios_base::binary);
@@ -91,11 +130,17 @@ void RunStorage::reset(const vector<string> &_par_names, const vector<string> &_
 	buf_stream.seekp(get_stream_pos(end_of_runs), ios_base::beg);
 	buf_stream.write(reinterpret_cast<char*>(&buf_status), sizeof(buf_status));
 	buf_stream.flush();
+	if (use_mmap)
+	{
+		buf_stream.close();
+		mmap_open();
+	}
 }
 
 
 void RunStorage::init_restart(const std::string &_filename)
 {
+	mmap_close(true);
 	filename = _filename;
 	par_names.clear();
 	obs_names.clear();
@@ -176,10 +221,273 @@ void RunStorage::init_restart(const std::string &_filename)
 		buf_stream.write(reinterpret_cast<char*>(&buf_status), sizeof(buf_status));
 		buf_stream.flush();
 	}
+	//apply any batch of completed runs that was journaled but not yet written to the main file
+	replay_journal();
+	if (use_mmap)
+	{
+		buf_stream.close();
+		mmap_open();
+	}
+}
+
+void RunStorage::replay_journal()
+{
+	string jnl_filename = get_journal_filename();
+	FILE *fp = fopen(jnl_filename.c_str(), "rb");
+	if (fp == nullptr)
+		return;
+	//a journal is only applied if it ends with a commit marker, otherwise the crash happened
+	//before the batch was fully journaled and the main file was never touched
+	vector<PendingRun> recs;
+	std::int64_t jnl_nruns = -1;
+	while (true)
+	{
+		std::int32_t id;
+		if (fread(&id, sizeof(id), 1, fp) != 1)
+			break;
+		if (id == -1)
+		{
+			if (fread(&jnl_nruns, sizeof(jnl_nruns), 1, fp) != 1)
+				jnl_nruns = -1;
+			break;
+		}
+		PendingRun rec;
+		rec.run_id = id;
+		rec.data.resize(run_data_byte_size);
+		if (fread(&rec.r_status, sizeof(rec.r_status), 1, fp) != 1)
+			break;
+		if (fread(rec.data.data(), 1, rec.data.size(), fp) != rec.data.size())
+			break;
+		recs.push_back(rec);
+	}
+	fclose(fp);
+	if (jnl_nruns >= 0)
+	{
+		std::int64_t n_runs_64 = max(std::int64_t(get_nruns()), jnl_nruns);
+		buf_stream.seekp(0, ios_base::beg);
+		buf_stream.write((char*)&n_runs_64, sizeof(n_runs_64));
+		for (auto &rec : recs)
+		{
+			if ((rec.run_id < 0) || (rec.run_id >= n_runs_64))
+				continue;
+			buf_stream.seekp(get_stream_pos(rec.run_id), ios_base::beg);
+			buf_stream.write(reinterpret_cast<char*>(&rec.r_status), sizeof(rec.r_status));
+			buf_stream.seekp(sizeof(char)*info_txt_length + sizeof(double), ios_base::cur);
+			buf_stream.write(rec.data.data(), rec.data.size());
+		}
+		std::int8_t buf_status = 0;
+		buf_stream.seekp(get_stream_pos(n_runs_64), ios_base::beg);
+		buf_stream.write(reinterpret_cast<char*>(&buf_status), sizeof(buf_status));
+		buf_stream.flush();
+		cout << "RunStorage: replayed " << recs.size() << " journaled run(s) from " << jnl_filename << endl;
+	}
+	remove(jnl_filename.c_str());
+}
+
+void RunStorage::mmap_open()
+{
+	mmap_file.open(filename, MappedFile::Mode::READ_WRITE);
+	if (mmap_file.size() < sizeof(std::int64_t))
+	{
+		throw PestFileErrorAccess(filename, " RunStorage: file is too short to contain a header");
+	}
+	memcpy(&mmap_nruns, mmap_file.data(), sizeof(mmap_nruns));
+	mmap_committed_nruns = mmap_nruns;
+	pending.clear();
+	pending_idx.clear();
+	mmap_reserve(mmap_nruns);
+	last_commit = chrono::steady_clock::now();
+}
+
+void RunStorage::mmap_close(bool do_commit)
+{
+	if (!mmap_file.is_open())
+		return;
+	if (do_commit)
+	{
+		commit();
+	}
+	pending.clear();
+	pending_idx.clear();
+	//drop the unused preallocated capacity so the file looks like one written by buf_stream
+	mmap_file.resize(get_stream_pos(mmap_committed_nruns) + sizeof(std::int8_t));
+	mmap_file.close();
+}
+
+void RunStorage::mmap_reserve(std::int64_t nruns)
+{
+	//room for nruns records plus the trailing double-buffer flag
+	size_t need = get_stream_pos(nruns) + sizeof(std::int8_t);
+	size_t cur = mmap_file.size();
+	if (need <= cur)
+		return;
+	//grow geometrically so add_run() doesn't remap on every call
+	size_t grow = max(need, cur + cur / 2);
+	mmap_file.resize(grow);
+}
+
+void RunStorage::commit()
+{
+	if (!mmap_file.is_open())
+		return;
+	if ((pending.empty()) && (mmap_nruns == mmap_committed_nruns))
+		return;
+	string jnl_filename = get_journal_filename();
+	//records added since the last commit only live in the unused tail of the file, so they just need
+	//to be on disk before the journal (or the header) can point at them
+	if (mmap_nruns > mmap_committed_nruns)
+	{
+		streamoff beg = get_stream_pos(mmap_committed_nruns);
+		mmap_file.sync(beg, get_stream_pos(mmap_nruns) - beg);
+	}
+	//every change to an existing record goes through the journal, which is forced to disk before
+	//the main file is touched so a crash while the batch is applied can be replayed
+	if (!pending.empty())
+	{
+		FILE *fp = fopen(jnl_filename.c_str(), "wb");
+		if (fp == nullptr)
+		{
+			throw PestFileError(jnl_filename);
+		}
+		for (auto &rec : pending)
+		{
+			fwrite(&rec.run_id, sizeof(rec.run_id), 1, fp);
+			fwrite(&rec.r_status, sizeof(rec.r_status), 1, fp);
+			fwrite(rec.data.data(), 1, rec.data.size(), fp);
+		}
+		std::int32_t marker = -1;
+		fwrite(&marker, sizeof(marker), 1, fp);
+		fwrite(&mmap_nruns, sizeof(mmap_nruns), 1, fp);
+		MappedFile::sync_stream(fp);
+		fclose(fp);
+	}
+	char *base = mmap_file.data();
+	for (auto &rec : pending)
+	{
+		char *rec_ptr = base + get_stream_pos(rec.run_id);
+		rec_ptr[0] = rec.r_status;
+		memcpy(rec_ptr + rec_head_size, rec.data.data(), rec.data.size());
+	}
+	memcpy(base, &mmap_nruns, sizeof(mmap_nruns));
+	base[get_stream_pos(mmap_nruns)] = 0;
+	mmap_file.sync();
+	if (!pending.empty())
+	{
+		remove(jnl_filename.c_str());
+	}
+	mmap_committed_nruns = mmap_nruns;
+	pending.clear();
+	pending_idx.clear();
+	last_commit = chrono::steady_clock::now();
+}
+
+void RunStorage::mmap_stage_update(int run_id, std::int8_t r_status, vector<char> &data)
+{
+	auto it = pending_idx.find(run_id);
+	if (it != pending_idx.end())
+	{
+		pending[it->second].r_status = r_status;
+		pending[it->second].data.swap(data);
+	}
+	else
+	{
+		PendingRun rec;
+		rec.run_id = run_id;
+		rec.r_status = r_status;
+		rec.data.swap(data);
+		pending_idx[run_id] = pending.size();
+		pending.push_back(std::move(rec));
+	}
+	double secs = chrono::duration<double>(chrono::steady_clock::now() - last_commit).count();
+	if ((pending.size() >= size_t(commit_nruns)) || (secs >= commit_secs))
+	{
+		commit();
+	}
+}
+
+void RunStorage::mmap_read_staged(const PendingRun &rec, std::streamoff offset, char *dest, size_t nbytes) const
+{
+	//overlay the staged status and data on the part of the record that was requested
+	streamoff end = offset + nbytes;
+	streamoff data_beg = rec_head_size;
+	if ((offset <= 0) && (end > 0))
+		dest[-offset] = rec.r_status;
+	streamoff beg = max(offset, data_beg);
+	streamoff data_end = min(end, data_beg + streamoff(rec.data.size()));
+	if (beg < data_end)
+		memcpy(dest + (beg - offset), rec.data.data() + (beg - data_beg), data_end - beg);
+}
+
+int RunStorage::mmap_add_run(const double *model_pars, size_t npars, const string &info_txt, double info_value)
+{
+	int run_id = increment_nruns() - 1;
+	char *rec_ptr = mmap_file.data() + get_stream_pos(run_id);
+	rec_ptr[0] = 0;
+	memset(rec_ptr + sizeof(std::int8_t), '\0', info_txt_length);
+	memcpy(rec_ptr + sizeof(std::int8_t), info_txt.data(), min(info_txt.size(), size_t(info_txt_length) - 1));
+	memcpy(rec_ptr + sizeof(std::int8_t) + info_txt_length, &info_value, sizeof(double));
+	memcpy(rec_ptr + rec_head_size, model_pars, npars * sizeof(double));
+	//new records go to the unused tail of the file; the header only counts them after the next commit
+	return run_id;
+}
+
+void RunStorage::read_rec_head(int run_id, std::int8_t &r_status, string &info_txt, double &info_value)
+{
+	vector<char> head_buf(rec_head_size + 1, '\0');
+	read_rec(run_id, 0, head_buf.data(), rec_head_size);
+	r_status = head_buf[0];
+	//the trailing '\0' guarantees termination even if info_txt filled the field
+	info_txt = &head_buf[sizeof(std::int8_t)];
+	memcpy(&info_value, &head_buf[sizeof(std::int8_t) + info_txt_length], sizeof(double));
+}
+
+void RunStorage::read_rec(int run_id, std::streamoff offset, char *dest, size_t nbytes)
+{
+	if (mmap_file.is_open())
+	{
+		memcpy(dest, mmap_file.data() + get_stream_pos(run_id) + offset, nbytes);
+		auto it = pending_idx.find(run_id);
+		if (it != pending_idx.end())
+		{
+			mmap_read_staged(pending[it->second], offset, dest, nbytes);
+		}
+	}
+	else
+	{
+		buf_stream.seekg(get_stream_pos(run_id) + offset, ios_base::beg);
+		buf_stream.read(dest, nbytes);
+	}
+}
+
+void RunStorage::write_run_status(int run_id, std::int8_t r_status)
+{
+	if (mmap_file.is_open())
+	{
+		auto it = pending_idx.find(run_id);
+		if (it != pending_idx.end())
+		{
+			pending[it->second].r_status = r_status;
+		}
+		else
+		{
+			//the record is staged as a whole so the status change is journaled with the next commit
+			const char *rec_ptr = mmap_file.data() + get_stream_pos(run_id) + rec_head_size;
+			vector<char> data(rec_ptr, rec_ptr + run_data_byte_size);
+			mmap_stage_update(run_id, r_status, data);
+		}
+	}
+	else
+	{
+		buf_stream.seekp(get_stream_pos(run_id), ios_base::beg);
+		buf_stream.write(reinterpret_cast<char*>(&r_status), sizeof(r_status));
+		buf_stream.flush();
+	}
 }
 
 int RunStorage::get_nruns()
 {
+	if (mmap_file.is_open())
+		return mmap_nruns;
 	streamoff init_pos = buf_stream.tellg();
 	buf_stream.seekg(0, ios_base::beg);
 	std::int64_t n_runs_64;
@@ -205,6 +513,12 @@ int RunStorage::get_num_good_runs()
 }
 int RunStorage::increment_nruns()
 {
+	if (mmap_file.is_open())
+	{
+		mmap_reserve(mmap_nruns + 1);
+		++mmap_nruns;
+		return mmap_nruns;
+	}
 	buf_stream.seekg(0, ios_base::beg);
 	std::int64_t n_runs_64;
 	buf_stream.read((char*) &n_runs_64, sizeof(n_runs_64));
@@ -225,7 +539,7 @@ const std::vector<string>& RunStorage::get_obs_name_vec()const
 	return obs_names;
 }
 
-streamoff RunStorage::get_stream_pos(int run_id)
+streamoff RunStorage::get_stream_pos(int run_id) const
 {
 	streamoff pos = beg_run0 + run_byte_size*run_id;
 	return pos;
@@ -233,6 +547,8 @@ streamoff RunStorage::get_stream_pos(int run_id)
 
  int RunStorage::add_run(const vector<double> &model_pars, const string &info_txt, double info_value)
  {
+	if (mmap_file.is_open())
+		return mmap_add_run(model_pars.data(), model_pars.size(), info_txt, info_value);
 	std::int8_t r_status = 0;
 	int run_id = increment_nruns() - 1;
 	vector<char> info_txt_buf;
@@ -254,6 +570,8 @@ streamoff RunStorage::get_stream_pos(int run_id)
 
  int RunStorage::add_run(const Eigen::VectorXd &model_pars, const string &info_txt, double info_value)
  {
+	if (mmap_file.is_open())
+		return mmap_add_run(model_pars.data(), model_pars.size(), info_txt, info_value);
 	std::int8_t r_status = 0;
 	int run_id = increment_nruns() - 1;
 	vector<char> info_txt_buf;
@@ -301,10 +619,30 @@ void RunStorage::copy(const RunStorage &rhs_rs)
 	}
 
 	// copy rhs runstorage information
-	std::streampos rhs_initial_pos = rhs_rs.buf_stream.tellg();
-	rhs_rs.buf_stream.seekg(0, ios_base::beg);
-	buf_stream << rhs_rs.buf_stream.rdbuf();
-	rhs_rs.buf_stream.seekg(rhs_initial_pos);
+	if (rhs_rs.mmap_file.is_open())
+	{
+		//the staged runs of rhs are written over the copy of its mapped view, so rhs is left as is
+		std::int8_t buf_status = 0;
+		buf_stream.write(rhs_rs.mmap_file.data(), rhs_rs.get_stream_pos(rhs_rs.mmap_nruns));
+		buf_stream.write(reinterpret_cast<char*>(&buf_status), sizeof(buf_status));
+		buf_stream.seekp(0, ios_base::beg);
+		buf_stream.write((char*)&rhs_rs.mmap_nruns, sizeof(rhs_rs.mmap_nruns));
+		for (auto &rec : rhs_rs.pending)
+		{
+			buf_stream.seekp(rhs_rs.get_stream_pos(rec.run_id), ios_base::beg);
+			buf_stream.write((char*)&rec.r_status, sizeof(rec.r_status));
+			buf_stream.seekp(rec_head_size - sizeof(rec.r_status), ios_base::cur);
+			buf_stream.write(rec.data.data(), rec.data.size());
+		}
+		buf_stream.flush();
+	}
+	else
+	{
+		std::streampos rhs_initial_pos = rhs_rs.buf_stream.tellg();
+		rhs_rs.buf_stream.seekg(0, ios_base::beg);
+		buf_stream << rhs_rs.buf_stream.rdbuf();
+		rhs_rs.buf_stream.seekg(rhs_initial_pos);
+	}
 	beg_run0 = rhs_rs.beg_run0;
 	run_byte_size = rhs_rs.run_byte_size;
 	run_par_byte_size = rhs_rs.run_par_byte_size;
@@ -320,6 +658,14 @@ void RunStorage::update_run(int run_id, const Parameters &pars, const Observatio
 	check_rec_id(run_id);
 	vector<double> par_data(pars.get_data_vec(par_names));
 	vector<double> obs_data(obs.get_data_vec(obs_names));
+	if (mmap_file.is_open())
+	{
+		vector<char> data(run_data_byte_size);
+		memcpy(data.data(), par_data.data(), run_par_byte_size);
+		memcpy(data.data() + run_par_byte_size, obs_data.data(), obs_data.size() * sizeof(double));
+		mmap_stage_update(run_id, r_status, data);
+		return;
+	}
 	//write data to buffer at end of file and set buffer flag to 1
 	std::int8_t buf_status = 0;
 	std::int32_t buf_run_id = run_id;
@@ -357,6 +703,19 @@ void RunStorage::update_run(int run_id, const Observations &obs)
 	check_rec_id(run_id);
 	vector<double> obs_data(obs.get_data_vec(obs_names));
 	size_t n_pars = par_names.size();
+	if (mmap_file.is_open())
+	{
+		//the parameter values are kept as they are, either staged or already in the file
+		vector<char> data(run_data_byte_size);
+		auto it = pending_idx.find(run_id);
+		if (it != pending_idx.end())
+			memcpy(data.data(), pending[it->second].data.data(), run_par_byte_size);
+		else
+			memcpy(data.data(), mmap_file.data() + get_stream_pos(run_id) + rec_head_size, run_par_byte_size);
+		memcpy(data.data() + run_par_byte_size, obs_data.data(), obs_data.size() * sizeof(double));
+		mmap_stage_update(run_id, r_status, data);
+		return;
+	}
 
 	//write data to buffer at end of file and set buffer flag to 1
 	std::int8_t buf_status = 0;
@@ -391,11 +750,22 @@ void RunStorage::update_run(int run_id, const Observations &obs)
 }
 
 void RunStorage::update_run(int run_id, const vector<char> serial_data)
+{
+	update_run(run_id, serial_data.data(), serial_data.size());
+}
+
+void RunStorage::update_run(int run_id, const char *serial_data, size_t nbytes)
 {
 	//set run status flage to complete
 	std::int8_t r_status = 1;
-	check_rec_size(serial_data);
+	check_rec_size(nbytes);
 	check_rec_id(run_id);
+	if (mmap_file.is_open())
+	{
+		vector<char> data(serial_data, serial_data + nbytes);
+		mmap_stage_update(run_id, r_status, data);
+		return;
+	}
 	//write data to buffer at end of file and set buffer flag to 2
 	std::int8_t buf_status = 0;
 	std::int32_t buf_run_id = run_id;
@@ -404,7 +774,7 @@ void RunStorage::update_run(int run_id, const vector<char> serial_data)
 	buf_stream.write(reinterpret_cast<char*>(&buf_status), sizeof(buf_status));
 	buf_stream.write(reinterpret_cast<char*>(&buf_run_id), sizeof(buf_run_id));
 	buf_stream.write(reinterpret_cast<char*>(&r_status), sizeof(r_status));
-	buf_stream.write(serial_data.data(), serial_data.size());
+	buf_stream.write(serial_data, nbytes);
 	buf_status = 2;
 	buf_stream.seekp(get_stream_pos(end_of_runs), ios_base::beg);
 	buf_stream.write(reinterpret_cast<char*>(&buf_status), sizeof(buf_status));
@@ -414,7 +784,7 @@ void RunStorage::update_run(int run_id, const vector<char> serial_data)
 	buf_stream.write(reinterpret_cast<char*>(&r_status), sizeof(r_status));
 	//skip over info_txt and info_value fields
 	buf_stream.seekp(sizeof(char)*info_txt_length+sizeof(double), ios_base::cur);
-	buf_stream.write(serial_data.data(), serial_data.size());
+	buf_stream.write(serial_data, nbytes);
 	buf_stream.flush();
 	//reset flag for buffer at end of file to 0 to signal it is no longer relavent
 	buf_status = 0;
@@ -427,14 +797,13 @@ void RunStorage::update_run(int run_id, const vector<char> serial_data)
 void RunStorage::update_run_failed(int run_id)
 {
 	std::int8_t r_status = get_run_status_native(run_id);
-	if (r_status < 1)
+	//canceled runs keep their status
+	if ((r_status < 1) && (r_status > -100))
 	{
 		--r_status;
 		check_rec_id(run_id);
 		//update run status flag
-		buf_stream.seekp(get_stream_pos(run_id), ios_base::beg);
-		buf_stream.write(reinterpret_cast<char*>(&r_status), sizeof(r_status));
-		buf_stream.flush();
+		write_run_status(run_id, r_status);
 	}
 }
 
@@ -443,17 +812,27 @@ void RunStorage::set_run_nfailed(int run_id, int nfail)
 	std::int8_t r_status = -nfail;
 	check_rec_id(run_id);
 	//update run status flag
-	buf_stream.seekp(get_stream_pos(run_id), ios_base::beg);
-	buf_stream.write(reinterpret_cast<char*>(&r_status), sizeof(r_status));
-	buf_stream.flush();
+	write_run_status(run_id, r_status);
+}
+
+void RunStorage::set_run_canceled(int run_id)
+{
+	std::int8_t r_status = -100;
+	check_rec_id(run_id);
+	write_run_status(run_id, r_status);
 }
 
 std::int8_t RunStorage::get_run_status_native(int run_id)
 {
 	std::int8_t  r_status;
 	check_rec_id(run_id);
-	buf_stream.seekg(get_stream_pos(run_id), ios_base::beg);
-	buf_stream.read(reinterpret_cast<char*>(&r_status), sizeof(r_status));
+	if (mmap_file.is_open())
+	{
+		auto it = pending_idx.find(run_id);
+		if (it != pending_idx.end())
+			return pending[it->second].r_status;
+	}
+	read_rec(run_id, 0, reinterpret_cast<char*>(&r_status), sizeof(r_status));
 	return r_status;
 }
 
@@ -466,16 +845,8 @@ int RunStorage::get_run_status(int run_id)
 void RunStorage::get_info(int run_id, int &run_status, string &info_txt, double &info_value)
 {
 	std::int8_t  r_status;
-	vector<char> info_txt_buf;
-	info_txt_buf.resize(info_txt_length, '\0');
-
-	buf_stream.seekg(get_stream_pos(run_id), ios_base::beg);
-	buf_stream.read(reinterpret_cast<char*>(&r_status), sizeof(r_status));
-	buf_stream.read(reinterpret_cast<char*>(&info_txt_buf[0]), sizeof(char)*info_txt_length);
-	buf_stream.read(reinterpret_cast<char*>(&info_value), sizeof(double));
-
+	read_rec_head(run_id, r_status, info_txt, info_value);
 	run_status = r_status;
-	info_txt = info_txt_buf.data();
 }
 
 int RunStorage::get_run(int run_id, Parameters &pars, Observations &obs, string &info_txt, double &info_value, bool clear_old)
@@ -507,8 +878,6 @@ int RunStorage::get_run(int run_id, Parameters &pars, Observations &obs, bool cl
 int RunStorage::get_run(int run_id, double *pars, size_t npars, double *obs, size_t nobs, string &info_txt, double &info_value)
 {
 	std::int8_t r_status;
-	vector<char> info_txt_buf;
-	info_txt_buf.resize(info_txt_length, '\0');
 
 	check_rec_id(run_id);
 
@@ -527,22 +896,16 @@ int RunStorage::get_run(int run_id, double *pars, size_t npars, double *obs, siz
 
 	p_size = min(p_size, npars);
 	o_size = min(o_size, nobs);
-	buf_stream.seekg(get_stream_pos(run_id), ios_base::beg);
-	buf_stream.read(reinterpret_cast<char*>(&r_status), sizeof(r_status));
-	buf_stream.read(reinterpret_cast<char*>(&info_txt_buf[0]), sizeof(char)*info_txt_length);
-	buf_stream.read(reinterpret_cast<char*>(&info_value), sizeof(double));
-	buf_stream.read(reinterpret_cast<char*>(pars), p_size * sizeof(double));
-	buf_stream.read(reinterpret_cast<char*>(obs), o_size * sizeof(double));
+	read_rec_head(run_id, r_status, info_txt, info_value);
+	read_rec(run_id, rec_head_size, reinterpret_cast<char*>(pars), p_size * sizeof(double));
+	read_rec(run_id, rec_head_size + run_par_byte_size, reinterpret_cast<char*>(obs), o_size * sizeof(double));
 	int status = r_status;
-	info_txt = info_txt_buf.data();
 	return status;
 }
 
 int RunStorage::get_run(int run_id, vector<double> &pars_vec, vector<double> &obs_vec, string &info_txt, double &info_value)
 {
 	std::int8_t  r_status;
-	vector<char> info_txt_buf;
-	info_txt_buf.resize(info_txt_length, '\0');
 
 	size_t n_par = par_names.size();
 	size_t n_obs = obs_names.size();
@@ -552,14 +915,10 @@ int RunStorage::get_run(int run_id, vector<double> &pars_vec, vector<double> &ob
 
 	check_rec_id(run_id);
 
-	buf_stream.seekg(get_stream_pos(run_id), ios_base::beg);
-	buf_stream.read(reinterpret_cast<char*>(&r_status), sizeof(r_status));
-	buf_stream.read(reinterpret_cast<char*>(&info_txt_buf[0]), sizeof(char)*info_txt_length);
-	buf_stream.read(reinterpret_cast<char*>(&info_value), sizeof(double));
-	buf_stream.read(reinterpret_cast<char*>(&pars_vec[0]), n_par * sizeof(double));
-	buf_stream.read(reinterpret_cast<char*>(&obs_vec[0]), n_obs * sizeof(double));
+	read_rec_head(run_id, r_status, info_txt, info_value);
+	read_rec(run_id, rec_head_size, reinterpret_cast<char*>(pars_vec.data()), n_par * sizeof(double));
+	read_rec(run_id, rec_head_size + run_par_byte_size, reinterpret_cast<char*>(obs_vec.data()), n_obs * sizeof(double));
 	int status = r_status;
-	info_txt = info_txt_buf.data();
 	return status;
 }
 
@@ -580,34 +939,41 @@ int RunStorage::get_run(int run_id, double *pars, size_t npars, double *obs, siz
 vector<char> RunStorage::get_serial_pars(int run_id)
 {
 	check_rec_id(run_id);
-	std::int8_t r_status;
 
 	vector<char> serial_data;
 	serial_data.resize(run_par_byte_size);
-	buf_stream.seekg(get_stream_pos(run_id), ios_base::beg);
-	buf_stream.seekg(sizeof(r_status)+sizeof(char)*info_txt_length+sizeof(double), ios_base::cur);
-	buf_stream.read(serial_data.data(), serial_data.size());
+	read_rec(run_id, rec_head_size, serial_data.data(), serial_data.size());
 	return serial_data;
 }
 
+void RunStorage::get_serial_data(int run_id, std::vector<char> &serial_data)
+{
+	check_rec_id(run_id);
+	serial_data.resize(run_data_byte_size);
+	if (mmap_file.is_open())
+	{
+		//serve staged results from the pending batch rather than forcing a commit
+		auto it = pending_idx.find(run_id);
+		if ((it != pending_idx.end()) && (pending[it->second].data.size() == serial_data.size()))
+		{
+			memcpy(serial_data.data(), pending[it->second].data.data(), serial_data.size());
+			return;
+		}
+	}
+	read_rec(run_id, rec_head_size, serial_data.data(), serial_data.size());
+}
+
 int  RunStorage::get_parameters(int run_id, Parameters &pars)
 {
 	std::int8_t r_status;
-	vector<char> info_txt_buf;
-	info_txt_buf.resize(info_txt_length, '\0');
-	double info_value;
 
 	check_rec_id(run_id);
 
 	size_t n_par = par_names.size();
 	vector<double> par_data;
 	par_data.resize(n_par);
-	buf_stream.seekg(get_stream_pos(run_id), ios_base::beg);
-	buf_stream.read(reinterpret_cast<char*>(&r_status), sizeof(r_status));
-	buf_stream.read(reinterpret_cast<char*>(&info_txt_buf[0]), sizeof(char)*info_txt_length);
-	buf_stream.read(reinterpret_cast<char*>(&info_value), sizeof(double));
-
-	buf_stream.read(reinterpret_cast<char*>(par_data.data()), n_par*sizeof(double));
+	read_rec(run_id, 0, reinterpret_cast<char*>(&r_status), sizeof(r_status));
+	read_rec(run_id, rec_head_size, reinterpret_cast<char*>(par_data.data()), n_par*sizeof(double));
 	pars.update(par_names, par_data);
 	int status = r_status;
 	return status;
@@ -617,22 +983,14 @@ int  RunStorage::get_parameters(int run_id, Parameters &pars)
 int  RunStorage::get_observations(int run_id, Observations &obs)
 {
 	std::int8_t r_status;
-	vector<char> info_txt_buf;
-	info_txt_buf.resize(info_txt_length, '\0');
-	double info_value;
 
 	check_rec_id(run_id);
 
-	size_t n_par = par_names.size();
 	size_t n_obs = obs_names.size();
 	vector<double> obs_data;
 	obs_data.resize(n_obs);
-	buf_stream.seekg(get_stream_pos(run_id), ios_base::beg);
-	buf_stream.read(reinterpret_cast<char*>(&r_status), sizeof(r_status));
-	buf_stream.read(reinterpret_cast<char*>(&info_txt_buf[0]), sizeof(char)*info_txt_length);
-	buf_stream.read(reinterpret_cast<char*>(&info_value), sizeof(double));
-	buf_stream.seekg(n_par*sizeof(double), ios_base::cur);
-	buf_stream.read(reinterpret_cast<char*>(obs_data.data()), n_obs*sizeof(double));
+	read_rec(run_id, 0, reinterpret_cast<char*>(&r_status), sizeof(r_status));
+	read_rec(run_id, rec_head_size + run_par_byte_size, reinterpret_cast<char*>(obs_data.data()), n_obs*sizeof(double));
 	int status = r_status;
 	obs.update(obs_names, obs_data);
 	return status;
@@ -642,36 +1000,162 @@ int  RunStorage::get_observations(int run_id, Observations &obs)
 int  RunStorage::get_observations_vec(int run_id, vector<double> &obs_data)
 {
 	std::int8_t r_status;
-	vector<char> info_txt_buf;
-	info_txt_buf.resize(info_txt_length, '\0');
-	double info_value;
 
 	check_rec_id(run_id);
 
-	size_t n_par = par_names.size();
 	size_t n_obs = obs_names.size();
 	obs_data.resize(n_obs);
-	buf_stream.seekg(get_stream_pos(run_id), ios_base::beg);
-	buf_stream.read(reinterpret_cast<char*>(&r_status), sizeof(r_status));
-	buf_stream.read(reinterpret_cast<char*>(&info_txt_buf[0]), sizeof(char)*info_txt_length);
-	buf_stream.read(reinterpret_cast<char*>(&info_value), sizeof(double));
-	buf_stream.seekg(n_par*sizeof(double), ios_base::cur);
-	buf_stream.read(reinterpret_cast<char*>(obs_data.data()), n_obs*sizeof(double));
+	read_rec(run_id, 0, reinterpret_cast<char*>(&r_status), sizeof(r_status));
+	read_rec(run_id, rec_head_size + run_par_byte_size, reinterpret_cast<char*>(obs_data.data()), n_obs*sizeof(double));
 	int status = r_status;
 	return status;
 }
 
+vector<int> RunStorage::get_observations_matrix(const vector<int> &run_ids, Eigen::MatrixXd &obs_mat, int num_threads)
+{
+	size_t n_obs = obs_names.size();
+	size_t n_rows = run_ids.size();
+	vector<int> status(n_rows, 0);
+	obs_mat.resize(n_rows, n_obs);
+	if (n_rows == 0)
+		return status;
+	for (auto run_id : run_ids)
+	{
+		check_rec_id(run_id);
+	}
+	//read the records in file order so the stream (or page cache) only ever moves forward
+	vector<size_t> order(n_rows);
+	for (size_t i = 0; i < n_rows; ++i)
+		order[i] = i;
+	sort(order.begin(), order.end(), [&run_ids](size_t a, size_t b) { return run_ids[a] < run_ids[b]; });
+
+	//obs_mat is column major, so records are gathered a tile of rows at a time and then scattered
+	//column-by-column, which keeps the strided writes inside a cache-sized block
+	const size_t tile_rows = 16;
+	auto scatter_tile = [&](const vector<double> &tile, size_t beg, size_t n)
+	{
+		for (size_t j = 0; j < n_obs; ++j)
+			for (size_t t = 0; t < n; ++t)
+				obs_mat(order[beg + t], j) = tile[t * n_obs + j];
+	};
+	if (mmap_file.is_open())
+	{
+		const char *base = mmap_file.data();
+		streamoff obs_offset = rec_head_size + run_par_byte_size;
+		//each worker copies a contiguous block of rows straight out of the mapped view, taking
+		//staged runs from the pending batch (which is only read here)
+		auto worker = [&](size_t start, size_t end)
+		{
+			vector<double> tile(tile_rows * n_obs);
+			for (size_t i = start; i < end; i += tile_rows)
+			{
+				size_t n = min(tile_rows, end - i);
+				for (size_t t = 0; t < n; ++t)
+				{
+					size_t irow = order[i + t];
+					auto it = pending_idx.find(run_ids[irow]);
+					if (it != pending_idx.end())
+					{
+						const PendingRun &rec = pending[it->second];
+						status[irow] = rec.r_status;
+						memcpy(&tile[t * n_obs], rec.data.data() + run_par_byte_size, n_obs * sizeof(double));
+						continue;
+					}
+					const char *rec = base + get_stream_pos(run_ids[irow]);
+					status[irow] = static_cast<std::int8_t>(rec[0]);
+					memcpy(&tile[t * n_obs], rec + obs_offset, n_obs * sizeof(double));
+				}
+				scatter_tile(tile, i, n);
+			}
+		};
+		if (num_threads < 1)
+			num_threads = max(1, (int)thread::hardware_concurrency());
+		//not worth spinning up threads for small reads
+		size_t min_rows_per_thread = max((size_t)tile_rows, (size_t)(1000000 / max(n_obs, (size_t)1)));
+		num_threads = (int)min((size_t)num_threads, max((size_t)1, n_rows / min_rows_per_thread));
+		if (num_threads <= 1)
+		{
+			worker(0, n_rows);
+		}
+		else
+		{
+			vector<thread> threads;
+			//keep the chunks tile-aligned so threads never share a tile
+			size_t chunk = (n_rows + num_threads - 1) / num_threads;
+			chunk = ((chunk + tile_rows - 1) / tile_rows) * tile_rows;
+			for (size_t start = 0; start < n_rows; start += chunk)
+			{
+				threads.push_back(thread(worker, start, min(n_rows, start + chunk)));
+			}
+			for (auto &t : threads)
+			{
+				t.join();
+			}
+		}
+	}
+	else
+	{
+		vector<double> tile(tile_rows * n_obs);
+		for (size_t i = 0; i < n_rows; i += tile_rows)
+		{
+			size_t n = min(tile_rows, n_rows - i);
+			for (size_t t = 0; t < n; ++t)
+			{
+				size_t irow = order[i + t];
+				std::int8_t r_status;
+				read_rec(run_ids[irow], 0, reinterpret_cast<char*>(&r_status), sizeof(r_status));
+				read_rec(run_ids[irow], rec_head_size + run_par_byte_size, reinterpret_cast<char*>(&tile[t * n_obs]), n_obs * sizeof(double));
+				status[irow] = r_status;
+			}
+			scatter_tile(tile, i, n);
+		}
+	}
+	return status;
+}
+
+vector<double> RunStorage::get_parameter_values(const vector<int> &run_ids, const vector<int> &par_idxs)
+{
+	if (run_ids.size() != par_idxs.size())
+		throw(PestIndexError("RunStorage::get_parameter_values: run_ids and par_idxs differ in length"));
+	size_t n = run_ids.size();
+	vector<double> values(n);
+	//read in file order so the stream (or page cache) only ever moves forward
+	vector<size_t> order(n);
+	for (size_t i = 0; i < n; ++i)
+		order[i] = i;
+	sort(order.begin(), order.end(), [&](size_t a, size_t b)
+	{
+		return (run_ids[a] < run_ids[b]) || ((run_ids[a] == run_ids[b]) && (par_idxs[a] < par_idxs[b]));
+	});
+	for (auto i : order)
+	{
+		check_rec_id(run_ids[i]);
+		if ((par_idxs[i] < 0) || ((size_t)par_idxs[i] >= par_names.size()))
+			throw(PestIndexError("RunStorage::get_parameter_values: parameter index out of range"));
+		read_rec(run_ids[i], rec_head_size + par_idxs[i] * sizeof(double), reinterpret_cast<char*>(&values[i]), sizeof(double));
+	}
+	return values;
+}
+
 void RunStorage::free_memory()
 {
+	if (mmap_file.is_open())
+	{
+		pending.clear();
+		pending_idx.clear();
+		mmap_file.close();
+		remove(get_journal_filename().c_str());
+		remove(filename.c_str());
+	}
 	if (buf_stream.is_open()) {
 		buf_stream.close();
 		remove(filename.c_str());
 	}
 }
 
-void RunStorage::check_rec_size(const vector<char> &serial_data) const
+void RunStorage::check_rec_size(size_t nbytes) const
 {
-	if (serial_data.size() != run_data_byte_size)
+	if (nbytes != run_data_byte_size)
 	{
 		throw PestError("Error in RunStorage routine.  Size of serial data is different from what is expected");
 	}
@@ -794,4 +1278,12 @@ void RunStorage::export_diff_to_text_file(const std::string &in1_filename, const
 RunStorage::~RunStorage()
 {
   //free_memory();
+	try
+	{
+		mmap_close(true);
+	}
+	catch (...)
+	{
+		cerr << "RunStorage: error committing staged runs to " << filename << endl;
+	}
 }
@@ -24,9 +24,12 @@
 #include <fstream>
 #include <ostream>
 #include <vector>
+#include <map>
+#include <chrono>
 #include <cstdint>
 #include <Eigen/Dense>
 #include "network_package.h"
+#include "mapped_file.h"
 
 class Parameters;
 class Observations;
@@ -50,12 +53,25 @@ class RunStorage {
 	//                   depends on the type of model run being stored  )
 	//       parameter_values  (parameters values for model runs)                     double*number of parameters
 	//       observationn_values( observations results produced by the model run)     double*number of observations
+	//
+	//  When set_mmap(true) is used, the same file layout is accessed through a memory-mapped view instead
+	//  of buf_stream.  Completed runs (and any other change to an existing record) are staged in memory
+	//  and committed in batches, every commit_nruns staged records or commit_secs seconds, whichever comes
+	//  first, and when the storage is closed.  A commit writes the batch to a write-ahead journal
+	//  (<filename>.jnl) which is fsync'ed before the batch is copied into the mapped view; the view is
+	//  then fsync'ed and the journal removed, so there is one journal and one sync per batch and
+	//  init_restart() replays a complete journal left behind by a crash.  New records from add_run()
+	//  are written to the unused tail of the file and are counted in the header at the next commit.
+	//  Reads of staged runs are served from the pending batch.
 
 public:
 	static const double no_data;
 	RunStorage(const std::string &_filename);
 	void reset(const std::vector<std::string> &par_names, const std::vector<std::string> &obs_names, const std::string &_filename = std::string(""));
 	void init_restart(const std::string &_filename);
+	void set_mmap(bool _use_mmap, int _commit_nruns = 100, double _commit_secs = 5.0);
+	bool get_mmap() const { return use_mmap; }
+	void commit();
 	virtual int add_run(const std::vector<double> &model_pars, const std::string &info_txt="", double info_value=no_data);
 	virtual int add_run(const Parameters &pars, const std::string &info_txt="", double info_value=no_data);
 	virtual int add_run(const Eigen::VectorXd &model_pars, const std::string &info_txt="", double info_value=no_data);
@@ -63,8 +79,11 @@ public:
 	void update_run(int run_id, const Parameters &pars, const Observations &obs);
 	void update_run(int run_id, const Observations &obs);
 	void update_run(int run_id, const std::vector<char> serial_data);
+	//serial_data holds the parameter values followed by the observation values of the run
+	void update_run(int run_id, const char *serial_data, size_t nbytes);
 	void update_run_failed(int run_id);
 	void set_run_nfailed(int run_id, int nfail);
+	void set_run_canceled(int run_id);
 	int get_nruns();
 	int get_num_good_runs();
 	int increment_nruns();
@@ -81,8 +100,15 @@ public:
 	int get_run(int run_id, std::vector<double> &pars_vec, std::vector<double> &obs_vec);
 	int get_parameters(int run_id, Parameters &pars);
 	std::vector<char> get_serial_pars(int run_id);
+	//raw parameter + observation bytes of a run, in the layout accepted by update_run()
+	void get_serial_data(int run_id, std::vector<char> &serial_data);
 	int get_observations_vec(int run_id, std::vector<double> &data_vec);
 	int get_observations(int run_id, Observations &obs);
+	//bulk-read the simulated values of several runs into the rows of obs_mat (one row per entry of
+	//run_ids, columns in get_obs_name_vec() order).  Returns the run status of each row.
+	std::vector<int> get_observations_matrix(const std::vector<int> &run_ids, Eigen::MatrixXd &obs_mat, int num_threads = -1);
+	//read single parameter values: entry i is parameter par_idxs[i] (in get_par_name_vec() order) of run run_ids[i]
+	std::vector<double> get_parameter_values(const std::vector<int> &run_ids, const std::vector<int> &par_idxs);
 	static void export_diff_to_text_file(const std::string &in1_filename, const std::string &in2_filename, const std::string &out_filename);
 	void free_memory();
 	std::string get_filename() { return filename; }
@@ -90,6 +116,14 @@ public:
 	~RunStorage();
 private:
 	static const int info_txt_length = NetPackage::DESC_LEN;
+	//number of bytes preceding the parameter values in each run record (run_status, info_txt and info_value)
+	static const std::streamoff rec_head_size = sizeof(std::int8_t) + info_txt_length * sizeof(char) + sizeof(double);
+	struct PendingRun
+	{
+		std::int32_t run_id;
+		std::int8_t r_status;
+		std::vector<char> data;
+	};
 	std::string filename;
 	mutable std::fstream buf_stream;
 	std::streamoff beg_run0;
@@ -98,10 +132,30 @@ private:
 	std::streamoff run_data_byte_size;
 	std::vector<std::string> par_names;
 	std::vector<std::string> obs_names;
-	void check_rec_size(const std::vector<char> &serial_data) const;
+	bool use_mmap;
+	int commit_nruns;
+	double commit_secs;
+	MappedFile mmap_file;
+	std::int64_t mmap_nruns;
+	std::int64_t mmap_committed_nruns;
+	std::vector<PendingRun> pending;
+	std::map<int, size_t> pending_idx;
+	std::chrono::steady_clock::time_point last_commit;
+	std::string get_journal_filename() const { return filename + ".jnl"; }
+	void mmap_open();
+	void mmap_close(bool do_commit);
+	void mmap_reserve(std::int64_t nruns);
+	int mmap_add_run(const double *model_pars, size_t npars, const std::string &info_txt, double info_value);
+	void mmap_stage_update(int run_id, std::int8_t r_status, std::vector<char> &data);
+	void mmap_read_staged(const PendingRun &rec, std::streamoff offset, char *dest, size_t nbytes) const;
+	void replay_journal();
+	void read_rec_head(int run_id, std::int8_t &r_status, std::string &info_txt, double &info_value);
+	void read_rec(int run_id, std::streamoff offset, char *dest, size_t nbytes);
+	void write_run_status(int run_id, std::int8_t r_status);
+	void check_rec_size(size_t nbytes) const;
 	void check_rec_id(int run_id);
 	std::int8_t get_run_status_native(int run_id);
-	std::streamoff get_stream_pos(int run_id);
+	std::streamoff get_stream_pos(int run_id) const;
 };
 
 #endif //RUN_STORAGE_H_
@@ -27,6 +27,7 @@
 class Transformable;
 class Parameters;
 class Observations;
+class RunStorage;
 
 class Serialization
 {
@@ -46,6 +47,8 @@ public:
 	static unsigned long unserialize(const std::vector<int8_t> &ser_data, std::vector<std::string> &string_vec, unsigned long start_loc = 0, unsigned long max_read_bytes = ULONG_MAX);
 	static unsigned long unserialize(const std::vector<int8_t> &ser_data, Transformable &items, const std::vector<std::string> &names_vec, unsigned long start_loc = 0);
 	static unsigned long unserialize(const std::vector<int8_t> &ser_data, Parameters &pars, const std::vector<std::string> &par_names, Observations &obs, const std::vector<std::string> &obs_names, double &run_time);
+	//decode a serialized model run (as produced by the serialize() overload above) directly into run_id's record in rs
+	static unsigned long unserialize(const std::vector<int8_t> &ser_data, RunStorage &rs, int run_id, double &run_time);
 private:
 };
 
@@ -24,6 +24,8 @@
 #include <cassert>
 #include "Serialization.h"
 #include "Transformable.h"
+#include "RunStorage.h"
+#include "pest_error.h"
 #include "utilities.h"
 
 using namespace std;
@@ -141,16 +143,24 @@ vector<int8_t> Serialization::serialize(const Parameters &pars, const vector<str
 	size_t par_buf_sz = npar * sizeof(double);
 	size_t obs_buf_sz = nobs * sizeof(double);
 	size_t run_time_sz = sizeof(double);
-	serial_data.resize(par_buf_sz + obs_buf_sz + run_time_sz, Parameters::no_data);
+	serial_data.resize(par_buf_sz + obs_buf_sz + run_time_sz);
 
+	//write the values straight into the buffer rather than through temporary vectors
 	int8_t *buf = &serial_data[0];
-	vector<double> par_data = pars.get_data_vec(par_names_vec);
-	w_memcpy_s(buf, par_buf_sz, &par_data[0], par_data.size() * sizeof(double));
-
-	vector<double> obs_data = obs.get_data_vec(obs_names_vec);
-
-	w_memcpy_s(buf+par_buf_sz, obs_buf_sz, &obs_data[0], obs_data.size() * sizeof(double));
-	w_memcpy_s(buf + par_buf_sz + obs_buf_sz, run_time_sz, &run_time, sizeof(double));
+	double value;
+	for (auto &name : par_names_vec)
+	{
+		value = pars.get_rec(name);
+		w_memcpy_s(buf, sizeof(double), &value, sizeof(double));
+		buf += sizeof(double);
+	}
+	for (auto &name : obs_names_vec)
+	{
+		value = obs.get_rec(name);
+		w_memcpy_s(buf, sizeof(double), &value, sizeof(double));
+		buf += sizeof(double);
+	}
+	w_memcpy_s(buf, run_time_sz, &run_time, sizeof(double));
 
 	return serial_data;
 }
@@ -286,3 +296,17 @@ unsigned long Serialization::unserialize(const vector<int8_t> &ser_data, Paramet
 	w_memcpy_s(&run_time, sizeof(double), ser_data.data() + bytes_read, sizeof(double));
 	return bytes_read;
 }
+
+unsigned long Serialization::unserialize(const vector<int8_t> &ser_data, RunStorage &rs, int run_id, double &run_time)
+{
+	size_t rec_sz = (rs.get_par_name_vec().size() + rs.get_obs_name_vec().size()) * sizeof(double);
+	if (ser_data.size() < rec_sz + sizeof(double))
+	{
+		stringstream ss;
+		ss << "Serialization::unserialize(): serialized run is " << ser_data.size() << " bytes, expected " << rec_sz + sizeof(double);
+		throw PestError(ss.str());
+	}
+	rs.update_run(run_id, reinterpret_cast<const char*>(ser_data.data()), rec_sz);
+	w_memcpy_s(&run_time, sizeof(double), ser_data.data() + rec_sz, sizeof(double));
+	return rec_sz;
+}
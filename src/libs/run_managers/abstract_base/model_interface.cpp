@@ -10,6 +10,15 @@
 #include <sstream>
 #include <thread>
 #include <unordered_set>
+#include <unordered_map>
+#include <map>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdint>
+#include <stdexcept>
 #include "model_interface.h"
 
 using namespace std;
@@ -170,385 +179,287 @@ void ModelInterface::run(Parameters* pars, Observations* obs)
 
 }
 
-void ThreadedInstructionProcess::work(int tid, vector<int>& ins_idx, Observations& obs, string additional_ins_delims)
+void ModelInterface::set_model_plugin(const string& filename, const string& config,
+	const vector<string>& par_names, const vector<string>& obs_names)
 {
-	int count = 0, i;
-	unique_lock<mutex> obs_guard(obs_lock, defer_lock);
-	unique_lock<mutex> idx_guard(idx_lock, defer_lock);
-	while (true)
-	{
-		i = -999;
-		while (true)
-		{
-			if (idx_guard.try_lock())
-			{
-				if (ins_idx.size() == 0)
-				{
-					cout << "thread " << tid << " processed " << count << " instruction files" << endl;
-					return;
-				}
-				i = ins_idx[ins_idx.size() - 1];
-				ins_idx.pop_back();
-				idx_guard.unlock();
-				break;
-			}
-		}
-		InstructionFile ins(insfile_vec[i]);
-		ins.set_additional_delimiters(additional_ins_delims);
-		Observations oobs = ins.read_output_file(outfile_vec[i]);
-		while (true)
-		{
-			if (obs_guard.try_lock())
-			{
-				//pro_par_vec.push_back(pro_pars);
-				obs.update_without_clear(oobs.get_keys(), oobs.get_data_vec(oobs.get_keys()));
-				obs_guard.unlock();
-				break;
-			}
-		}
-		count++;
-	}
+	plugin = make_shared<ModelPlugin>();
+	plugin->load(filename, config, par_names, obs_names);
+	cout << "loaded model plugin '" << filename << "'";
+	if (plugin->has_batch())
+		cout << " (with batch evaluation)";
+	cout << endl;
 }
 
-void ThreadedTemplateProcess::work(int tid, vector<int>& tpl_idx, Parameters pars, Parameters& pro_pars)
+void ModelInterface::run_model_plugin(Parameters* pars_ptr, Observations* obs_ptr)
 {
-	int count = 0, i;
-	unique_lock<mutex> par_guard(par_lock, defer_lock);
-	unique_lock<mutex> idx_guard(idx_lock, defer_lock);
-	while (true)
+	vector<double> par_vals = pars_ptr->get_data_vec(plugin->get_par_names());
+	vector<double> obs_vals;
+	plugin->run(par_vals, obs_vals);
+	obs_ptr->update_without_clear(plugin->get_obs_names(), obs_vals);
+}
+
+//process items [0, n) on up to num_threads threads.  each thread claims the next unprocessed
+//item from a shared counter; error messages are returned by item (empty if the item succeeded)
+static void run_file_threads(int num_threads, int n, const function<void(int)>& work, vector<string>& errors)
+{
+	errors.assign(n, "");
+	atomic<int> next(0);
+	auto worker = [&]()
 	{
-		i = -999;
 		while (true)
 		{
-			if (idx_guard.try_lock())
+			int i = next.fetch_add(1);
+			if (i >= n)
+				return;
+			try
 			{
-				if (tpl_idx.size() == 0)
-				{
-					cout << "thread " << tid << " processed " << count << " template files" << endl;
-					return;
-				}
-				i = tpl_idx[tpl_idx.size() - 1];
-				tpl_idx.pop_back();
-				idx_guard.unlock();
-				break;
+				work(i);
 			}
-		}
-		TemplateFile tpl(tplfile_vec[i]);
-		tpl.set_fill_zeros(fill);
-		Parameters ppars = tpl.write_input_file(inpfile_vec[i], pars);
-		while (true)
-		{
-			if (par_guard.try_lock())
+			catch (const std::exception& e)
 			{
-				//pro_par_vec.push_back(pro_pars);
-				pro_pars.update_without_clear(ppars.get_keys(), ppars.get_data_vec(ppars.get_keys()));
-				par_guard.unlock();
-				break;
+				errors[i] = e.what();
+				if (errors[i].size() == 0)
+					errors[i] = "unknown exception";
+			}
+			catch (...)
+			{
+				errors[i] = "unknown exception";
 			}
 		}
-		count++;
+	};
+	if (num_threads > n)
+		num_threads = n;
+	if (num_threads <= 1)
+	{
+		worker();
+		return;
 	}
+	vector<thread> threads;
+	for (int i = 0; i < num_threads; i++)
+		threads.push_back(thread(worker));
+	for (auto& t : threads)
+		t.join();
 }
 
-void process_template_file_thread(int tid, vector<int>& tpl_idx, ThreadedTemplateProcess& ttp, Parameters pars, Parameters& pro_pars, exception_ptr& eptr)
+static void throw_file_errors(const string& file_type, const vector<string>& file_vec, const vector<string>& errors)
 {
-	
-	try
-	{
-		ttp.work(tid, tpl_idx, pars, pro_pars);
-	}
-	catch (const std::exception& e)
-	{
-		eptr = current_exception();
-	}
-	catch (...)
+	stringstream ss;
+	int num_exp = 0;
+	for (size_t i = 0; i < errors.size(); i++)
 	{
-		eptr = current_exception();
+		if (errors[i].size() == 0)
+			continue;
+		ss << " error processing " << file_type << " file '" << file_vec[i] << "': " << errors[i] << endl;
+		num_exp++;
 	}
-
-	return;
+	if (num_exp > 0)
+		throw runtime_error(ss.str());
 }
 
-void process_instruction_file_thread(int tid, vector<int>& ins_idx, ThreadedInstructionProcess& tip, Observations& obs, string additional_ins_delims, exception_ptr& eptr)
+void ModelInterface::set_work_dir(const string& dir)
 {
-
-	try
+	//strip any previous work dir prefix so this can be called more than once
+	auto rebase = [&](vector<string>& files)
 	{
-		tip.work(tid, ins_idx, obs, additional_ins_delims);
-	}
-	catch (const std::exception& e)
-	{
-		eptr = current_exception();
-	}
-	catch (...)
-	{
-		eptr = current_exception();
-	}
-
-	return;
+		for (auto& f : files)
+		{
+			if ((!work_dir.empty()) && (f.compare(0, work_dir.size() + 1, work_dir + OperSys::DIR_SEP) == 0))
+				f = f.substr(work_dir.size() + 1);
+			if ((!dir.empty()) && (!OperSys::is_absolute_path(f)))
+				f = dir + OperSys::DIR_SEP + f;
+		}
+	};
+	rebase(inpfile_vec);
+	rebase(outfile_vec);
+	work_dir = dir;
 }
 
-
-void ModelInterface::write_input_files(Parameters *pars_ptr)
+void ModelInterface::set_additional_ins_delimiters(string delims)
 {
-	int num_threads =10;
-	if (num_threads > tplfile_vec.size())
-		num_threads = tplfile_vec.size();
-	std::chrono::system_clock::time_point start_time = chrono::system_clock::now();
-	cout << pest_utils::get_time_string() << " processing template files with " << num_threads << " threads..." << endl;
-	vector<thread> threads;
-	vector<exception_ptr> exception_ptrs;
-	Parameters pro_pars = *pars_ptr; //copy
-	ThreadedTemplateProcess ttp(tplfile_vec, inpfile_vec, fill_tpl_zeros);
-
-	for (int i = 0; i < num_threads; i++)
-	{
-		exception_ptrs.push_back(exception_ptr());
-	}
+	additional_ins_delimiters = delims;
+	for (auto& ins : instructionfiles)
+		ins.set_additional_delimiters(delims);
+}
 
-	vector<int> tpl_idx;
-	for (int i = 0; i < tplfile_vec.size(); i++)
-		tpl_idx.push_back(i);
+void ModelInterface::set_fill_tpl_zeros(bool _flag)
+{
+	fill_tpl_zeros = _flag;
+	for (auto& tpl : templatefiles)
+		tpl.set_fill_zeros(_flag);
+}
 
-	for (int i = 0; i < num_threads; i++)
-	{
-		threads.push_back(thread(process_template_file_thread, i, std::ref(tpl_idx), std::ref(ttp), *pars_ptr, std::ref(pro_pars), std::ref(exception_ptrs[i])));
-	}
-	stringstream ss;
-	int num_exp = 0;
-	for (int i = 0; i < num_threads; ++i)
-	{
-		bool found = false;
-		if (exception_ptrs[i])
+void ModelInterface::compile_templates()
+{
+	templatefiles.clear();
+	for (auto& tpl_file : tplfile_vec)
+		templatefiles.push_back(TemplateFile(tpl_file, fill_tpl_zeros));
+	vector<string> errors;
+	run_file_threads(num_threads, templatefiles.size(), [this](int i) { templatefiles[i].compile(); }, errors);
+	throw_file_errors("template", tplfile_vec, errors);
+
+	//map the slots of each plan onto the union of parameter names
+	unordered_map<string, int> name_map;
+	plan_par_names.clear();
+	tpl_slots.clear();
+	for (auto& tpl : templatefiles)
+	{
+		vector<int> slots;
+		for (auto& name : tpl.get_plan_par_names())
 		{
-			found = true;
-			try
-			{
-				rethrow_exception(exception_ptrs[i]);
-			}
-			catch (const std::exception& e)
-			{
-				//stringstream ss;
-				ss << " thread processing template file '" << tplfile_vec[i] << "' raised an exception: " << e.what() << endl;
-				num_exp++;
-				//cout << "Error: " << ss.str();
-				//throw runtime_error(ss.str());
-			}
-			catch (...)
+			auto it = name_map.find(name);
+			if (it == name_map.end())
 			{
-				//stringstream ss;
-				ss << " thread processing template file '" << tplfile_vec[i] << "' raised an exception" << endl;
-				num_exp++;
-				//cout << "Error: " << ss.str();
-				//throw runtime_error(ss.str());
+				it = name_map.insert(make_pair(name, (int)plan_par_names.size())).first;
+				plan_par_names.push_back(name);
 			}
+			slots.push_back(it->second);
 		}
-		threads[i].join();
-		if ((exception_ptrs[i]) && (!found))
+		tpl_slots.push_back(slots);
+	}
+}
+
+void ModelInterface::compile_instructions()
+{
+	instructionfiles.clear();
+	for (auto& ins_file : insfile_vec)
+		instructionfiles.push_back(InstructionFile(ins_file, additional_ins_delimiters));
+	vector<string> errors;
+	run_file_threads(num_threads, instructionfiles.size(), [this](int i) { instructionfiles[i].compile(); }, errors);
+	throw_file_errors("instruction", insfile_vec, errors);
+
+	unordered_map<string, int> name_map;
+	plan_obs_names.clear();
+	ins_slots.clear();
+	for (auto& ins : instructionfiles)
+	{
+		vector<int> slots;
+		for (auto& name : ins.get_plan_obs_names())
 		{
-			try
-			{
-				rethrow_exception(exception_ptrs[i]);
-			}
-			catch (const std::exception& e)
-			{
-				//stringstream ss;
-				ss << " thread processing template file '" << tplfile_vec[i] << "' raised an exception: " << e.what() << endl;
-				num_exp++;
-				//cout << "Error: " << ss.str();
-				//throw runtime_error(ss.str());
-			}
-			catch (...)
+			auto it = name_map.find(name);
+			if (it == name_map.end())
 			{
-				//stringstream ss;
-				ss << " thread processing template file '" << tplfile_vec[i] << "' raised an exception" << endl;
-				num_exp++;
-				//cout << "Error: " << ss.str();
-				//throw runtime_error(ss.str());
+				it = name_map.insert(make_pair(name, (int)plan_obs_names.size())).first;
+				plan_obs_names.push_back(name);
 			}
+			slots.push_back(it->second);
 		}
+		ins_slots.push_back(slots);
 	}
+	ins_names_checked = false;
+}
+
+void ModelInterface::write_input_files(Parameters *pars_ptr)
+{
+	std::chrono::system_clock::time_point start_time = chrono::system_clock::now();
+	if (templatefiles.size() != tplfile_vec.size())
+		compile_templates();
+	int nt = min(num_threads, (int)tplfile_vec.size());
+	cout << pest_utils::get_time_string() << " processing template files with " << nt << " threads..." << endl;
+
+	//look up each parameter once, then every template works from flat arrays
+	size_t n_par = plan_par_names.size();
+	vector<double> par_vals(n_par);
+	vector<char> par_found(n_par, 1);
+	Parameters::const_iterator end = pars_ptr->end();
+	for (size_t i = 0; i < n_par; i++)
+	{
+		Parameters::const_iterator it = pars_ptr->find(plan_par_names[i]);
+		if (it == end)
+			par_found[i] = 0;
+		else
+			par_vals[i] = it->second;
+	}
+
+	vector<vector<double>> pro_vals(templatefiles.size());
+	vector<string> errors;
+	run_file_threads(num_threads, templatefiles.size(), [&](int i)
+	{
+		const vector<int>& slots = tpl_slots[i];
+		vector<double> vals(slots.size());
+		for (size_t j = 0; j < slots.size(); j++)
+		{
+			if (!par_found[slots[j]])
+				templatefiles[i].throw_tpl_error("parameter '" + plan_par_names[slots[j]] + "' not in parameters instance");
+			vals[j] = par_vals[slots[j]];
+		}
+		templatefiles[i].write_input_file(inpfile_vec[i], vals, pro_vals[i]);
+	}, errors);
+	throw_file_errors("template", tplfile_vec, errors);
 
-	//if (templatefiles.size() == 0)
-	//{
-	//	for (auto t : tplfile_vec)
-	//	{
-	//		TemplateFile tt(t);
-	//		tt.set_fill_zeros(fill_tpl_zeros);
-	//		templatefiles.push_back(tt);
-	//	}
-	//}
-
-	//
-	//vector<string> notnormal = pars_ptr->get_notnormal_keys();
-	//if (notnormal.size() > 0)
-	//{
-	//	throw runtime_error("denormal floating point parameter values found");
-	//}
-
-	//vector<Parameters> pro_par_vec;
-	//for (int i = 0; i < templatefiles.size(); i++)
-	//{
-	//	string name = templatefiles[i].get_tpl_filename();
-	//	//cout << name << endl;
-	//	pro_par_vec.push_back(templatefiles[i].write_input_file(inpfile_vec[i], *pars_ptr));
-	//}
 	//update pars to account for possibly truncated par values...important for jco calcs
-	//for (auto pro_pars : pro_par_vec)
-	//	pars_ptr->update_without_clear(pro_pars.get_keys(), pro_pars.get_data_vec(pro_pars.get_keys()));
-	if (num_exp > 0)
+	for (size_t i = 0; i < templatefiles.size(); i++)
 	{
-		//cout << "errors processing template files: " << endl << ss.str();
-		throw runtime_error(ss.str());
+		const vector<int>& slots = tpl_slots[i];
+		for (size_t j = 0; j < slots.size(); j++)
+			par_vals[slots[j]] = pro_vals[i][j];
 	}
-
-	pars_ptr->update_without_clear(pro_pars.get_keys(), pro_pars.get_data_vec(pro_pars.get_keys()));
+	pars_ptr->update_without_clear(plan_par_names, par_vals);
 	cout << pest_utils::get_time_string() << " done, took " << pest_utils::get_duration_sec(start_time) << " seconds" << endl;
 }
 
 void ModelInterface::read_output_files(Observations *obs)
 {
-	int num_threads = 10;
-	if (num_threads > insfile_vec.size())
-		num_threads = insfile_vec.size();
 	std::chrono::system_clock::time_point start_time = chrono::system_clock::now();
-	cout << pest_utils::get_time_string() <<  " processing instruction files with " << num_threads << " threads..." << endl;
-	vector<thread> threads;
-	vector<exception_ptr> exception_ptrs;
-	Observations temp_obs;
-
-	ThreadedInstructionProcess tip(insfile_vec, outfile_vec);
-
-	for (int i = 0; i < num_threads; i++)
-	{
-		exception_ptrs.push_back(exception_ptr());
-	}
-
-	vector<int> ins_idx;
-	for (int i = 0; i < insfile_vec.size(); i++)
-		ins_idx.push_back(i);
-
-	for (int i = 0; i < num_threads; i++)
-	{
-		threads.push_back(thread(process_instruction_file_thread, i, std::ref(ins_idx), std::ref(tip), std::ref(temp_obs), additional_ins_delimiters,
-			std::ref(exception_ptrs[i])));
-	}
-	stringstream ss;
-	int num_exp = 0;
-	for (int i = 0; i < num_threads; ++i)
-	{
-		bool found = false;
-		if (exception_ptrs[i])
+	if (instructionfiles.size() != insfile_vec.size())
+		compile_instructions();
+	int nt = min(num_threads, (int)insfile_vec.size());
+	cout << pest_utils::get_time_string() <<  " processing instruction files with " << nt << " threads..." << endl;
+
+	vector<vector<double>> file_vals(instructionfiles.size());
+	vector<string> errors;
+	run_file_threads(num_threads, instructionfiles.size(), [&](int i)
+	{
+		instructionfiles[i].read_output_file(outfile_vec[i], file_vals[i]);
+	}, errors);
+	throw_file_errors("instruction", insfile_vec, errors);
+
+	//the set of observation names read is fixed by the plans, so it only needs checking once
+	if (!ins_names_checked)
+	{
+		unordered_set<string> ins_names, pst_names;
+		vector<string> t, diff;
+		t = obs->get_keys();
+		pst_names.insert(t.begin(), t.end());
+		ins_names.insert(plan_obs_names.begin(), plan_obs_names.end());
+		unordered_set<string>::iterator end = ins_names.end();
+		for (auto o : pst_names)
 		{
-			found = true;
-			try
-			{
-				rethrow_exception(exception_ptrs[i]);
-			}
-			catch (const std::exception& e)
-			{
-				//stringstream ss;
-				ss << " thread processing instruction file '" << insfile_vec[i] << "' raised an exception: " << e.what() << endl;
-				//cout << "Error: " << ss.str() << endl;
-				//throw runtime_error(ss.str());
-				num_exp++;
-			}
-			catch (...)
-			{
-				//stringstream ss;
-				ss << " thread processing instruction file '" << insfile_vec[i] << "' raised an exception" << endl;
-				//cout << "Error: " << ss.str() << endl;
-				//throw runtime_error(ss.str());
-				num_exp++;
-			}
+			if (ins_names.find(o) == end)
+				diff.push_back(o);
 		}
-		threads[i].join();
-		if ((exception_ptrs[i]) && (!found))
+		if (diff.size() > 0)
 		{
-			try
-			{
-				rethrow_exception(exception_ptrs[i]);
-			}
-			catch (const std::exception& e)
-			{
-				//stringstream ss;
-				ss << " thread processing instruction file '" << insfile_vec[i] << "' raised an exception: " << e.what() << endl;
-				//cout << "Error: " << ss.str() << endl;
-				//throw runtime_error(ss.str());
-				num_exp++;
-			}
-			catch (...)
-			{
-				//stringstream ss;
-				ss << " thread processing instruction file '" << insfile_vec[i] << "' raised an exception" << endl;
-				//cout << "Error: " << ss.str() << endl;
-				//throw runtime_error(ss.str());
-				num_exp++;
-			}
+			stringstream ss;
+			ss << "ModelInterace error: the following instruction observations are not in the control file:";
+			for (auto d : diff)
+				ss << d << ",";
+			throw_mio_error(ss.str());
 		}
-	}
-	
-	
-	
-	/*if (instructionfiles.size() == 0)
-	{
-		for (auto i : insfile_vec)
+		end = pst_names.end();
+		for (auto o : ins_names)
 		{
-			InstructionFile ii(i);
-			ii.set_additional_delimiters(additional_ins_delimiters);
-			instructionfiles.push_back(ii);
+			if (pst_names.find(o) == end)
+				diff.push_back(o);
 		}
-	}
-	
-	Observations temp_obs, pro_obs;
-	for (int i = 0; i < instructionfiles.size(); i++)
-	{
-		pro_obs = instructionfiles[i].read_output_file(outfile_vec[i]);
-		temp_obs.update_without_clear(pro_obs.get_keys(), pro_obs.get_data_vec(pro_obs.get_keys()));
-	}*/
-
-	if (num_exp > 0)
-	{
-		//cout << "errors processing instruction files: " << endl << ss.str();
-		throw runtime_error(ss.str());
+		if (diff.size() > 0)
+		{
+			stringstream ss;
+			ss << "ModelInterace error: the following control file observations are not in the instruction files:";
+			for (auto d : diff)
+				ss << d << ",";
+			throw_mio_error(ss.str());
+		}
+		ins_names_checked = true;
 	}
 
-	unordered_set<string> ins_names, pst_names;
-	vector<string> t, diff;
-	t = obs->get_keys();
-	pst_names.insert(t.begin(), t.end());
-	t = temp_obs.get_keys();
-	ins_names.insert(t.begin(), t.end());
-	unordered_set<string>::iterator end = ins_names.end();
-	for (auto o : pst_names)
+	vector<double> obs_vals(plan_obs_names.size());
+	for (size_t i = 0; i < instructionfiles.size(); i++)
 	{
-		if (ins_names.find(o) == end)
-			diff.push_back(o);
-	}
-	if (diff.size() > 0)
-	{
-		stringstream ss;
-		ss << "ModelInterace error: the following instruction observations are not in the control file:";
-		for (auto d : diff)
-			ss << d << ",";
-		throw_mio_error(ss.str());
-	}
-	end = pst_names.end();
-	for (auto o : ins_names)
-	{
-		if (pst_names.find(o) == end)
-			diff.push_back(o);
-	}
-	if (diff.size() > 0)
-	{
-		stringstream ss;
-		ss << "ModelInterace error: the following control file observations are not in the instruction files:";
-		for (auto d : diff)
-			ss << d << ",";
-		throw_mio_error(ss.str());
+		const vector<int>& slots = ins_slots[i];
+		for (size_t j = 0; j < slots.size(); j++)
+			obs_vals[slots[j]] = file_vals[i][j];
 	}
-	t = temp_obs.get_keys();
-	obs->update(t, temp_obs.get_data_vec(t));
+	obs->update(plan_obs_names, obs_vals);
 	cout << pest_utils::get_time_string() << " done, took " << pest_utils::get_duration_sec(start_time) << " seconds" << endl;
 
 }
@@ -606,6 +517,12 @@ void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_
 			
 	try
 	{
+		if (has_model_plugin())
+		{
+			run_model_plugin(pars_ptr, obs_ptr);
+			finished->set(true);
+			return;
+		}
 		remove_existing();
 		write_input_files(pars_ptr);
 		
@@ -630,7 +547,7 @@ void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_
 			PROCESS_INFORMATION pi;
 			try
 			{
-				pi = start(cmd_string);
+				pi = start(cmd_string, work_dir);
 			}
 			catch (...)
 			{
@@ -685,7 +602,7 @@ void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_
 		for (auto &cmd_string : comline_vec)
 		{
 			//start the command
-			int command_pid = start(cmd_string);
+			int command_pid = start(cmd_string, work_dir);
 			while (true)
 			{
 				//sleep
@@ -757,103 +674,122 @@ unordered_set<string> TemplateFile::parse_and_check()
 }
 
 Parameters TemplateFile::write_input_file(const string& input_filename, Parameters& pars)
+{
+	if (!compiled)
+		compile();
+	vector<double> par_vals, pro_vals;
+	for (auto& name : plan_par_names)
+	{
+		try
+		{
+			par_vals.push_back(pars.get_rec(name));
+		}
+		catch (...)
+		{
+			throw_tpl_error("parameter '" + name + "' not in parameters instance");
+		}
+	}
+	write_input_file(input_filename, par_vals, pro_vals);
+	Parameters pro_pars;
+	pro_pars.insert(plan_par_names, pro_vals);
+	return pro_pars;
+}
+
+void TemplateFile::compile()
 {
 	ifstream f_tpl(tpl_filename);
+	line_num = 0;
 	prep_tpl_file_for_reading(f_tpl);
-	ofstream f_in(input_filename);
-	if (f_in.bad())
-		throw_tpl_error("couldn't open model input file '" + input_filename + "' for writing");
-	string line, val_str, name;
-	double val;
+	string line;
 	vector<pair<string, pair<int, int>>> tpl_line_map;
-	Parameters pro_pars;
-	//vector<string> t = pars.get_keys();
-	//unordered_set<string> pnames(t.begin(), t.end());
-	//unordered_set<string>::iterator end = pnames.end();
-	//t.resize(0);
+	unordered_map<string, int> par_slots;
+	map<pair<int, int>, int> fmt_slots;
+	plan_image.clear();
+	plan_fields.clear();
+	plan_par_names.clear();
+	plan_fmts.clear();
 	while (true)
 	{
 		if (f_tpl.eof())
 			break;
 		line = read_line(f_tpl);
-		
 		if (line.size() == 0)
 		{
 			if (f_tpl.eof())
 				break;
-			f_in << endl;
+			plan_image.push_back('\n');
 			continue;
 		}
 		tpl_line_map = parse_tpl_line(line);
-		for (auto t : tpl_line_map)
+		for (auto& t : tpl_line_map)
 		{
-			name = t.first;
-			//if (pnames.find(name) == end)
-			//	throw_tpl_error("parameter '" + name + "' not listed in control file");
-
-			/*val = 1.23456789123456789123456789E+100;
-			val_str = cast_to_fixed_len_string(200, val, name);
-			pest_utils::convert_ip(val_str, val);
-
-			val = 1.23456789123456789123456789E+100;
-			val_str = cast_to_fixed_len_string(8, val, name);
-			pest_utils::convert_ip(val_str, val);
-
-			val = 1.23456789123456789123456789E-100;
-			val_str = cast_to_fixed_len_string(8, val, name);
-			pest_utils::convert_ip(val_str, val);
-
-			val = -1.23456789123456789123456789E+100;
-			val_str = cast_to_fixed_len_string(9, val, name);
-			pest_utils::convert_ip(val_str, val);
-
-			val = -1.23456789123456789123456789E-100;
-			val_str = cast_to_fixed_len_string(9, val, name);
-			pest_utils::convert_ip(val_str, val);
-
-			val = 1.23456789123456789123456789E+10;
-			val_str = cast_to_fixed_len_string(7, val, name);
-			pest_utils::convert_ip(val_str, val);
-
-			val = 1.23456789123456789123456789E-10;
-			val_str = cast_to_fixed_len_string(7, val, name);
-			pest_utils::convert_ip(val_str, val);
-
-			val = 1.23456789123456789123456789;
-			val_str = cast_to_fixed_len_string(1, val, name);
-			pest_utils::convert_ip(val_str, val);
-
-			val = -1.23456789123456789123456789;
-			val_str = cast_to_fixed_len_string(2, val, name);
-			pest_utils::convert_ip(val_str, val);
-			*/
-			try
+			auto it = par_slots.find(t.first);
+			if (it == par_slots.end())
 			{
-				val = pars.get_rec(t.first);
+				it = par_slots.insert(make_pair(t.first, (int)plan_par_names.size())).first;
+				plan_par_names.push_back(t.first);
 			}
-			catch (...)
+			pair<int, int> fmt(it->second, t.second.second);
+			auto fit = fmt_slots.find(fmt);
+			if (fit == fmt_slots.end())
 			{
-				throw_tpl_error("parameter '" + name + "' not in parameters instance");
+				fit = fmt_slots.insert(make_pair(fmt, (int)plan_fmts.size())).first;
+				plan_fmts.push_back(fmt);
 			}
-			val_str = cast_to_fixed_len_string(t.second.second, val, name);
-			line.replace(t.second.first, t.second.second, val_str);
-			//pest_utils::convert_ip(val_str, val);
-			val = stod(val_str);
-			pro_pars.insert(name, val);
+			TemplateField field;
+			field.offset = plan_image.size() + t.second.first;
+			field.width = t.second.second;
+			field.fmt_slot = fit->second;
+			plan_fields.push_back(field);
 		}
-		f_in << line << endl;
-		if (f_in.bad())
+		plan_image.append(line);
+		plan_image.push_back('\n');
+	}
+	f_tpl.close();
+	compiled = true;
+}
+
+void TemplateFile::write_input_file(const string& input_filename, const vector<double>& par_vals, vector<double>& pro_vals)
+{
+	if (!compiled)
+		compile();
+	if (par_vals.size() != plan_par_names.size())
+		throw_tpl_error("internal error: number of parameter values does not match compiled template");
+	//format each (parameter, width) pair once
+	vector<string> fmt_strs(plan_fmts.size());
+	pro_vals.assign(plan_par_names.size(), 0.0);
+	vector<char> pro_set(plan_par_names.size(), 0);
+	for (size_t i = 0; i < plan_fmts.size(); i++)
+	{
+		int slot = plan_fmts[i].first;
+		fmt_strs[i] = cast_to_fixed_len_string(plan_fmts[i].second, par_vals[slot], plan_par_names[slot]);
+	}
+	string image = plan_image;
+	for (auto& field : plan_fields)
+	{
+		const string& val_str = fmt_strs[field.fmt_slot];
+		memcpy(&image[field.offset], val_str.data(), field.width);
+		//the first field of each parameter sets the processed value
+		int slot = plan_fmts[field.fmt_slot].first;
+		if (!pro_set[slot])
 		{
-			throw_tpl_error("ofstream is bad after writing line '" + line + "'", line_num);
+			pro_vals[slot] = stod(val_str);
+			pro_set[slot] = 1;
 		}
 	}
-	f_tpl.close();
+	ofstream f_in(input_filename);
+	if (f_in.bad())
+		throw_tpl_error("couldn't open model input file '" + input_filename + "' for writing");
+	f_in.write(image.data(), image.size());
+	if (f_in.bad())
+	{
+		throw_tpl_error("ofstream is bad after writing model input file '" + input_filename + "'");
+	}
 	f_in.close();
 	if (f_in.bad())
 	{
 		throw_tpl_error("ofstream is bad after closing file, something is probably corrupt");
 	}
-	return pro_pars;
 }
 
 void TemplateFile::prep_tpl_file_for_reading(ifstream& f_tpl)
@@ -1095,22 +1031,265 @@ string InstructionFile::read_ins_line(ifstream& f_ins)
 }
 
 
-string InstructionFile::read_out_line(ifstream& f_out)
+const char* OutputLine::search(const char* hay, size_t n, const char* s, size_t sn)
+{
+	if (sn == 0)
+		return hay;
+	if (sn > n)
+		return nullptr;
+	const char* last = hay + (n - sn);
+	const char* p = hay;
+	while (p <= last)
+	{
+		p = (const char*)memchr(p, s[0], (last - p) + 1);
+		if (p == nullptr)
+			return nullptr;
+		if (memcmp(p + 1, s + 1, sn - 1) == 0)
+			return p;
+		p++;
+	}
+	return nullptr;
+}
+
+size_t OutputLine::find(const char* s, size_t n, size_t from) const
+{
+	if (from > len)
+		return string::npos;
+	if (n == 0)
+		return from;
+	const char* p = search(ptr + from, len - from, s, n);
+	if (p == nullptr)
+		return string::npos;
+	return p - ptr;
+}
+
+size_t OutputLine::find_first_of(const string& delims, size_t from) const
+{
+	for (size_t i = from; i < len; i++)
+		if (memchr(delims.data(), ptr[i], delims.size()) != nullptr)
+			return i;
+	return string::npos;
+}
+
+size_t OutputLine::find_first_not_of(const string& delims, size_t from) const
+{
+	for (size_t i = from; i < len; i++)
+		if (memchr(delims.data(), ptr[i], delims.size()) == nullptr)
+			return i;
+	return string::npos;
+}
+
+OutputLine OutputLine::substr(size_t pos, size_t count) const
+{
+	if (pos > len)
+		throw out_of_range("OutputLine::substr(): pos (" + to_string(pos) + ") > size (" + to_string(len) + ")");
+	if (count > len - pos)
+		count = len - pos;
+	return OutputLine(ptr + pos, count);
+}
+
+
+void OutputFileScanner::open(const string& filename)
+{
+	mf.open(filename);
+	mf.advise_sequential();
+	data = mf.data();
+	size = mf.size();
+	pos = 0;
+	at_eof = false;
+}
+
+void OutputFileScanner::close()
+{
+	mf.close();
+	data = nullptr;
+	size = 0;
+	pos = 0;
+	at_eof = false;
+}
+
+OutputLine OutputFileScanner::read_line()
+{
+	if (pos >= size)
+	{
+		//same as getline() at the end of a newline-terminated file: an empty line and eof
+		at_eof = true;
+		return OutputLine(data + size, 0);
+	}
+	const char* s = data + pos;
+	const char* nl = (const char*)memchr(s, '\n', size - pos);
+	size_t n;
+	if (nl == nullptr)
+	{
+		n = size - pos;
+		pos = size;
+		at_eof = true;
+	}
+	else
+	{
+		n = nl - s;
+		pos += n + 1;
+	}
+#ifdef OS_WIN
+	//the ifstream was opened in text mode, which drops the '\r' of a crlf
+	if ((n > 0) && (s[n - 1] == '\r'))
+		n--;
+#endif
+	return OutputLine(s, n);
+}
+
+bool OutputFileScanner::seek_line_containing(const string& tag, int& line_count)
+{
+	line_count = 0;
+	const char* s = data + pos;
+	size_t n = size - pos;
+	const char* hit = (pos >= size) ? nullptr : OutputLine::search(s, n, tag.data(), tag.size());
+	if ((hit == nullptr) && (!tag.empty()))
+	{
+		//every remaining line gets read looking for the tag, including the
+		//trailing empty one if the file ends with a newline
+		const char* p = s;
+		const char* e = data + size;
+		while ((p < e) && ((p = (const char*)memchr(p, '\n', e - p)) != nullptr))
+		{
+			line_count++;
+			p++;
+		}
+		line_count++;
+		pos = size;
+		at_eof = true;
+		return false;
+	}
+	if (hit == nullptr)
+		return true;
+	//back up to the start of the line holding the hit and count the lines in between
+	const char* line_start = hit;
+	while ((line_start > s) && (*(line_start - 1) != '\n'))
+		line_start--;
+	const char* p = s;
+	while ((p < line_start) && ((p = (const char*)memchr(p, '\n', line_start - p)) != nullptr))
+	{
+		line_count++;
+		p++;
+	}
+	pos = line_start - data;
+	return true;
+}
+
+bool OutputFileScanner::parse_double(const char* p, size_t n, double& value)
+{
+	static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const char* c = p;
+	const char* end = p + n;
+	while ((c < end) && isspace((unsigned char)*c))
+		c++;
+	bool neg = false;
+	if ((c < end) && ((*c == '-') || (*c == '+')))
+	{
+		neg = (*c == '-');
+		c++;
+	}
+	bool fast = true;
+	//hex floats are strtod() territory
+	if ((c + 1 < end) && (c[0] == '0') && ((c[1] == 'x') || (c[1] == 'X')))
+		fast = false;
+	uint64_t mant = 0;
+	int nsig = 0, exp10 = 0;
+	bool any_digit = false;
+	while (fast && (c < end) && (*c >= '0') && (*c <= '9'))
+	{
+		any_digit = true;
+		if ((mant != 0) || (*c != '0'))
+		{
+			if (nsig == 19)
+				fast = false;
+			mant = mant * 10 + (*c - '0');
+			nsig++;
+		}
+		c++;
+	}
+	if (fast && (c < end) && (*c == '.'))
+	{
+		c++;
+		while (fast && (c < end) && (*c >= '0') && (*c <= '9'))
+		{
+			any_digit = true;
+			if ((mant != 0) || (*c != '0'))
+			{
+				if (nsig == 19)
+					fast = false;
+				mant = mant * 10 + (*c - '0');
+				nsig++;
+			}
+			exp10--;
+			c++;
+		}
+	}
+	if (!any_digit)
+		fast = false;
+	if (fast && (c < end) && ((*c == 'e') || (*c == 'E')))
+	{
+		//the exponent only counts if at least one digit follows, same as strtod()
+		const char* ec = c + 1;
+		bool eneg = false;
+		if ((ec < end) && ((*ec == '-') || (*ec == '+')))
+		{
+			eneg = (*ec == '-');
+			ec++;
+		}
+		int e = 0;
+		bool any_edigit = false;
+		while ((ec < end) && (*ec >= '0') && (*ec <= '9'))
+		{
+			any_edigit = true;
+			if (e < 10000)
+				e = e * 10 + (*ec - '0');
+			ec++;
+		}
+		if (any_edigit)
+			exp10 += eneg ? -e : e;
+	}
+	if (fast)
+	{
+		if (mant == 0)
+		{
+			value = neg ? -0.0 : 0.0;
+			return true;
+		}
+		//both the mantissa and the power of ten are exact doubles, so a single
+		//multiply or divide gives the correctly rounded result
+		if ((mant <= (uint64_t(1) << 53)) && (exp10 >= -22) && (exp10 <= 22))
+		{
+			double v = (double)mant;
+			v = (exp10 < 0) ? v / pow10[-exp10] : v * pow10[exp10];
+			value = neg ? -v : v;
+			return true;
+		}
+	}
+	string temp(p, n);
+	char* tend;
+	errno = 0;
+	double v = strtod(temp.c_str(), &tend);
+	if ((tend == temp.c_str()) || (errno == ERANGE))
+		return false;
+	value = v;
+	return true;
+}
+
+
+OutputLine InstructionFile::read_out_line(OutputFileScanner& f_out)
 {
-	if (f_out.bad())
-		throw_ins_error("cant read next output file line", ins_line_num, out_line_num);
-	string line;
 	if (f_out.eof())
 		throw_ins_error("unexpected output file eof ", ins_line_num, out_line_num);
-	getline(f_out, line);
-	last_out_line = line;
+	last_out_line = f_out.read_line();
 	out_line_num++;
-	return line;
+	return last_out_line;
 }
 
 
-InstructionFile::InstructionFile(string _ins_filename, string _addtitional_delimiters): ins_filename(_ins_filename), ins_line_num(0),
-out_line_num(0),last_ins_line(""),last_out_line(""), additional_delimiters(_addtitional_delimiters)
+InstructionFile::InstructionFile(string _ins_filename, string _addtitional_delimiters): compiled(false), ins_filename(_ins_filename), ins_line_num(0),
+out_line_num(0),last_ins_line(""), additional_delimiters(_addtitional_delimiters)
 {
 	obs_tags.push_back(pair<char, char>('(', ')'));
 	obs_tags.push_back(pair<char, char>('[', ']'));	
@@ -1184,107 +1363,190 @@ void InstructionFile::prep_ins_file_for_reading(ifstream& f_ins)
 
 Observations InstructionFile::read_output_file(const string& output_filename)
 {
-	if (!pest_utils::check_exist_in(output_filename))
-		throw_ins_error("output file'" + output_filename + "' not found");
-	ifstream f_ins(ins_filename);
-	ifstream f_out(output_filename);
-	prep_ins_file_for_reading(f_ins);
-	if (f_out.bad())
+	if (!compiled)
+		compile();
+	vector<double> obs_vals;
+	read_output_file(output_filename, obs_vals);
+	Observations obs;
+	obs.insert(plan_obs_names, obs_vals);
+	return obs;
+}
+
+InstructionFile::Instruction InstructionFile::compile_token(const string& token, int itoken, unordered_map<string, int>& obs_slots)
+{
+	Instruction ins;
+	ins.token = token;
+	ins.count = 0;
+	ins.start = 0;
+	ins.end = 0;
+	ins.obs_slot = -1;
+	string name;
+	if (token[0] == 'L')
+	{
+		ins.type = Instruction::Type::LINE_ADVANCE;
+		try
+		{
+			ins.count = stoi(token.substr(1));
+		}
+		catch (...)
+		{
+			throw_ins_error("error casting line advance instruction '" + token + "'", ins_line_num);
+		}
+		if (ins.count < 1)
+			throw_ins_error("line advance instruction error: number of lines must be greater or equal to 1, not '" + token.substr(1) + "'", ins_line_num);
+	}
+	else if (token[0] == 'W')
+	{
+		ins.type = Instruction::Type::WHITESPACE;
+	}
+	else if ((token[0] == '[') || (token[0] == '('))
+	{
+		bool fixed = token[0] == '[';
+		ins.type = fixed ? Instruction::Type::FIXED : Instruction::Type::SEMI;
+		pair<string, pair<int, int>> info = parse_obs_instruction(token, fixed ? "]" : ")");
+		name = info.first;
+		ins.start = info.second.first;
+		ins.end = info.second.second;
+	}
+	else if (token[0] == '!')
+	{
+		ins.type = Instruction::Type::FREE;
+		name = token.substr(1, token.size() - 2);
+	}
+	else if (token[0] == marker)
 	{
-		throw_ins_error("can't open output file'" + output_filename + "' for reading");
+		if (token.size() == 1)
+		{
+			throw_ins_error("markers with spaces not supported...", ins_line_num);
+		}
+		//if this is the first instruction, its a primary search
+		ins.type = (itoken == 0) ? Instruction::Type::PRIMARY : Instruction::Type::SECONDARY;
+		if (token.substr(token.size() - 1, 1) != string(1, marker))
+		{
+			if (itoken == 0)
+				throw_ins_error("primary marker token '" + token + "' doesn't have a closing marker char", ins_line_num);
+			else
+				throw_ins_error("secondary marker token '" + token + "' doesnt have a closing marker char");
+		}
+		ins.tag = token.substr(1, token.size() - 2);
 	}
-	string ins_line, out_line;
+	else
+	{
+		throw_ins_error("unrecognized instruction '" + token + "'", ins_line_num);
+	}
+	//repeated names keep the first value read, dum values are discarded
+	if ((name.size() > 0) && (name != "DUM") && (obs_slots.find(name) == obs_slots.end()))
+	{
+		ins.obs_slot = plan_obs_names.size();
+		obs_slots[name] = ins.obs_slot;
+		plan_obs_names.push_back(name);
+	}
+	return ins;
+}
+
+void InstructionFile::compile()
+{
+	ifstream f_ins(ins_filename);
+	ins_line_num = 0;
+	out_line_num = 0;
+	prep_ins_file_for_reading(f_ins);
+	string ins_line;
 	vector<string> tokens;
-	Observations obs;
-	pair<string, double> lhs;
+	unordered_map<string, int> obs_slots;
+	plan.clear();
+	plan_obs_names.clear();
 	while (true)
 	{
 		if (f_ins.eof())
 			break;
-		tokens.clear();
 		ins_line = read_ins_line(f_ins);
 		tokens = tokenize_ins_line(ins_line);
+		if (tokens.size() == 0)
+			continue;
 		//check that the first token is either a marker or a line advance
-		if (tokens.size() > 0)
+		char first = tokens[0][0];
+		if ((first != 'L') && (first != marker))
 		{
-			char first = tokens[0][0];
-			if ((first != 'L') && (first != marker))
-			{
-				stringstream ss;
-				ss << "first token on each instruction file line must be either a primary marker ";
-				ss << " or a line advance instruction, not '" << tokens[0] << "'";
-				throw_ins_error(ss.str());
-			}
+			stringstream ss;
+			ss << "first token on each instruction file line must be either a primary marker ";
+			ss << " or a line advance instruction, not '" << tokens[0] << "'";
+			throw_ins_error(ss.str());
 		}
-		//int itoken = 0;
+		InstructionLine iline;
+		iline.ins_line_num = ins_line_num;
+		iline.ins_line = ins_line;
+		for (int itoken = 0; itoken < tokens.size(); itoken++)
+			iline.instructions.push_back(compile_token(tokens[itoken], itoken, obs_slots));
+		plan.push_back(iline);
+	}
+	f_ins.close();
+	compiled = true;
+}
+
+void InstructionFile::read_output_file(const string& output_filename, vector<double>& obs_vals)
+{
+	if (!compiled)
+		compile();
+	if (!pest_utils::check_exist_in(output_filename))
+		throw_ins_error("output file'" + output_filename + "' not found");
+	OutputFileScanner f_out;
+	try
+	{
+		f_out.open(output_filename);
+	}
+	catch (exception& e)
+	{
+		throw_ins_error("can't open output file'" + output_filename + "' for reading: " + e.what());
+	}
+	out_line_num = 0;
+	last_out_line = OutputLine();
+	obs_vals.assign(plan_obs_names.size(), 0.0);
+	OutputLine out_line;
+	double value;
+	for (auto& iline : plan)
+	{
+		ins_line_num = iline.ins_line_num;
+		last_ins_line = iline.ins_line;
+		const vector<Instruction>& instructions = iline.instructions;
 		bool all_markers_so_far = true;
-		//for (auto token : tokens)
-		for (int itoken=0;itoken<tokens.size();itoken++)
+		for (int itoken = 0; itoken < instructions.size(); itoken++)
 		{
-			string token = tokens[itoken];
-
-			if (token[0] == 'L')
+			const Instruction& ins = instructions[itoken];
+			switch (ins.type)
 			{
-				execute_line_advance(token, out_line, f_out);
-			}
-			else if (token[0] == 'W')
-			{
-				execute_whitespace(token, out_line, f_out);
-			}
-			else if (token[0] == '[')
-			{
-				lhs = execute_fixed(token, out_line, f_out);
-				if (lhs.first != "DUM")
-					obs.insert(lhs.first,lhs.second);
-				all_markers_so_far = false;
-			}
-			else if (token[0] == '!')
-			{
-				lhs = execute_free(token, out_line, f_out);
-				if (lhs.first != "DUM")
-					obs.insert(lhs.first, lhs.second);
-				all_markers_so_far = false;
-			}
-			else if (token[0] == '(')
-			{
-				lhs = execute_semi(token, out_line, f_out);
-				if (lhs.first != "DUM")
-					obs.insert(lhs.first, lhs.second);
-				all_markers_so_far = false;
-			}
-			else if (token[0] == marker)
-			{
-				if (token.size() == 1)
-				{
-					throw_ins_error("markers with spaces not supported...", ins_line_num);
-				}
-				//if this is the first instruction, its a primary search
-				//if (token == tokens[0])
-				if (itoken == 0)
-				{
-					execute_primary(token, out_line, f_out);
-				}
+			case Instruction::Type::LINE_ADVANCE:
+				execute_line_advance(ins, out_line, f_out);
+				break;
+			case Instruction::Type::WHITESPACE:
+				execute_whitespace(ins, out_line, f_out);
+				break;
+			case Instruction::Type::FIXED:
+			case Instruction::Type::SEMI:
+			case Instruction::Type::FREE:
+				if (ins.type == Instruction::Type::FIXED)
+					value = execute_fixed(ins, out_line, f_out);
+				else if (ins.type == Instruction::Type::SEMI)
+					value = execute_semi(ins, out_line, f_out);
 				else
+					value = execute_free(ins, out_line, f_out);
+				if (ins.obs_slot >= 0)
+					obs_vals[ins.obs_slot] = value;
+				all_markers_so_far = false;
+				break;
+			case Instruction::Type::PRIMARY:
+				execute_primary(ins, out_line, f_out);
+				break;
+			case Instruction::Type::SECONDARY:
+				if (execute_secondary(ins, out_line, f_out, all_markers_so_far))
 				{
-					bool rewind = execute_secondary(token, out_line, f_out, all_markers_so_far);
-					if (rewind)
-					{
-						itoken = -1; //-1 so that when the for loop increments we are back to zero
-						continue;
-					}
-
+					itoken = -1; //-1 so that when the for loop increments we are back to zero
+					continue;
 				}
+				break;
 			}
-			else
-			{
-				throw_ins_error("unrecognized instruction '" + token + "'", ins_line_num);
-			}
-			//itoken++;
 		}
 	}
-	f_ins.close();
 	f_out.close();
-	return obs;	
 }
 
 
@@ -1420,116 +1682,96 @@ pair<string, pair<int, int>> InstructionFile::parse_obs_instruction(const string
 	return pair<string, pair<int, int>>(name,se);
 }
 
-pair<string, double> InstructionFile::execute_fixed(const string& token, string& line, ifstream& f_out)
+double InstructionFile::execute_fixed(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out)
 {
-	string temp;
+	const string& token = ins.token;
+	OutputLine temp;
 	double value;
-	pair<string, pair<int, int>> info = parse_obs_instruction(token, "]");
+	int s = ins.start, e = ins.end;
 	//use the raw last_out_line since "line" has been getting progressively truncated
-	if (last_out_line.size() < info.second.second)
+	if (last_out_line.size() < e)
 	{
 		//throw_ins_error("output line not long enough for fixed obs instruction '" + token + "',");
-		info.second.second = last_out_line.size();
-	}
-	int len = (info.second.second - info.second.first) + 1;
-	temp = last_out_line.substr(info.second.first, len);
-	try
-	{
-		//pest_utils::convert_ip(temp, value);
-		value = stod(temp);
+		e = last_out_line.size();
 	}
-	catch (...)
+	int len = (e - s) + 1;
+	temp = last_out_line.substr(s, len);
+	if (!OutputFileScanner::parse_double(temp, value))
 	{
-		throw_ins_error("error casting fixed observation instruction '" + token + "' from output string '" + temp + "' on line '" + line + "'",ins_line_num, out_line_num);
+		throw_ins_error("error casting fixed observation instruction '" + token + "' from output string '" + temp.str() + "' on line '" + line.str() + "'",ins_line_num, out_line_num);
 	}
-	int pos = line.find(temp);
+	size_t pos = line.find(temp);
 	if (pos == string::npos)
-		throw_ins_error("internal error: string t: '"+temp+"' not found in line: '"+line+"'",ins_line_num,out_line_num);
+		throw_ins_error("internal error: string t: '"+temp.str()+"' not found in line: '"+line.str()+"'",ins_line_num,out_line_num);
 	if ((value != 0.0) && (!isnormal(value)))
 	{
-		throw_ins_error("casting '" + temp + "' to double yielded denormal value on line '" + line + "' for fixed observation instruction '" + token + "'", ins_line_num, out_line_num);
+		throw_ins_error("casting '" + temp.str() + "' to double yielded denormal value on line '" + line.str() + "' for fixed observation instruction '" + token + "'", ins_line_num, out_line_num);
 	}
 	line = line.substr(pos + temp.size());
 	
-	return pair<string, double>(info.first,value);
+	return value;
 }
 
-pair<string, double> InstructionFile::execute_semi(const string& token, string& line, ifstream& f_out)
+double InstructionFile::execute_semi(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out)
 {
-	string temp;
-	vector<string> tokens;
+	const string& token = ins.token;
+	OutputLine temp;
 	double value;
-	pair<string, pair<int, int>> info = parse_obs_instruction(token, ")");
+	int s = ins.start, e = ins.end;
 	//use the raw last_out_line since "line" has been getting progressively truncated
-	if (last_out_line.size() < info.second.second)
+	if (last_out_line.size() < e)
 	{
 		//throw_ins_error("output line not long enough for semi-fixed obs instruction '" + token + "',");
-		info.second.second = last_out_line.size();
+		e = last_out_line.size();
 	}
 
-	int len = (info.second.second - info.second.first) + 1;
-	int pos = last_out_line.find_first_not_of(", \t\n\r"+additional_delimiters, info.second.first); //include the comma here for csv files
+	int pos = last_out_line.find_first_not_of(", \t\n\r"+additional_delimiters, s); //include the comma here for csv files
 	if (pos == string::npos)
-		throw_ins_error("EOL encountered when looking for non-whitespace char in semi-fixed instruction '" + token + "' on line: '" + line + "'",ins_line_num,out_line_num);
-	if (pos > info.second.second)
-		throw_ins_error("no non-whitespace char found before end index in semi-fixed instruction '" + token + "' on line: '" + line + "'", ins_line_num,out_line_num);
-	pest_utils::tokenize(last_out_line.substr(pos), tokens);
-	temp = tokens[0];
-	try
-	{
-		//pest_utils::convert_ip(temp, value);
-		value = stod(temp);
-	}
-	catch (...)
-	{
-		throw_ins_error("error casting string '" + temp + "' to double for semi-fixed instruction '" + token + "' on line: '" + line + "'", ins_line_num, out_line_num);
-	}
-	pos = line.find(temp);
-	if (pos == string::npos)
-		throw_ins_error("internal error: temp '" + temp + "' not found in line: '" + line + "'", ins_line_num, out_line_num);
+		throw_ins_error("EOL encountered when looking for non-whitespace char in semi-fixed instruction '" + token + "' on line: '" + line.str() + "'",ins_line_num,out_line_num);
+	if (pos > e)
+		throw_ins_error("no non-whitespace char found before end index in semi-fixed instruction '" + token + "' on line: '" + line.str() + "'", ins_line_num,out_line_num);
+	//the value runs from pos to the next whitespace
+	temp = last_out_line.substr(pos);
+	temp = temp.substr(0, temp.find_first_of(" \t\n\r"));
+	if (!OutputFileScanner::parse_double(temp, value))
+	{
+		throw_ins_error("error casting string '" + temp.str() + "' to double for semi-fixed instruction '" + token + "' on line: '" + line.str() + "'", ins_line_num, out_line_num);
+	}
+	size_t tpos = line.find(temp);
+	if (tpos == string::npos)
+		throw_ins_error("internal error: temp '" + temp.str() + "' not found in line: '" + line.str() + "'", ins_line_num, out_line_num);
 	if ((value != 0.0) && (!isnormal(value)))
 	{
-		throw_ins_error("casting '" + temp + "' to double yielded denormal value for semi-fixed instruction '" + token + "' on line: '" + line + "'", ins_line_num, out_line_num);
+		throw_ins_error("casting '" + temp.str() + "' to double yielded denormal value for semi-fixed instruction '" + token + "' on line: '" + line.str() + "'", ins_line_num, out_line_num);
 	}
-	line = line.substr(pos + temp.size());
-	return pair<string, double>(info.first,value);
+	line = line.substr(tpos + temp.size());
+	return value;
 }
 
 
 
-pair<string, double> InstructionFile::execute_free(const string& token, string& line, ifstream& f_out)
+double InstructionFile::execute_free(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out)
 {
-	int tsize = line.size() / 20;
-	if (tsize > 50)
-		tsize = 50;
-	vector<string> tokens;
-	tokens.reserve(tsize);
-	tokenize(line, tokens,", \t\n\r" + additional_delimiters) ; //include the comma in the delimiters here
-	if (tokens.size() == 0)
-		throw_ins_error("error tokenizing output line ('"+last_out_line+"') for free instruction '"+token+"' on line: " +last_ins_line, ins_line_num, out_line_num);
+	const string& token = ins.token;
+	string delims = ", \t\n\r" + additional_delimiters; //include the comma in the delimiters here
+	//the first token is the first run of non-delimiter chars
+	size_t tpos = line.find_first_not_of(delims);
+	if (tpos == string::npos)
+		throw_ins_error("error tokenizing output line ('"+last_out_line.str()+"') for free instruction '"+token+"' on line: " +last_ins_line, ins_line_num, out_line_num);
+	OutputLine temp = line.substr(tpos);
+	temp = temp.substr(0, temp.find_first_of(delims));
 	double value;
-	try
-	{
-		//pest_utils::convert_ip(tokens[0], value);
-		value = stod(tokens[0]);
-	}
-	catch (...)
-	{
-		throw_ins_error("error converting '" + tokens[0] + "' to double on output line '" + last_out_line + "' for free instruciton: '"+token+"'", ins_line_num, out_line_num);
-	}
-	string name = token.substr(1, token.size() - 2);
-	int pos = line.find(tokens[0]);
-	if (pos == string::npos)
+	if (!OutputFileScanner::parse_double(temp, value))
 	{
-		throw_ins_error("internal error: could not find free obs token '"+tokens[0]+"'", ins_line_num, out_line_num);
+		throw_ins_error("error converting '" + temp.str() + "' to double on output line '" + last_out_line.str() + "' for free instruciton: '"+token+"'", ins_line_num, out_line_num);
 	}
 	if ((value != 0.0) && (!isnormal(value)))
 	{
-		throw_ins_error("casting '" + tokens[0] + "' to double yielded denormal value for free instruction: '" + token + "' on line: '" + line + "'", ins_line_num, out_line_num);
+		throw_ins_error("casting '" + temp.str() + "' to double yielded denormal value for free instruction: '" + token + "' on line: '" + line.str() + "'", ins_line_num, out_line_num);
 	}
-	line = line.substr(pos + tokens[0].size());
+	line = line.substr(tpos + temp.size());
 
-	return pair<string, double>(name,value);
+	return value;
 }
 
 void InstructionFile::tokenize(const std::string& str, vector<string>& tokens, const std::string& delimiters, const bool trimEmpty)
@@ -1557,39 +1799,33 @@ void InstructionFile::tokenize(const std::string& str, vector<string>& tokens, c
 	}
 }
 
-void InstructionFile::execute_primary(const string& token, string& line, ifstream& f_out)
+void InstructionFile::execute_primary(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out)
 {
-	//check that a closing marker is found
-	//this shouldnt be a prob,but good to check
-	if (token.substr(token.size()-1,1) != string(1,marker))
-		throw_ins_error("primary marker token '" + token + "' doesn't have a closing marker char", ins_line_num);
-	int pos;
-	string primary_tag = token.substr(1, token.size() - 2);
-	while (true)
-	{
-		if (f_out.eof())
-			throw_ins_error("EOF encountered while executing marker search ('" + token + "')", ins_line_num, out_line_num);
-		line = read_out_line(f_out);
-		pos = line.find(primary_tag);
-		if (pos != string::npos)
-		{
-			break;
-		}
-	}
+	//the closing marker was checked when the plan was compiled
+	const string& token = ins.token;
+	const string& primary_tag = ins.tag;
+	if (f_out.eof())
+		throw_ins_error("EOF encountered while executing marker search ('" + token + "')", ins_line_num, out_line_num);
+	//search the rest of the file in one pass instead of line by line
+	int skipped;
+	bool found = f_out.seek_line_containing(primary_tag, skipped);
+	out_line_num += skipped;
+	if (!found)
+		throw_ins_error("EOF encountered while executing marker search ('" + token + "')", ins_line_num, out_line_num);
+	line = read_out_line(f_out);
+	size_t pos = line.find(primary_tag);
+	if (pos == string::npos)
+		throw_ins_error("internal error: primary marker '" + primary_tag + "' not found in line: '" + line.str() + "'", ins_line_num, out_line_num);
 	pos = pos + primary_tag.size();
 	line = line.substr(pos);
 	return;
 }
 
 
-bool InstructionFile::execute_secondary(const string& token, string& line, ifstream& f_out, bool all_markers_so_far)
+bool InstructionFile::execute_secondary(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out, bool all_markers_so_far)
 {
-	//check that a closing marker is found
-	int pos;
-	if (token.substr(token.size()-1,1) != string(1,marker))
-		throw_ins_error("secondary marker token '" + token + "' doesnt have a closing marker char");
-	string secondary_tag = token.substr(1, token.size()-2);
-	pos = line.find(secondary_tag);
+	const string& secondary_tag = ins.tag;
+	size_t pos = line.find(secondary_tag);
 	if (pos == string::npos)
 	{
 		if (all_markers_so_far)
@@ -1602,11 +1838,11 @@ bool InstructionFile::execute_secondary(const string& token, string& line, ifstr
 }
 
 
-void InstructionFile::execute_whitespace(const string& token, string& line, ifstream& f_out)
+void InstructionFile::execute_whitespace(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out)
 {
 	string delims = " \t" + additional_delimiters;
 
-	int pos = line.find_first_not_of(delims);
+	size_t pos = line.find_first_not_of(delims);
 	if (pos == string::npos)
 	{
 		throw_ins_error("EOL encountered while executing whitespace instruction on output line", ins_line_num, out_line_num);
@@ -1615,14 +1851,12 @@ void InstructionFile::execute_whitespace(const string& token, string& line, ifst
 	//the search
 	if (pos == 0)
 	{
-		vector<string> tokens;
-		pest_utils::tokenize(line, tokens, delims);
-		pos = line.find(tokens[0]);
+		pos = line.find_first_of(delims);
 		if (pos == string::npos)
 		{
-			throw_ins_error("internal error in execute_whitespace: couldnt find first token");
+			throw_ins_error("EOL encountered while executing whitespace instruction on output line", ins_line_num, out_line_num);
 		}
-		line = line.substr(pos + tokens[0].size());
+		line = line.substr(pos);
 		pos = line.find_first_not_of(delims);
 		if (pos == string::npos)
 		{
@@ -1634,20 +1868,11 @@ void InstructionFile::execute_whitespace(const string& token, string& line, ifst
 }
 
 
-void InstructionFile::execute_line_advance(const string& token, string& line, ifstream& f_out)
+void InstructionFile::execute_line_advance(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out)
 {
-	stringstream ss;
-	int num;
-	//pest_utils::convert_ip(token.substr(1), num);
-	num = stoi(token.substr(1));
-	if (num < 1)
-		throw_ins_error("line advance instruction error: number of lines must be greater or equal to 1, not '" + token.substr(1) + "'",ins_line_num,out_line_num);
+	int num = ins.count;
 	for (int i = 0; i < num; i++)
 	{
-		if (f_out.bad())
-		{	
-			throw_ins_error("'bad' stream when executing line advance instruction", ins_line_num, out_line_num);
-		}
 		if (f_out.eof())
 		{
 			throw_ins_error("EOF encountered when executing line advance instruction", ins_line_num, out_line_num);
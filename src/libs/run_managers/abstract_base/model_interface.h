@@ -4,10 +4,14 @@
 #include <vector>
 #include <string>
 #include <unordered_set>
+#include <unordered_map>
 #include <mutex>
+#include <memory>
 #include "Transformable.h"
 #include "utilities.h"
 #include "Pest.h"
+#include "mapped_file.h"
+#include "model_plugin.h"
 
 using namespace std;
 
@@ -15,13 +19,28 @@ class TemplateFile {
 public:
 	static vector<int> find_all_marker_indices(const string& line, const string& marker);
 	TemplateFile(string _tpl_filename, bool _fill_zeros=false): tpl_filename(_tpl_filename),line_num(0),
-	fill_zeros(_fill_zeros){ ; }
+	fill_zeros(_fill_zeros), compiled(false){ ; }
 	unordered_set<string> parse_and_check();
 	Parameters write_input_file(const string& input_filename, Parameters& pars);
+	//parse the template once into a plan: the output image plus the offset, width and
+	//parameter slot of every field
+	void compile();
+	bool is_compiled() const { return compiled; }
+	//parameter names referenced by the compiled plan, in slot order
+	const vector<string>& get_plan_par_names() const { return plan_par_names; }
+	//write the input file from the compiled plan.  par_vals holds one value per plan slot;
+	//the values actually written (after fixed-width formatting) are returned in pro_vals
+	void write_input_file(const string& input_filename, const vector<double>& par_vals, vector<double>& pro_vals);
 	void throw_tpl_error(const string& message, int lnum=0, bool warn=false);
 	void set_fill_zeros(bool _flag) { fill_zeros = _flag; }
 	string get_tpl_filename() { return tpl_filename; }
 private:
+	struct TemplateField
+	{
+		size_t offset;
+		int width;
+		int fmt_slot;
+	};
 	int line_num;
 	string marker;
 	string tpl_filename;
@@ -31,55 +50,126 @@ private:
 	void prep_tpl_file_for_reading(ifstream& f_tpl);
 	unordered_set<string> get_names(ifstream& f);
 	bool fill_zeros;
+	bool compiled;
+	string plan_image;
+	vector<TemplateField> plan_fields;
+	vector<string> plan_par_names;
+	//unique (parameter slot, width) pairs, so each is formatted once per run
+	vector<pair<int, int>> plan_fmts;
 	
 };
 
-class ThreadedTemplateProcess {
+class OutputLine
+{
+	// Non-owning view of (part of) one line of a memory-mapped model output file.  It
+	// mirrors the bits of std::string the instruction routines use, so output lines are
+	// never copied while an instruction file is executed
 public:
-	ThreadedTemplateProcess(vector<string> _tplfile_vec, vector<string> _inpfile_vec, bool _fill) : 
-		tplfile_vec(_tplfile_vec), inpfile_vec(_inpfile_vec), fill(_fill) {;};
-	void work(int tid, vector<int>& tpl_idx, Parameters pars, Parameters& pro_pars);
+	OutputLine() : ptr(nullptr), len(0) { ; }
+	OutputLine(const char* _ptr, size_t _len) : ptr(_ptr), len(_len) { ; }
+	const char* data() const { return ptr; }
+	size_t size() const { return len; }
+	bool empty() const { return len == 0; }
+	string str() const { return string(ptr, len); }
+	size_t find(const char* s, size_t n, size_t from = 0) const;
+	size_t find(const string& s, size_t from = 0) const { return find(s.data(), s.size(), from); }
+	size_t find(const OutputLine& s, size_t from = 0) const { return find(s.data(), s.size(), from); }
+	size_t find_first_of(const string& delims, size_t from = 0) const;
+	size_t find_first_not_of(const string& delims, size_t from = 0) const;
+	//throws out_of_range when pos > size(), same as string::substr()
+	OutputLine substr(size_t pos, size_t count = string::npos) const;
+	//search [hay, hay+n) for the first occurrence of s (memchr on the first byte, then memcmp)
+	static const char* search(const char* hay, size_t n, const char* s, size_t sn);
 private:
-	vector<string> tplfile_vec;
-	vector<string> inpfile_vec;
-	bool fill;
-	mutex par_lock, idx_lock;
+	const char* ptr;
+	size_t len;
 };
 
-class ThreadedInstructionProcess {
+class OutputFileScanner
+{
+	// Line reader over a memory-mapped model output file.  read_line() has getline()
+	// semantics (the newline is dropped, the last line need not be terminated and eof()
+	// is set once the end of the file has been consumed), so the instruction line
+	// counting and eof handling are unchanged from reading through an ifstream
 public:
-	ThreadedInstructionProcess(vector<string> _insfile_vec, vector<string> _outfile_vec) :
-		insfile_vec(_insfile_vec), outfile_vec(_outfile_vec){;};
-	void work(int tid, vector<int>& ins_idx, Observations& obs, string additional_ins_delims);
+	OutputFileScanner() : data(nullptr), size(0), pos(0), at_eof(false) { ; }
+	void open(const string& filename);
+	void close();
+	bool eof() const { return at_eof; }
+	OutputLine read_line();
+	//position the scanner at the start of the first remaining line that contains tag,
+	//searching the whole remaining view at once rather than line by line.  line_count
+	//receives the number of lines skipped over.  if no line contains tag, false is
+	//returned with the scanner at eof and line_count holding the lines read to get there
+	bool seek_line_containing(const string& tag, int& line_count);
+	//stod()-compatible parse of the leading number in [p, p+n): leading whitespace is
+	//skipped, trailing characters are ignored and false is returned where stod() would
+	//throw.  short decimal strings are converted exactly without a copy; everything else
+	//(long mantissas, large exponents, inf/nan, hex) falls back to strtod()
+	static bool parse_double(const char* p, size_t n, double& value);
+	static bool parse_double(const OutputLine& s, double& value) { return parse_double(s.data(), s.size(), value); }
 private:
-	vector<string> insfile_vec;
-	vector<string> outfile_vec;
-	mutex obs_lock, idx_lock;
+	MappedFile mf;
+	const char* data;
+	size_t size;
+	size_t pos;
+	bool at_eof;
 };
 
-
 class InstructionFile {
 	
 public:
 	InstructionFile(string _ins_filename, string _additional_delimiters="");
 	unordered_set<string> parse_and_check();
 	Observations read_output_file(const string& output_filename);
+	//parse the instruction file once into a plan of pre-tokenized, pre-parsed instructions
+	void compile();
+	bool is_compiled() const { return compiled; }
+	//observation names read by the compiled plan, in slot order
+	const vector<string>& get_plan_obs_names() const { return plan_obs_names; }
+	//execute the compiled plan against an output file, one value per plan slot
+	void read_output_file(const string& output_filename, vector<double>& obs_vals);
 	void set_additional_delimiters(string delims) { additional_delimiters = delims; }
 private:
+	struct Instruction
+	{
+		enum class Type { LINE_ADVANCE, PRIMARY, SECONDARY, WHITESPACE, FIXED, SEMI, FREE };
+		Type type;
+		string token;
+		//marker search text
+		string tag;
+		//line advance count
+		int count;
+		//0-based column range of fixed and semi-fixed observations
+		int start, end;
+		//plan slot of the observation value, -1 for dum and repeated names
+		int obs_slot;
+	};
+	struct InstructionLine
+	{
+		int ins_line_num;
+		string ins_line;
+		vector<Instruction> instructions;
+	};
+	bool compiled;
+	vector<InstructionLine> plan;
+	vector<string> plan_obs_names;
 	int ins_line_num, out_line_num;
 	char marker;
-	string ins_filename, last_out_line, last_ins_line;
+	string ins_filename, last_ins_line;
+	OutputLine last_out_line;
 	vector<pair<char, char>> obs_tags;
-	pair<string, double> execute_fixed(const string& token, string& line, ifstream& f_out);
-	pair<string, double> execute_semi(const string& token, string& line, ifstream& f_out);
-	pair<string, double> execute_free(const string& token, string& line, ifstream& f_out);
-	void execute_primary(const string& token, string& line, ifstream& f_out);
-	bool execute_secondary(const string& token, string& line, ifstream& f_out,bool all_markers_so_far);
-	void execute_whitespace(const string& token, string& line, ifstream& f_out);
-	void execute_line_advance(const string& token, string& line, ifstream& f_out);
+	double execute_fixed(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out);
+	double execute_semi(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out);
+	double execute_free(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out);
+	void execute_primary(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out);
+	bool execute_secondary(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out,bool all_markers_so_far);
+	void execute_whitespace(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out);
+	void execute_line_advance(const Instruction& ins, OutputLine& line, OutputFileScanner& f_out);
+	Instruction compile_token(const string& token, int itoken, unordered_map<string, int>& obs_slots);
 	void prep_ins_file_for_reading(ifstream& f_ins);
 	string read_ins_line(ifstream& f_ins);
-	string read_out_line(ifstream& f_out);
+	OutputLine read_out_line(OutputFileScanner& f_out);
 	void throw_ins_error(const string& message, int ins_lnum = 0, int out_lnum=0, bool warn = false);
 	string parse_obs_name_from_token(const string& token);
 	vector<string> tokenize_ins_line(const string& line);
@@ -94,12 +184,13 @@ private:
 
 class ModelInterface{
 public:
-	ModelInterface() { ; }
+	ModelInterface() : fill_tpl_zeros(false), num_threads(10), ins_names_checked(false) { ; }
 	//ModelInterface(Pest* _pest_scenario_ptr) { pest_scenario_ptr = _pest_scenario_ptr; }
 	ModelInterface(vector<string> _tplfile_vec, vector<string> _inpfile_vec, vector<string>
 		_insfile_vec, vector<string> _outfile_vec, vector<string> _comline_vec) :
 		insfile_vec(_insfile_vec), outfile_vec(_outfile_vec), tplfile_vec(_tplfile_vec),
-		inpfile_vec(_inpfile_vec), comline_vec(_comline_vec), fill_tpl_zeros(false), additional_ins_delimiters("") {;}
+		inpfile_vec(_inpfile_vec), comline_vec(_comline_vec), fill_tpl_zeros(false), additional_ins_delimiters(""),
+		num_threads(10), ins_names_checked(false) {;}
 	void throw_mio_error(string base_message);
 	void run(Parameters* pars, Observations* obs);
 	void run(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished,
@@ -107,8 +198,22 @@ public:
 		Parameters* par, Observations* obs);
 	void check_io_access();
 	void check_tplins(const vector<string> &par_names, const vector<string> &obs_names);
-	void set_additional_ins_delimiters(string delims) { additional_ins_delimiters = delims; }
-	void set_fill_tpl_zeros(bool _flag) { fill_tpl_zeros = _flag; }
+	void set_additional_ins_delimiters(string delims);
+	void set_fill_tpl_zeros(bool _flag);
+	//number of threads used to write template files and read instruction files
+	void set_num_threads(int _num_threads) { num_threads = _num_threads; }
+	//evaluate runs in-process through a model plugin shared library instead of writing
+	//the templates, running the commands and reading the instruction files.  the names
+	//set the order of the values passed to and from the plugin
+	void set_model_plugin(const string& filename, const string& config,
+		const vector<string>& par_names, const vector<string>& obs_names);
+	bool has_model_plugin() const { return (plugin) && (plugin->is_loaded()); }
+	shared_ptr<ModelPlugin> get_model_plugin() { return plugin; }
+	//run the model commands in work_dir and write/read the relative model input and
+	//output files there.  template and instruction files are still read from their
+	//given paths, so an already-compiled interface can be copied for each work dir
+	void set_work_dir(const string& dir);
+	const string& get_work_dir() const { return work_dir; }
 
 private:
 	//Pest* pest_scenario_ptr;
@@ -119,11 +224,24 @@ private:
 	vector<string> outfile_vec; 
 	vector<string> tplfile_vec; 
 	vector<string> comline_vec; 
+	string work_dir;
 	bool fill_tpl_zeros;
 	string additional_ins_delimiters;
+	int num_threads;
+	//union of the names used by the compiled plans and, per file, the union index of each plan slot
+	vector<string> plan_par_names;
+	vector<vector<int>> tpl_slots;
+	vector<string> plan_obs_names;
+	vector<vector<int>> ins_slots;
+	bool ins_names_checked;
+	//shared so that ModelInterface stays copyable
+	shared_ptr<ModelPlugin> plugin;
 
+	void compile_templates();
+	void compile_instructions();
 	void write_input_files(Parameters *pars_ptr);
 	void read_output_files(Observations *obs_ptr);
+	void run_model_plugin(Parameters *pars_ptr, Observations *obs_ptr);
 	void remove_existing();
 
 };
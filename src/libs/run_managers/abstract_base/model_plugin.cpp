@@ -0,0 +1,173 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#include <sstream>
+#include "config_os.h"
+#include "model_plugin.h"
+#include "pest_error.h"
+
+#ifdef OS_WIN
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+using namespace std;
+
+ModelPlugin::ModelPlugin() : handle(nullptr), run_ptr(nullptr), run_batch_ptr(nullptr),
+	finalize_ptr(nullptr)
+{
+}
+
+void *ModelPlugin::get_symbol(const string &name)
+{
+#ifdef OS_WIN
+	return (void*)GetProcAddress((HMODULE)handle, name.c_str());
+#else
+	return dlsym(handle, name.c_str());
+#endif
+}
+
+void ModelPlugin::load(const string &_filename, const string &config,
+	const vector<string> &_par_names, const vector<string> &_obs_names)
+{
+	unload();
+	filename = _filename;
+#ifdef OS_WIN
+	handle = (void*)LoadLibraryA(filename.c_str());
+	if (handle == nullptr)
+	{
+		stringstream ss;
+		ss << "ModelPlugin::load(): LoadLibrary() failed for '" << filename << "', error code " << GetLastError();
+		throw PestError(ss.str());
+	}
+#else
+	handle = dlopen(filename.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (handle == nullptr)
+	{
+		const char *err = dlerror();
+		throw PestError("ModelPlugin::load(): dlopen() failed for '" + filename + "': " + string(err == nullptr ? "" : err));
+	}
+#endif
+	pestpp_plugin_api_version_t version_ptr = (pestpp_plugin_api_version_t)get_symbol("pestpp_plugin_api_version");
+	if (version_ptr != nullptr)
+	{
+		int version = version_ptr();
+		if (version != PESTPP_PLUGIN_API_VERSION)
+		{
+			stringstream ss;
+			ss << "ModelPlugin::load(): plugin '" << filename << "' was built against plugin API version " << version
+				<< ", this version of PEST++ supports version " << PESTPP_PLUGIN_API_VERSION;
+			unload();
+			throw PestError(ss.str());
+		}
+	}
+	run_ptr = (pestpp_plugin_run_t)get_symbol("pestpp_plugin_run");
+	if (run_ptr == nullptr)
+	{
+		unload();
+		throw PestError("ModelPlugin::load(): plugin '" + _filename + "' does not export 'pestpp_plugin_run'");
+	}
+	run_batch_ptr = (pestpp_plugin_run_batch_t)get_symbol("pestpp_plugin_run_batch");
+	finalize_ptr = (pestpp_plugin_finalize_t)get_symbol("pestpp_plugin_finalize");
+
+	par_names = _par_names;
+	obs_names = _obs_names;
+	pestpp_plugin_init_t init_ptr = (pestpp_plugin_init_t)get_symbol("pestpp_plugin_init");
+	if (init_ptr != nullptr)
+	{
+		vector<const char*> pnames, onames;
+		for (auto &name : par_names)
+			pnames.push_back(name.c_str());
+		for (auto &name : obs_names)
+			onames.push_back(name.c_str());
+		int result = init_ptr(pnames.size(), pnames.data(), onames.size(), onames.data(), config.c_str());
+		if (result != 0)
+		{
+			stringstream ss;
+			ss << "ModelPlugin::load(): pestpp_plugin_init() in '" << filename << "' returned " << result;
+			//don't call finalize on a plugin that never initialized
+			finalize_ptr = nullptr;
+			unload();
+			throw PestError(ss.str());
+		}
+	}
+}
+
+void ModelPlugin::run(const vector<double> &par_vals, vector<double> &obs_vals)
+{
+	if (handle == nullptr)
+		throw PestError("ModelPlugin::run(): no plugin loaded");
+	if (par_vals.size() != par_names.size())
+		throw PestError("ModelPlugin::run(): parameter vector size does not match the plugin parameter names");
+	obs_vals.resize(obs_names.size());
+	int result = run_ptr(par_vals.data(), obs_vals.data());
+	if (result != 0)
+	{
+		stringstream ss;
+		ss << "model plugin '" << filename << "' returned " << result << " from pestpp_plugin_run()";
+		throw PestError(ss.str());
+	}
+}
+
+void ModelPlugin::run_batch(int nruns, const vector<double> &par_vals, vector<double> &obs_vals,
+	vector<int> &status)
+{
+	if (handle == nullptr)
+		throw PestError("ModelPlugin::run_batch(): no plugin loaded");
+	size_t npar = par_names.size(), nobs = obs_names.size();
+	if (par_vals.size() != nruns * npar)
+		throw PestError("ModelPlugin::run_batch(): parameter matrix size does not match the number of runs");
+	obs_vals.resize(nruns * nobs);
+	status.assign(nruns, 0);
+	if (run_batch_ptr != nullptr)
+	{
+		int result = run_batch_ptr(nruns, par_vals.data(), obs_vals.data(), status.data());
+		if (result != 0)
+			status.assign(nruns, result);
+		return;
+	}
+	for (int i = 0; i < nruns; i++)
+		status[i] = run_ptr(&par_vals[i * npar], &obs_vals[i * nobs]);
+}
+
+void ModelPlugin::unload()
+{
+	if (handle == nullptr)
+		return;
+	if (finalize_ptr != nullptr)
+		finalize_ptr();
+#ifdef OS_WIN
+	FreeLibrary((HMODULE)handle);
+#else
+	dlclose(handle);
+#endif
+	handle = nullptr;
+	run_ptr = nullptr;
+	run_batch_ptr = nullptr;
+	finalize_ptr = nullptr;
+}
+
+ModelPlugin::~ModelPlugin()
+{
+	unload();
+}
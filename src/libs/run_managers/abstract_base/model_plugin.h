@@ -0,0 +1,61 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MODEL_PLUGIN_H_
+#define MODEL_PLUGIN_H_
+
+#include <string>
+#include <vector>
+#include "pestpp_plugin.h"
+
+class ModelPlugin
+{
+	// Loads a model plugin shared library (dlopen/LoadLibrary) and resolves the entry
+	// points declared in pestpp_plugin.h.  Errors are reported as PestError
+public:
+	ModelPlugin();
+	void load(const std::string &_filename, const std::string &config,
+		const std::vector<std::string> &par_names, const std::vector<std::string> &obs_names);
+	void unload();
+	bool is_loaded() const { return handle != nullptr; }
+	//true if the plugin evaluates batches natively rather than one run at a time
+	bool has_batch() const { return run_batch_ptr != nullptr; }
+	const std::string &get_filename() const { return filename; }
+	const std::vector<std::string> &get_par_names() const { return par_names; }
+	const std::vector<std::string> &get_obs_names() const { return obs_names; }
+	void run(const std::vector<double> &par_vals, std::vector<double> &obs_vals);
+	//par_vals is nruns x npar and obs_vals nruns x nobs, row-major.  status gets one code
+	//per run (0 for success) and failed runs are not an error here
+	void run_batch(int nruns, const std::vector<double> &par_vals, std::vector<double> &obs_vals,
+		std::vector<int> &status);
+	~ModelPlugin();
+private:
+	std::string filename;
+	void *handle;
+	pestpp_plugin_run_t run_ptr;
+	pestpp_plugin_run_batch_t run_batch_ptr;
+	pestpp_plugin_finalize_t finalize_ptr;
+	std::vector<std::string> par_names;
+	std::vector<std::string> obs_names;
+	void *get_symbol(const std::string &name);
+	ModelPlugin(const ModelPlugin &) = delete;
+	ModelPlugin &operator=(const ModelPlugin &) = delete;
+};
+
+#endif /* MODEL_PLUGIN_H_ */
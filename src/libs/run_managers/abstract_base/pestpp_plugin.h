@@ -0,0 +1,76 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PESTPP_PLUGIN_H_
+#define PESTPP_PLUGIN_H_
+
+/*
+	C interface of an in-process model plugin.  A plugin is a shared library
+	(.so/.dylib/.dll) named with the "model_plugin" ++ option; PEST++ loads it
+	once and calls it with parameter values in place of writing template files,
+	running the model command(s) and reading instruction files.
+
+	Parameter and observation values are passed in the order of the names given
+	to pestpp_plugin_init(), which need not be the control file order.  Parameter
+	values are in model space, the same values that would have been written
+	through the templates.
+	Every function returns 0 on success; any other value fails the run (or, for
+	init, stops PEST++).  Each function is exported with C linkage under its
+	typedef name minus the "_t" (pestpp_plugin_run, ...); only
+	pestpp_plugin_run() is required.
+
+	The plugin is called from one thread at a time.
+*/
+
+#define PESTPP_PLUGIN_API_VERSION 1
+
+#if defined(_WIN32)
+#define PESTPP_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define PESTPP_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* optional: the API version the plugin was built against (PESTPP_PLUGIN_API_VERSION) */
+typedef int (*pestpp_plugin_api_version_t)(void);
+
+/* optional: called once before any run with the parameter and observation names and
+   the "model_plugin_config" ++ option string (empty if not given) */
+typedef int (*pestpp_plugin_init_t)(int npar, const char* const* par_names,
+	int nobs, const char* const* obs_names, const char* config);
+
+/* required: evaluate one run.  par_vals holds npar values, obs_vals receives nobs values */
+typedef int (*pestpp_plugin_run_t)(const double* par_vals, double* obs_vals);
+
+/* optional: evaluate nruns runs in one call.  par_vals is nruns x npar and obs_vals is
+   nruns x nobs, both row-major (one run after another).  status receives one code per
+   run, 0 for success.  without it, pestpp_plugin_run() is called once per run */
+typedef int (*pestpp_plugin_run_batch_t)(int nruns, const double* par_vals, double* obs_vals, int* status);
+
+/* optional: called once when PEST++ is done with the plugin */
+typedef void (*pestpp_plugin_finalize_t)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PESTPP_PLUGIN_H_ */
@@ -26,6 +26,10 @@
 #include <cstring>
 #include <map>
 #include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "system_variables.h"
 #include "Transformable.h"
 #include "utilities.h"
@@ -34,24 +38,39 @@
 using namespace std;
 using namespace pest_utils;
 
+const string RunManagerSerial::worker_dir_prefix = "pestpp_local_worker_";
 
 RunManagerSerial::RunManagerSerial(const vector<string> _comline_vec,
 	const vector<string> _tplfile_vec, const vector<string> _inpfile_vec,
 	const vector<string> _insfile_vec, const vector<string> _outfile_vec,
 	const string &stor_filename, const string &_run_dir, int _max_run_fail,
-	bool fill_tpl_zeros, string additional_ins_delimiters)
+	bool fill_tpl_zeros, string additional_ins_delimiters, int num_tpl_ins_threads,
+	string _model_plugin, string _model_plugin_config, int _model_plugin_batch_size,
+	int _num_local_workers)
 	: RunManagerAbstract(_comline_vec, _tplfile_vec, _inpfile_vec,
 	_insfile_vec, _outfile_vec, stor_filename, _max_run_fail),
-	run_dir(_run_dir), mi(_tplfile_vec,_inpfile_vec,_insfile_vec,_outfile_vec, _comline_vec)
+	run_dir(_run_dir), mi(_tplfile_vec,_inpfile_vec,_insfile_vec,_outfile_vec, _comline_vec),
+	model_plugin(_model_plugin), model_plugin_config(_model_plugin_config),
+	model_plugin_batch_size(max(1, _model_plugin_batch_size)),
+	num_local_workers(max(1, _num_local_workers))
 {
 	mi.set_additional_ins_delimiters(additional_ins_delimiters);
 	mi.set_fill_tpl_zeros(fill_tpl_zeros);
+	mi.set_num_threads(num_tpl_ins_threads);
 
 	cout << "              starting serial run manager ..." << endl << endl;
+	if ((num_local_workers > 1) && (model_plugin.size() == 0))
+		cout << "              using " << num_local_workers << " local workers" << endl << endl;
 }
 
 void RunManagerSerial::run()
 {
+	run_until(RUN_UNTIL_COND::NORMAL);
+}
+
+RunManagerAbstract::RUN_UNTIL_COND RunManagerSerial::run_until(RUN_UNTIL_COND condition, int max_no_ops, double max_time_sec)
+{
+	RUN_UNTIL_COND terminate_reason = RUN_UNTIL_COND::NORMAL;
 	int success_runs = 0;
 	int prev_sucess_runs = 0;
 	int failed_runs = 0;
@@ -63,8 +82,23 @@ void RunManagerSerial::run()
 	vector<int> run_id_vec;
 	int nruns = get_outstanding_run_ids().size();
 	std::chrono::system_clock::time_point start_time_all = std::chrono::system_clock::now();
-	while (!(run_id_vec = get_outstanding_run_ids()).empty())
+	//the plugin is loaded on the first call, once the run storage names are known
+	if ((model_plugin.size() > 0) && (!mi.has_model_plugin()))
+		mi.set_model_plugin(model_plugin, model_plugin_config, par_name_vec, obs_name_vec);
+	while ((terminate_reason == RUN_UNTIL_COND::NORMAL) && (!(run_id_vec = get_outstanding_run_ids()).empty()))
 	{
+		if (mi.has_model_plugin())
+		{
+			terminate_reason = run_plugin_batches(run_id_vec, condition, max_no_ops, max_time_sec, start_time_all,
+				success_runs, failed_runs, nruns);
+			continue;
+		}
+		if (num_local_workers > 1)
+		{
+			terminate_reason = run_local_workers(run_id_vec, condition, max_no_ops, max_time_sec, start_time_all,
+				success_runs, failed_runs, nruns);
+			continue;
+		}
 		for (int i_run : run_id_vec)
 		{
 			std::chrono::system_clock::time_point start_time = std::chrono::system_clock::now();
@@ -107,6 +141,11 @@ void RunManagerSerial::run()
 			message << endl << endl << "-->" << pest_utils::get_time_string() << " run complete, took: " << pest_utils::get_duration_sec(start_time) << " seconds";
 			message << endl << "-->" << success_runs << " of " << nruns << " complete, "<<  failed_runs << " failed" << endl << endl << endl;
 			std::cout << message.str();
+			if ((condition == RUN_UNTIL_COND::TIME || condition == RUN_UNTIL_COND::NO_OPS_OR_TIME) && get_duration_sec(start_time_all) >= max_time_sec)
+			{
+				terminate_reason = RUN_UNTIL_COND::TIME;
+				break;
+			}
 		}
 	}
 	total_runs += success_runs;
@@ -145,8 +184,236 @@ void RunManagerSerial::run()
 		vector<double> pars;
 		int status = file_stor.get_run(0, pars, init_sim);
 	}
+	return terminate_reason;
 }
 
+void RunManagerSerial::setup_local_workers()
+{
+	if (worker_mi.size() == num_local_workers)
+		return;
+	//each worker gets its own copy of the model files, made once from run_dir.  the run
+	//storage file and any other worker dirs are left out of the copy
+	vector<string> skip_names;
+	string stor_name = pest_utils::get_filename(file_stor.get_filename());
+	skip_names.push_back(stor_name);
+	skip_names.push_back(stor_name + ".jnl");
+	vector<string> skip_prefixes{ worker_dir_prefix };
+	worker_mi.clear();
+	for (int i = 0; i < num_local_workers; i++)
+	{
+		stringstream ss;
+		ss << run_dir << OperSys::DIR_SEP << worker_dir_prefix << i;
+		string worker_dir = ss.str();
+		cout << "    copying '" << run_dir << "' to local worker dir '" << worker_dir << "'" << endl;
+		OperSys::copy_dir(run_dir, worker_dir, skip_names, skip_prefixes);
+		//copy the main interface settings; each copy compiles its own templates and instructions
+		worker_mi.push_back(mi);
+		worker_mi.back().set_work_dir(worker_dir);
+	}
+	cout << endl;
+}
+
+RunManagerAbstract::RUN_UNTIL_COND RunManagerSerial::run_local_workers(const vector<int> &run_id_vec,
+	RUN_UNTIL_COND condition, int max_no_ops, double max_time_sec,
+	std::chrono::system_clock::time_point start_time, int &success_runs, int &failed_runs, int nruns)
+{
+	setup_local_workers();
+	const vector<string> &obs_name_vec = file_stor.get_obs_name_vec();
+	const vector<double> no_data_obs(obs_name_vec.size(), RunStorage::no_data);
+	RUN_UNTIL_COND terminate_reason = RUN_UNTIL_COND::NORMAL;
+	int n_no_ops = 0;
+	mutex result_lock;
+	condition_variable result_cv;
+	deque<LocalRunResult> results;
+	vector<thread> slot_threads(num_local_workers);
+	vector<int> free_slots;
+	for (int i = num_local_workers - 1; i >= 0; i--)
+		free_slots.push_back(i);
+	size_t next_run = 0;
+	stringstream message;
+	//the worker threads reference the locals above, so they must be joined on any exit
+	auto join_all = [&slot_threads]()
+	{
+		for (auto &t : slot_threads)
+			if (t.joinable())
+				t.join();
+	};
+	try
+	{
+		while (true)
+		{
+			//hand out runs to idle slots
+			while ((terminate_reason == RUN_UNTIL_COND::NORMAL) && (next_run < run_id_vec.size()) && (!free_slots.empty()))
+			{
+				int slot = free_slots.back();
+				free_slots.pop_back();
+				LocalRunResult job;
+				job.slot = slot;
+				job.run_id = run_id_vec[next_run++];
+				job.success = false;
+				job.seconds = 0.0;
+				try
+				{
+					file_stor.get_parameters(job.run_id, job.pars);
+				}
+				catch (const std::exception& ex)
+				{
+					job.message = ex.what();
+					lock_guard<mutex> lk(result_lock);
+					results.push_back(std::move(job));
+					continue;
+				}
+				job.obs.insert(obs_name_vec, no_data_obs);
+				ModelInterface *worker = &worker_mi[slot];
+				slot_threads[slot] = thread([worker, &result_lock, &result_cv, &results](LocalRunResult job)
+				{
+					std::chrono::system_clock::time_point run_start = std::chrono::system_clock::now();
+					try
+					{
+						worker->run(&job.pars, &job.obs);
+						job.success = true;
+					}
+					catch (const std::exception& ex)
+					{
+						job.message = ex.what();
+					}
+					catch (...)
+					{
+						job.message = "unknown exception";
+					}
+					job.seconds = pest_utils::get_duration_sec(run_start);
+					{
+						lock_guard<mutex> lk(result_lock);
+						results.push_back(std::move(job));
+					}
+					result_cv.notify_one();
+				}, std::move(job));
+			}
+			if ((int)free_slots.size() == num_local_workers)
+			{
+				unique_lock<mutex> lk(result_lock);
+				if (results.empty() && ((next_run >= run_id_vec.size()) || (terminate_reason != RUN_UNTIL_COND::NORMAL)))
+					break;
+			}
+
+			//wait for results and store them from this thread only
+			deque<LocalRunResult> finished;
+			{
+				unique_lock<mutex> lk(result_lock);
+				result_cv.wait_for(lk, std::chrono::milliseconds(100), [&results]() { return !results.empty(); });
+				finished.swap(results);
+			}
+			if (finished.empty())
+				++n_no_ops;
+			else
+				n_no_ops = 0;
+			for (auto &result : finished)
+			{
+				if (slot_threads[result.slot].joinable())
+					slot_threads[result.slot].join();
+				if (find(free_slots.begin(), free_slots.end(), result.slot) == free_slots.end())
+					free_slots.push_back(result.slot);
+				message.str("");
+				if (result.success)
+				{
+					file_stor.update_run(result.run_id, result.pars, result.obs);
+					success_runs++;
+				}
+				else
+				{
+					update_run_failed(result.run_id);
+					failed_runs++;
+					message << endl << "  Error running model (run id " << result.run_id << ", local worker " << result.slot << "): " << result.message;
+					message << endl << "  Aborting model run" << endl;
+				}
+				message << endl << "-->" << pest_utils::get_time_string() << " run " << result.run_id << " complete on local worker "
+					<< result.slot << ", took: " << result.seconds << " seconds";
+				message << endl << "-->" << success_runs << " of " << nruns << " complete, " << failed_runs << " failed" << endl << endl;
+				std::cout << message.str();
+			}
+
+			if ((condition == RUN_UNTIL_COND::NO_OPS || condition == RUN_UNTIL_COND::NO_OPS_OR_TIME) && n_no_ops >= max_no_ops)
+				terminate_reason = RUN_UNTIL_COND::NO_OPS;
+			if ((condition == RUN_UNTIL_COND::TIME || condition == RUN_UNTIL_COND::NO_OPS_OR_TIME) && get_duration_sec(start_time) >= max_time_sec)
+				terminate_reason = RUN_UNTIL_COND::TIME;
+		}
+	}
+	catch (...)
+	{
+		join_all();
+		throw;
+	}
+	join_all();
+	return terminate_reason;
+}
+
+
+RunManagerAbstract::RUN_UNTIL_COND RunManagerSerial::run_plugin_batches(const vector<int> &run_id_vec,
+	RUN_UNTIL_COND condition, int max_no_ops, double max_time_sec,
+	std::chrono::system_clock::time_point start_time_all, int &success_runs, int &failed_runs, int nruns)
+{
+	RUN_UNTIL_COND terminate_reason = RUN_UNTIL_COND::NORMAL;
+	//every batch comes back with its runs, so there are no idle polls to count
+	int n_no_ops = 0;
+	const vector<string> &par_name_vec = file_stor.get_par_name_vec();
+	const vector<string> &obs_name_vec = file_stor.get_obs_name_vec();
+	//the plugin works in run storage order so that records can be moved as raw doubles
+	if ((mi.get_model_plugin()->get_par_names() != par_name_vec) || (mi.get_model_plugin()->get_obs_names() != obs_name_vec))
+		mi.set_model_plugin(model_plugin, model_plugin_config, par_name_vec, obs_name_vec);
+	shared_ptr<ModelPlugin> plugin = mi.get_model_plugin();
+	size_t npar = par_name_vec.size();
+	size_t nobs = obs_name_vec.size();
+	vector<double> par_vals, obs_vals, run_data(npar + nobs);
+	vector<int> status;
+	stringstream message;
+	for (size_t start = 0; (terminate_reason == RUN_UNTIL_COND::NORMAL) && (start < run_id_vec.size()); start += model_plugin_batch_size)
+	{
+		std::chrono::system_clock::time_point start_time = std::chrono::system_clock::now();
+		int nbatch = min(run_id_vec.size() - start, (size_t)model_plugin_batch_size);
+		par_vals.resize(nbatch * npar);
+		for (int i = 0; i < nbatch; i++)
+		{
+			vector<char> serial_pars = file_stor.get_serial_pars(run_id_vec[start + i]);
+			memcpy(&par_vals[i * npar], serial_pars.data(), npar * sizeof(double));
+		}
+		try
+		{
+			plugin->run_batch(nbatch, par_vals, obs_vals, status);
+		}
+		catch (const std::exception& ex)
+		{
+			cerr << "  Error running model plugin: " << ex.what() << endl;
+			status.assign(nbatch, -1);
+		}
+		int batch_failed = 0;
+		for (int i = 0; i < nbatch; i++)
+		{
+			int i_run = run_id_vec[start + i];
+			if (status[i] != 0)
+			{
+				update_run_failed(i_run);
+				failed_runs++;
+				batch_failed++;
+				continue;
+			}
+			memcpy(run_data.data(), &par_vals[i * npar], npar * sizeof(double));
+			memcpy(run_data.data() + npar, &obs_vals[i * nobs], nobs * sizeof(double));
+			file_stor.update_run(i_run, reinterpret_cast<const char*>(run_data.data()), run_data.size() * sizeof(double));
+			success_runs++;
+		}
+		message.str("");
+		message << "-->" << pest_utils::get_time_string() << " model plugin batch of " << nbatch << " runs took: "
+			<< pest_utils::get_duration_sec(start_time) << " seconds, " << batch_failed << " failed" << endl;
+		message << "-->" << success_runs << " of " << nruns << " complete, " << failed_runs << " failed" << endl;
+		std::cout << message.str();
+
+		if ((condition == RUN_UNTIL_COND::NO_OPS || condition == RUN_UNTIL_COND::NO_OPS_OR_TIME) && n_no_ops >= max_no_ops)
+			terminate_reason = RUN_UNTIL_COND::NO_OPS;
+		if ((condition == RUN_UNTIL_COND::TIME || condition == RUN_UNTIL_COND::NO_OPS_OR_TIME) && get_duration_sec(start_time_all) >= max_time_sec)
+			terminate_reason = RUN_UNTIL_COND::TIME;
+	}
+	return terminate_reason;
+}
 
 RunManagerSerial::~RunManagerSerial(void)
 {
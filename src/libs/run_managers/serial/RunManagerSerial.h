@@ -21,6 +21,7 @@
 
 #include "RunManagerAbstract.h"
 #include <string>
+#include <vector>
 #include "model_interface.h"
 
 class RunManagerSerial : public RunManagerAbstract
@@ -30,12 +31,47 @@ public:
 		const std::vector<std::string> _tplfile_vec, const std::vector<std::string> _inpfile_vec,
 		const std::vector<std::string> _insfile_vec, const std::vector<std::string> _outfile_vec,
 		const std::string &stor_filename, const std::string &run_dir, int _max_run_fail=1,
-		bool fill_tpl_zeros=false, string additional_ins_delimiters="");
+		bool fill_tpl_zeros=false, string additional_ins_delimiters="", int num_tpl_ins_threads=10,
+		string _model_plugin="", string _model_plugin_config="", int _model_plugin_batch_size=1000,
+		int _num_local_workers=1);
 	virtual void run();
+	//TIME and NO_OPS stop handing out runs; runs already started are allowed to finish
+	//and are stored before returning
+	virtual RunManagerAbstract::RUN_UNTIL_COND run_until(RUN_UNTIL_COND condition, int max_no_ops = 0, double max_time_sec = 0.0);
 	~RunManagerSerial(void);
 private:
+	//result of one run made by a local worker thread, stored by the calling thread
+	struct LocalRunResult
+	{
+		int slot;
+		int run_id;
+		bool success;
+		std::string message;
+		double seconds;
+		Parameters pars;
+		Observations obs;
+	};
 	ModelInterface mi;
 	std::string run_dir;
+	std::string model_plugin;
+	std::string model_plugin_config;
+	int model_plugin_batch_size;
+	int num_local_workers;
+	//one interface per worker slot, each running the model in its own copy of run_dir
+	std::vector<ModelInterface> worker_mi;
+	static const std::string worker_dir_prefix;
+	//evaluate runs through the model plugin, model_plugin_batch_size runs per call.  the run
+	//until condition is checked between batches
+	RUN_UNTIL_COND run_plugin_batches(const std::vector<int> &run_id_vec, RUN_UNTIL_COND condition,
+		int max_no_ops, double max_time_sec, std::chrono::system_clock::time_point start_time,
+		int &success_runs, int &failed_runs, int nruns);
+	void setup_local_workers();
+	//run the outstanding runs num_local_workers at a time.  only the calling thread
+	//touches the run storage: it reads the parameters of each run it hands out and
+	//stores each result as it comes back
+	RUN_UNTIL_COND run_local_workers(const std::vector<int> &run_id_vec, RUN_UNTIL_COND condition,
+		int max_no_ops, double max_time_sec, std::chrono::system_clock::time_point start_time,
+		int &success_runs, int &failed_runs, int nruns);
 };
 
 #endif /* RUNMANAGERSERIAL_H */
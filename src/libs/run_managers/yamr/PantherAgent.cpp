@@ -2,6 +2,7 @@
 #include "utilities.h"
 #include "Serialization.h"
 #include "system_variables.h"
+#include "payload_codec.h"
 #include <cassert>
 #include <cstring>
 #include <algorithm>
@@ -22,10 +23,44 @@ int  linpack_wrap(void);
 PANTHERAgent::PANTHERAgent(ofstream &_frec)
 	: frec(_frec),
 	  max_time_without_master_ping_seconds(300),
-	  restart_on_error(false)
+	  restart_on_error(false),
+	  payload_codec(false)
 {
 }
 
+void PANTHERAgent::encode_results(int group_id, int run_id, int64_t ref_id, vector<int8_t> &serialized_data)
+{
+	const int8_t *ref = nullptr;
+	size_t ref_nbytes = 0;
+	if (ref_id >= 0)
+	{
+		for (auto &entry : codec_cache)
+		{
+			if ((entry.first.first == group_id) && (entry.first.second == ref_id))
+			{
+				ref = entry.second.data();
+				//the master only stores pars and obs, so the trailing run time is not delta'd
+				ref_nbytes = entry.second.size() - sizeof(double);
+				break;
+			}
+		}
+	}
+	if (ref == nullptr)
+		ref_id = -1;
+	PayloadCodec::encode(serialized_data.data(), serialized_data.size(), ref, ref_nbytes, ref_id, codec_buffer);
+
+	//keep the raw results so the next run can be encoded against them
+	vector<int8_t> raw;
+	if (codec_cache.size() >= codec_cache_size)
+	{
+		raw.swap(codec_cache.front().second);
+		codec_cache.pop_front();
+	}
+	raw.swap(serialized_data);
+	codec_cache.push_back(make_pair(make_pair(group_id, run_id), std::move(raw)));
+	serialized_data.swap(codec_buffer);
+}
+
 
 void PANTHERAgent::init_network(const string &host, const string &port)
 {
@@ -134,11 +169,22 @@ void PANTHERAgent::process_ctl_file(const string &ctl_filename)
 		pest_scenario.get_model_exec_info().insfile_vec,
 		pest_scenario.get_model_exec_info().outfile_vec,
 		pest_scenario.get_model_exec_info().comline_vec);
-	mi.check_io_access();
-	if (pest_scenario.get_pestpp_options().get_check_tplins())
-		mi.check_tplins(pest_scenario.get_ctl_ordered_par_names(), pest_scenario.get_ctl_ordered_obs_names());
+	string model_plugin = pest_scenario.get_pestpp_options().get_model_plugin();
+	if (model_plugin.size() > 0)
+	{
+		report("loading model plugin: " + model_plugin, true);
+		mi.set_model_plugin(model_plugin, pest_scenario.get_pestpp_options().get_model_plugin_config(),
+			pest_scenario.get_ctl_ordered_par_names(), pest_scenario.get_ctl_ordered_obs_names());
+	}
+	else
+	{
+		mi.check_io_access();
+		if (pest_scenario.get_pestpp_options().get_check_tplins())
+			mi.check_tplins(pest_scenario.get_ctl_ordered_par_names(), pest_scenario.get_ctl_ordered_obs_names());
+	}
 	mi.set_additional_ins_delimiters(pest_scenario.get_pestpp_options().get_additional_ins_delimiters());
 	mi.set_fill_tpl_zeros(pest_scenario.get_pestpp_options().get_fill_tpl_zeros());
+	mi.set_num_threads(pest_scenario.get_pestpp_options().get_num_tpl_ins_threads());
 
 	restart_on_error = pest_scenario.get_pestpp_options().get_panther_agent_restart_on_error();
 	max_time_without_master_ping_seconds = pest_scenario.get_pestpp_options().get_panther_agent_no_ping_timeout_secs();
@@ -293,6 +339,23 @@ std::pair<NetPackage::PackType,std::string> PANTHERAgent::run_model(Parameters &
 	thread_flag f_finished(false);
 	thread_exceptions shared_execptions;
 	stringstream ss;
+	if (mi.has_model_plugin())
+	{
+		//in-process plugin runs return quickly and leave no files behind, so there is no
+		//run thread to watch and no file handle cleanup to wait for
+		try
+		{
+			mi.run(&pars, &obs);
+			final_run_status = NetPackage::PackType::RUN_FINISHED;
+		}
+		catch (const std::exception& ex)
+		{
+			report("model plugin run failed: " + string(ex.what()), true);
+			smessage << ex.what();
+			final_run_status = NetPackage::PackType::RUN_FAILED;
+		}
+		return pair<NetPackage::PackType, std::string>(final_run_status, smessage.str());
+	}
 	try
 	{
 		vector<string> par_name_vec;
@@ -654,6 +717,9 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 				terminate_or_restart(-1);
 			}
 			Serialization::unserialize(net_pack.get_data(), obs_name_vec);
+			//the master offers the result payload codec in the description of this package
+			payload_codec = (net_pack.get_info_txt() == PayloadCodec::handshake_token());
+			codec_cache.clear();
 			//make sure all par names are found in the scenario
 			vector<string> vnames = pest_scenario.get_ctl_ordered_obs_names();
 			set<string> snames(vnames.begin(), vnames.end());
@@ -709,7 +775,9 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 		{
 			report("received REQ_LINPACK",true);
 			linpack_wrap();
-			net_pack.reset(NetPackage::PackType::LINPACK, 0, 0,"");
+			//accept the payload codec if it was offered
+			string codec_reply = payload_codec ? PayloadCodec::handshake_token() : "";
+			net_pack.reset(NetPackage::PackType::LINPACK, 0, 0, codec_reply);
 			char data;
 			err = send_message(net_pack, &data, 0);
 			if (err.first != 1)
@@ -863,7 +931,12 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 			
 			//do this after we handle a cycle change so that par_name_vec is updated
 
-			Serialization::unserialize(net_pack.get_data(), pars, par_name_vec);
+			//with the payload codec, the pars are preceded by the id of the reference run
+			int64_t codec_ref_id = -1;
+			unsigned long par_loc = 0;
+			if (payload_codec)
+				par_loc = Serialization::unserialize(net_pack.get_data(), codec_ref_id);
+			Serialization::unserialize(net_pack.get_data(), pars, par_name_vec, par_loc);
 			// run model
 			if (pest_scenario.get_pestpp_options().get_panther_debug_loop())
 			{
@@ -872,6 +945,8 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 				
 				report(ss.str(), true);
 				serialized_data = Serialization::serialize(pars, par_name_vec, obs, obs_name_vec, run_time);
+				if (payload_codec)
+					encode_results(group_id, run_id, codec_ref_id, serialized_data);
 				ss.str("");
 				double rd = ((double)rand() / (double)RAND_MAX);
 				if (rd < 0.1)
@@ -950,6 +1025,8 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 				ss << ", run took " << run_time << " seconds";
 				string message = final_run_status.second + ss.str();
 				serialized_data = Serialization::serialize(pars, par_name_vec, obs, obs_name_vec, run_time);
+				if (payload_codec)
+					encode_results(group_id, run_id, codec_ref_id, serialized_data);
 				net_pack.reset(NetPackage::PackType::RUN_FINISHED, group_id, run_id, message);
 				err = send_message(net_pack, serialized_data.data(), serialized_data.size());
 				if (err.first != 1)
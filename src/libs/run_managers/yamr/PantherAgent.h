@@ -26,6 +26,7 @@
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <deque>
 #include "utilities.h"
 #include "pest_error.h"
 #include "network_package.h"
@@ -83,6 +84,14 @@ private:
 	//Parameters ctl_pars;
 	Pest pest_scenario;
 
+	//result payload codec negotiated with the master and the most recent results
+	//(keyed by group id, run id) that later results can be delta-encoded against
+	bool payload_codec;
+	static const size_t codec_cache_size = 4;
+	std::deque<std::pair<std::pair<int, int>, std::vector<int8_t>>> codec_cache;
+	std::vector<int8_t> codec_buffer;
+	void encode_results(int group_id, int run_id, int64_t ref_id, std::vector<int8_t> &serialized_data);
+
 	void report(const string& _message, bool to_cout);
 
 };
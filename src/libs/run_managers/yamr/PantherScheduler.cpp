@@ -0,0 +1,171 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <numeric>
+#include "PantherScheduler.h"
+#include "pest_error.h"
+#include "utilities.h"
+
+using namespace std;
+
+PantherRunHistory::PantherRunHistory(double _weight) : weight(_weight), global_runtime(-1.0)
+{
+}
+
+void PantherRunHistory::add_run(int run_id, const string &info_txt)
+{
+	if (!info_txt.empty())
+		run_info[run_id] = info_txt;
+}
+
+void PantherRunHistory::set_lane(int run_id, int lane)
+{
+	if (lane == 0)
+		run_lane.erase(run_id);
+	else
+		run_lane[run_id] = lane;
+}
+
+int PantherRunHistory::get_lane(int run_id) const
+{
+	auto it = run_lane.find(run_id);
+	return (it == run_lane.end()) ? 0 : it->second;
+}
+
+void PantherRunHistory::update_mean(double &mean, double seconds) const
+{
+	if (mean < 0.0)
+		mean = seconds;
+	else
+		mean = (weight * seconds) + ((1.0 - weight) * mean);
+}
+
+void PantherRunHistory::end_run(int run_id, const string &agent_name, double seconds)
+{
+	//compare against the expectation from before this run
+	double expected = get_expected_runtime(run_id);
+	double factor = (expected > 0.0) ? seconds / expected : 1.0;
+	auto it = agent_factor.find(agent_name);
+	if (it == agent_factor.end())
+		agent_factor[agent_name] = factor;
+	else
+		update_mean(it->second, factor);
+	update_mean(global_runtime, seconds);
+	auto it_info = run_info.find(run_id);
+	if (it_info == run_info.end())
+		return;
+	auto it_rt = info_runtime.find(it_info->second);
+	if (it_rt == info_runtime.end())
+		info_runtime[it_info->second] = seconds;
+	else
+		update_mean(it_rt->second, seconds);
+}
+
+double PantherRunHistory::get_expected_runtime(int run_id) const
+{
+	auto it_info = run_info.find(run_id);
+	if (it_info != run_info.end())
+	{
+		auto it_rt = info_runtime.find(it_info->second);
+		if (it_rt != info_runtime.end())
+			return it_rt->second;
+	}
+	return global_runtime;
+}
+
+double PantherRunHistory::get_agent_runtime_factor(const string &agent_name) const
+{
+	auto it = agent_factor.find(agent_name);
+	return (it == agent_factor.end()) ? 1.0 : it->second;
+}
+
+void PantherRunHistory::clear_runs()
+{
+	run_info.clear();
+	run_lane.clear();
+}
+
+void PantherSchedulePolicy::order_runs(deque<int> &waiting_runs, const PantherRunHistory &history) const
+{
+	stable_sort(waiting_runs.begin(), waiting_runs.end(), [&history](int a, int b)
+	{
+		return history.get_lane(a) > history.get_lane(b);
+	});
+}
+
+void PantherSchedulePolicy::order_agents(const vector<double> &agent_factors, vector<int> &order) const
+{
+	order.resize(agent_factors.size());
+	iota(order.begin(), order.end(), 0);
+}
+
+unique_ptr<PantherSchedulePolicy> PantherSchedulePolicy::create(const string &name)
+{
+	string upper_name = pest_utils::upper_cp(name);
+	if ((upper_name.empty()) || (upper_name == "FIFO"))
+		return unique_ptr<PantherSchedulePolicy>(new FifoSchedulePolicy());
+	if (upper_name == "LONGEST_FIRST")
+		return unique_ptr<PantherSchedulePolicy>(new LongestFirstSchedulePolicy());
+	if (upper_name == "AGENT_AFFINITY")
+		return unique_ptr<PantherSchedulePolicy>(new AgentAffinitySchedulePolicy());
+	throw PestError("PantherSchedulePolicy: unrecognized panther_schedule_policy '" + name +
+		"', should be 'fifo', 'longest_first' or 'agent_affinity'");
+}
+
+void LongestFirstSchedulePolicy::order_runs(deque<int> &waiting_runs, const PantherRunHistory &history) const
+{
+	//look up each key once rather than in every comparison
+	vector<pair<int, double>> keys;
+	keys.reserve(waiting_runs.size());
+	for (int run_id : waiting_runs)
+		keys.push_back(make_pair(history.get_lane(run_id), history.get_expected_runtime(run_id)));
+	vector<int> order(waiting_runs.size());
+	iota(order.begin(), order.end(), 0);
+	stable_sort(order.begin(), order.end(), [&keys](int a, int b)
+	{
+		if (keys[a].first != keys[b].first)
+			return keys[a].first > keys[b].first;
+		return keys[a].second > keys[b].second;
+	});
+	deque<int> sorted;
+	for (int i : order)
+		sorted.push_back(waiting_runs[i]);
+	waiting_runs.swap(sorted);
+}
+
+static void order_fastest_first(const vector<double> &agent_factors, vector<int> &order)
+{
+	order.resize(agent_factors.size());
+	iota(order.begin(), order.end(), 0);
+	stable_sort(order.begin(), order.end(), [&agent_factors](int a, int b)
+	{
+		return agent_factors[a] < agent_factors[b];
+	});
+}
+
+void LongestFirstSchedulePolicy::order_agents(const vector<double> &agent_factors, vector<int> &order) const
+{
+	order_fastest_first(agent_factors, order);
+}
+
+void AgentAffinitySchedulePolicy::order_agents(const vector<double> &agent_factors, vector<int> &order) const
+{
+	order_fastest_first(agent_factors, order);
+}
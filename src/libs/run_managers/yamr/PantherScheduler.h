@@ -0,0 +1,105 @@
+/*
+
+
+	This file is part of PEST++.
+
+	PEST++ is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	PEST++ is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PANTHER_SCHEDULER_H_
+#define PANTHER_SCHEDULER_H_
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+class PantherRunHistory
+{
+	// Run time history used by the PANTHER scheduling policies: exponentially weighted
+	// mean run times per info_txt (the realization or parameter name a run was queued with),
+	// a run time factor per agent (its run times relative to the expected run times) and
+	// the priority lane of each queued run.  The history survives reinitialize() so that
+	// later batches are ordered by what earlier batches measured
+public:
+	PantherRunHistory(double _weight = 0.5);
+	void add_run(int run_id, const std::string &info_txt);
+	void set_lane(int run_id, int lane);
+	int get_lane(int run_id) const;
+	//record a completed run of run_id on agent_name
+	void end_run(int run_id, const std::string &agent_name, double seconds);
+	//mean run time of runs queued with the same info_txt, or of all runs if there is no history
+	double get_expected_runtime(int run_id) const;
+	//how long runs take on agent_name relative to their expected run time: below 1.0 is
+	//a faster than average agent.  1.0 if the agent has no history
+	double get_agent_runtime_factor(const std::string &agent_name) const;
+	//forget the queued runs but keep the run time history
+	void clear_runs();
+private:
+	double weight;
+	double global_runtime;
+	std::unordered_map<int, std::string> run_info;
+	std::unordered_map<int, int> run_lane;
+	std::unordered_map<std::string, double> info_runtime;
+	std::unordered_map<std::string, double> agent_factor;
+	void update_mean(double &mean, double seconds) const;
+};
+
+class PantherSchedulePolicy
+{
+	// Orders the waiting run queue and the free agents each time RunManagerPanther hands
+	// out runs.  Runs in a higher priority lane always go first; the policy orders runs
+	// within a lane.  Orderings are stable so ties keep the queue order
+public:
+	virtual ~PantherSchedulePolicy() {}
+	virtual std::string get_name() const = 0;
+	virtual void order_runs(std::deque<int> &waiting_runs, const PantherRunHistory &history) const;
+	//agent_factors holds the run time factor of each free agent; order receives the
+	//positions of the agents in the order they should get runs
+	virtual void order_agents(const std::vector<double> &agent_factors, std::vector<int> &order) const;
+	//true if order_agents() changes the order the agents were given in
+	virtual bool orders_agents() const { return false; }
+	//"FIFO", "LONGEST_FIRST" or "AGENT_AFFINITY"; throws PestError for anything else
+	static std::unique_ptr<PantherSchedulePolicy> create(const std::string &name);
+};
+
+//queue order within each lane, agents in the order they connected (the original behavior)
+class FifoSchedulePolicy : public PantherSchedulePolicy
+{
+public:
+	virtual std::string get_name() const { return "FIFO"; }
+};
+
+//runs with the longest expected run time first, handed to the fastest free agents.
+//starting the long runs early keeps them from trailing at the end of a batch
+class LongestFirstSchedulePolicy : public PantherSchedulePolicy
+{
+public:
+	virtual std::string get_name() const { return "LONGEST_FIRST"; }
+	virtual void order_runs(std::deque<int> &waiting_runs, const PantherRunHistory &history) const;
+	virtual void order_agents(const std::vector<double> &agent_factors, std::vector<int> &order) const;
+	virtual bool orders_agents() const { return true; }
+};
+
+//queue order within each lane, fastest free agents first
+class AgentAffinitySchedulePolicy : public PantherSchedulePolicy
+{
+public:
+	virtual std::string get_name() const { return "AGENT_AFFINITY"; }
+	virtual void order_agents(const std::vector<double> &agent_factors, std::vector<int> &order) const;
+	virtual bool orders_agents() const { return true; }
+};
+
+#endif /* PANTHER_SCHEDULER_H_ */
@@ -36,6 +36,7 @@
 #include <algorithm>
 #include "network_wrapper.h"
 #include "network_package.h"
+#include "payload_codec.h"
 #include "Transformable.h"
 #include "utilities.h"
 #include "Serialization.h"
@@ -68,6 +69,9 @@ AgentInfoRec::AgentInfoRec(int _socket_fd)
 	ping = false;
 	failed_pings = 0;
 	failed_runs = 0;
+	payload_codec = false;
+	codec_ref_group_id = UNKNOWN_ID;
+	codec_ref_run_id = -1;
 	state_strings = vector<string>({ "NEW", "CWD_REQ", "CWD_RCV", "NAMES_SENT", "LINPACK_REQ", "LINPACK_RCV", "WAITING", "ACTIVE",
 	"KILLED", "KILLED_FAILED", "COMPLETE" });
 
@@ -270,15 +274,20 @@ int AgentInfoRec::seconds_since_last_ping_time() const
 
 
 RunManagerPanther::RunManagerPanther(const string& stor_filename, const string& _port, ofstream& _f_rmr, int _max_n_failure,
-	double _overdue_reched_fac, double _overdue_giveup_fac, double _overdue_giveup_minutes, bool _should_echo)
+	double _overdue_reched_fac, double _overdue_giveup_fac, double _overdue_giveup_minutes, bool _should_echo,
+	bool _use_payload_codec, const string &_schedule_policy)
 	: RunManagerAbstract(vector<string>(), vector<string>(), vector<string>(),
 		vector<string>(), vector<string>(), stor_filename, _max_n_failure),
 	overdue_reched_fac(_overdue_reched_fac), overdue_giveup_fac(_overdue_giveup_fac),
 	port(_port), f_rmr(_f_rmr), n_no_ops(0), overdue_giveup_minutes(_overdue_giveup_minutes),
 	terminate_idle_thread(false), currently_idle(true), idling(false), idle_thread_finished(false),
-	idle_thread(nullptr), idle_thread_raii(nullptr), should_echo(_should_echo)
+	idle_thread(nullptr), idle_thread_raii(nullptr), should_echo(_should_echo),
+	use_payload_codec(_use_payload_codec), schedule_policy(PantherSchedulePolicy::create(_schedule_policy)),
+	reorder_waiting_runs(false), run_until_resume(false), file_stor_secs(0.0)
 {
 	cout << "          starting PANTHER master..." << endl << endl;
+	if (schedule_policy->get_name() != "FIFO")
+		cout << "          using '" << pest_utils::lower_cp(schedule_policy->get_name()) << "' run scheduling" << endl << endl;
 	max_concurrent_runs = max(MAX_CONCURRENT_RUNS_LOWER_LIMIT, _max_n_failure);
 	w_init();
 	std::pair<int, string> status;
@@ -315,14 +324,16 @@ RunManagerPanther::RunManagerPanther(const string& stor_filename, const string&
 	w_listen(listener, BACKLOG);
 	//free servinfo
 	freeaddrinfo(servinfo);
-	fdmax = listener;
-	FD_ZERO(&master);
-	FD_SET(listener, &master);
+	if (!poller.add(listener))
+	{
+		throw(PestError("PANTHER master unable to poll the listener socket"));
+	}
 	//cant do this here because the run manager doesnt yet know the par and obs names
 	//resume_idle();
 	f_rmr << endl;
 	cout << "PANTHER master listening on socket: " << w_get_addrinfo_string(connect_addr) << endl;
 	f_rmr << "PANTHER master listening on socket:" << w_get_addrinfo_string(connect_addr) << endl;
+	f_rmr << "PANTHER master socket polling: " << poller.get_backend_name() << endl;
 	
 	
 }
@@ -378,11 +389,14 @@ void RunManagerPanther::reinitialize(const std::string &_filename)
 	free_memory();
 	RunManagerAbstract::reinitialize(_filename);
 	cur_group_id = NetPackage::get_new_group_id();
+	run_until_resume = false;
+	file_stor_secs = 0.0;
 }
 
 void  RunManagerPanther::free_memory()
 {
 	waiting_runs.clear();
+	run_history.clear_runs();
 	model_runs_done = 0;
 	failure_map.clear();
 	active_runid_to_iterset_map.clear();
@@ -390,25 +404,52 @@ void  RunManagerPanther::free_memory()
 
 int RunManagerPanther::add_run(const Parameters &model_pars, const string &info_txt, double info_value)
 {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
 	int run_id = file_stor.add_run(model_pars, info_txt, info_value);
+	add_file_stor_secs(start);
 	waiting_runs.push_back(run_id);
+	run_history.add_run(run_id, info_txt);
+	reorder_waiting_runs = true;
 	return run_id;
 }
 
 int RunManagerPanther::add_run(const std::vector<double> &model_pars, const string &info_txt, double info_value)
 {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
 	int run_id = file_stor.add_run(model_pars, info_txt, info_value);
+	add_file_stor_secs(start);
 	waiting_runs.push_back(run_id);
+	run_history.add_run(run_id, info_txt);
+	reorder_waiting_runs = true;
 	return run_id;
 }
 
 int RunManagerPanther::add_run(const Eigen::VectorXd &model_pars, const string &info_txt, double info_value)
 {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
 	int run_id = file_stor.add_run(model_pars, info_txt, info_value);
+	add_file_stor_secs(start);
 	waiting_runs.push_back(run_id);
+	run_history.add_run(run_id, info_txt);
+	reorder_waiting_runs = true;
 	return run_id;
 }
 
+void RunManagerPanther::set_run_priority(int run_id, RUN_PRIORITY priority)
+{
+	run_history.set_lane(run_id, static_cast<int>(priority));
+	reorder_waiting_runs = true;
+}
+
+void RunManagerPanther::cancel_run(int run_id)
+{
+	RunManagerAbstract::cancel_run(run_id);
+	if (!run_canceled(run_id))
+		return;
+	waiting_runs.erase(remove(waiting_runs.begin(), waiting_runs.end(), run_id), waiting_runs.end());
+	kill_runs(run_id, false, "run canceled");
+}
+
 void RunManagerPanther::update_run(int run_id, const Parameters &pars, const Observations &obs)
 {
 
@@ -443,38 +484,42 @@ RunManagerAbstract::RUN_UNTIL_COND RunManagerPanther::run_until(RUN_UNTIL_COND c
 	// Pause idle pinging thread
 	pause_idle();
 
-	model_runs_done = 0;
-	model_runs_failed = 0;
-	model_runs_timed_out = 0;
-	failure_map.clear();
-	active_runid_to_iterset_map.clear();
-	int num_runs = waiting_runs.size();
-	cout << "    running model " << num_runs << " times" << endl;
-	f_rmr << "running model " << num_runs << " times" << endl;
-	cout << "    starting at " << pest_utils::get_time_string() << endl;
-	if (agent_info_set.size() == 0) // first entry is the listener, slave apears after this
-	{
-		cout << endl << "      waiting for agents to appear..." << endl << endl;
-		//f_rmr << endl << "    waiting for agents to appear..." << endl << endl;
-		report("waiting for agents to appear", false);
-	}
-	else
-	{
-		for (auto &si : agent_info_set)
-			si.reset_runtime();
-	}
-	cout << endl;
-	f_rmr << endl;
-	if (should_echo)
-	{
-		cout << "PANTHER progress" << endl;
-		cout << "   runs(C = completed | F = failed | T = timed out)" << endl;
-		cout << "   agents(R = running | W = waiting | U = unavailable)" << endl;
-		cout << "------------------------------------------------------------------------------" << endl;
-	}
-	else
-	{
-		cout << "'panther_echo' is 'false', running in silent mode - see rmr file for details" << endl;
+	//a call that resumes an early return keeps the counters and the active runs
+	if (!run_until_resume)
+	{
+		model_runs_done = 0;
+		model_runs_failed = 0;
+		model_runs_timed_out = 0;
+		failure_map.clear();
+		active_runid_to_iterset_map.clear();
+		int num_runs = waiting_runs.size();
+		cout << "    running model " << num_runs << " times" << endl;
+		f_rmr << "running model " << num_runs << " times" << endl;
+		cout << "    starting at " << pest_utils::get_time_string() << endl;
+		if (agent_info_set.size() == 0) // first entry is the listener, slave apears after this
+		{
+			cout << endl << "      waiting for agents to appear..." << endl << endl;
+			//f_rmr << endl << "    waiting for agents to appear..." << endl << endl;
+			report("waiting for agents to appear", false);
+		}
+		else
+		{
+			for (auto &si : agent_info_set)
+				si.reset_runtime();
+		}
+		cout << endl;
+		f_rmr << endl;
+		if (should_echo)
+		{
+			cout << "PANTHER progress" << endl;
+			cout << "   runs(C = completed | F = failed | T = timed out)" << endl;
+			cout << "   agents(R = running | W = waiting | U = unavailable)" << endl;
+			cout << "------------------------------------------------------------------------------" << endl;
+		}
+		else
+		{
+			cout << "'panther_echo' is 'false', running in silent mode - see rmr file for details" << endl;
+		}
 	}
 
 	std::chrono::system_clock::time_point start_time = std::chrono::system_clock::now();
@@ -535,7 +580,7 @@ RunManagerAbstract::RUN_UNTIL_COND RunManagerPanther::run_until(RUN_UNTIL_COND c
 			for (auto fid : fids)
 				f_rmr << " " << fid << "(" << failure_map.count(fid) << ")";
 		}
-		f_rmr << endl << endl;
+		f_rmr << endl << "  run storage seconds: " << file_stor_secs << endl << endl;
 			
 
 		if (init_sim.size() == 0)
@@ -545,8 +590,14 @@ RunManagerAbstract::RUN_UNTIL_COND RunManagerPanther::run_until(RUN_UNTIL_COND c
 		}
 	}
 
-	// Resume idle pinging thread
-	resume_idle();
+	//runs are still out on the agents after an early return, so keep the idle thread paused
+	//and leave their results to be picked up by the next call
+	run_until_resume = (terminate_reason != RUN_UNTIL_COND::NORMAL);
+	if (!run_until_resume)
+	{
+		// Resume idle pinging thread
+		resume_idle();
+	}
 
 	return terminate_reason;
 }
@@ -554,14 +605,19 @@ RunManagerAbstract::RUN_UNTIL_COND RunManagerPanther::run_until(RUN_UNTIL_COND c
 bool RunManagerPanther::ping(pest_utils::thread_flag* terminate/* = nullptr*/)
 {
 	bool ping_sent = false;
+	//ping() can close an agent, so work from a copy of the socket list
+	vector<int> sock_nums;
 	for (auto &i : socket_to_iter_map)
+		sock_nums.push_back(i.first);
+	for (auto i_sock : sock_nums)
 	{
 		if (terminate && terminate->get())
 		{
 			break;
 		}
-
-		if (ping(i.first))
+		if (socket_to_iter_map.find(i_sock) == socket_to_iter_map.end())
+			continue;
+		if (ping(i_sock))
 		{
 			ping_sent = true;
 	}
@@ -752,9 +808,8 @@ bool RunManagerPanther::ping(int i_sock)
 	}
 
 	string sock_hostname = agent_info_iter->get_hostname();
-	fd_set read_fds = master;
 	//if the agent hasn't communicated since the last ping request
-	if ((!FD_ISSET(i_sock, &read_fds)) && agent_info_iter->get_ping())
+	if ((!poller.contains(i_sock)) && agent_info_iter->get_ping())
 	{
 		int fails = agent_info_iter->add_failed_ping();
 		report("failed to receive ping response from agent: " + sock_hostname + "$" + agent_info_iter->get_work_dir(), false);
@@ -801,20 +856,16 @@ bool RunManagerPanther::listen(pest_utils::thread_flag* terminate/* = nullptr*/)
 {
 	bool got_message = false;
 	struct sockaddr_storage remote_addr;
-	fd_set read_fds; // temp file descriptor list for select()
 	socklen_t addr_len;
-	timeval tv;
-	tv.tv_sec = 1;
-	tv.tv_usec = 0;
-	read_fds = master; // copy it
-	if (w_select(fdmax+1, &read_fds, NULL, NULL, &tv) == -1)
+	vector<int> ready_fds;
+	if (poller.wait(1000, ready_fds) == -1)
 	{
 		// there are no slaves available.  W need to keep listening until at least one appears
 		got_message = true;
 		return got_message;
 	}
-	// run through the existing connections looking for data to read
-	for (int i = 0; i <= fdmax; i++)
+	// run through the connections that have data to read
+	for (int i : ready_fds)
 	{
 		// Stop early if we're requested to terminate
 	 	if(terminate && terminate->get())
@@ -822,28 +873,29 @@ bool RunManagerPanther::listen(pest_utils::thread_flag* terminate/* = nullptr*/)
 	 		break;
 	 	}
 
-		if (FD_ISSET(i, &read_fds)) { // we got one!!
-			got_message = true;
-			if (i == listener)  // handle new connections
+		got_message = true;
+		if (i == listener)  // handle new connections
+		{
+			int newfd;
+			addr_len = sizeof remote_addr;
+			newfd = w_accept(listener,(struct sockaddr *)&remote_addr, &addr_len);
+			if (newfd == -1) {}
+			else
 			{
-				int newfd;
-				addr_len = sizeof remote_addr;
-				newfd = w_accept(listener,(struct sockaddr *)&remote_addr, &addr_len);
-				if (newfd == -1) {}
-				else
-				{
-					add_agent(newfd);
-				}
+				add_agent(newfd);
 			}
-			else  // handle data from a client
-			{
-				//set the ping flag since the slave sent something back
-				list<AgentInfoRec>::iterator iter = socket_to_iter_map.at(i);
-				iter->set_ping(false);
-				process_message(i);
-			} // END handle data from client
-		} // END got new incoming connection
-	} // END looping through file descriptors
+		}
+		else  // handle data from a client
+		{
+			//an earlier message in this batch may have closed the agent
+			auto iter = socket_to_iter_map.find(i);
+			if (iter == socket_to_iter_map.end())
+				continue;
+			//set the ping flag since the slave sent something back
+			iter->second->set_ping(false);
+			process_message(i);
+		} // END handle data from client
+	} // END looping through ready sockets
 	return got_message;
 }
 
@@ -881,8 +933,8 @@ void RunManagerPanther::close_agent(list<AgentInfoRec>::iterator agent_info_iter
 	AgentInfoRec::State state = agent_info_iter->get_state();
 
 	string socket_name = agent_info_iter->get_socket_name();
+	poller.remove(i_sock); // remove from the polled set
 	w_close(i_sock); // bye!
-	FD_CLR(i_sock, &master); // remove from master set
 	// remove run from active_runid_to_iterset_map
 	unschedule_run(agent_info_iter);
 
@@ -908,6 +960,23 @@ void RunManagerPanther::schedule_runs()
 
 	std::list<list<AgentInfoRec>::iterator> free_agent_list = get_free_agent_list();
 	int n_responsive_agents = get_n_responsive_agents();
+	if (reorder_waiting_runs)
+	{
+		schedule_policy->order_runs(waiting_runs, run_history);
+		reorder_waiting_runs = false;
+	}
+	if ((schedule_policy->orders_agents()) && (free_agent_list.size() > 1))
+	{
+		vector<list<AgentInfoRec>::iterator> free_agents(free_agent_list.begin(), free_agent_list.end());
+		vector<double> agent_factors;
+		for (auto &it_agent : free_agents)
+			agent_factors.push_back(run_history.get_agent_runtime_factor(it_agent->get_hostname() + "$" + it_agent->get_work_dir()));
+		vector<int> order;
+		schedule_policy->order_agents(agent_factors, order);
+		free_agent_list.clear();
+		for (int i : order)
+			free_agent_list.push_back(free_agents[i]);
+	}
 	//first try to schedule waiting runs
 	for (auto it_run = waiting_runs.begin(); !free_agent_list.empty() && it_run != waiting_runs.end();)
 	{
@@ -1083,11 +1152,20 @@ int RunManagerPanther::schedule_run(int run_id, std::list<list<AgentInfoRec>::it
 	if (it_agent != free_agent_list.end())
 	{
 		int socket_fd = (*it_agent)->get_socket_fd();
+		chrono::steady_clock::time_point stor_start = chrono::steady_clock::now();
 		vector<char> data = file_stor.get_serial_pars(run_id);
+		if ((*it_agent)->get_payload_codec())
+		{
+			//codec agents get the id of the run to delta-encode their results against
+			int64_t ref_id = (*it_agent)->get_codec_ref(cur_group_id);
+			const char *p = reinterpret_cast<const char*>(&ref_id);
+			data.insert(data.begin(), p, p + sizeof(ref_id));
+		}
 		string info_txt;
 		double info_val;
 		int rstat;
 		file_stor.get_info(run_id, rstat, info_txt, info_val);
+		add_file_stor_secs(stor_start);
 		string host_name = (*it_agent)->get_hostname();
 		//  info_txt = "sending run to " + host_name + ":" + (*it_agent)->get_work_dir() + " at " + pest_utils::get_time_string();
 		NetPackage net_pack(NetPackage::PackType::START_RUN, cur_group_id, run_id, info_txt);
@@ -1149,6 +1227,8 @@ void RunManagerPanther::process_message(int i_sock)
 	string host_name = agent_info_iter->get_hostname();
 	string port_name = agent_info_iter->get_port();
 	string socket_name = agent_info_iter->get_socket_name();
+	//receive into this agent's pooled buffer so large result packages don't reallocate each time
+	net_pack.swap_data(agent_info_iter->get_recv_buffer());
 	err = net_pack.recv(i_sock);
 	if( err.first <=0) // error or lost connection
 	{
@@ -1195,8 +1275,12 @@ void RunManagerPanther::process_message(int i_sock)
 	{
 		agent_info_iter->end_linpack();
 		agent_info_iter->set_state(AgentInfoRec::State::LINPACK_RCV);
+		bool codec = (use_payload_codec) && (net_pack.get_info_txt() == PayloadCodec::handshake_token());
+		agent_info_iter->set_payload_codec(codec);
 		stringstream ss;
 		ss << "new agent ready: " << agent_info_iter->get_hostname() << "$" << agent_info_iter->get_work_dir() << ":" << agent_info_iter->get_socket_name() ;
+		if (codec)
+			ss << " (payload codec: " << PayloadCodec::NAME << ")";
 		report(ss.str(), false);
 	}
 	else if (net_pack.get_type() == NetPackage::PackType::READY)
@@ -1237,6 +1321,7 @@ void RunManagerPanther::process_message(int i_sock)
 		else
 		{
 			// keep track of model run time
+			run_history.end_run(run_id, host_name + "$" + agent_info_iter->get_work_dir(), agent_info_iter->get_duration_sec());
 			agent_info_iter->end_run();
 			stringstream ss;
 			ss << "run " << run_id << " received from: " << host_name << "$" << agent_info_iter->get_work_dir() <<
@@ -1259,7 +1344,7 @@ void RunManagerPanther::process_message(int i_sock)
 		int n_concur = get_n_concurrent(run_id);
 		stringstream ss;
 
-		if (!run_finished(run_id))
+		if ((!run_finished(run_id)) && (!run_canceled(run_id)))
 		{
 			ss << "Run " << run_id << " failed on agent:" << host_name << "$" << agent_info_iter->get_work_dir() << "  (group id: " << group_id << ", run id: " << run_id << ", concurrent: " << n_concur << ") ";
 			string netpack_message = net_pack.get_info_txt();
@@ -1317,6 +1402,12 @@ void RunManagerPanther::process_message(int i_sock)
 		net_pack.print_header(f_rmr);
 		//save results from model run
 	}
+	//hand the buffer back, unless the agent was closed while processing the message
+	auto it = socket_to_iter_map.find(i_sock);
+	if (it != socket_to_iter_map.end())
+	{
+		net_pack.swap_data(it->second->get_recv_buffer());
+	}
 }
 
 bool RunManagerPanther::process_model_run(int sock_id, NetPackage &net_pack)
@@ -1328,11 +1419,34 @@ bool RunManagerPanther::process_model_run(int sock_id, NetPackage &net_pack)
 	//check if another instance of this model run has already completed
 	if (!run_finished(run_id))
 	{
-		Parameters pars;
-		Observations obs;
+		if (agent_info_iter->get_payload_codec())
+		{
+			try
+			{
+				decode_model_run(agent_info_iter, net_pack);
+			}
+			catch (exception &e)
+			{
+				stringstream ss;
+				ss << "error decoding results of run " << run_id << " from agent: " << agent_info_iter->get_hostname() <<
+					"$" << agent_info_iter->get_work_dir() << ": " << e.what() << ", treating as a failed run";
+				report(ss.str(), false);
+				model_runs_failed++;
+				update_run_failed(run_id, sock_id);
+				auto it = get_active_run_iter(sock_id);
+				unschedule_run(it);
+				if ((get_n_concurrent(run_id) == 0) && (failure_map.count(run_id) < max_n_failure))
+					waiting_runs.push_front(run_id);
+				return false;
+			}
+		}
 		double run_time = 0;
-		Serialization::unserialize(net_pack.get_data(), pars, get_par_name_vec(), obs, get_obs_name_vec(), run_time);
-		file_stor.update_run(run_id, pars, obs);
+		//decode the results straight into the run storage record
+		chrono::steady_clock::time_point stor_start = chrono::steady_clock::now();
+		Serialization::unserialize(net_pack.get_data(), file_stor, run_id, run_time);
+		add_file_stor_secs(stor_start);
+		if (agent_info_iter->get_payload_codec())
+			agent_info_iter->set_codec_ref(cur_group_id, run_id);
 		agent_info_iter->set_state(AgentInfoRec::State::COMPLETE);
 		//slave_info_iter->set_state(SlaveInfoRec::State::WAITING);
 		use_run = true;
@@ -1352,6 +1466,29 @@ bool RunManagerPanther::process_model_run(int sock_id, NetPackage &net_pack)
 	return use_run;
 }
 
+void RunManagerPanther::decode_model_run(list<AgentInfoRec>::iterator agent_info_iter, NetPackage &net_pack)
+{
+	const vector<int8_t> &enc = net_pack.get_data();
+	int64_t ref_id = PayloadCodec::get_ref_id(enc.data(), enc.size());
+	const int8_t *ref = nullptr;
+	size_t ref_nbytes = 0;
+	if (ref_id >= 0)
+	{
+		if (ref_id != agent_info_iter->get_codec_ref(cur_group_id))
+		{
+			stringstream ss;
+			ss << "payload encoded against unexpected reference run " << ref_id;
+			throw PestError(ss.str());
+		}
+		file_stor.get_serial_data((int)ref_id, codec_ref_buffer);
+		ref = reinterpret_cast<const int8_t*>(codec_ref_buffer.data());
+		ref_nbytes = codec_ref_buffer.size();
+	}
+	PayloadCodec::decode(enc.data(), enc.size(), ref, ref_nbytes, codec_raw_buffer);
+	//the decoded payload replaces the encoded one; the encoded buffer is kept for reuse
+	net_pack.swap_data(codec_raw_buffer);
+}
+
 void RunManagerPanther::kill_run(list<AgentInfoRec>::iterator agent_info_iter, const string &reason)
 {
 	int socket_id = agent_info_iter->get_socket_fd();
@@ -1460,7 +1597,9 @@ void RunManagerPanther::kill_all_active_runs()
 			data = Serialization::serialize(tmp_vec);
 			pair<int,string> err_par = net_pack.send(i_sock, &data[0], data.size());
 			//send observation names
-			net_pack = NetPackage(NetPackage::PackType::OBS_NAMES, 0, 0, "");
+			//offer the result payload codec; the agent accepts it in its LINPACK reply
+			string codec_offer = use_payload_codec ? PayloadCodec::handshake_token() : "";
+			net_pack = NetPackage(NetPackage::PackType::OBS_NAMES, 0, 0, codec_offer);
 			tmp_vec = file_stor.get_obs_name_vec();
 			data = Serialization::serialize(tmp_vec);
 			pair<int,string> err_obs = net_pack.send(i_sock, &data[0], data.size());
@@ -1551,9 +1690,12 @@ void RunManagerPanther::kill_all_active_runs()
 	 stringstream ss;
 	 ss << "new connection from: " << w_getnameinfo_string(sock_id);
 	 report(ss.str(), false);
-	 FD_SET(sock_id, &master); // add to master set
-	 if (sock_id > fdmax) { // keep track of the max
-		 fdmax = sock_id;
+	 if (!poller.add(sock_id)) // add to the polled set
+	 {
+		 //an agent that is never polled would only look idle, so drop the connection instead
+		 report("unable to poll socket for new connection, closing it: " + w_getnameinfo_string(sock_id), true);
+		 w_close(sock_id);
+		 return agent_info_set.end();
 	 }
 
 	 //list<SlaveInfoRec>::iterator
@@ -1674,9 +1816,17 @@ void RunManagerPanther::kill_all_active_runs()
  }
 
 
+ void RunManagerPanther::add_file_stor_secs(const chrono::steady_clock::time_point &start)
+ {
+	 file_stor_secs += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+ }
+
+
  void RunManagerPanther::update_run_failed(int run_id, int socket_fd)
  {
+	 chrono::steady_clock::time_point start = chrono::steady_clock::now();
 	 file_stor.update_run_failed(run_id);
+	 add_file_stor_secs(start);
 	 failure_map.insert(make_pair(run_id, socket_fd));
 	 list<AgentInfoRec>::iterator agent_info_iter = socket_to_iter_map.at(socket_fd);
 	 agent_info_iter->add_failed_run();
@@ -1695,20 +1845,17 @@ RunManagerPanther::~RunManagerPanther(void)
 
 	//close sockets and cleanup
 	int err;
+	poller.remove(listener);
 	err = w_close(listener);
-	FD_CLR(listener, &master);
 	// this is needed to ensure that the first slave closes properly
 	w_sleep(2000);
-	for (int i = 0; i <= fdmax; i++)
+	for (int i : poller.get_fds())
 	{
-		if (FD_ISSET(i, &master))
-		{
-			NetPackage netpack(NetPackage::PackType::TERMINATE, 0, 0,"");
-			char data;
-			netpack.send(i, &data, 0);
-			err = w_close(i);
-			FD_CLR(i, &master);
-		}
+		NetPackage netpack(NetPackage::PackType::TERMINATE, 0, 0,"");
+		char data;
+		netpack.send(i, &data, 0);
+		poller.remove(i);
+		err = w_close(i);
 	}
 	w_cleanup();
 }
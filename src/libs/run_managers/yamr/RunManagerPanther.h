@@ -28,8 +28,10 @@
 #include <thread>
 #include "network_wrapper.h"
 #include "network_package.h"
+#include "socket_poller.h"
 #include "RunManagerAbstract.h"
 #include "RunStorage.h"
+#include "PantherScheduler.h"
 #include "utilities.h"
 
 class AgentInfoRec {
@@ -71,6 +73,14 @@ public:
 	void reset_last_ping_time();
 	void reset_runtime() { run_time = std::chrono::system_clock::duration::zero(); }
 	int seconds_since_last_ping_time() const;
+	//receive buffer reused for every message from this agent
+	std::vector<int8_t> &get_recv_buffer() { return recv_buffer; }
+	//payload codec accepted by this agent during the handshake
+	void set_payload_codec(bool val) { payload_codec = val; }
+	bool get_payload_codec() const { return payload_codec; }
+	//last run from this agent whose results were stored; used as the delta reference
+	void set_codec_ref(int _group_id, int _run_id) { codec_ref_group_id = _group_id; codec_ref_run_id = _run_id; }
+	int get_codec_ref(int _group_id) const { return (_group_id == codec_ref_group_id) ? codec_ref_run_id : -1; }
 	~AgentInfoRec(){}
 private:
 	int socket_fd;
@@ -86,6 +96,10 @@ private:
 	std::chrono::system_clock::time_point last_ping_time;
 	std::string work_dir;
 	std::vector<string> name_info_vec;
+	std::vector<int8_t> recv_buffer;
+	bool payload_codec;
+	int codec_ref_group_id;
+	int codec_ref_run_id;
 public:
 	class CompareTimes
 	{
@@ -100,7 +114,8 @@ class RunManagerPanther : public RunManagerAbstract
 {
 public:
 	RunManagerPanther(const std::string &stor_filename, const std::string &port, std::ofstream &_f_rmr, int _max_n_failure,
-		double overdue_reched_fac, double overdue_giveup_fac, double overdue_giveup_minutes, bool _should_echo=true);
+		double overdue_reched_fac, double overdue_giveup_fac, double overdue_giveup_minutes, bool _should_echo=true,
+		bool _use_payload_codec=false, const std::string &_schedule_policy="FIFO");
 	virtual void initialize(const Parameters &model_pars, const Observations &obs, const std::string &_filename = std::string(""));
 	virtual void initialize_restart(const std::string &_filename);
 	virtual void reinitialize(const std::string &_filename = std::string(""));
@@ -109,6 +124,8 @@ public:
 	virtual int add_run(const std::vector<double> &model_pars, const std::string &info_txt="", double info_valuee=RunStorage::no_data);
 	virtual int add_run(const Eigen::VectorXd &model_pars, const std::string &info_txt="", double info_valuee=RunStorage::no_data);
 	virtual void update_run(int run_id, const Parameters &pars, const Observations &obs);
+	virtual void set_run_priority(int run_id, RUN_PRIORITY priority);
+	virtual void cancel_run(int run_id);
 	virtual void run();
 	virtual RunManagerAbstract::RUN_UNTIL_COND run_until(RUN_UNTIL_COND condition, int n_nops = 0, double sec = 0.0);
 	~RunManagerPanther(void);
@@ -131,16 +148,27 @@ private:
 	int max_concurrent_runs;
 	int n_no_ops;  //number of consecutive times tcp/ip has looked for slave communciations and not found any
 	int listener;
-	int fdmax;
 	int model_runs_done;
 	int model_runs_failed;
 	int model_runs_timed_out;
 	bool should_echo;
-	fd_set master; // master file descriptor list
+	bool use_payload_codec;
+	std::vector<char> codec_ref_buffer;
+	std::vector<int8_t> codec_raw_buffer;
+	SocketPoller poller; // listener and agent sockets
 	list<AgentInfoRec> agent_info_set;
-	map<int, list<AgentInfoRec>::iterator> socket_to_iter_map;
+	unordered_map<int, list<AgentInfoRec>::iterator> socket_to_iter_map;
 	multimap<int, list<AgentInfoRec>::iterator> active_runid_to_iterset_map;
 	std::deque<int> waiting_runs;
+	std::unique_ptr<PantherSchedulePolicy> schedule_policy;
+	PantherRunHistory run_history;
+	//set when runs are queued or reprioritized so the queue is reordered once before scheduling
+	bool reorder_waiting_runs;
+	//set when run_until() returns before the runs are complete, so the next call picks up
+	//where it left off instead of starting a new batch
+	bool run_until_resume;
+	//wall time spent in file_stor calls since the last reinitialize(), reported in the rmr file
+	double file_stor_secs;
 	std::unordered_multimap<int, int> failure_map;
 	pest_utils::thread_flag terminate_idle_thread;
 	pest_utils::thread_flag currently_idle;
@@ -166,9 +194,11 @@ private:
 	std::ofstream &f_rmr;
 	bool listen(pest_utils::thread_flag* terminate = nullptr);
 	bool process_model_run(int sock_id, NetPackage &net_pack);
+	void decode_model_run(std::list<AgentInfoRec>::iterator agent_info_iter, NetPackage &net_pack);
 	void process_message(int i);
 	void schedule_runs();
 	void init_agents(pest_utils::thread_flag* terminate = nullptr);
+	//agent_info_set.end() if the socket could not be added to the poller (it is closed)
 	list<AgentInfoRec>::iterator add_agent(int sock_id);
 	void erase_agent(int sock_id);
 	bool ping(int i_sock);
@@ -186,6 +216,7 @@ private:
 	int get_n_concurrent(int run_id);
 	int get_n_unique_failures();
 	int get_n_responsive_agents();
+	void add_file_stor_secs(const std::chrono::steady_clock::time_point &start);
 	virtual void update_run_failed(int run_id, int socket_fd);
 	virtual void update_run_failed(int run_id);
 	map<string, int> get_agent_stats();
@@ -0,0 +1,376 @@
+/*
+
+
+This file is part of PEST++.
+
+PEST++ is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+PEST++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with PEST++.  If not, see<http://www.gnu.org/licenses/>.
+*/
+// Loopback stress harness for the PANTHER master.  A RunManagerPanther is driven from the main
+// thread while a single helper thread impersonates a large number of agents, each on its own
+// loopback socket.  The fake agents speak the normal agent protocol but "run" the model instantly,
+// so the timings reflect the master's message handling and scheduling only.
+//
+// usage: pestpp-panther-stress [n_agents] [n_runs] [port] [n_par] [n_obs] [payload_codec]
+//
+// With payload_codec=1 the master offers the result payload codec and the fake agents accept it,
+// delta-encoding each result against their previous one.
+// Two rounds of n_runs are made: the first includes the agent handshakes, the second is timed and
+// reports runs/sec, messages/sec and the scheduling latency (time from an agent reporting READY to
+// the master handing it the next run).
+
+#include "RunManagerPanther.h" //needs to be first because it includes winsock2.h
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include "config_os.h"
+#include "Transformable.h"
+#include "Serialization.h"
+#include "network_package.h"
+#include "network_wrapper.h"
+#include "socket_poller.h"
+#include "payload_codec.h"
+#include "utilities.h"
+#include "pest_error.h"
+#ifdef OS_LINUX
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+class FakeAgentPool
+{
+public:
+	FakeAgentPool(int _n_agents, const string &_port) : stop(false), measuring(false), n_messages(0), n_connected(0),
+		n_result_bytes(0), n_raw_result_bytes(0), n_agents(_n_agents), port(_port) {}
+	void run();
+	atomic<bool> stop;
+	atomic<bool> measuring;
+	atomic<long long> n_messages;
+	atomic<int> n_connected;
+	atomic<long long> n_result_bytes;
+	atomic<long long> n_raw_result_bytes;
+	vector<double> latency_sec;
+private:
+	struct AgentState
+	{
+		vector<string> par_names;
+		vector<string> obs_names;
+		bool ready_sent = false;
+		chrono::steady_clock::time_point ready_time;
+		bool payload_codec = false;
+		int last_group_id = -1;
+		int last_run_id = -1;
+		vector<int8_t> last_result;
+	};
+	int n_agents;
+	string port;
+	SocketPoller poller;
+	unordered_map<int, AgentState> agents;
+	bool connect_agent();
+	void send(int sock, NetPackage &net_pack, const void *data, int64_t data_len);
+	void send_ready(int sock);
+	void process_message(int sock);
+	void close_agent(int sock);
+};
+
+bool FakeAgentPool::connect_agent()
+{
+	struct addrinfo hints;
+	struct addrinfo *servinfo;
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	pair<int, string> status = w_getaddrinfo("127.0.0.1", port.c_str(), &hints, &servinfo);
+	if (status.first != 0)
+		return false;
+	int sock = -1;
+	addrinfo *p = w_connect_first_avl(servinfo, sock);
+	freeaddrinfo(servinfo);
+	if (p == nullptr)
+		return false;
+	if (!poller.add(sock))
+	{
+		w_close(sock);
+		return false;
+	}
+	agents[sock] = AgentState();
+	++n_connected;
+	return true;
+}
+
+void FakeAgentPool::send(int sock, NetPackage &net_pack, const void *data, int64_t data_len)
+{
+	pair<int, string> err = net_pack.send(sock, data, data_len);
+	if (err.first <= 0)
+	{
+		close_agent(sock);
+		return;
+	}
+	if (measuring)
+		++n_messages;
+}
+
+void FakeAgentPool::send_ready(int sock)
+{
+	NetPackage net_pack(NetPackage::PackType::READY, 0, 0, "");
+	char data = '\0';
+	send(sock, net_pack, &data, 0);
+	auto it = agents.find(sock);
+	if (it != agents.end())
+	{
+		it->second.ready_sent = true;
+		it->second.ready_time = chrono::steady_clock::now();
+	}
+}
+
+void FakeAgentPool::close_agent(int sock)
+{
+	poller.remove(sock);
+	w_close(sock);
+	agents.erase(sock);
+	--n_connected;
+}
+
+void FakeAgentPool::process_message(int sock)
+{
+	auto it = agents.find(sock);
+	if (it == agents.end())
+		return;
+	AgentState &agent = it->second;
+	NetPackage net_pack;
+	pair<int, string> err = net_pack.recv(sock);
+	if (err.first <= 0)
+	{
+		close_agent(sock);
+		return;
+	}
+	if (measuring)
+		++n_messages;
+	NetPackage::PackType type = net_pack.get_type();
+	if (type == NetPackage::PackType::REQ_RUNDIR)
+	{
+		stringstream ss;
+		ss << "stress_agent_" << sock;
+		string cwd = ss.str();
+		net_pack.reset(NetPackage::PackType::RUNDIR, 0, 0, "");
+		send(sock, net_pack, cwd.c_str(), cwd.size());
+	}
+	else if (type == NetPackage::PackType::PAR_NAMES)
+	{
+		Serialization::unserialize(net_pack.get_data(), agent.par_names);
+	}
+	else if (type == NetPackage::PackType::OBS_NAMES)
+	{
+		Serialization::unserialize(net_pack.get_data(), agent.obs_names);
+		agent.payload_codec = (net_pack.get_info_txt() == PayloadCodec::handshake_token());
+	}
+	else if (type == NetPackage::PackType::REQ_LINPACK)
+	{
+		net_pack.reset(NetPackage::PackType::LINPACK, 0, 0, agent.payload_codec ? PayloadCodec::handshake_token() : "");
+		char data = '\0';
+		send(sock, net_pack, &data, 0);
+	}
+	else if (type == NetPackage::PackType::START_RUN)
+	{
+		if ((measuring) && (agent.ready_sent))
+		{
+			latency_sec.push_back(chrono::duration<double>(chrono::steady_clock::now() - agent.ready_time).count());
+		}
+		agent.ready_sent = false;
+		int group_id = net_pack.get_group_id();
+		int run_id = net_pack.get_run_id();
+		Parameters pars;
+		int64_t ref_id = -1;
+		unsigned long par_loc = 0;
+		if (agent.payload_codec)
+			par_loc = Serialization::unserialize(net_pack.get_data(), ref_id);
+		Serialization::unserialize(net_pack.get_data(), pars, agent.par_names, par_loc);
+		//smooth, slightly run-dependent outputs, like a model responding to a small perturbation
+		Observations obs;
+		for (size_t i = 0; i < agent.obs_names.size(); ++i)
+		{
+			obs.insert(agent.obs_names[i], 100.0 * sin((double)i + 1.0) + 1.0e-4 * (run_id % 17));
+		}
+		vector<int8_t> serialized_data = Serialization::serialize(pars, agent.par_names, obs, agent.obs_names, 0.0);
+		if (measuring)
+			n_raw_result_bytes += serialized_data.size();
+		if (agent.payload_codec)
+		{
+			bool have_ref = (ref_id >= 0) && (agent.last_group_id == group_id) && (agent.last_run_id == ref_id);
+			vector<int8_t> enc;
+			PayloadCodec::encode(serialized_data.data(), serialized_data.size(),
+				have_ref ? agent.last_result.data() : nullptr, have_ref ? agent.last_result.size() - sizeof(double) : 0,
+				have_ref ? ref_id : -1, enc);
+			agent.last_group_id = group_id;
+			agent.last_run_id = run_id;
+			agent.last_result.swap(serialized_data);
+			serialized_data.swap(enc);
+		}
+		if (measuring)
+			n_result_bytes += serialized_data.size();
+		net_pack.reset(NetPackage::PackType::RUN_FINISHED, group_id, run_id, "");
+		send(sock, net_pack, serialized_data.data(), serialized_data.size());
+		if (agents.find(sock) != agents.end())
+			send_ready(sock);
+	}
+	else if (type == NetPackage::PackType::REQ_KILL)
+	{
+		net_pack.reset(NetPackage::PackType::RUN_KILLED, 0, 0, "");
+		char data = '\0';
+		send(sock, net_pack, &data, 0);
+		if (agents.find(sock) != agents.end())
+			send_ready(sock);
+	}
+	else if (type == NetPackage::PackType::PING)
+	{
+		net_pack.reset(NetPackage::PackType::PING, 0, 0, "");
+		char data = '\0';
+		send(sock, net_pack, &data, 0);
+	}
+	else if (type == NetPackage::PackType::TERMINATE)
+	{
+		close_agent(sock);
+	}
+}
+
+void FakeAgentPool::run()
+{
+	vector<int> ready_fds;
+	int n_to_connect = n_agents;
+	while (!stop)
+	{
+		//connect in small batches so the agents that are already up keep getting serviced
+		for (int i = 0; (i < 50) && (n_to_connect > 0); ++i)
+		{
+			if (connect_agent())
+			{
+				--n_to_connect;
+			}
+			else
+			{
+				cerr << "failed to connect fake agent, " << n_to_connect << " agents not started" << endl;
+				n_to_connect = 0;
+			}
+		}
+		poller.wait(10, ready_fds);
+		for (int sock : ready_fds)
+		{
+			process_message(sock);
+		}
+	}
+	for (int sock : poller.get_fds())
+	{
+		close_agent(sock);
+	}
+}
+
+static void raise_fd_limit(int n_agents)
+{
+#ifdef OS_LINUX
+	//the master and the fake agents each hold one socket per agent
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0)
+	{
+		rlim_t need = (rlim_t)(2 * n_agents + 64);
+		if (rl.rlim_cur < need)
+		{
+			rl.rlim_cur = min(need, rl.rlim_max);
+			setrlimit(RLIMIT_NOFILE, &rl);
+		}
+	}
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+	int n_agents = (argc > 1) ? atoi(argv[1]) : 1000;
+	int n_runs = (argc > 2) ? atoi(argv[2]) : 20000;
+	string port = (argc > 3) ? argv[3] : "4004";
+	int n_par = (argc > 4) ? atoi(argv[4]) : 10;
+	int n_obs = (argc > 5) ? atoi(argv[5]) : 10;
+	bool payload_codec = (argc > 6) ? (atoi(argv[6]) != 0) : false;
+	if ((n_agents < 1) || (n_runs < 1) || (n_par < 1) || (n_obs < 1))
+	{
+		cerr << "usage: pestpp-panther-stress [n_agents] [n_runs] [port] [n_par] [n_obs] [payload_codec]" << endl;
+		return 1;
+	}
+	raise_fd_limit(n_agents);
+
+	try
+	{
+		Parameters pars;
+		for (int i = 0; i < n_par; ++i)
+			pars.insert("p" + to_string(i), 1.0 + i);
+		Observations obs;
+		for (int i = 0; i < n_obs; ++i)
+			obs.insert("o" + to_string(i), 0.0);
+
+		ofstream f_rmr("panther_stress.rmr");
+		RunManagerPanther run_manager("panther_stress.rns", port, f_rmr, 3, 1.15, 100.0, 1.0e+30, false, payload_codec);
+		run_manager.initialize(pars, obs);
+
+		FakeAgentPool agent_pool(n_agents, port);
+		thread agent_thread(&FakeAgentPool::run, &agent_pool);
+
+		double round_sec[2];
+		for (int round = 0; round < 2; ++round)
+		{
+			if (round > 0)
+			{
+				run_manager.reinitialize();
+				agent_pool.measuring = true;
+			}
+			for (int i = 0; i < n_runs; ++i)
+				run_manager.add_run(pars);
+			auto start = chrono::steady_clock::now();
+			run_manager.run();
+			round_sec[round] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			agent_pool.measuring = false;
+		}
+		agent_pool.stop = true;
+		agent_thread.join();
+
+		vector<double> &lat = agent_pool.latency_sec;
+		sort(lat.begin(), lat.end());
+		auto pct = [&lat](double p) { return lat.empty() ? 0.0 : lat[min(lat.size() - 1, (size_t)(p * lat.size()))] * 1000.0; };
+		double mean = 0.0;
+		for (double l : lat)
+			mean += l;
+		if (!lat.empty())
+			mean /= lat.size();
+
+		cout << endl << "PANTHER loopback stress results" << endl;
+		cout << "  agents: " << n_agents << ", runs per round: " << n_runs << ", pars: " << n_par << ", obs: " << n_obs << endl;
+		cout << "  round 1 (with handshakes): " << round_sec[0] << " sec" << endl;
+		cout << "  round 2: " << round_sec[1] << " sec, " << n_runs / round_sec[1] << " runs/sec, "
+			<< agent_pool.n_messages / round_sec[1] << " messages/sec" << endl;
+		cout << "  scheduling latency (ms): mean " << mean * 1000.0 << ", p50 " << pct(0.5)
+			<< ", p99 " << pct(0.99) << ", max " << pct(1.0) << " (" << lat.size() << " samples)" << endl;
+		cout << "  result payload bytes: " << agent_pool.n_result_bytes << " sent, " << agent_pool.n_raw_result_bytes
+			<< " raw (payload codec " << (payload_codec ? "on" : "off") << ")" << endl;
+		run_manager.free_memory();
+	}
+	catch (exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -267,7 +267,9 @@ int main(int argc, char* argv[])
 					pest_scenario.get_pestpp_options().get_overdue_reched_fac(),
 					pest_scenario.get_pestpp_options().get_overdue_giveup_fac(),
 					pest_scenario.get_pestpp_options().get_overdue_giveup_minutes(),
-					pest_scenario.get_pestpp_options().get_panther_echo());
+					pest_scenario.get_pestpp_options().get_panther_echo(),
+					pest_scenario.get_pestpp_options().get_panther_payload_codec(),
+					pest_scenario.get_pestpp_options().get_panther_schedule_policy());
 			}
 		}
 		
@@ -293,12 +295,21 @@ int main(int argc, char* argv[])
 				file_manager.build_filename("rns"), pathname,
 				pest_scenario.get_pestpp_options().get_max_run_fail(),
 				pest_scenario.get_pestpp_options().get_fill_tpl_zeros(),
-				pest_scenario.get_pestpp_options().get_additional_ins_delimiters());
+				pest_scenario.get_pestpp_options().get_additional_ins_delimiters(),
+				pest_scenario.get_pestpp_options().get_num_tpl_ins_threads(),
+				pest_scenario.get_pestpp_options().get_model_plugin(),
+				pest_scenario.get_pestpp_options().get_model_plugin_config(),
+				pest_scenario.get_pestpp_options().get_model_plugin_batch_size(),
+				pest_scenario.get_pestpp_options().get_num_local_workers());
 		}
+		run_manager_ptr->set_run_storage_mmap(pest_scenario.get_pestpp_options().get_run_storage_mmap(),
+			pest_scenario.get_pestpp_options().get_run_storage_commit_nruns(),
+			pest_scenario.get_pestpp_options().get_run_storage_commit_secs());
 
 		const ParamTransformSeq &base_trans_seq = pest_scenario.get_base_par_tran_seq();
 		ObjectiveFunc obj_func(&(pest_scenario.get_ctl_observations()), &(pest_scenario.get_ctl_observation_info()), &(pest_scenario.get_prior_info()));
 		Jacobian *base_jacobian_ptr = new Jacobian_1to1(file_manager,output_file_writer);
+		base_jacobian_ptr->set_num_threads(pest_scenario.get_pestpp_options().get_num_jco_threads());
 		std::mt19937 rand_gen(pest_scenario.get_pestpp_options().get_random_seed());
 		TerminationController termination_ctl(pest_scenario.get_control_info().noptmax, pest_scenario.get_control_info().phiredstp,
 			pest_scenario.get_control_info().nphistp, pest_scenario.get_control_info().nphinored, pest_scenario.get_control_info().relparstp,
@@ -322,6 +333,7 @@ int main(int argc, char* argv[])
 		base_svd.set_svd_package(pest_scenario.get_pestpp_options().get_svd_pack());
 		//Build Super-Parameter problem
 		Jacobian *super_jacobian_ptr = new Jacobian(file_manager);
+		super_jacobian_ptr->set_num_threads(pest_scenario.get_pestpp_options().get_num_jco_threads());
 		ParamTransformSeq trans_svda;
 		// method must be involked as pointer as the transformation sequence it is added to will
 		// take responsibility for destroying it
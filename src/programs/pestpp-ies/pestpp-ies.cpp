@@ -222,7 +222,9 @@ int main(int argc, char* argv[])
 				pest_scenario.get_pestpp_options().get_overdue_reched_fac(),
 				pest_scenario.get_pestpp_options().get_overdue_giveup_fac(),
 				pest_scenario.get_pestpp_options().get_overdue_giveup_minutes(),
-				pest_scenario.get_pestpp_options().get_panther_echo());
+				pest_scenario.get_pestpp_options().get_panther_echo(),
+				pest_scenario.get_pestpp_options().get_panther_payload_codec(),
+				pest_scenario.get_pestpp_options().get_panther_schedule_policy());
 		}
 		else
 		{
@@ -238,8 +240,16 @@ int main(int argc, char* argv[])
 				file_manager.build_filename("rns"), pathname,
 				pest_scenario.get_pestpp_options().get_max_run_fail(),
 				pest_scenario.get_pestpp_options().get_fill_tpl_zeros(),
-				pest_scenario.get_pestpp_options().get_additional_ins_delimiters());
+				pest_scenario.get_pestpp_options().get_additional_ins_delimiters(),
+				pest_scenario.get_pestpp_options().get_num_tpl_ins_threads(),
+				pest_scenario.get_pestpp_options().get_model_plugin(),
+				pest_scenario.get_pestpp_options().get_model_plugin_config(),
+				pest_scenario.get_pestpp_options().get_model_plugin_batch_size(),
+				pest_scenario.get_pestpp_options().get_num_local_workers());
 		}
+		run_manager_ptr->set_run_storage_mmap(pest_scenario.get_pestpp_options().get_run_storage_mmap(),
+			pest_scenario.get_pestpp_options().get_run_storage_commit_nruns(),
+			pest_scenario.get_pestpp_options().get_run_storage_commit_secs());
 
 		const ParamTransformSeq &base_trans_seq = pest_scenario.get_base_par_tran_seq();
 		ObjectiveFunc obj_func(&(pest_scenario.get_ctl_observations()), &(pest_scenario.get_ctl_observation_info()), &(pest_scenario.get_prior_info()));